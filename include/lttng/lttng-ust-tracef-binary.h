@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <lttng/tracepoint.h>
+#include <stdint.h>
+
+/*
+ * Binary form of the tracef() events: the address of the format string,
+ * which can be resolved with the base addresses of the executable and
+ * shared objects recorded by the state dump, followed by the raw values
+ * of the arguments.
+ */
+TRACEPOINT_EVENT(lttng_ust_tracef_binary, event,
+	TP_ARGS(const char *, fmt, const uint8_t *, args,
+		unsigned int, args_len, void *, ip),
+	TP_FIELDS(
+		ctf_integer_hex(unsigned long, fmt, (unsigned long) fmt)
+		ctf_sequence_hex(uint8_t, args, args, unsigned int, args_len)
+	)
+)
+TRACEPOINT_LOGLEVEL(lttng_ust_tracef_binary, event, TRACE_DEBUG)
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <lttng/tracepoint.h>
+#include <stdint.h>
+
+/*
+ * Binary form of the tracelog() events. See lttng-ust-tracef-binary.h.
+ */
+TRACEPOINT_EVENT_CLASS(lttng_ust_tracelog_binary, tlbinclass,
+	TP_ARGS(const char *, file, int, line, const char *, func,
+		const char *, fmt, const uint8_t *, args,
+		unsigned int, args_len, void *, ip),
+	TP_FIELDS(
+		ctf_integer(int, line, line)
+		ctf_string(file, file)
+		ctf_string(func, func)
+		ctf_integer_hex(unsigned long, fmt, (unsigned long) fmt)
+		ctf_sequence_hex(uint8_t, args, args, unsigned int, args_len)
+	)
+)
+
+#define TP_TRACELOG_BINARY_TEMPLATE(_level_enum) \
+	TRACEPOINT_EVENT_INSTANCE(lttng_ust_tracelog_binary, tlbinclass, _level_enum, \
+		TP_ARGS(const char *, file, int, line, const char *, func, \
+			const char *, fmt, const uint8_t *, args, \
+			unsigned int, args_len, void *, ip) \
+	) \
+	TRACEPOINT_LOGLEVEL(lttng_ust_tracelog_binary, _level_enum, _level_enum)
+
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_EMERG)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_ALERT)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_CRIT)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_ERR)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_WARNING)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_NOTICE)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_INFO)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_SYSTEM)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_PROGRAM)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_PROCESS)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_MODULE)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_UNIT)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_FUNCTION)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG_LINE)
+TP_TRACELOG_BINARY_TEMPLATE(TRACE_DEBUG)
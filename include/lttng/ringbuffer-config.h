@@ -126,6 +126,17 @@ struct lttng_ust_lib_ring_buffer_client_cb {
  * RING_BUFFER_ALLOC_GLOBAL and RING_BUFFER_SYNC_GLOBAL :
  *   Global shared buffer with global synchronization.
  *
+ * RING_BUFFER_ALLOC_PER_THREAD and RING_BUFFER_SYNC_GLOBAL :
+ *   Pool of buffers, each owned by at most one thread at a time. A thread
+ *   claims a buffer of the pool the first time it traces into the channel
+ *   and releases it when it exits. Buffers owned by threads which died
+ *   without releasing them (e.g. in a crashed process sharing per-UID
+ *   buffers) are reclaimed when the pool is exhausted. Threads which
+ *   cannot claim a buffer share one with its owner. Buffer
+ *   synchronization is global, so timers and flush can switch
+ *   sub-buffers of buffers owned by other threads, as for per-cpu
+ *   buffers.
+ *
  * wakeup:
  *
  * RING_BUFFER_WAKEUP_BY_TIMER uses per-cpu deferrable timers to poll the
@@ -145,6 +156,7 @@ struct lttng_ust_lib_ring_buffer_client_cb {
 enum lttng_ust_lib_ring_buffer_alloc_types {
 	RING_BUFFER_ALLOC_PER_CPU,
 	RING_BUFFER_ALLOC_GLOBAL,
+	RING_BUFFER_ALLOC_PER_THREAD,
 };
 
 enum lttng_ust_lib_ring_buffer_sync_types {
@@ -190,6 +202,18 @@ enum lttng_ust_lib_ring_buffer_wakeup_types {
 					 */
 };
 
+/*
+ * Backing of the stream shared memory and of the wait/wakeup fds,
+ * passed to channel_create().
+ */
+enum lttng_ust_lib_ring_buffer_shm_flags {
+	RING_BUFFER_SHM_MEMFD = (1U << 0),	/* anonymous memory file */
+	RING_BUFFER_SHM_HUGEPAGE = (1U << 1),	/* huge pages (memfd only) */
+	RING_BUFFER_SHM_POPULATE = (1U << 2),	/* pre-fault at creation */
+	RING_BUFFER_SHM_LAZY = (1U << 3),	/* per-cpu: populate on write */
+	RING_BUFFER_SHM_EVENTFD = (1U << 4),	/* eventfd wait/wakeup fds */
+};
+
 struct lttng_ust_lib_ring_buffer_config {
 	enum lttng_ust_lib_ring_buffer_alloc_types alloc;
 	enum lttng_ust_lib_ring_buffer_sync_types sync;
@@ -220,6 +244,7 @@ struct lttng_ust_lib_ring_buffer_config {
  * ring buffer context
  *
  * Context passed to lib_ring_buffer_reserve(), lib_ring_buffer_commit(),
+ * lib_ring_buffer_reserve_batch(), lib_ring_buffer_commit_batch(),
  * lib_ring_buffer_try_discard_reserve(), lib_ring_buffer_align_ctx() and
  * lib_ring_buffer_write().
  *
@@ -228,7 +253,8 @@ struct lttng_ust_lib_ring_buffer_config {
  * removed.
  */
 #define LTTNG_UST_RING_BUFFER_CTX_PADDING	\
-		(24 - sizeof(int) - sizeof(void *) - sizeof(void *))
+		(24 - sizeof(int) - sizeof(void *) - sizeof(void *) \
+		 - sizeof(unsigned int))
 struct lttng_ust_lib_ring_buffer_ctx {
 	/* input received by lib_ring_buffer_reserve(), saved here. */
 	struct channel *chan;		/* channel */
@@ -259,6 +285,10 @@ struct lttng_ust_lib_ring_buffer_ctx {
 	unsigned int padding1;		/* padding to realign on pointer */
 	void *ip;			/* caller ip address */
 	void *priv2;			/* 2nd priv data */
+	unsigned int batch_nr;		/*
+					 * number of records reserved by
+					 * lib_ring_buffer_reserve_batch()
+					 */
 	char padding2[LTTNG_UST_RING_BUFFER_CTX_PADDING];
 };
 
@@ -294,6 +324,7 @@ void lib_ring_buffer_ctx_init(struct lttng_ust_lib_ring_buffer_ctx *ctx,
 	ctx->padding1 = 0;
 	ctx->ip = 0;
 	ctx->priv2 = priv2;
+	ctx->batch_nr = 0;
 	memset(ctx->padding2, 0, LTTNG_UST_RING_BUFFER_CTX_PADDING);
 }
 
@@ -24,6 +24,7 @@
  */
 
 #include <lttng/lttng-ust-tracef.h>
+#include <lttng/lttng-ust-tracef-binary.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,7 +36,8 @@ void _lttng_ust_tracef(const char *fmt, ...);
 #define tracef(fmt, ...)						\
 	do {								\
 		LTTNG_STAP_PROBEV(tracepoint_lttng_ust_tracef, event, ## __VA_ARGS__); \
-		if (caa_unlikely(__tracepoint_lttng_ust_tracef___event.state)) \
+		if (caa_unlikely(__tracepoint_lttng_ust_tracef___event.state \
+				|| __tracepoint_lttng_ust_tracef_binary___event.state)) \
 			_lttng_ust_tracef(fmt, ## __VA_ARGS__);		\
 	} while (0)
 
@@ -24,6 +24,7 @@
  */
 
 #include <lttng/lttng-ust-tracelog.h>
+#include <lttng/lttng-ust-tracelog-binary.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -54,7 +55,8 @@ TP_TRACELOG_CB_TEMPLATE(TRACE_DEBUG);
 #define tracelog(level, fmt, ...)					\
 	do {								\
 		LTTNG_STAP_PROBEV(tracepoint_lttng_ust_tracelog, level, ## __VA_ARGS__); \
-		if (caa_unlikely(__tracepoint_lttng_ust_tracelog___##level.state)) \
+		if (caa_unlikely(__tracepoint_lttng_ust_tracelog___##level.state \
+				|| __tracepoint_lttng_ust_tracelog_binary___##level.state)) \
 			_lttng_ust_tracelog_##level(__FILE__, __LINE__, __func__, \
 				fmt, ## __VA_ARGS__); \
 	} while (0)
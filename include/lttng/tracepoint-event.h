@@ -35,6 +35,8 @@
 	TRACEPOINT_EVENT_INSTANCE(_provider, _name, _name,		\
 			_TP_PARAMS(_args))
 
+#undef TRACEPOINT_EVENT_BATCH
+#define TRACEPOINT_EVENT_BATCH(_provider, _name, _args)
 
 #undef TRACEPOINT_CREATE_PROBES
 
@@ -89,4 +91,9 @@
 #undef TRACEPOINT_MODEL_EMF_URI
 #define TRACEPOINT_MODEL_EMF_URI(provider, name, uri)
 
+#undef TRACEPOINT_EVENT_BATCH
+#define TRACEPOINT_EVENT_BATCH(provider, name, args)			\
+	_DECLARE_TRACEPOINT_BATCH(provider, name, _TP_PARAMS(args))	\
+	_DEFINE_TRACEPOINT_BATCH(provider, name, _TP_PARAMS(args))
+
 #endif /* TRACEPOINT_CREATE_PROBES */
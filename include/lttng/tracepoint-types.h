@@ -23,6 +23,12 @@
  * SOFTWARE.
  */
 
+/*
+ * Suffix of the name of the tracepoint connecting batch probes, defined by
+ * TRACEPOINT_EVENT_BATCH().
+ */
+#define LTTNG_UST_TRACEPOINT_BATCH_SUFFIX	":batch"
+
 struct lttng_ust_tracepoint_probe {
 	void (*func)(void);
 	void *data;
@@ -38,4 +44,14 @@ struct lttng_ust_tracepoint {
 	char padding[LTTNG_UST_TRACEPOINT_PADDING];
 };
 
+/*
+ * Static branch call site of a tracepoint, emitted in the
+ * __tracepoints_branches section when TRACEPOINT_STATIC_BRANCH is
+ * defined (see lttng/tracepoint.h).
+ */
+struct lttng_ust_tracepoint_branch {
+	unsigned long site;	/* Address of the patched instruction */
+	struct lttng_ust_tracepoint *tracepoint;
+};
+
 #endif /* _LTTNG_TRACEPOINT_TYPES_H */
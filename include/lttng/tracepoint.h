@@ -46,9 +46,71 @@
 extern "C" {
 #endif
 
+/*
+ * Static branches: when TRACEPOINT_STATIC_BRANCH is defined before
+ * including this header, the enable check of each tracepoint call site
+ * is a single instruction patched by liblttng-ust-tracepoint when the
+ * tracepoint state changes, rather than a load and a conditional
+ * branch. A disabled call site executes
+ *
+ *   cmp $(l_yes - (site + 5)), %eax
+ *
+ * which only clobbers the flags, and an enabled one executes
+ *
+ *   jmp l_yes
+ *
+ * where l_yes checks the tracepoint state, as the default enable check
+ * does. Call sites are emitted in the jmp form, so they are correct
+ * whether or not they are ever patched: liblttng-ust-tracepoint only
+ * turns the call sites of disabled tracepoints into the cmp form when
+ * it can modify code safely (see tracepoint.c).
+ *
+ * This is only available on x86-64 with compilers supporting asm goto.
+ * Only the call sites within the module (executable or shared object)
+ * which defines TRACEPOINT_DEFINE for the provider are patched: call
+ * sites in other modules are never turned into the cmp form, and always
+ * check the tracepoint state.
+ */
+#if defined(TRACEPOINT_STATIC_BRANCH) && defined(__x86_64__)		\
+	&& defined(__GNUC__) && !defined(__clang__)			\
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 5))
+#define _TP_HAVE_STATIC_BRANCH
+#endif
+
+#ifdef _TP_HAVE_STATIC_BRANCH
+
+#define _TP_STATIC_BRANCH_STRINGIFY(x)	#x
+
+#define _tracepoint_static_branch(sym)					\
+	__extension__ ({						\
+		__label__ __tp_branch_yes;				\
+		int __tp_branch_ret = 0;				\
+									\
+		__asm__ goto ("1:\n\t"					\
+			".byte 0xe9\n\t"				\
+			".long %l[__tp_branch_yes] - (1b + 5)\n\t"	\
+			".pushsection __tracepoints_branches, \"aw\"\n\t" \
+			".balign 8\n\t"					\
+			".quad 1b, " _TP_STATIC_BRANCH_STRINGIFY(sym) "\n\t" \
+			".popsection\n\t"				\
+			: : : "cc" : __tp_branch_yes);			\
+		if (0) {						\
+__tp_branch_yes:							\
+			__tp_branch_ret = CMM_LOAD_SHARED((sym).state);	\
+		}							\
+		__tp_branch_ret;					\
+	})
+
+#define tracepoint_enabled(provider, name) \
+	caa_unlikely(_tracepoint_static_branch(__tracepoint_##provider##___##name))
+
+#else /* _TP_HAVE_STATIC_BRANCH */
+
 #define tracepoint_enabled(provider, name) \
 	caa_unlikely(CMM_LOAD_SHARED(__tracepoint_##provider##___##name.state))
 
+#endif /* _TP_HAVE_STATIC_BRANCH */
+
 #define do_tracepoint(provider, name, ...) \
 	__tracepoint_cb_##provider##___##name(__VA_ARGS__)
 
@@ -59,6 +121,28 @@ extern "C" {
 			do_tracepoint(provider, name, __VA_ARGS__);	    \
 	} while (0)
 
+#define tracepoint_batch_enabled(provider, name) \
+	caa_unlikely(CMM_LOAD_SHARED(__tracepoint_batch_##provider##___##name.state))
+
+#define do_tracepoint_batch(provider, name, nr, ...) \
+	__tracepoint_batch_cb_##provider##___##name(nr, ## __VA_ARGS__)
+
+/*
+ * tracepoint_batch() records nr events of a tracepoint declared with
+ * TRACEPOINT_EVENT_BATCH(). Each argument following nr is an array of
+ * nr values of the type declared in TP_ARGS. Buffer space is reserved
+ * for several events at once. If the probes do not support batches,
+ * the events are recorded one by one.
+ */
+#define tracepoint_batch(provider, name, nr, ...)			    \
+	do {								    \
+		if (tracepoint_batch_enabled(provider, name))		    \
+			do_tracepoint_batch(provider, name, nr, ## __VA_ARGS__); \
+		else if (tracepoint_enabled(provider, name))		    \
+			__tracepoint_batch_split_##provider##___##name(nr, \
+				## __VA_ARGS__);			    \
+	} while (0)
+
 #define TP_ARGS(...)       __VA_ARGS__
 
 /*
@@ -140,6 +224,65 @@ extern "C" {
 #define _TP_EXDATA_PROTO18(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r)		void *__tp_data,a b,c d,e f,g h,i j,k l,m n,o p,q r
 #define _TP_EXDATA_PROTO20(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t)	void *__tp_data,a b,c d,e f,g h,i j,k l,m n,o p,q r,s t
 
+/*
+ * _TP_EXBATCH* extract the prototype and arguments of batch callbacks,
+ * where each tuple of type, var becomes an array of __tp_batch_nr values
+ * named __tp_batch_arg_var, which cannot clash with the other variables
+ * of the batch probe. _TP_EXBATCH_ELEM* extract element __tp_batch_i of
+ * each array.
+ */
+#define _TP_EXBATCH_PROTO0()						size_t __tp_batch_nr
+#define _TP_EXBATCH_PROTO1(a)						size_t __tp_batch_nr
+#define _TP_EXBATCH_PROTO2(a,b)						size_t __tp_batch_nr,a const *__tp_batch_arg_##b
+#define _TP_EXBATCH_PROTO4(a,b,c,d)					size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d
+#define _TP_EXBATCH_PROTO6(a,b,c,d,e,f)					size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f
+#define _TP_EXBATCH_PROTO8(a,b,c,d,e,f,g,h)				size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h
+#define _TP_EXBATCH_PROTO10(a,b,c,d,e,f,g,h,i,j)			size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j
+#define _TP_EXBATCH_PROTO12(a,b,c,d,e,f,g,h,i,j,k,l)			size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l
+#define _TP_EXBATCH_PROTO14(a,b,c,d,e,f,g,h,i,j,k,l,m,n)		size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n
+#define _TP_EXBATCH_PROTO16(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p)		size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n,o const *__tp_batch_arg_##p
+#define _TP_EXBATCH_PROTO18(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r)	size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n,o const *__tp_batch_arg_##p,q const *__tp_batch_arg_##r
+#define _TP_EXBATCH_PROTO20(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t)	size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n,o const *__tp_batch_arg_##p,q const *__tp_batch_arg_##r,s const *__tp_batch_arg_##t
+
+#define _TP_EXBATCH_DATA_PROTO0()						void *__tp_data,size_t __tp_batch_nr
+#define _TP_EXBATCH_DATA_PROTO1(a)						void *__tp_data,size_t __tp_batch_nr
+#define _TP_EXBATCH_DATA_PROTO2(a,b)						void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b
+#define _TP_EXBATCH_DATA_PROTO4(a,b,c,d)					void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d
+#define _TP_EXBATCH_DATA_PROTO6(a,b,c,d,e,f)					void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f
+#define _TP_EXBATCH_DATA_PROTO8(a,b,c,d,e,f,g,h)				void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h
+#define _TP_EXBATCH_DATA_PROTO10(a,b,c,d,e,f,g,h,i,j)				void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j
+#define _TP_EXBATCH_DATA_PROTO12(a,b,c,d,e,f,g,h,i,j,k,l)			void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l
+#define _TP_EXBATCH_DATA_PROTO14(a,b,c,d,e,f,g,h,i,j,k,l,m,n)			void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n
+#define _TP_EXBATCH_DATA_PROTO16(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p)		void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n,o const *__tp_batch_arg_##p
+#define _TP_EXBATCH_DATA_PROTO18(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r)		void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n,o const *__tp_batch_arg_##p,q const *__tp_batch_arg_##r
+#define _TP_EXBATCH_DATA_PROTO20(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t)	void *__tp_data,size_t __tp_batch_nr,a const *__tp_batch_arg_##b,c const *__tp_batch_arg_##d,e const *__tp_batch_arg_##f,g const *__tp_batch_arg_##h,i const *__tp_batch_arg_##j,k const *__tp_batch_arg_##l,m const *__tp_batch_arg_##n,o const *__tp_batch_arg_##p,q const *__tp_batch_arg_##r,s const *__tp_batch_arg_##t
+
+#define _TP_EXBATCH_DATA_VAR0()						__tp_data,__tp_batch_nr
+#define _TP_EXBATCH_DATA_VAR1(a)					__tp_data,__tp_batch_nr
+#define _TP_EXBATCH_DATA_VAR2(a,b)					__tp_data,__tp_batch_nr,__tp_batch_arg_##b
+#define _TP_EXBATCH_DATA_VAR4(a,b,c,d)					__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d
+#define _TP_EXBATCH_DATA_VAR6(a,b,c,d,e,f)				__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f
+#define _TP_EXBATCH_DATA_VAR8(a,b,c,d,e,f,g,h)				__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h
+#define _TP_EXBATCH_DATA_VAR10(a,b,c,d,e,f,g,h,i,j)			__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h,__tp_batch_arg_##j
+#define _TP_EXBATCH_DATA_VAR12(a,b,c,d,e,f,g,h,i,j,k,l)			__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h,__tp_batch_arg_##j,__tp_batch_arg_##l
+#define _TP_EXBATCH_DATA_VAR14(a,b,c,d,e,f,g,h,i,j,k,l,m,n)		__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h,__tp_batch_arg_##j,__tp_batch_arg_##l,__tp_batch_arg_##n
+#define _TP_EXBATCH_DATA_VAR16(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p)		__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h,__tp_batch_arg_##j,__tp_batch_arg_##l,__tp_batch_arg_##n,__tp_batch_arg_##p
+#define _TP_EXBATCH_DATA_VAR18(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r)	__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h,__tp_batch_arg_##j,__tp_batch_arg_##l,__tp_batch_arg_##n,__tp_batch_arg_##p,__tp_batch_arg_##r
+#define _TP_EXBATCH_DATA_VAR20(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t)	__tp_data,__tp_batch_nr,__tp_batch_arg_##b,__tp_batch_arg_##d,__tp_batch_arg_##f,__tp_batch_arg_##h,__tp_batch_arg_##j,__tp_batch_arg_##l,__tp_batch_arg_##n,__tp_batch_arg_##p,__tp_batch_arg_##r,__tp_batch_arg_##t
+
+#define _TP_EXBATCH_ELEM0()
+#define _TP_EXBATCH_ELEM1(a)
+#define _TP_EXBATCH_ELEM2(a,b)						__tp_batch_arg_##b[__tp_batch_i]
+#define _TP_EXBATCH_ELEM4(a,b,c,d)					__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i]
+#define _TP_EXBATCH_ELEM6(a,b,c,d,e,f)					__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i]
+#define _TP_EXBATCH_ELEM8(a,b,c,d,e,f,g,h)				__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i]
+#define _TP_EXBATCH_ELEM10(a,b,c,d,e,f,g,h,i,j)				__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i],__tp_batch_arg_##j[__tp_batch_i]
+#define _TP_EXBATCH_ELEM12(a,b,c,d,e,f,g,h,i,j,k,l)			__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i],__tp_batch_arg_##j[__tp_batch_i],__tp_batch_arg_##l[__tp_batch_i]
+#define _TP_EXBATCH_ELEM14(a,b,c,d,e,f,g,h,i,j,k,l,m,n)			__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i],__tp_batch_arg_##j[__tp_batch_i],__tp_batch_arg_##l[__tp_batch_i],__tp_batch_arg_##n[__tp_batch_i]
+#define _TP_EXBATCH_ELEM16(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p)		__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i],__tp_batch_arg_##j[__tp_batch_i],__tp_batch_arg_##l[__tp_batch_i],__tp_batch_arg_##n[__tp_batch_i],__tp_batch_arg_##p[__tp_batch_i]
+#define _TP_EXBATCH_ELEM18(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r)		__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i],__tp_batch_arg_##j[__tp_batch_i],__tp_batch_arg_##l[__tp_batch_i],__tp_batch_arg_##n[__tp_batch_i],__tp_batch_arg_##p[__tp_batch_i],__tp_batch_arg_##r[__tp_batch_i]
+#define _TP_EXBATCH_ELEM20(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t)	__tp_batch_arg_##b[__tp_batch_i],__tp_batch_arg_##d[__tp_batch_i],__tp_batch_arg_##f[__tp_batch_i],__tp_batch_arg_##h[__tp_batch_i],__tp_batch_arg_##j[__tp_batch_i],__tp_batch_arg_##l[__tp_batch_i],__tp_batch_arg_##n[__tp_batch_i],__tp_batch_arg_##p[__tp_batch_i],__tp_batch_arg_##r[__tp_batch_i],__tp_batch_arg_##t[__tp_batch_i]
+
 /* Preprocessor trick to count arguments. Inspired from sdt.h. */
 #define _TP_NARGS(...)			__TP_NARGS(__VA_ARGS__, 20,19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
 #define __TP_NARGS(_0,_1,_2,_3,_4,_5,_6,_7,_8,_9,_10,_11,_12,_13,_14,_15,_16,_17,_18,_19,_20, N, ...)	N
@@ -151,6 +294,14 @@ extern "C" {
 #define _TP_ARGS_VAR(...)		_TP_VAR_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
 #define _TP_ARGS_DATA_PROTO(...)	_TP_DATA_PROTO_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
 #define _TP_ARGS_DATA_VAR(...)		_TP_DATA_VAR_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
+#define _TP_BATCH_PROTO_N(N, ...)	_TP_PARAMS(_TP_COMBINE_TOKENS(_TP_EXBATCH_PROTO, N)(__VA_ARGS__))
+#define _TP_BATCH_DATA_PROTO_N(N, ...)	_TP_PARAMS(_TP_COMBINE_TOKENS(_TP_EXBATCH_DATA_PROTO, N)(__VA_ARGS__))
+#define _TP_BATCH_DATA_VAR_N(N, ...)	_TP_PARAMS(_TP_COMBINE_TOKENS(_TP_EXBATCH_DATA_VAR, N)(__VA_ARGS__))
+#define _TP_BATCH_ELEM_N(N, ...)	_TP_PARAMS(_TP_COMBINE_TOKENS(_TP_EXBATCH_ELEM, N)(__VA_ARGS__))
+#define _TP_ARGS_BATCH_PROTO(...)	_TP_BATCH_PROTO_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
+#define _TP_ARGS_BATCH_DATA_PROTO(...)	_TP_BATCH_DATA_PROTO_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
+#define _TP_ARGS_BATCH_DATA_VAR(...)	_TP_BATCH_DATA_VAR_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
+#define _TP_ARGS_BATCH_ELEM(...)	_TP_BATCH_ELEM_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
 #define _TP_PARAMS(...)			__VA_ARGS__
 
 /*
@@ -203,6 +354,47 @@ void __tracepoint_unregister_##_provider##___##_name(char *name,			\
 	__tracepoint_probe_unregister(name, func, data);				\
 }
 
+/*
+ * Batch callback of a tracepoint declared with TRACEPOINT_EVENT_BATCH(),
+ * calling the batch probes. The split callback calls the tracepoint
+ * callback once per event instead.
+ */
+#define _DECLARE_TRACEPOINT_BATCH(_provider, _name, ...)			\
+extern struct lttng_ust_tracepoint __tracepoint_batch_##_provider##___##_name;	\
+static inline __attribute__((always_inline, unused)) lttng_ust_notrace		\
+void __tracepoint_batch_cb_##_provider##___##_name(_TP_ARGS_BATCH_PROTO(__VA_ARGS__)); \
+static										\
+void __tracepoint_batch_cb_##_provider##___##_name(_TP_ARGS_BATCH_PROTO(__VA_ARGS__)) \
+{										\
+	struct lttng_ust_tracepoint_probe *__tp_probe;				\
+										\
+	if (caa_unlikely(!TP_RCU_LINK_TEST()))					\
+		return;								\
+	tp_rcu_read_lock_bp();							\
+	__tp_probe = tp_rcu_dereference_bp(__tracepoint_batch_##_provider##___##_name.probes); \
+	if (caa_unlikely(!__tp_probe))						\
+		goto end;							\
+	do {									\
+		void (*__tp_cb)(void) = __tp_probe->func;			\
+		void *__tp_data = __tp_probe->data;				\
+										\
+		URCU_FORCE_CAST(void (*)(_TP_ARGS_BATCH_DATA_PROTO(__VA_ARGS__)), __tp_cb) \
+				(_TP_ARGS_BATCH_DATA_VAR(__VA_ARGS__));		\
+	} while ((++__tp_probe)->func);						\
+end:										\
+	tp_rcu_read_unlock_bp();						\
+}										\
+static inline lttng_ust_notrace							\
+void __tracepoint_batch_split_##_provider##___##_name(_TP_ARGS_BATCH_PROTO(__VA_ARGS__)); \
+static inline									\
+void __tracepoint_batch_split_##_provider##___##_name(_TP_ARGS_BATCH_PROTO(__VA_ARGS__)) \
+{										\
+	size_t __tp_batch_i;							\
+										\
+	for (__tp_batch_i = 0; __tp_batch_i < __tp_batch_nr; __tp_batch_i++)	\
+		__tracepoint_cb_##_provider##___##_name(_TP_ARGS_BATCH_ELEM(__VA_ARGS__)); \
+}
+
 extern int __tracepoint_probe_register(const char *name, void (*func)(void),
 		void *data, const char *signature);
 extern int __tracepoint_probe_unregister(const char *name, void (*func)(void),
@@ -221,6 +413,11 @@ struct lttng_ust_tracepoint_dlopen {
 	void (*rcu_read_lock_sym_bp)(void);
 	void (*rcu_read_unlock_sym_bp)(void);
 	void *(*rcu_dereference_sym_bp)(void *p);
+	/* New UST 2.9 */
+	int (*tracepoint_register_lib_branches)(struct lttng_ust_tracepoint * const *tracepoints_start,
+		int tracepoints_count,
+		struct lttng_ust_tracepoint_branch *branches_start,
+		int branches_count);
 };
 
 extern struct lttng_ust_tracepoint_dlopen tracepoint_dlopen;
@@ -358,6 +555,10 @@ extern struct lttng_ust_tracepoint * const __start___tracepoints_ptrs[]
 	__attribute__((weak, visibility("hidden")));
 extern struct lttng_ust_tracepoint * const __stop___tracepoints_ptrs[]
 	__attribute__((weak, visibility("hidden")));
+extern struct lttng_ust_tracepoint_branch __start___tracepoints_branches[]
+	__attribute__((weak, visibility("hidden")));
+extern struct lttng_ust_tracepoint_branch __stop___tracepoints_branches[]
+	__attribute__((weak, visibility("hidden")));
 
 /*
  * When TRACEPOINT_PROBE_DYNAMIC_LINKAGE is defined, we do not emit a
@@ -401,6 +602,26 @@ extern struct lttng_ust_tracepoint * const __stop___tracepoints_ptrs[]
 		__attribute__((used, section("__tracepoints_ptrs"))) =		\
 			&__tracepoint_##_provider##___##_name;
 
+#define _DEFINE_TRACEPOINT_BATCH(_provider, _name, _args)			\
+	extern int __tracepoint_provider_##_provider; 				\
+	static const char __tp_strtab_batch_##_provider##___##_name[]		\
+		__attribute__((section("__tracepoints_strings"))) =		\
+			#_provider ":" #_name LTTNG_UST_TRACEPOINT_BATCH_SUFFIX; \
+	struct lttng_ust_tracepoint __tracepoint_batch_##_provider##___##_name	\
+		__attribute__((section("__tracepoints"))) =			\
+		{								\
+			__tp_strtab_batch_##_provider##___##_name,		\
+			0,							\
+			NULL,							\
+			_TRACEPOINT_UNDEFINED_REF(_provider), 			\
+			_TP_EXTRACT_STRING(_args),				\
+			{ },							\
+		};								\
+	static struct lttng_ust_tracepoint *					\
+		__tracepoint_ptr_batch_##_provider##___##_name			\
+		__attribute__((used, section("__tracepoints_ptrs"))) =		\
+			&__tracepoint_batch_##_provider##___##_name;
+
 static void lttng_ust_notrace __attribute__((constructor))
 __tracepoints__ptrs_init(void);
 static void
@@ -423,8 +644,25 @@ __tracepoints__ptrs_init(void)
 		URCU_FORCE_CAST(int (*)(struct lttng_ust_tracepoint * const *),
 				dlsym(tracepoint_dlopen_ptr->liblttngust_handle,
 					"tracepoint_unregister_lib"));
+	tracepoint_dlopen_ptr->tracepoint_register_lib_branches =
+		URCU_FORCE_CAST(int (*)(struct lttng_ust_tracepoint * const *, int,
+				struct lttng_ust_tracepoint_branch *, int),
+				dlsym(tracepoint_dlopen_ptr->liblttngust_handle,
+					"tracepoint_register_lib_branches"));
 	__tracepoint__init_urcu_sym();
-	if (tracepoint_dlopen_ptr->tracepoint_register_lib) {
+	/*
+	 * Static branch call sites of this module can only be enabled
+	 * if they are known by liblttng-ust-tracepoint.
+	 */
+	if (__stop___tracepoints_branches - __start___tracepoints_branches
+			&& tracepoint_dlopen_ptr->tracepoint_register_lib_branches) {
+		tracepoint_dlopen_ptr->tracepoint_register_lib_branches(__start___tracepoints_ptrs,
+				__stop___tracepoints_ptrs -
+				__start___tracepoints_ptrs,
+				__start___tracepoints_branches,
+				__stop___tracepoints_branches -
+				__start___tracepoints_branches);
+	} else if (tracepoint_dlopen_ptr->tracepoint_register_lib) {
 		tracepoint_dlopen_ptr->tracepoint_register_lib(__start___tracepoints_ptrs,
 				__stop___tracepoints_ptrs -
 				__start___tracepoints_ptrs);
@@ -459,6 +697,7 @@ __tracepoints__ptrs_destroy(void)
 #else /* TRACEPOINT_DEFINE */
 
 #define _DEFINE_TRACEPOINT(_provider, _name, _args)
+#define _DEFINE_TRACEPOINT_BATCH(_provider, _name, _args)
 
 #endif /* #else TRACEPOINT_DEFINE */
 
@@ -709,3 +948,24 @@ enum {
 #define TRACEPOINT_MODEL_EMF_URI(provider, name, uri)
 
 #endif /* #ifndef TRACEPOINT_MODEL_EMF_URI */
+
+#ifndef TRACEPOINT_EVENT_BATCH
+
+/*
+ * Declare that events of a tracepoint can be recorded in batches with
+ * tracepoint_batch(). A TRACEPOINT_EVENT or TRACEPOINT_EVENT_INSTANCE
+ * should be declared prior to the TRACEPOINT_EVENT_BATCH for a given
+ * tracepoint name, with the same args:
+ *
+ *      TRACEPOINT_EVENT_BATCH(< [com_company_]project[_component] >, < event >,
+ *              TP_ARGS(...))
+ *
+ * The probe then reserves buffer space for up to LTTNG_UST_BATCH_CHUNK
+ * events at once.
+ */
+
+#define TRACEPOINT_EVENT_BATCH(provider, name, args)			\
+	_DECLARE_TRACEPOINT_BATCH(provider, name, _TP_PARAMS(args))	\
+	_DEFINE_TRACEPOINT_BATCH(provider, name, _TP_PARAMS(args))
+
+#endif /* #ifndef TRACEPOINT_EVENT_BATCH */
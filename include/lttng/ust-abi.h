@@ -43,7 +43,7 @@
 
 /* Version for ABI between liblttng-ust, sessiond, consumerd */
 #define LTTNG_UST_ABI_MAJOR_VERSION		7
-#define LTTNG_UST_ABI_MINOR_VERSION		1
+#define LTTNG_UST_ABI_MINOR_VERSION		2
 
 enum lttng_ust_instrumentation {
 	LTTNG_UST_TRACEPOINT		= 0,
@@ -64,6 +64,7 @@ enum lttng_ust_output {
 enum lttng_ust_chan_type {
 	LTTNG_UST_CHAN_PER_CPU = 0,
 	LTTNG_UST_CHAN_METADATA = 1,
+	LTTNG_UST_CHAN_PER_THREAD = 2,
 };
 
 struct lttng_ust_tracer_version {
@@ -180,6 +181,44 @@ struct lttng_ust_channel_attr {
 	char padding[LTTNG_UST_CHANNEL_ATTR_PADDING];
 } LTTNG_PACKED;
 
+/*
+ * Channel stream shared memory backing flags.
+ *
+ * LTTNG_UST_CHAN_SHM_MEMFD: streams are backed by anonymous memory
+ *   files created by the tracer rather than by the stream file
+ *   descriptors provided by the consumer, which can be -1.
+ * LTTNG_UST_CHAN_SHM_HUGEPAGE: use huge pages, from the hugetlb pool
+ *   when it has enough free pages, transparent huge pages otherwise.
+ *   Implies LTTNG_UST_CHAN_SHM_MEMFD.
+ * LTTNG_UST_CHAN_SHM_POPULATE: pre-fault the stream pages when the
+ *   channel is created and when the application maps its streams,
+ *   rather than on first write.
+ * LTTNG_UST_CHAN_SHM_LAZY: per-cpu streams are sized but not populated
+ *   at channel creation: their pages are allocated as the cpu writes
+ *   to them. Each stream becomes active on its first write, which
+ *   wakes up the channel wait fd. Excludes LTTNG_UST_CHAN_SHM_POPULATE.
+ */
+#define LTTNG_UST_CHAN_SHM_MEMFD		(1U << 0)
+#define LTTNG_UST_CHAN_SHM_HUGEPAGE		(1U << 1)
+#define LTTNG_UST_CHAN_SHM_POPULATE		(1U << 2)
+#define LTTNG_UST_CHAN_SHM_LAZY			(1U << 3)
+
+/*
+ * Channel and stream wait/wakeup notification.
+ *
+ * LTTNG_UST_CHAN_WAKEUP_PIPE: each wakeup writes a byte into a pipe.
+ *   The wait fd reports POLLHUP once every application holding the
+ *   wakeup fd has closed it, including when it exits abnormally.
+ * LTTNG_UST_CHAN_WAKEUP_EVENTFD: wakeups increment an eventfd counter,
+ *   so that any number of them is consumed by a single read. The wait
+ *   fds are drained with ustctl_{channel,stream}_drain_wait_fd(). Both
+ *   ends refer to the same eventfd, so the wait fd never reports
+ *   POLLHUP: application exit must be detected by other means, e.g.
+ *   its command socket. Not allowed for metadata channels.
+ */
+#define LTTNG_UST_CHAN_WAKEUP_PIPE		0
+#define LTTNG_UST_CHAN_WAKEUP_EVENTFD		1
+
 #define LTTNG_UST_TRACEPOINT_ITER_PADDING	16
 struct lttng_ust_tracepoint_iter {
 	char name[LTTNG_UST_SYM_NAME_LEN];	/* provider:name */
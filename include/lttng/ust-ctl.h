@@ -43,6 +43,11 @@
 struct lttng_ust_shm_handle;
 struct lttng_ust_lib_ring_buffer;
 
+/*
+ * The consumer must zero-initialize the whole structure, including its
+ * padding, which is reserved for future options.
+ */
+#define USTCTL_CONSUMER_CHANNEL_ATTR_PADDING	128
 struct ustctl_consumer_channel_attr {
 	enum lttng_ust_chan_type type;
 	uint64_t subbuf_size;			/* bytes */
@@ -53,6 +58,9 @@ struct ustctl_consumer_channel_attr {
 	enum lttng_ust_output output;		/* splice, mmap */
 	uint32_t chan_id;			/* channel ID */
 	unsigned char uuid[LTTNG_UST_UUID_LEN]; /* Trace session unique ID */
+	uint32_t shm_flags;			/* LTTNG_UST_CHAN_SHM_* */
+	uint32_t wakeup;			/* LTTNG_UST_CHAN_WAKEUP_* */
+	char padding[USTCTL_CONSUMER_CHANNEL_ATTR_PADDING];
 } LTTNG_PACKED;
 
 /*
@@ -160,6 +168,13 @@ struct ustctl_consumer_stream;
 struct ustctl_consumer_channel_attr;
 
 int ustctl_get_nr_stream_per_channel(void);
+/*
+ * Per-thread channels (LTTNG_UST_CHAN_PER_THREAD) use a pool of streams
+ * claimed by application threads as they start tracing. The pool size
+ * is the number of stream fds passed to ustctl_create_channel().
+ * Returns a default pool size.
+ */
+int ustctl_get_nr_stream_per_thread_channel(void);
 
 struct ustctl_consumer_channel *
 	ustctl_create_channel(struct ustctl_consumer_channel_attr *attr,
@@ -176,6 +191,16 @@ int ustctl_channel_close_wait_fd(struct ustctl_consumer_channel *consumer_chan);
 int ustctl_channel_close_wakeup_fd(struct ustctl_consumer_channel *consumer_chan);
 int ustctl_channel_get_wait_fd(struct ustctl_consumer_channel *consumer_chan);
 int ustctl_channel_get_wakeup_fd(struct ustctl_consumer_channel *consumer_chan);
+/*
+ * Consume the pending wakeups of the channel wait fd without blocking.
+ * Returns the number of wakeups coalesced since the last drain, 0 if
+ * none, or a negative error value. Must be used instead of reading the
+ * wait fd directly with LTTNG_UST_CHAN_WAKEUP_EVENTFD. In that mode, the
+ * wait fd is not hung up when the application exits: consumers relying
+ * on POLLHUP to release per-application buffers must keep
+ * LTTNG_UST_CHAN_WAKEUP_PIPE.
+ */
+int ustctl_channel_drain_wait_fd(struct ustctl_consumer_channel *consumer_chan);
 
 int ustctl_write_metadata_to_channel(
 		struct ustctl_consumer_channel *channel,
@@ -196,6 +221,8 @@ int ustctl_stream_close_wait_fd(struct ustctl_consumer_stream *stream);
 int ustctl_stream_close_wakeup_fd(struct ustctl_consumer_stream *stream);
 int ustctl_stream_get_wait_fd(struct ustctl_consumer_stream *stream);
 int ustctl_stream_get_wakeup_fd(struct ustctl_consumer_stream *stream);
+/* Same as ustctl_channel_drain_wait_fd(), for a stream wait fd. */
+int ustctl_stream_drain_wait_fd(struct ustctl_consumer_stream *stream);
 
 /* Create/destroy stream buffers for read */
 struct ustctl_consumer_stream *
@@ -257,6 +284,23 @@ int ustctl_get_sequence_number(struct ustctl_consumer_stream *stream,
 int ustctl_get_instance_id(struct ustctl_consumer_stream *stream,
 		uint64_t *id);
 
+/*
+ * Returns 1 if the application has written to the stream, 0 otherwise.
+ * With LTTNG_UST_CHAN_SHM_LAZY channels, the channel wait fd is woken
+ * up when a stream becomes active. The consumer can defer handling the
+ * other streams.
+ */
+int ustctl_stream_is_active(struct ustctl_consumer_stream *stream);
+
+/*
+ * NUMA placement of the per-cpu streams of a channel, sampled when the
+ * channel is created: number of sampled stream pages located on the
+ * memory node of their cpu, and number of sampled pages. Both are 0
+ * when the placement is unknown (e.g. non-NUMA system).
+ */
+int ustctl_channel_get_numa_placement(struct ustctl_consumer_channel *chan,
+		uint64_t *local_pages, uint64_t *sampled_pages);
+
 /* returns whether UST has perf counters support. */
 int ustctl_has_perf_counters(void);
 
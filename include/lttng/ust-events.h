@@ -52,7 +52,20 @@ extern "C" {
  * rejected by an older lttng-ust library.
  */
 #define LTTNG_UST_PROVIDER_MAJOR	1
-#define LTTNG_UST_PROVIDER_MINOR	0
+#define LTTNG_UST_PROVIDER_MINOR	1
+
+/*
+ * Maximum number of records for which a batch probe reserves buffer
+ * space at once.
+ */
+#define LTTNG_UST_BATCH_CHUNK		16
+
+/*
+ * Maximum payload size of events with a fixed layout which the probe
+ * lays out in a local buffer and writes at once. Larger payloads are
+ * written field by field, which does not copy them on the stack.
+ */
+#define LTTNG_UST_FIXED_WRITE_MAX	128
 
 struct lttng_channel;
 struct lttng_session;
@@ -75,6 +88,8 @@ enum lttng_client_types {
 	LTTNG_CLIENT_OVERWRITE = 2,
 	LTTNG_CLIENT_DISCARD_RT = 3,
 	LTTNG_CLIENT_OVERWRITE_RT = 4,
+	LTTNG_CLIENT_DISCARD_PER_THREAD = 5,
+	LTTNG_CLIENT_OVERWRITE_PER_THREAD = 6,
 	LTTNG_NR_CLIENT_TYPES,
 };
 
@@ -321,6 +336,7 @@ struct lttng_event_desc {
 	union {
 		struct {
 			const char **model_emf_uri;
+			void (**batch_callback)(void);	/* see TRACEPOINT_EVENT_BATCH */
 		} ext;
 		char padding[LTTNG_UST_EVENT_DESC_PADDING];
 	} u;
@@ -363,6 +379,7 @@ struct lttng_enabler {
 	struct lttng_channel *chan;
 	struct lttng_ctx *ctx;
 	unsigned int enabled:1;
+	struct cds_list_head sync_node;	/* per-session list of changed enablers */
 };
 
 struct tp_list_entry {
@@ -416,6 +433,14 @@ enum lttng_filter_ret {
 	/* Other bits are kept for future use. */
 };
 
+/*
+ * Bit of struct lttng_bytecode_runtime field_mask associated with the
+ * field of an event at index _index. Fields beyond the 63rd share the
+ * last bit.
+ */
+#define LTTNG_FILTER_FIELD_BIT(_index)	\
+	(1ULL << ((_index) < 63 ? (_index) : 63))
+
 struct lttng_bytecode_runtime {
 	/* Associated bytecode */
 	struct lttng_ust_filter_bytecode_node *bc;
@@ -423,6 +448,12 @@ struct lttng_bytecode_runtime {
 	int link_failed;
 	struct cds_list_head node;	/* list of bytecode runtime in event */
 	struct lttng_session *session;
+	/*
+	 * Fields read by the filter (LTTNG_FILTER_FIELD_BIT), set before
+	 * linking. Only present if the channel ops has_filter_field_mask
+	 * flag is set.
+	 */
+	uint64_t field_mask;
 };
 
 /*
@@ -463,6 +494,9 @@ struct lttng_event {
 	struct cds_list_head enablers_ref_head;
 	struct cds_hlist_node hlist;	/* session ht of events */
 	int registered;			/* has reg'd tracepoint probe */
+
+	/* LTTng-UST 2.9 starts here */
+	struct cds_list_head sync_node;	/* list of events to sync */
 };
 
 struct lttng_enum {
@@ -489,11 +523,16 @@ struct lttng_channel_ops {
 			unsigned int read_timer_interval,
 			unsigned char *uuid,
 			uint32_t chan_id,
-			const int *stream_fds, int nr_stream_fds);
+			const int *stream_fds, int nr_stream_fds,
+			unsigned int shm_flags);
 	void (*channel_destroy)(struct lttng_channel *chan);
 	union {
 		void *_deprecated1;
-		unsigned long has_strcpy:1;		/* ABI has strcpy */
+		struct {
+			unsigned long has_strcpy:1;	/* ABI has strcpy */
+			/* ABI has lttng_bytecode_runtime field_mask */
+			unsigned long has_filter_field_mask:1;
+		};
 	} u;
 	void *_deprecated2;
 	int (*event_reserve)(struct lttng_ust_lib_ring_buffer_ctx *ctx,
@@ -515,6 +554,19 @@ struct lttng_channel_ops {
 	int (*flush_buffer)(struct channel *chan, struct lttng_ust_shm_handle *handle);
 	void (*event_strcpy)(struct lttng_ust_lib_ring_buffer_ctx *ctx,
 			const char *src, size_t len);
+	/*
+	 * Batch reservation, only used by batch probes. Those are
+	 * registered by lttng-ust versions implementing these callbacks.
+	 * event_reserve_batch returns the number of records reserved,
+	 * each of which is written after a call to event_batch_next with
+	 * its payload size.
+	 */
+	int (*event_reserve_batch)(struct lttng_ust_lib_ring_buffer_ctx *ctx,
+			uint32_t event_id, const size_t *data_sizes,
+			unsigned int nr);
+	void (*event_batch_next)(struct lttng_ust_lib_ring_buffer_ctx *ctx,
+			uint32_t event_id, size_t data_size);
+	void (*event_commit_batch)(struct lttng_ust_lib_ring_buffer_ctx *ctx);
 };
 
 /*
@@ -572,6 +624,16 @@ struct lttng_ust_enum_ht {
 	struct cds_hlist_head table[LTTNG_UST_ENUM_HT_SIZE];
 };
 
+/*
+ * Hash table of cds_hlist buckets, doubled in size when its number of
+ * entries exceeds its number of buckets.
+ */
+struct lttng_ust_ht {
+	struct cds_hlist_head *table;
+	unsigned long size;		/* Number of buckets (power of 2) */
+	unsigned long count;		/* Number of entries */
+};
+
 /*
  * IMPORTANT: this structure is part of the ABI between the probe and
  * UST. Fields need to be only added at the end, never reordered, never
@@ -592,7 +654,7 @@ struct lttng_session {
 	/* New UST 2.1 */
 	/* List of enablers */
 	struct cds_list_head enablers_head;
-	struct lttng_ust_event_ht events_ht;	/* ht of events */
+	struct lttng_ust_event_ht _deprecated5;
 	void *owner;				/* object owner */
 	int tstate:1;				/* Transient enable state */
 
@@ -600,9 +662,16 @@ struct lttng_session {
 	int statedump_pending:1;
 
 	/* New UST 2.8 */
-	struct lttng_ust_enum_ht enums_ht;	/* ht of enumerations */
+	struct lttng_ust_enum_ht _deprecated6;
 	struct cds_list_head enums_head;
 	struct lttng_ctx *ctx;			/* contexts for filters. */
+
+	/* New UST 2.9 */
+	struct cds_list_head filter_runtime_head; /* linked filter bytecode */
+	struct lttng_ust_ht events_ht;		/* ht of events */
+	struct lttng_ust_ht enums_ht;		/* ht of enumerations */
+	/* Enablers changed since the last synchronization */
+	struct cds_list_head sync_enablers_head;
 };
 
 struct lttng_transport {
@@ -655,7 +724,7 @@ void synchronize_trace(void);
 
 int lttng_probe_register(struct lttng_probe_desc *desc);
 void lttng_probe_unregister(struct lttng_probe_desc *desc);
-int lttng_fix_pending_events(void);
+int lttng_fix_pending_events(struct cds_list_head *new_probes);
 int lttng_probes_init(void);
 void lttng_probes_exit(void);
 int lttng_find_context(struct lttng_ctx *ctx, const char *name);
@@ -724,6 +793,10 @@ void lttng_free_event_filter_runtime(struct lttng_event *event);
 void lttng_filter_sync_state(struct lttng_bytecode_runtime *runtime);
 
 struct cds_list_head *lttng_get_probe_list_head(void);
+const struct lttng_event_desc *lttng_probes_find_event_desc(const char *name);
+const struct lttng_event_desc * const *
+	lttng_probes_find_event_desc_prefix(const char *prefix, size_t len,
+		size_t *count);
 int lttng_session_active(void);
 
 typedef int (*t_statedump_func_ptr)(struct lttng_session *session);
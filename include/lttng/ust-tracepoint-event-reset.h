@@ -46,6 +46,9 @@
 #undef TRACEPOINT_MODEL_EMF_URI
 #define TRACEPOINT_MODEL_EMF_URI(provider, name, uri)
 
+#undef TRACEPOINT_EVENT_BATCH
+#define TRACEPOINT_EVENT_BATCH(provider, name, args)
+
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, \
 			_nowrite)
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <urcu/compiler.h>
 #include <urcu/rculist.h>
 #include <lttng/ust-events.h>
@@ -416,6 +417,9 @@ size_t __event_get_size__##_provider##___##_name(size_t *__dynamic_len, _TP_ARGS
  *
  * Create static inline function that layout the filter stack data.
  * We make both write and nowrite data available to the filter.
+ * Only the fields selected by the __filter_fields mask (see
+ * LTTNG_FILTER_FIELD_BIT()) are computed: the layout stays the same,
+ * but the fields not read by the filters are left uninitialized.
  */
 
 /* Reset all macros within TRACEPOINT_EVENT */
@@ -425,123 +429,130 @@ size_t __event_get_size__##_provider##___##_name(size_t *__dynamic_len, _TP_ARGS
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite)     \
-	if (lttng_is_signed_type(_type)) {				       \
-		int64_t __ctf_tmp_int64;				       \
-		switch (sizeof(_type)) {				       \
-		case 1:							       \
-		{							       \
-			union { _type t; int8_t v; } __tmp = { (_type) (_src) }; \
-			__ctf_tmp_int64 = (int64_t) __tmp.v;		       \
-			break;						       \
+	if (__filter_fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {	       \
+		if (lttng_is_signed_type(_type)) {			       \
+			int64_t __ctf_tmp_int64;			       \
+			switch (sizeof(_type)) {			       \
+			case 1:						       \
+			{						       \
+				union { _type t; int8_t v; } __tmp = { (_type) (_src) }; \
+				__ctf_tmp_int64 = (int64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			case 2:						       \
+			{						       \
+				union { _type t; int16_t v; } __tmp = { (_type) (_src) }; \
+				if (_byte_order != BYTE_ORDER)		       \
+					__tmp.v = bswap_16(__tmp.v);	       \
+				__ctf_tmp_int64 = (int64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			case 4:						       \
+			{						       \
+				union { _type t; int32_t v; } __tmp = { (_type) (_src) }; \
+				if (_byte_order != BYTE_ORDER)		       \
+					__tmp.v = bswap_32(__tmp.v);	       \
+				__ctf_tmp_int64 = (int64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			case 8:						       \
+			{						       \
+				union { _type t; int64_t v; } __tmp = { (_type) (_src) }; \
+				if (_byte_order != BYTE_ORDER)		       \
+					__tmp.v = bswap_64(__tmp.v);	       \
+				__ctf_tmp_int64 = (int64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			default:					       \
+				abort();				       \
+			};						       \
+			memcpy(__stack_data, &__ctf_tmp_int64, sizeof(int64_t)); \
+		} else {						       \
+			uint64_t __ctf_tmp_uint64;			       \
+			switch (sizeof(_type)) {			       \
+			case 1:						       \
+			{						       \
+				union { _type t; uint8_t v; } __tmp = { (_type) (_src) }; \
+				__ctf_tmp_uint64 = (uint64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			case 2:						       \
+			{						       \
+				union { _type t; uint16_t v; } __tmp = { (_type) (_src) }; \
+				if (_byte_order != BYTE_ORDER)		       \
+					__tmp.v = bswap_16(__tmp.v);	       \
+				__ctf_tmp_uint64 = (uint64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			case 4:						       \
+			{						       \
+				union { _type t; uint32_t v; } __tmp = { (_type) (_src) }; \
+				if (_byte_order != BYTE_ORDER)		       \
+					__tmp.v = bswap_32(__tmp.v);	       \
+				__ctf_tmp_uint64 = (uint64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			case 8:						       \
+			{						       \
+				union { _type t; uint64_t v; } __tmp = { (_type) (_src) }; \
+				if (_byte_order != BYTE_ORDER)		       \
+					__tmp.v = bswap_64(__tmp.v);	       \
+				__ctf_tmp_uint64 = (uint64_t) __tmp.v;	       \
+				break;					       \
+			}						       \
+			default:					       \
+				abort();				       \
+			};						       \
+			memcpy(__stack_data, &__ctf_tmp_uint64, sizeof(uint64_t)); \
 		}							       \
-		case 2:							       \
-		{							       \
-			union { _type t; int16_t v; } __tmp = { (_type) (_src) }; \
-			if (_byte_order != BYTE_ORDER)			       \
-				__tmp.v = bswap_16(__tmp.v);		       \
-			__ctf_tmp_int64 = (int64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		case 4:							       \
-		{							       \
-			union { _type t; int32_t v; } __tmp = { (_type) (_src) }; \
-			if (_byte_order != BYTE_ORDER)			       \
-				__tmp.v = bswap_32(__tmp.v);		       \
-			__ctf_tmp_int64 = (int64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		case 8:							       \
-		{							       \
-			union { _type t; int64_t v; } __tmp = { (_type) (_src) }; \
-			if (_byte_order != BYTE_ORDER)			       \
-				__tmp.v = bswap_64(__tmp.v);		       \
-			__ctf_tmp_int64 = (int64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		default:						       \
-			abort();					       \
-		};							       \
-		memcpy(__stack_data, &__ctf_tmp_int64, sizeof(int64_t));       \
-	} else {							       \
-		uint64_t __ctf_tmp_uint64;				       \
-		switch (sizeof(_type)) {				       \
-		case 1:							       \
-		{							       \
-			union { _type t; uint8_t v; } __tmp = { (_type) (_src) }; \
-			__ctf_tmp_uint64 = (uint64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		case 2:							       \
-		{							       \
-			union { _type t; uint16_t v; } __tmp = { (_type) (_src) }; \
-			if (_byte_order != BYTE_ORDER)			       \
-				__tmp.v = bswap_16(__tmp.v);		       \
-			__ctf_tmp_uint64 = (uint64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		case 4:							       \
-		{							       \
-			union { _type t; uint32_t v; } __tmp = { (_type) (_src) }; \
-			if (_byte_order != BYTE_ORDER)			       \
-				__tmp.v = bswap_32(__tmp.v);		       \
-			__ctf_tmp_uint64 = (uint64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		case 8:							       \
-		{							       \
-			union { _type t; uint64_t v; } __tmp = { (_type) (_src) }; \
-			if (_byte_order != BYTE_ORDER)			       \
-				__tmp.v = bswap_64(__tmp.v);		       \
-			__ctf_tmp_uint64 = (uint64_t) __tmp.v;		       \
-			break;						       \
-		}							       \
-		default:						       \
-			abort();					       \
-		};							       \
-		memcpy(__stack_data, &__ctf_tmp_uint64, sizeof(uint64_t));     \
 	}								       \
-	__stack_data += sizeof(int64_t);
+	__stack_data += sizeof(int64_t);				       \
+	__field_idx++;
 
 #undef _ctf_float
 #define _ctf_float(_type, _item, _src, _nowrite)			       \
-	{								       \
+	if (__filter_fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {	       \
 		double __ctf_tmp_double = (double) (_type) (_src);	       \
 		memcpy(__stack_data, &__ctf_tmp_double, sizeof(double));       \
-		__stack_data += sizeof(double);				       \
-	}
+	}								       \
+	__stack_data += sizeof(double);					       \
+	__field_idx++;
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _byte_order, _length,	       \
 			_encoding, _nowrite, _elem_type_base)		       \
-	{								       \
+	if (__filter_fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {	       \
 		unsigned long __ctf_tmp_ulong = (unsigned long) (_length);     \
 		const void *__ctf_tmp_ptr = (_src);			       \
 		memcpy(__stack_data, &__ctf_tmp_ulong, sizeof(unsigned long)); \
-		__stack_data += sizeof(unsigned long);			       \
-		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+		memcpy(__stack_data + sizeof(unsigned long), &__ctf_tmp_ptr,   \
+			sizeof(void *));				       \
+	}								       \
+	__stack_data += sizeof(unsigned long) + sizeof(void *);		       \
+	__field_idx++;
 
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
 			_src_length, _encoding, _nowrite, _elem_type_base)     \
-	{								       \
+	if (__filter_fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {	       \
 		unsigned long __ctf_tmp_ulong = (unsigned long) (_src_length); \
 		const void *__ctf_tmp_ptr = (_src);			       \
 		memcpy(__stack_data, &__ctf_tmp_ulong, sizeof(unsigned long)); \
-		__stack_data += sizeof(unsigned long);			       \
-		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+		memcpy(__stack_data + sizeof(unsigned long), &__ctf_tmp_ptr,   \
+			sizeof(void *));				       \
+	}								       \
+	__stack_data += sizeof(unsigned long) + sizeof(void *);		       \
+	__field_idx++;
 
 #undef _ctf_string
 #define _ctf_string(_item, _src, _nowrite)				       \
-	{								       \
+	if (__filter_fields & LTTNG_FILTER_FIELD_BIT(__field_idx)) {	       \
 		const void *__ctf_tmp_ptr =				       \
 			((_src) ? (_src) : __LTTNG_UST_NULL_STRING);	       \
 		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+	}								       \
+	__stack_data += sizeof(void *);					       \
+	__field_idx++;
 
 #undef _ctf_enum
 #define _ctf_enum(_provider, _name, _type, _item, _src, _nowrite)		\
@@ -556,9 +567,14 @@ size_t __event_get_size__##_provider##___##_name(size_t *__dynamic_len, _TP_ARGS
 #undef TRACEPOINT_EVENT_CLASS
 #define TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
 static inline								      \
-void __event_prepare_filter_stack__##_provider##___##_name(char *__stack_data,\
+void __event_prepare_filter_stack__##_provider##___##_name(char *__stack_data, \
+						 uint64_t __filter_fields,    \
 						 _TP_ARGS_DATA_PROTO(_args))  \
 {									      \
+	unsigned int __field_idx = 0;					      \
+									      \
+	if (0)								      \
+		(void) __field_idx;	/* don't warn if unused */	      \
 	_fields								      \
 }
 
@@ -620,6 +636,193 @@ size_t __event_get_align__##_provider##___##_name(_TP_ARGS_PROTO(_args))      \
 
 #include TRACEPOINT_INCLUDE
 
+/*
+ * Stage 4.1 of tracepoint event generation.
+ *
+ * Create a structure describing the payload layout of each event, made
+ * of its integer, floating point, enumeration and array fields. Each
+ * member is aligned like its field in the ring buffer, so the offset of
+ * the __end member is the size of the payload of events which only
+ * contain such fixed-size fields.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+#include <lttng/ust-tracepoint-event-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite)     \
+	_type __tp_field_##_item					       \
+		__attribute__((aligned(lttng_alignof(_type))));
+
+#undef _ctf_float
+#define _ctf_float(_type, _item, _src, _nowrite)			       \
+	_type __tp_field_##_item					       \
+		__attribute__((aligned(lttng_alignof(_type))));
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _byte_order, _length,	       \
+			_encoding, _nowrite, _elem_type_base)		       \
+	_type __tp_field_##_item[_length]				       \
+		__attribute__((aligned(lttng_alignof(_type))));
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
+			_src_length, _encoding, _nowrite, _elem_type_base)
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _nowrite)
+
+#undef _ctf_enum
+#define _ctf_enum(_provider, _name, _type, _item, _src, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, BYTE_ORDER, 10, _nowrite)
+
+#undef TP_ARGS
+#define TP_ARGS(...) __VA_ARGS__
+
+#undef TP_FIELDS
+#define TP_FIELDS(...) __VA_ARGS__
+
+#undef TRACEPOINT_EVENT_CLASS
+#define TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
+struct __event_payload__##_provider##___##_name {			      \
+	_fields								      \
+	char __end[0];							      \
+} __attribute__((packed));
+
+#include TRACEPOINT_INCLUDE
+
+/*
+ * Stage 4.2 of tracepoint event generation.
+ *
+ * Detect the events without sequence nor string field. Their payload
+ * size and alignment are compile-time constants. The payload of those
+ * no larger than LTTNG_UST_FIXED_WRITE_MAX is written at once.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+#include <lttng/ust-tracepoint-event-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite)
+
+#undef _ctf_float
+#define _ctf_float(_type, _item, _src, _nowrite)
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _byte_order, _length,	       \
+			_encoding, _nowrite, _elem_type_base)
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
+			_src_length, _encoding, _nowrite, _elem_type_base)     \
+	&& 0
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _nowrite)				       \
+	&& 0
+
+#undef _ctf_enum
+#define _ctf_enum(_provider, _name, _type, _item, _src, _nowrite)
+
+#undef TP_ARGS
+#define TP_ARGS(...) __VA_ARGS__
+
+#undef TP_FIELDS
+#define TP_FIELDS(...) __VA_ARGS__
+
+#undef TRACEPOINT_EVENT_CLASS
+#define TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
+enum {									      \
+	__event_fixed_layout__##_provider##___##_name = 1 _fields,	      \
+	__event_fixed_len__##_provider##___##_name =			      \
+		offsetof(struct __event_payload__##_provider##___##_name, __end), \
+	__event_fixed_align__##_provider##___##_name =			      \
+		lttng_alignof(struct __event_payload__##_provider##___##_name), \
+	__event_fixed_write__##_provider##___##_name =			      \
+		__event_fixed_layout__##_provider##___##_name		      \
+		&& __event_fixed_len__##_provider##___##_name <= LTTNG_UST_FIXED_WRITE_MAX, \
+	__event_fixed_write_len__##_provider##___##_name =		      \
+		__event_fixed_write__##_provider##___##_name ?		      \
+		__event_fixed_len__##_provider##___##_name : 1,		      \
+};
+
+#include TRACEPOINT_INCLUDE
+
+/*
+ * Stage 4.3 of tracepoint event generation.
+ *
+ * Create static inline function that lays out the payload of small
+ * events with a fixed layout in a local buffer, so the probe can write
+ * it into the ring buffer at once rather than aligning and writing each
+ * field.
+ * Padding bytes are cleared so no stack content ends up in the trace.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+#include <lttng/ust-tracepoint-event-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite)     \
+	{								       \
+		_type __tmp = (_src);					       \
+		memcpy(__payload + offsetof(__tp_payload_t, __tp_field_##_item), \
+			&__tmp, sizeof(__tmp));				       \
+	}
+
+#undef _ctf_float
+#define _ctf_float(_type, _item, _src, _nowrite)			       \
+	{								       \
+		_type __tmp = (_src);					       \
+		memcpy(__payload + offsetof(__tp_payload_t, __tp_field_##_item), \
+			&__tmp, sizeof(__tmp));				       \
+	}
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _byte_order, _length,	       \
+			_encoding, _nowrite, _elem_type_base)		       \
+	memcpy(__payload + offsetof(__tp_payload_t, __tp_field_##_item),      \
+		_src, sizeof(_type) * (_length));
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
+			_src_length, _encoding, _nowrite, _elem_type_base)
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _nowrite)
+
+#undef _ctf_enum
+#define _ctf_enum(_provider, _name, _type, _item, _src, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, BYTE_ORDER, 10, _nowrite)
+
+#undef TP_ARGS
+#define TP_ARGS(...) __VA_ARGS__
+
+#undef TP_FIELDS
+#define TP_FIELDS(...) __VA_ARGS__
+
+#undef TRACEPOINT_EVENT_CLASS
+#define TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
+static inline lttng_ust_notrace						      \
+void __event_write_fixed__##_provider##___##_name(char *__payload,	      \
+		_TP_ARGS_DATA_PROTO(_args));				      \
+static inline								      \
+void __event_write_fixed__##_provider##___##_name(char *__payload,	      \
+		_TP_ARGS_DATA_PROTO(_args))				      \
+{									      \
+	typedef struct __event_payload__##_provider##___##_name		      \
+		__tp_payload_t __attribute__((unused));			      \
+									      \
+	if (!__event_fixed_write__##_provider##___##_name)		      \
+		return;							      \
+	memset(__payload, 0, __event_fixed_len__##_provider##___##_name);     \
+	_fields								      \
+}
+
+#include TRACEPOINT_INCLUDE
+
 
 /*
  * Stage 5 of tracepoint event generation.
@@ -659,7 +862,7 @@ size_t __event_get_align__##_provider##___##_name(_TP_ARGS_PROTO(_args))      \
 			_src_length, _encoding, _nowrite, _elem_type_base) \
 	{								\
 		_length_type __tmpl = __stackvar.__dynamic_len[__dynamic_len_idx]; \
-		lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_length_type));\
+		lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_length_type)); \
 		__chan->ops->event_write(&__ctx, &__tmpl, sizeof(_length_type));\
 	}								\
 	lib_ring_buffer_align_ctx(&__ctx, lttng_alignof(_type));	\
@@ -675,6 +878,22 @@ size_t __event_get_align__##_provider##___##_name(_TP_ARGS_PROTO(_args))      \
 #error "Tracepoint probe provider major version has changed. Please remove dynamic check for has_strcpy."
 #endif
 
+/*
+ * __chan->ops->u.has_filter_field_mask is a flag letting us know if the
+ * LTTng-UST tracepoint provider ABI sets the field_mask of bytecode
+ * runtimes. If it does not, all fields are prepared for the filters.
+ * This dynamic check can be removed when the tracepoint provider ABI
+ * moves to 2.
+ */
+#if (LTTNG_UST_PROVIDER_MAJOR > 1)
+#error "Tracepoint probe provider major version has changed. Please remove dynamic check for has_filter_field_mask."
+#endif
+
+#undef __event_filter_field_mask
+#define __event_filter_field_mask(_chan, _bc_runtime)			\
+	((_chan)->ops->u.has_filter_field_mask ?			\
+		(_bc_runtime)->field_mask : ~0ULL)
+
 #undef _ctf_string
 #define _ctf_string(_item, _src, _nowrite)			        \
 	{									\
@@ -736,12 +955,35 @@ size_t __event_get_align__##_provider##___##_name(_TP_ARGS_PROTO(_args))      \
 
 #endif /* TP_IP_PARAM */
 
+/*
+ * _TP_ARGS_BATCH_LOCALS declares the probe arguments as local variables
+ * holding element __tp_batch_i of the batch probe arrays.
+ */
+#define _TP_EXBATCH_LOCAL0()
+#define _TP_EXBATCH_LOCAL1(a)
+#define _TP_EXBATCH_LOCAL2(a,b)					a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL4(a,b,c,d)				a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL6(a,b,c,d,e,f)				a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL8(a,b,c,d,e,f,g,h)			a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL10(a,b,c,d,e,f,g,h,i,j)		a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i]; i j __attribute__((unused)) = __tp_batch_arg_##j[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL12(a,b,c,d,e,f,g,h,i,j,k,l)		a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i]; i j __attribute__((unused)) = __tp_batch_arg_##j[__tp_batch_i]; k l __attribute__((unused)) = __tp_batch_arg_##l[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL14(a,b,c,d,e,f,g,h,i,j,k,l,m,n)	a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i]; i j __attribute__((unused)) = __tp_batch_arg_##j[__tp_batch_i]; k l __attribute__((unused)) = __tp_batch_arg_##l[__tp_batch_i]; m n __attribute__((unused)) = __tp_batch_arg_##n[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL16(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p)	a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i]; i j __attribute__((unused)) = __tp_batch_arg_##j[__tp_batch_i]; k l __attribute__((unused)) = __tp_batch_arg_##l[__tp_batch_i]; m n __attribute__((unused)) = __tp_batch_arg_##n[__tp_batch_i]; o p __attribute__((unused)) = __tp_batch_arg_##p[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL18(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r)	a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i]; i j __attribute__((unused)) = __tp_batch_arg_##j[__tp_batch_i]; k l __attribute__((unused)) = __tp_batch_arg_##l[__tp_batch_i]; m n __attribute__((unused)) = __tp_batch_arg_##n[__tp_batch_i]; o p __attribute__((unused)) = __tp_batch_arg_##p[__tp_batch_i]; q r __attribute__((unused)) = __tp_batch_arg_##r[__tp_batch_i];
+#define _TP_EXBATCH_LOCAL20(a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t)	a b __attribute__((unused)) = __tp_batch_arg_##b[__tp_batch_i]; c d __attribute__((unused)) = __tp_batch_arg_##d[__tp_batch_i]; e f __attribute__((unused)) = __tp_batch_arg_##f[__tp_batch_i]; g h __attribute__((unused)) = __tp_batch_arg_##h[__tp_batch_i]; i j __attribute__((unused)) = __tp_batch_arg_##j[__tp_batch_i]; k l __attribute__((unused)) = __tp_batch_arg_##l[__tp_batch_i]; m n __attribute__((unused)) = __tp_batch_arg_##n[__tp_batch_i]; o p __attribute__((unused)) = __tp_batch_arg_##p[__tp_batch_i]; q r __attribute__((unused)) = __tp_batch_arg_##r[__tp_batch_i]; s t __attribute__((unused)) = __tp_batch_arg_##t[__tp_batch_i];
+#define _TP_BATCH_LOCALS_N(N, ...)	_TP_PARAMS(_TP_COMBINE_TOKENS(_TP_EXBATCH_LOCAL, N)(__VA_ARGS__))
+#define _TP_ARGS_BATCH_LOCALS(...)	_TP_BATCH_LOCALS_N(_TP_NARGS(0, ##__VA_ARGS__), ##__VA_ARGS__)
+
 /*
  * Using twice size for filter stack data to hold size and pointer for
  * each field (worse case). For integers, max size required is 64-bit.
  * Same for double-precision floats. Those fit within
  * 2*sizeof(unsigned long) for all supported architectures.
  * Perform UNION (||) of filter runtime list.
+ *
+ * The batch probe records the events of a tracepoint_batch() call. It
+ * filters and sizes up to LTTNG_UST_BATCH_CHUNK events, then writes
+ * them with as few buffer reservations as possible.
  */
 #undef TRACEPOINT_EVENT_CLASS
 #define TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
@@ -777,10 +1019,16 @@ void __event_probe__##_provider##___##_name(_TP_ARGS_DATA_PROTO(_args))	      \
 	if (caa_unlikely(!cds_list_empty(&__event->bytecode_runtime_head))) { \
 		struct lttng_bytecode_runtime *bc_runtime;		      \
 		int __filter_record = __event->has_enablers_without_bytecode; \
+		uint64_t __filter_prepared = 0, __filter_fields;	      \
 									      \
-		__event_prepare_filter_stack__##_provider##___##_name(__stackvar.__filter_stack_data, \
-			_TP_ARGS_DATA_VAR(_args));			      \
 		tp_list_for_each_entry_rcu(bc_runtime, &__event->bytecode_runtime_head, node) { \
+			/* Only compute the fields read by this filter. */    \
+			__filter_fields = __event_filter_field_mask(__chan, bc_runtime) & ~__filter_prepared; \
+			if (__filter_fields) {				      \
+				__event_prepare_filter_stack__##_provider##___##_name(__stackvar.__filter_stack_data, \
+					__filter_fields, _TP_ARGS_DATA_VAR(_args)); \
+				__filter_prepared |= __filter_fields;	      \
+			}						      \
 			if (caa_unlikely(bc_runtime->filter(bc_runtime,	      \
 					__stackvar.__filter_stack_data) & LTTNG_FILTER_RECORD_FLAG)) \
 				__filter_record = 1;			      \
@@ -788,9 +1036,14 @@ void __event_probe__##_provider##___##_name(_TP_ARGS_DATA_PROTO(_args))	      \
 		if (caa_likely(!__filter_record))			      \
 			return;						      \
 	}								      \
-	__event_len = __event_get_size__##_provider##___##_name(__stackvar.__dynamic_len, \
-		 _TP_ARGS_DATA_VAR(_args));				      \
-	__event_align = __event_get_align__##_provider##___##_name(_TP_ARGS_VAR(_args)); \
+	if (__event_fixed_layout__##_provider##___##_name) {		      \
+		__event_len = __event_fixed_len__##_provider##___##_name;     \
+		__event_align = __event_fixed_align__##_provider##___##_name; \
+	} else {							      \
+		__event_len = __event_get_size__##_provider##___##_name(__stackvar.__dynamic_len, \
+			 _TP_ARGS_DATA_VAR(_args));			      \
+		__event_align = __event_get_align__##_provider##___##_name(_TP_ARGS_VAR(_args)); \
+	}								      \
 	memset(&__lttng_ctx, 0, sizeof(__lttng_ctx));			      \
 	__lttng_ctx.event = __event;					      \
 	__lttng_ctx.chan_ctx = tp_rcu_dereference_bp(__chan->ctx);	      \
@@ -801,8 +1054,138 @@ void __event_probe__##_provider##___##_name(_TP_ARGS_DATA_PROTO(_args))	      \
 	__ret = __chan->ops->event_reserve(&__ctx, __event->id);	      \
 	if (__ret < 0)							      \
 		return;							      \
-	_fields								      \
+	if (__event_fixed_write__##_provider##___##_name) {		      \
+		char __payload[__event_fixed_write_len__##_provider##___##_name]; \
+									      \
+		__event_write_fixed__##_provider##___##_name(__payload,	      \
+			_TP_ARGS_DATA_VAR(_args));			      \
+		lib_ring_buffer_align_ctx(&__ctx,			      \
+			__event_fixed_align__##_provider##___##_name);	      \
+		__chan->ops->event_write(&__ctx, __payload, sizeof(__payload)); \
+	} else {							      \
+		_fields							      \
+	}								      \
 	__chan->ops->event_commit(&__ctx);				      \
+}									      \
+static lttng_ust_notrace __attribute__((unused))			      \
+void __event_probe_batch__##_provider##___##_name(_TP_ARGS_BATCH_DATA_PROTO(_args)); \
+static									      \
+void __event_probe_batch__##_provider##___##_name(_TP_ARGS_BATCH_DATA_PROTO(_args)) \
+{									      \
+	struct lttng_event *__event = (struct lttng_event *) __tp_data;	      \
+	struct lttng_channel *__chan = __event->chan;			      \
+	struct lttng_ust_lib_ring_buffer_ctx __ctx;			      \
+	struct lttng_stack_ctx __lttng_ctx;				      \
+	size_t __event_len[LTTNG_UST_BATCH_CHUNK];			      \
+	size_t __batch_dynamic_len[LTTNG_UST_BATCH_CHUNK][_TP_ARRAY_SIZE(__event_fields___##_provider##___##_name) - 1]; \
+	size_t __batch_idx[LTTNG_UST_BATCH_CHUNK];			      \
+	size_t __batch_begin, __batch_nr, __batch_pos, __tp_batch_i;	      \
+	size_t __event_align = 1;					      \
+	size_t __dynamic_len_idx = 0;					      \
+	union {								      \
+		size_t __dynamic_len[_TP_ARRAY_SIZE(__event_fields___##_provider##___##_name) - 1]; \
+		char __filter_stack_data[2 * sizeof(unsigned long) * (_TP_ARRAY_SIZE(__event_fields___##_provider##___##_name) - 1)]; \
+	} __stackvar;							      \
+	int __ret;							      \
+									      \
+	if (0)								      \
+		(void) __dynamic_len_idx;	/* don't warn if unused */    \
+	if (caa_unlikely(!CMM_ACCESS_ONCE(__chan->session->active)))	      \
+		return;							      \
+	if (caa_unlikely(!CMM_ACCESS_ONCE(__chan->enabled)))		      \
+		return;							      \
+	if (caa_unlikely(!CMM_ACCESS_ONCE(__event->enabled)))		      \
+		return;							      \
+	if (caa_unlikely(!TP_RCU_LINK_TEST()))				      \
+		return;							      \
+	memset(&__lttng_ctx, 0, sizeof(__lttng_ctx));			      \
+	__lttng_ctx.event = __event;					      \
+	__lttng_ctx.chan_ctx = tp_rcu_dereference_bp(__chan->ctx);	      \
+	__lttng_ctx.event_ctx = tp_rcu_dereference_bp(__event->ctx);	      \
+	for (__batch_begin = 0; __batch_begin < __tp_batch_nr;		      \
+			__batch_begin = __tp_batch_i) {			      \
+		/* Filter the events of the chunk and compute their size. */  \
+		__batch_nr = 0;						      \
+		for (__tp_batch_i = __batch_begin;			      \
+				__tp_batch_i < __tp_batch_nr		      \
+				&& __batch_nr < LTTNG_UST_BATCH_CHUNK;	      \
+				__tp_batch_i++) {			      \
+			_TP_ARGS_BATCH_LOCALS(_args)			      \
+									      \
+			if (!_TP_SESSION_CHECK(session, __chan->session))     \
+				continue;				      \
+			if (caa_unlikely(!cds_list_empty(&__event->bytecode_runtime_head))) { \
+				struct lttng_bytecode_runtime *bc_runtime;    \
+				int __filter_record = __event->has_enablers_without_bytecode; \
+				uint64_t __filter_prepared = 0, __filter_fields; \
+									      \
+				tp_list_for_each_entry_rcu(bc_runtime, &__event->bytecode_runtime_head, node) { \
+					__filter_fields = __event_filter_field_mask(__chan, bc_runtime) & ~__filter_prepared; \
+					if (__filter_fields) {		      \
+						__event_prepare_filter_stack__##_provider##___##_name(__stackvar.__filter_stack_data, \
+							__filter_fields, _TP_ARGS_DATA_VAR(_args)); \
+						__filter_prepared |= __filter_fields; \
+					}				      \
+					if (caa_unlikely(bc_runtime->filter(bc_runtime, \
+							__stackvar.__filter_stack_data) & LTTNG_FILTER_RECORD_FLAG)) \
+						__filter_record = 1;	      \
+				}					      \
+				if (caa_likely(!__filter_record))	      \
+					continue;			      \
+			}						      \
+			if (__event_fixed_layout__##_provider##___##_name) {  \
+				__event_len[__batch_nr] = __event_fixed_len__##_provider##___##_name; \
+				__event_align = __event_fixed_align__##_provider##___##_name; \
+			} else {					      \
+				__event_len[__batch_nr] = __event_get_size__##_provider##___##_name(__batch_dynamic_len[__batch_nr], \
+					_TP_ARGS_DATA_VAR(_args));	      \
+				__event_align = _tp_max_t(size_t, __event_align, \
+					__event_get_align__##_provider##___##_name(_TP_ARGS_VAR(_args))); \
+			}						      \
+			__batch_idx[__batch_nr++] = __tp_batch_i;	      \
+		}							      \
+		/* Write the events, reserving space for several at once. */  \
+		for (__batch_pos = 0; __batch_pos < __batch_nr; ) {	      \
+			lib_ring_buffer_ctx_init(&__ctx, __chan->chan, __event, \
+				__event_len[__batch_pos], __event_align, -1,  \
+				__chan->handle, &__lttng_ctx);		      \
+			__ret = __chan->ops->event_reserve_batch(&__ctx,      \
+				__event->id, &__event_len[__batch_pos],	      \
+				__batch_nr - __batch_pos);		      \
+			if (__ret < 0) {				      \
+				__batch_pos++;	/* event lost */	      \
+				continue;				      \
+			}						      \
+			for (; __ret > 0; __ret--, __batch_pos++) {	      \
+				__tp_batch_i = __batch_idx[__batch_pos];      \
+				{					      \
+					_TP_ARGS_BATCH_LOCALS(_args)	      \
+									      \
+					memcpy(__stackvar.__dynamic_len,      \
+						__batch_dynamic_len[__batch_pos], \
+						sizeof(__stackvar.__dynamic_len)); \
+					__dynamic_len_idx = 0;		      \
+					__ctx.ip = _TP_IP_PARAM(TP_IP_PARAM); \
+					__chan->ops->event_batch_next(&__ctx, \
+						__event->id,		      \
+						__event_len[__batch_pos]);    \
+					if (__event_fixed_write__##_provider##___##_name) { \
+						char __payload[__event_fixed_write_len__##_provider##___##_name]; \
+									      \
+						__event_write_fixed__##_provider##___##_name(__payload, \
+							_TP_ARGS_DATA_VAR(_args)); \
+						lib_ring_buffer_align_ctx(&__ctx, \
+							__event_fixed_align__##_provider##___##_name); \
+						__chan->ops->event_write(&__ctx, \
+							__payload, sizeof(__payload)); \
+					} else {			      \
+						_fields			      \
+					}				      \
+				}					      \
+			}						      \
+			__chan->ops->event_commit_batch(&__ctx);	      \
+		}							      \
+	}								      \
 }
 
 #include TRACEPOINT_INCLUDE
@@ -832,6 +1215,31 @@ static const char __tp_event_signature___##_provider##___##_name[] = 	\
 
 #undef _TP_EXTRACT_STRING2
 
+/*
+ * Stage 5.2 of tracepoint event generation.
+ *
+ * Create the batch probe callback of each event. Only emitted for
+ * events declared with TRACEPOINT_EVENT_BATCH.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+
+#undef TP_ARGS
+#define TP_ARGS(...) __VA_ARGS__
+
+#undef TRACEPOINT_EVENT_INSTANCE
+#define TRACEPOINT_EVENT_INSTANCE(_provider, _template, _name, _args)	\
+static inline lttng_ust_notrace						\
+void __event_probe_batch_cb__##_provider##___##_name(_TP_ARGS_BATCH_DATA_PROTO(_args)); \
+static inline								\
+void __event_probe_batch_cb__##_provider##___##_name(_TP_ARGS_BATCH_DATA_PROTO(_args)) \
+{									\
+	__event_probe_batch__##_provider##___##_template(_TP_ARGS_BATCH_DATA_VAR(_args)); \
+}
+
+#include TRACEPOINT_INCLUDE
+
 /*
  * Stage 6 of tracepoint event generation.
  *
@@ -867,6 +1275,22 @@ static const char *_model_emf_uri___##__provider##___##__name = __uri;
 
 #include TRACEPOINT_INCLUDE
 
+/*
+ * Stage 6.2 of tracepoint event generation.
+ *
+ * Tracepoint batch probe callbacks.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+
+#undef TRACEPOINT_EVENT_BATCH
+#define TRACEPOINT_EVENT_BATCH(__provider, __name, __args)		   \
+static void (*_batch_callback___##__provider##___##__name)(void) =	   \
+		(void (*)(void)) &__event_probe_batch_cb__##__provider##___##__name;
+
+#include TRACEPOINT_INCLUDE
+
 /*
  * Stage 7.1 of tracepoint event generation.
  *
@@ -886,6 +1310,9 @@ static const int *							       \
 static const char *							       \
 	__ref_model_emf_uri___##_provider##___##_name			       \
 	__attribute__((weakref ("_model_emf_uri___" #_provider "___" #_name)));\
+static void (*								       \
+	__ref_batch_callback___##_provider##___##_name)(void)		       \
+	__attribute__((weakref ("_batch_callback___" #_provider "___" #_name)));\
 static const struct lttng_event_desc __event_desc___##_provider##_##_name = {	       \
 	.name = #_provider ":" #_name,					       \
 	.probe_callback = (void (*)(void)) &__event_probe__##_provider##___##_template,\
@@ -897,6 +1324,7 @@ static const struct lttng_event_desc __event_desc___##_provider##_##_name = {
 	.u = {								       \
 	    .ext = {							       \
 		  .model_emf_uri = &__ref_model_emf_uri___##_provider##___##_name, \
+		  .batch_callback = &__ref_batch_callback___##_provider##___##_name, \
 		},							       \
 	},								       \
 };
@@ -69,11 +69,15 @@ extern void lttng_ring_buffer_client_overwrite_init(void);
 extern void lttng_ring_buffer_client_overwrite_rt_init(void);
 extern void lttng_ring_buffer_client_discard_init(void);
 extern void lttng_ring_buffer_client_discard_rt_init(void);
+extern void lttng_ring_buffer_client_discard_per_thread_init(void);
+extern void lttng_ring_buffer_client_overwrite_per_thread_init(void);
 extern void lttng_ring_buffer_metadata_client_init(void);
 extern void lttng_ring_buffer_client_overwrite_exit(void);
 extern void lttng_ring_buffer_client_overwrite_rt_exit(void);
 extern void lttng_ring_buffer_client_discard_exit(void);
 extern void lttng_ring_buffer_client_discard_rt_exit(void);
+extern void lttng_ring_buffer_client_discard_per_thread_exit(void);
+extern void lttng_ring_buffer_client_overwrite_per_thread_exit(void);
 extern void lttng_ring_buffer_metadata_client_exit(void);
 
 volatile enum ust_loglevel ust_loglevel;
@@ -1001,6 +1005,16 @@ int ustctl_get_nr_stream_per_channel(void)
 	return num_possible_cpus();
 }
 
+int ustctl_get_nr_stream_per_thread_channel(void)
+{
+	/*
+	 * Default stream pool size. Each thread tracing into the
+	 * channel owns one stream until it exits, so twice the number
+	 * of possible CPUs accommodates oversubscribed applications.
+	 */
+	return 2 * num_possible_cpus();
+}
+
 struct ustctl_consumer_channel *
 	ustctl_create_channel(struct ustctl_consumer_channel_attr *attr,
 		const int *stream_fds, int nr_stream_fds)
@@ -1008,6 +1022,7 @@ struct ustctl_consumer_channel *
 	struct ustctl_consumer_channel *chan;
 	const char *transport_name;
 	struct lttng_transport *transport;
+	unsigned int shm_flags = 0;
 
 	switch (attr->type) {
 	case LTTNG_UST_CHAN_PER_CPU:
@@ -1029,6 +1044,17 @@ struct ustctl_consumer_channel *
 			return NULL;
 		}
 		break;
+	case LTTNG_UST_CHAN_PER_THREAD:
+		if (attr->output == LTTNG_UST_MMAP) {
+			if (attr->overwrite) {
+				transport_name = "relay-overwrite-per-thread-mmap";
+			} else {
+				transport_name = "relay-discard-per-thread-mmap";
+			}
+		} else {
+			return NULL;
+		}
+		break;
 	case LTTNG_UST_CHAN_METADATA:
 		if (attr->output == LTTNG_UST_MMAP)
 			transport_name = "relay-metadata-mmap";
@@ -1040,6 +1066,39 @@ struct ustctl_consumer_channel *
 		return NULL;
 	}
 
+	if (attr->shm_flags & ~(LTTNG_UST_CHAN_SHM_MEMFD
+			| LTTNG_UST_CHAN_SHM_HUGEPAGE
+			| LTTNG_UST_CHAN_SHM_POPULATE
+			| LTTNG_UST_CHAN_SHM_LAZY))
+		return NULL;
+	if ((attr->shm_flags & LTTNG_UST_CHAN_SHM_LAZY)
+			&& (attr->shm_flags & LTTNG_UST_CHAN_SHM_POPULATE))
+		return NULL;
+	if (attr->shm_flags & (LTTNG_UST_CHAN_SHM_MEMFD
+			| LTTNG_UST_CHAN_SHM_HUGEPAGE))
+		shm_flags |= RING_BUFFER_SHM_MEMFD;
+	if (attr->shm_flags & LTTNG_UST_CHAN_SHM_HUGEPAGE)
+		shm_flags |= RING_BUFFER_SHM_HUGEPAGE;
+	if (attr->shm_flags & LTTNG_UST_CHAN_SHM_POPULATE)
+		shm_flags |= RING_BUFFER_SHM_POPULATE;
+	if (attr->shm_flags & LTTNG_UST_CHAN_SHM_LAZY)
+		shm_flags |= RING_BUFFER_SHM_LAZY;
+	switch (attr->wakeup) {
+	case LTTNG_UST_CHAN_WAKEUP_PIPE:
+		break;
+	case LTTNG_UST_CHAN_WAKEUP_EVENTFD:
+		/*
+		 * The metadata stream is torn down on hang-up of its wait
+		 * fd, which an eventfd never reports.
+		 */
+		if (attr->type == LTTNG_UST_CHAN_METADATA)
+			return NULL;
+		shm_flags |= RING_BUFFER_SHM_EVENTFD;
+		break;
+	default:
+		return NULL;
+	}
+
 	transport = lttng_transport_find(transport_name);
 	if (!transport) {
 		DBG("LTTng transport %s not found\n",
@@ -1056,7 +1115,7 @@ struct ustctl_consumer_channel *
 			attr->switch_timer_interval,
 			attr->read_timer_interval,
 			attr->uuid, attr->chan_id,
-			stream_fds, nr_stream_fds);
+			stream_fds, nr_stream_fds, shm_flags);
 	if (!chan->chan) {
 		goto chan_error;
 	}
@@ -1230,6 +1289,24 @@ int ustctl_stream_close_wakeup_fd(struct ustctl_consumer_stream *stream)
 			chan, stream->handle, stream->cpu);
 }
 
+int ustctl_channel_drain_wait_fd(struct ustctl_consumer_channel *consumer_chan)
+{
+	struct channel *chan;
+
+	chan = consumer_chan->chan->chan;
+	return ring_buffer_channel_drain_wait_fd(&chan->backend.config,
+			chan, chan->handle);
+}
+
+int ustctl_stream_drain_wait_fd(struct ustctl_consumer_stream *stream)
+{
+	struct channel *chan;
+
+	chan = stream->chan->chan->chan;
+	return ring_buffer_stream_drain_wait_fd(&chan->backend.config,
+			chan, stream->handle, stream->cpu);
+}
+
 struct ustctl_consumer_stream *
 	ustctl_create_stream(struct ustctl_consumer_channel *channel,
 			int cpu)
@@ -1743,6 +1820,26 @@ int ustctl_get_instance_id(struct ustctl_consumer_stream *stream,
 	return client_cb->instance_id(buf, handle, id);
 }
 
+int ustctl_stream_is_active(struct ustctl_consumer_stream *stream)
+{
+	if (!stream)
+		return -EINVAL;
+	return CMM_LOAD_SHARED(stream->buf->active);
+}
+
+int ustctl_channel_get_numa_placement(struct ustctl_consumer_channel *chan,
+		uint64_t *local_pages, uint64_t *sampled_pages)
+{
+	struct channel *rb_chan;
+
+	if (!chan || !local_pages || !sampled_pages)
+		return -EINVAL;
+	rb_chan = chan->chan->chan;
+	*local_pages = rb_chan->numa_local_pages;
+	*sampled_pages = rb_chan->numa_sampled_pages;
+	return 0;
+}
+
 #ifdef LTTNG_UST_HAVE_PERF_EVENT
 
 int ustctl_has_perf_counters(void)
@@ -2211,12 +2308,15 @@ void ustctl_init(void)
 	lttng_ring_buffer_client_overwrite_rt_init();
 	lttng_ring_buffer_client_discard_init();
 	lttng_ring_buffer_client_discard_rt_init();
-	lib_ringbuffer_signal_init();
+	lttng_ring_buffer_client_overwrite_per_thread_init();
+	lttng_ring_buffer_client_discard_per_thread_init();
 }
 
 static __attribute__((destructor))
 void ustctl_exit(void)
 {
+	lttng_ring_buffer_client_discard_per_thread_exit();
+	lttng_ring_buffer_client_overwrite_per_thread_exit();
 	lttng_ring_buffer_client_discard_rt_exit();
 	lttng_ring_buffer_client_discard_exit();
 	lttng_ring_buffer_client_overwrite_rt_exit();
@@ -147,6 +147,18 @@ enum filter_op {
 	FILTER_OP_GET_CONTEXT_REF_S64,
 	FILTER_OP_GET_CONTEXT_REF_DOUBLE,
 
+	/* sampling and rate limiting, push s64 (1: record) */
+	FILTER_OP_SAMPLE,
+	FILTER_OP_RATE_LIMIT,
+
+	/*
+	 * Precompiled string literal matchers. Internal to the tracer:
+	 * produced by the specializer from LOAD_STRING + EQ/NE_STRING,
+	 * never accepted from the session daemon.
+	 */
+	FILTER_OP_EQ_STRING_MATCH,
+	FILTER_OP_NE_STRING_MATCH,
+
 	NR_FILTER_OPS,
 };
 
@@ -180,4 +192,24 @@ struct return_op {
 	filter_opcode_t op;
 } __attribute__((packed));
 
+/* Evaluates to 1 for one event out of "period", picked at random. */
+struct sample_op {
+	filter_opcode_t op;
+	uint32_t period;
+	/* Initially 0. After link, index of the per-event state. */
+	uint16_t state;
+} __attribute__((packed));
+
+/*
+ * Token bucket: evaluates to 1 for at most "rate" events per second,
+ * allowing bursts of up to "burst" events.
+ */
+struct rate_limit_op {
+	filter_opcode_t op;
+	uint32_t rate;
+	uint32_t burst;
+	/* Initially 0. After link, index of the per-event state. */
+	uint16_t state;
+} __attribute__((packed));
+
 #endif /* _FILTER_BYTECODE_H */
@@ -81,6 +81,9 @@ void lttng_session_lazy_sync_enablers(struct lttng_session *session);
 static
 void lttng_session_sync_enablers(struct lttng_session *session);
 static
+void lttng_session_sync_changes(struct lttng_session *session,
+		struct cds_list_head *new_probes);
+static
 void lttng_enabler_destroy(struct lttng_enabler *enabler);
 
 /*
@@ -135,7 +138,6 @@ void synchronize_trace(void)
 struct lttng_session *lttng_session_create(void)
 {
 	struct lttng_session *session;
-	int i;
 
 	session = zmalloc(sizeof(struct lttng_session));
 	if (!session)
@@ -148,12 +150,21 @@ struct lttng_session *lttng_session_create(void)
 	CDS_INIT_LIST_HEAD(&session->events_head);
 	CDS_INIT_LIST_HEAD(&session->enums_head);
 	CDS_INIT_LIST_HEAD(&session->enablers_head);
-	for (i = 0; i < LTTNG_UST_EVENT_HT_SIZE; i++)
-		CDS_INIT_HLIST_HEAD(&session->events_ht.table[i]);
-	for (i = 0; i < LTTNG_UST_ENUM_HT_SIZE; i++)
-		CDS_INIT_HLIST_HEAD(&session->enums_ht.table[i]);
+	CDS_INIT_LIST_HEAD(&session->filter_runtime_head);
+	CDS_INIT_LIST_HEAD(&session->sync_enablers_head);
+	if (lttng_ust_ht_init(&session->events_ht))
+		goto error_events_ht;
+	if (lttng_ust_ht_init(&session->enums_ht))
+		goto error_enums_ht;
 	cds_list_add(&session->node, &sessions);
 	return session;
+
+error_enums_ht:
+	lttng_ust_ht_fini(&session->events_ht);
+error_events_ht:
+	lttng_destroy_context(session->ctx);
+	free(session);
+	return NULL;
 }
 
 /*
@@ -176,11 +187,28 @@ void _lttng_channel_unmap(struct lttng_channel *lttng_chan)
 	channel_destroy(chan, handle, 0);
 }
 
+/*
+ * Get the batch probe of an event, and the name of the tracepoint it
+ * connects to. Returns NULL if the event has no batch probe.
+ */
+static
+void (*event_batch_callback(const struct lttng_event_desc *desc,
+		char *name))(void)
+{
+	if (!desc->u.ext.batch_callback || !*desc->u.ext.batch_callback)
+		return NULL;
+	snprintf(name, LTTNG_UST_SYM_NAME_LEN, "%s%s", desc->name,
+		LTTNG_UST_TRACEPOINT_BATCH_SUFFIX);
+	return *desc->u.ext.batch_callback;
+}
+
 static
 void register_event(struct lttng_event *event)
 {
 	int ret;
 	const struct lttng_event_desc *desc;
+	char batch_name[LTTNG_UST_SYM_NAME_LEN];
+	void (*batch_callback)(void);
 
 	assert(event->registered == 0);
 	desc = event->desc;
@@ -188,8 +216,15 @@ void register_event(struct lttng_event *event)
 			desc->probe_callback,
 			event, desc->signature);
 	WARN_ON_ONCE(ret);
-	if (!ret)
-		event->registered = 1;
+	if (ret)
+		return;
+	batch_callback = event_batch_callback(desc, batch_name);
+	if (batch_callback) {
+		ret = __tracepoint_probe_register_queue_release(batch_name,
+				batch_callback, event, desc->signature);
+		WARN_ON_ONCE(ret);
+	}
+	event->registered = 1;
 }
 
 static
@@ -197,9 +232,17 @@ void unregister_event(struct lttng_event *event)
 {
 	int ret;
 	const struct lttng_event_desc *desc;
+	char batch_name[LTTNG_UST_SYM_NAME_LEN];
+	void (*batch_callback)(void);
 
 	assert(event->registered == 1);
 	desc = event->desc;
+	batch_callback = event_batch_callback(desc, batch_name);
+	if (batch_callback) {
+		ret = __tracepoint_probe_unregister_queue_release(batch_name,
+				batch_callback, event);
+		WARN_ON_ONCE(ret);
+	}
 	ret = __tracepoint_probe_unregister_queue_release(desc->name,
 			desc->probe_callback,
 			event);
@@ -243,10 +286,21 @@ void lttng_session_destroy(struct lttng_session *session)
 	cds_list_for_each_entry_safe(chan, tmpchan, &session->chan_head, node)
 		_lttng_channel_unmap(chan);
 	cds_list_del(&session->node);
+	lttng_ust_ht_fini(&session->enums_ht);
+	lttng_ust_ht_fini(&session->events_ht);
 	lttng_destroy_context(session->ctx);
 	free(session);
 }
 
+static
+uint32_t lttng_enum_hash_node(struct cds_hlist_node *node)
+{
+	struct lttng_enum *_enum =
+		caa_container_of(node, struct lttng_enum, hlist);
+
+	return jhash(_enum->desc->name, strlen(_enum->desc->name), 0);
+}
+
 static
 int lttng_enum_create(const struct lttng_enum_desc *desc,
 		struct lttng_session *session)
@@ -261,7 +315,7 @@ int lttng_enum_create(const struct lttng_enum_desc *desc,
 	int notify_socket;
 
 	hash = jhash(enum_name, name_len, 0);
-	head = &session->enums_ht.table[hash & (LTTNG_UST_ENUM_HT_SIZE - 1)];
+	head = lttng_ust_ht_bucket(&session->enums_ht, hash);
 	cds_hlist_for_each_entry(_enum, node, head, hlist) {
 		assert(_enum->desc);
 		if (!strncmp(_enum->desc->name, desc->name,
@@ -296,7 +350,8 @@ int lttng_enum_create(const struct lttng_enum_desc *desc,
 		goto sessiond_register_error;
 	}
 	cds_list_add(&_enum->node, &session->enums_head);
-	cds_hlist_add_head(&_enum->hlist, head);
+	lttng_ust_ht_add(&session->enums_ht, &_enum->hlist, hash,
+		lttng_enum_hash_node);
 	return 0;
 
 sessiond_register_error:
@@ -523,6 +578,15 @@ end:
 	return ret;
 }
 
+static
+uint32_t lttng_event_hash_node(struct cds_hlist_node *node)
+{
+	struct lttng_event *event =
+		caa_container_of(node, struct lttng_event, hlist);
+
+	return jhash(event->desc->name, strlen(event->desc->name), 0);
+}
+
 /*
  * Supports event creation while tracing session is active.
  */
@@ -542,7 +606,7 @@ int lttng_event_create(const struct lttng_event_desc *desc,
 	const char *uri;
 
 	hash = jhash(event_name, name_len, 0);
-	head = &chan->session->events_ht.table[hash & (LTTNG_UST_EVENT_HT_SIZE - 1)];
+	head = lttng_ust_ht_bucket(&session->events_ht, hash);
 	cds_hlist_for_each_entry(event, node, head, hlist) {
 		assert(event->desc);
 		if (!strncmp(event->desc->name, desc->name,
@@ -581,6 +645,7 @@ int lttng_event_create(const struct lttng_event_desc *desc,
 	event->registered = 0;
 	CDS_INIT_LIST_HEAD(&event->bytecode_runtime_head);
 	CDS_INIT_LIST_HEAD(&event->enablers_ref_head);
+	CDS_INIT_LIST_HEAD(&event->sync_node);
 	event->desc = desc;
 
 	if (desc->loglevel)
@@ -612,7 +677,8 @@ int lttng_event_create(const struct lttng_event_desc *desc,
 	/* Populate lttng_event structure before tracepoint registration. */
 	cmm_smp_wmb();
 	cds_list_add(&event->node, &chan->session->events_head);
-	cds_hlist_add_head(&event->hlist, head);
+	lttng_ust_ht_add(&session->events_ht, &event->hlist, hash,
+		lttng_event_hash_node);
 	return 0;
 
 sessiond_register_error:
@@ -709,17 +775,6 @@ int lttng_desc_match_enabler(const struct lttng_event_desc *desc,
 	}
 }
 
-static
-int lttng_event_match_enabler(struct lttng_event *event,
-		struct lttng_enabler *enabler)
-{
-	if (lttng_desc_match_enabler(event->desc, enabler)
-			&& event->chan == enabler->chan)
-		return 1;
-	else
-		return 0;
-}
-
 static
 struct lttng_enabler_ref * lttng_event_enabler_ref(struct lttng_event *event,
 		struct lttng_enabler *enabler)
@@ -735,122 +790,162 @@ struct lttng_enabler_ref * lttng_event_enabler_ref(struct lttng_event *event,
 }
 
 /*
- * Create struct lttng_event if it is missing and present in the list of
- * tracepoint probes.
+ * Get the event descriptors of registered probes which can match the
+ * enabler name, from the probes name index: a single descriptor for an
+ * event enabler, or the range of descriptors beginning with the prefix
+ * of a wildcard enabler. Loglevel and exclusions still need to be
+ * checked with lttng_desc_match_enabler().
  */
 static
-void lttng_create_event_if_missing(struct lttng_enabler *enabler)
+const struct lttng_event_desc * const *
+	lttng_enabler_candidate_descs(struct lttng_enabler *enabler,
+		const struct lttng_event_desc **single, size_t *count)
 {
-	struct lttng_session *session = enabler->chan->session;
-	struct lttng_probe_desc *probe_desc;
-	const struct lttng_event_desc *desc;
-	struct lttng_event *event;
-	int i;
-	struct cds_list_head *probe_list;
+	const char *name = enabler->event_param.name;
 
-	probe_list = lttng_get_probe_list_head();
-	/*
-	 * For each probe event, if we find that a probe event matches
-	 * our enabler, create an associated lttng_event if not
-	 * already present.
-	 */
-	cds_list_for_each_entry(probe_desc, probe_list, head) {
-		for (i = 0; i < probe_desc->nr_events; i++) {
-			int found = 0, ret;
-			struct cds_hlist_head *head;
-			struct cds_hlist_node *node;
-			const char *event_name;
-			size_t name_len;
-			uint32_t hash;
-
-			desc = probe_desc->event_desc[i];
-			if (!lttng_desc_match_enabler(desc, enabler))
-				continue;
-			event_name = desc->name;
-			name_len = strlen(event_name);
-
-			/*
-			 * Check if already created.
-			 */
-			hash = jhash(event_name, name_len, 0);
-			head = &session->events_ht.table[hash & (LTTNG_UST_EVENT_HT_SIZE - 1)];
-			cds_hlist_for_each_entry(event, node, head, hlist) {
-				if (event->desc == desc
-						&& event->chan == enabler->chan)
-					found = 1;
-			}
-			if (found)
-				continue;
-
-			/*
-			 * We need to create an event for this
-			 * event probe.
-			 */
-			ret = lttng_event_create(probe_desc->event_desc[i],
-					enabler->chan);
-			if (ret) {
-				DBG("Unable to create event %s, error %d\n",
-					probe_desc->event_desc[i]->name, ret);
-			}
-		}
+	switch (enabler->type) {
+	case LTTNG_ENABLER_WILDCARD:
+		/* Match excluding final '*' */
+		return lttng_probes_find_event_desc_prefix(name,
+				strlen(name) - 1, count);
+	case LTTNG_ENABLER_EVENT:
+		*single = lttng_probes_find_event_desc(name);
+		*count = *single ? 1 : 0;
+		return single;
+	default:
+		*count = 0;
+		return NULL;
 	}
 }
 
 /*
- * Create events associated with an enabler (if not already present),
- * and add backward reference from the event to the enabler.
+ * Find the event of a session associated with an event descriptor and
+ * a channel.
  */
 static
-int lttng_enabler_ref_events(struct lttng_enabler *enabler)
+struct lttng_event *lttng_event_find(struct lttng_session *session,
+		const struct lttng_event_desc *desc,
+		struct lttng_channel *chan)
 {
-	struct lttng_session *session = enabler->chan->session;
+	struct cds_hlist_head *head;
+	struct cds_hlist_node *node;
 	struct lttng_event *event;
+	uint32_t hash;
 
-	/* First ensure that probe events are created for this enabler. */
-	lttng_create_event_if_missing(enabler);
+	hash = jhash(desc->name, strlen(desc->name), 0);
+	head = lttng_ust_ht_bucket(&session->events_ht, hash);
+	cds_hlist_for_each_entry(event, node, head, hlist) {
+		if (event->desc == desc && event->chan == chan)
+			return event;
+	}
+	return NULL;
+}
 
-	/* For each event matching enabler in session event list. */
-	cds_list_for_each_entry(event, &session->events_head, node) {
-		struct lttng_enabler_ref *enabler_ref;
+/*
+ * Create the event associated with an enabler and an event descriptor
+ * (if not already present) when the descriptor matches the enabler, and
+ * add backward reference from the event to the enabler. If sync_events
+ * is non-NULL, the existing event is appended to this list of events
+ * which state needs to be synchronized, whether or not it still
+ * matches the enabler.
+ */
+static
+int lttng_enabler_ref_event(struct lttng_enabler *enabler,
+		const struct lttng_event_desc *desc,
+		struct cds_list_head *sync_events)
+{
+	struct lttng_session *session = enabler->chan->session;
+	struct lttng_enabler_ref *enabler_ref;
+	struct lttng_event *event;
 
-		if (!lttng_event_match_enabler(event, enabler))
-			continue;
+	event = lttng_event_find(session, desc, enabler->chan);
+	if (event && sync_events && cds_list_empty(&event->sync_node))
+		cds_list_add_tail(&event->sync_node, sync_events);
+	if (!lttng_desc_match_enabler(desc, enabler))
+		return 0;
+	if (!event) {
+		int ret;
 
-		enabler_ref = lttng_event_enabler_ref(event, enabler);
-		if (!enabler_ref) {
-			/*
-			 * If no backward ref, create it.
-			 * Add backward ref from event to enabler.
-			 */
-			enabler_ref = zmalloc(sizeof(*enabler_ref));
-			if (!enabler_ref)
-				return -ENOMEM;
-			enabler_ref->ref = enabler;
-			cds_list_add(&enabler_ref->node,
-				&event->enablers_ref_head);
+		/*
+		 * We need to create an event for this
+		 * event probe.
+		 */
+		ret = lttng_event_create(desc, enabler->chan);
+		if (ret) {
+			DBG("Unable to create event %s, error %d\n",
+				desc->name, ret);
+			return 0;
 		}
+		event = lttng_event_find(session, desc, enabler->chan);
+		assert(event);
+		if (sync_events)
+			cds_list_add_tail(&event->sync_node, sync_events);
+	}
 
+	enabler_ref = lttng_event_enabler_ref(event, enabler);
+	if (!enabler_ref) {
 		/*
-		 * Link filter bytecodes if not linked yet.
+		 * If no backward ref, create it.
+		 * Add backward ref from event to enabler.
 		 */
-		lttng_enabler_event_link_bytecode(event, enabler);
+		enabler_ref = zmalloc(sizeof(*enabler_ref));
+		if (!enabler_ref)
+			return -ENOMEM;
+		enabler_ref->ref = enabler;
+		cds_list_add(&enabler_ref->node,
+			&event->enablers_ref_head);
+	}
+
+	/*
+	 * Link filter bytecodes if not linked yet.
+	 */
+	lttng_enabler_event_link_bytecode(event, enabler);
+
+	/* TODO: merge event context. */
+	return 0;
+}
 
-		/* TODO: merge event context. */
+/*
+ * Create events associated with an enabler (if not already present),
+ * and add backward reference from the event to the enabler. Only the
+ * event descriptors selected by the probes name index are visited.
+ * Events referring to an enabler always have a name selected by the
+ * index, so the events appended to sync_events (if non-NULL) include
+ * all the events affected by a change of the enabler.
+ */
+static
+int lttng_enabler_ref_events(struct lttng_enabler *enabler,
+		struct cds_list_head *sync_events)
+{
+	const struct lttng_event_desc * const *descs;
+	const struct lttng_event_desc *single;
+	size_t i, count;
+
+	descs = lttng_enabler_candidate_descs(enabler, &single, &count);
+	for (i = 0; i < count; i++) {
+		int ret;
+
+		ret = lttng_enabler_ref_event(enabler, descs[i], sync_events);
+		if (ret)
+			return ret;
 	}
 	return 0;
 }
 
 /*
- * Called at library load: connect the probe on all enablers matching
- * this event.
+ * Called at library load: connect the newly registered probes, linked
+ * through their lazy_init_head, on all enablers matching their events.
  * Called with session mutex held.
  */
-int lttng_fix_pending_events(void)
+int lttng_fix_pending_events(struct cds_list_head *new_probes)
 {
 	struct lttng_session *session;
 
 	cds_list_for_each_entry(session, &sessions, node) {
-		lttng_session_lazy_sync_enablers(session);
+		/* Inactive sessions are fully synchronized on start. */
+		if (!session->active)
+			continue;
+		lttng_session_sync_changes(session, new_probes);
 	}
 	return 0;
 }
@@ -919,6 +1014,22 @@ void lttng_ust_events_exit(void)
 /*
  * Enabler management.
  */
+
+/*
+ * Log a change of an enabler, so the next synchronization of its
+ * session only recomputes the events it affects.
+ */
+static
+void lttng_enabler_log_change(struct lttng_enabler *enabler)
+{
+	struct lttng_session *session = enabler->chan->session;
+
+	if (cds_list_empty(&enabler->sync_node))
+		cds_list_add_tail(&enabler->sync_node,
+			&session->sync_enablers_head);
+	lttng_session_lazy_sync_enablers(session);
+}
+
 struct lttng_enabler *lttng_enabler_create(enum lttng_enabler_type type,
 		struct lttng_ust_event *event_param,
 		struct lttng_channel *chan)
@@ -936,22 +1047,23 @@ struct lttng_enabler *lttng_enabler_create(enum lttng_enabler_type type,
 	enabler->chan = chan;
 	/* ctx left NULL */
 	enabler->enabled = 0;
+	CDS_INIT_LIST_HEAD(&enabler->sync_node);
 	cds_list_add(&enabler->node, &enabler->chan->session->enablers_head);
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_log_change(enabler);
 	return enabler;
 }
 
 int lttng_enabler_enable(struct lttng_enabler *enabler)
 {
 	enabler->enabled = 1;
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_log_change(enabler);
 	return 0;
 }
 
 int lttng_enabler_disable(struct lttng_enabler *enabler)
 {
 	enabler->enabled = 0;
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_log_change(enabler);
 	return 0;
 }
 
@@ -960,7 +1072,7 @@ int lttng_enabler_attach_bytecode(struct lttng_enabler *enabler,
 {
 	bytecode->enabler = enabler;
 	cds_list_add_tail(&bytecode->node, &enabler->filter_bytecode_head);
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_log_change(enabler);
 	return 0;
 }
 
@@ -969,7 +1081,7 @@ int lttng_enabler_attach_exclusion(struct lttng_enabler *enabler,
 {
 	excluder->enabler = enabler;
 	cds_list_add_tail(&excluder->node, &enabler->excluder_head);
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_log_change(enabler);
 	return 0;
 }
 
@@ -1028,7 +1140,7 @@ int lttng_enabler_attach_context(struct lttng_enabler *enabler,
 			session);
 	if (ret)
 		return ret;
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_log_change(enabler);
 #endif
 	return -ENOSYS;
 }
@@ -1054,77 +1166,137 @@ void lttng_enabler_destroy(struct lttng_enabler *enabler)
 	/* Destroy contexts */
 	lttng_destroy_context(enabler->ctx);
 
+	cds_list_del(&enabler->sync_node);
 	cds_list_del(&enabler->node);
 	free(enabler);
 }
 
+/*
+ * Synchronize the enabled state, tracepoint registration and filters of
+ * an event with its enablers.
+ */
+static
+void lttng_event_sync_state(struct lttng_session *session,
+		struct lttng_event *event)
+{
+	struct lttng_enabler_ref *enabler_ref;
+	struct lttng_bytecode_runtime *runtime;
+	int enabled = 0, has_enablers_without_bytecode = 0;
+
+	/* Enable events */
+	cds_list_for_each_entry(enabler_ref,
+			&event->enablers_ref_head, node) {
+		if (enabler_ref->ref->enabled) {
+			enabled = 1;
+			break;
+		}
+	}
+	/*
+	 * Enabled state is based on union of enablers, with
+	 * intesection of session and channel transient enable
+	 * states.
+	 */
+	enabled = enabled && session->tstate && event->chan->tstate;
+
+	CMM_STORE_SHARED(event->enabled, enabled);
+	/*
+	 * Sync tracepoint registration with event enabled
+	 * state.
+	 */
+	if (enabled) {
+		if (!event->registered)
+			register_event(event);
+	} else {
+		if (event->registered)
+			unregister_event(event);
+	}
+
+	/* Check if has enablers without bytecode enabled */
+	cds_list_for_each_entry(enabler_ref,
+			&event->enablers_ref_head, node) {
+		if (enabler_ref->ref->enabled
+				&& cds_list_empty(&enabler_ref->ref->filter_bytecode_head)) {
+			has_enablers_without_bytecode = 1;
+			break;
+		}
+	}
+	event->has_enablers_without_bytecode =
+		has_enablers_without_bytecode;
+
+	/* Enable filters */
+	cds_list_for_each_entry(runtime,
+			&event->bytecode_runtime_head, node) {
+		lttng_filter_sync_state(runtime);
+	}
+}
+
 /*
  * lttng_session_sync_enablers should be called just before starting a
- * session.
+ * session, and when the session or channel transient states change,
+ * since those affect all events. It also consumes the log of enabler
+ * changes.
  */
 static
 void lttng_session_sync_enablers(struct lttng_session *session)
 {
-	struct lttng_enabler *enabler;
+	struct lttng_enabler *enabler, *tmp_enabler;
 	struct lttng_event *event;
 
 	cds_list_for_each_entry(enabler, &session->enablers_head, node)
-		lttng_enabler_ref_events(enabler);
+		lttng_enabler_ref_events(enabler, NULL);
+	cds_list_for_each_entry_safe(enabler, tmp_enabler,
+			&session->sync_enablers_head, sync_node)
+		cds_list_del_init(&enabler->sync_node);
 	/*
 	 * For each event, if at least one of its enablers is enabled,
 	 * and its channel and session transient states are enabled, we
 	 * enable the event, else we disable it.
 	 */
-	cds_list_for_each_entry(event, &session->events_head, node) {
-		struct lttng_enabler_ref *enabler_ref;
-		struct lttng_bytecode_runtime *runtime;
-		int enabled = 0, has_enablers_without_bytecode = 0;
-
-		/* Enable events */
-		cds_list_for_each_entry(enabler_ref,
-				&event->enablers_ref_head, node) {
-			if (enabler_ref->ref->enabled) {
-				enabled = 1;
-				break;
-			}
-		}
-		/*
-		 * Enabled state is based on union of enablers, with
-		 * intesection of session and channel transient enable
-		 * states.
-		 */
-		enabled = enabled && session->tstate && event->chan->tstate;
-
-		CMM_STORE_SHARED(event->enabled, enabled);
-		/*
-		 * Sync tracepoint registration with event enabled
-		 * state.
-		 */
-		if (enabled) {
-			if (!event->registered)
-				register_event(event);
-		} else {
-			if (event->registered)
-				unregister_event(event);
-		}
+	cds_list_for_each_entry(event, &session->events_head, node)
+		lttng_event_sync_state(session, event);
+	__tracepoint_probe_prune_release_queue();
+}
 
-		/* Check if has enablers without bytecode enabled */
-		cds_list_for_each_entry(enabler_ref,
-				&event->enablers_ref_head, node) {
-			if (enabler_ref->ref->enabled
-					&& cds_list_empty(&enabler_ref->ref->filter_bytecode_head)) {
-				has_enablers_without_bytecode = 1;
-				break;
+/*
+ * Apply the changes logged since the last synchronization to an active
+ * session: the enablers which changed, and the newly registered probes
+ * (if new_probes is non-NULL). Only the state of the events affected
+ * by those changes is recomputed.
+ */
+static
+void lttng_session_sync_changes(struct lttng_session *session,
+		struct cds_list_head *new_probes)
+{
+	struct lttng_enabler *enabler, *tmp_enabler;
+	struct lttng_event *event, *tmp_event;
+	CDS_LIST_HEAD(sync_events);
+
+	cds_list_for_each_entry_safe(enabler, tmp_enabler,
+			&session->sync_enablers_head, sync_node) {
+		lttng_enabler_ref_events(enabler, &sync_events);
+		cds_list_del_init(&enabler->sync_node);
+	}
+	if (new_probes) {
+		struct lttng_probe_desc *probe_desc;
+
+		cds_list_for_each_entry(probe_desc, new_probes,
+				lazy_init_head) {
+			int i;
+
+			for (i = 0; i < probe_desc->nr_events; i++) {
+				cds_list_for_each_entry(enabler,
+						&session->enablers_head, node) {
+					(void) lttng_enabler_ref_event(enabler,
+						probe_desc->event_desc[i],
+						&sync_events);
+				}
 			}
 		}
-		event->has_enablers_without_bytecode =
-			has_enablers_without_bytecode;
-
-		/* Enable filters */
-		cds_list_for_each_entry(runtime,
-				&event->bytecode_runtime_head, node) {
-			lttng_filter_sync_state(runtime);
-		}
+	}
+	cds_list_for_each_entry_safe(event, tmp_event, &sync_events,
+			sync_node) {
+		lttng_event_sync_state(session, event);
+		cds_list_del_init(&event->sync_node);
 	}
 	__tracepoint_probe_prune_release_queue();
 }
@@ -1133,7 +1305,8 @@ void lttng_session_sync_enablers(struct lttng_session *session)
  * Apply enablers to session events, adding events to session if need
  * be. It is required after each modification applied to an active
  * session, and right before session "start".
- * "lazy" sync means we only sync if required.
+ * "lazy" sync means we only sync if required, and only recompute the
+ * events affected by the logged changes.
  */
 static
 void lttng_session_lazy_sync_enablers(struct lttng_session *session)
@@ -1141,7 +1314,7 @@ void lttng_session_lazy_sync_enablers(struct lttng_session *session)
 	/* We can skip if session is not active */
 	if (!session->active)
 		return;
-	lttng_session_sync_enablers(session);
+	lttng_session_sync_changes(session, NULL);
 }
 
 /*
@@ -20,8 +20,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _GNU_SOURCE
 #include <urcu-pointer.h>
 #include "lttng-filter.h"
+#include "clock.h"
+#include "../libringbuffer/getcpu.h"
 
 /*
  * -1: wildcard found.
@@ -112,6 +115,97 @@ int stack_strcmp(struct estack *stack, int top, const char *cmp_type)
 	return diff;
 }
 
+/*
+ * Match a string field against a literal pre-parsed by the specializer.
+ * Same result as stack_strcmp() == 0 with the literal as operand.
+ */
+static
+int string_match(const struct estack_entry *entry,
+		const struct filter_string_matcher *matcher)
+{
+	const char *str = entry->u.s.str;
+	size_t seq_len = entry->u.s.seq_len;
+
+	switch (matcher->type) {
+	case FILTER_STRING_MATCH_EXACT:
+		if (seq_len < matcher->len
+				|| strncmp(str, matcher->str, matcher->len))
+			return 0;
+		return seq_len == matcher->len || str[matcher->len] == '\0';
+	case FILTER_STRING_MATCH_PREFIX:
+		return seq_len >= matcher->len
+			&& !strncmp(str, matcher->str, matcher->len);
+	case FILTER_STRING_MATCH_NONE:
+	default:
+		return 0;
+	}
+}
+
+/*
+ * State of a sampling or rate limiting op for the current cpu. The
+ * update is not atomic: a thread preempted in the middle of it may
+ * lose the update of another thread on the same cpu, which only
+ * affects accuracy.
+ */
+static
+union filter_op_state *filter_op_state(struct event_filter_runtime *runtime,
+		uint16_t index)
+{
+	int cpu = lttng_ust_get_cpu();
+
+	if (caa_unlikely(cpu < 0 || cpu >= runtime->nr_cpus))
+		cpu = 0;
+	return (union filter_op_state *) (runtime->state
+			+ cpu * runtime->state_stride) + index;
+}
+
+static
+int filter_sample(union filter_op_state *state, uint32_t period)
+{
+	uint64_t x = state->sample.x;
+
+	if (caa_unlikely(!x))
+		x = (trace_clock_read64() << 1) | 1;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	state->sample.x = x;
+	/* Scale the high 32 bits to [0, period). */
+	return (((x >> 32) * period) >> 32) == 0;
+}
+
+/*
+ * Token bucket refilled with "rate" tokens per second, holding at most
+ * "burst" tokens. Tokens are scaled by the clock frequency so a refill
+ * is a single multiplication.
+ */
+static
+int filter_rate_limit(union filter_op_state *state, uint32_t rate,
+		uint32_t burst)
+{
+	uint64_t now = trace_clock_read64();
+	uint64_t freq = trace_clock_freq();
+	uint64_t capacity = (uint64_t) burst * freq;
+	uint64_t delta;
+
+	if (caa_unlikely(!state->rate_limit.last)) {
+		state->rate_limit.tokens = capacity;
+		state->rate_limit.max_delta = rate ? capacity / rate + 1 : 0;
+	} else {
+		delta = now - state->rate_limit.last;
+		if (delta > state->rate_limit.max_delta)
+			delta = state->rate_limit.max_delta;
+		state->rate_limit.tokens += delta * rate;
+		if (state->rate_limit.tokens > capacity)
+			state->rate_limit.tokens = capacity;
+	}
+	state->rate_limit.last = now;
+	if (state->rate_limit.tokens < freq)
+		return 0;
+	state->rate_limit.tokens -= freq;
+	return 1;
+}
+
 uint64_t lttng_filter_false(void *filter_data,
 		const char *filter_stack_data)
 {
@@ -179,8 +273,9 @@ LABEL_##name
 uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		const char *filter_stack_data)
 {
-	struct bytecode_runtime *bytecode = filter_data;
-	struct lttng_session *session = bytecode->p.session;
+	struct event_filter_runtime *runtime = filter_data;
+	struct bytecode_runtime *bytecode = runtime->shared;
+	struct lttng_session *session = runtime->p.session;
 	void *pc, *next_pc, *start_pc;
 	int ret = -EINVAL;
 	uint64_t retval = 0;
@@ -291,6 +386,14 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		[ FILTER_OP_GET_CONTEXT_REF_STRING ] = &&LABEL_FILTER_OP_GET_CONTEXT_REF_STRING,
 		[ FILTER_OP_GET_CONTEXT_REF_S64 ] = &&LABEL_FILTER_OP_GET_CONTEXT_REF_S64,
 		[ FILTER_OP_GET_CONTEXT_REF_DOUBLE ] = &&LABEL_FILTER_OP_GET_CONTEXT_REF_DOUBLE,
+
+		/* sampling and rate limiting */
+		[ FILTER_OP_SAMPLE ] = &&LABEL_FILTER_OP_SAMPLE,
+		[ FILTER_OP_RATE_LIMIT ] = &&LABEL_FILTER_OP_RATE_LIMIT,
+
+		/* string literal matchers */
+		[ FILTER_OP_EQ_STRING_MATCH ] = &&LABEL_FILTER_OP_EQ_STRING_MATCH,
+		[ FILTER_OP_NE_STRING_MATCH ] = &&LABEL_FILTER_OP_NE_STRING_MATCH,
 	};
 #endif /* #ifndef INTERPRETER_USE_SWITCH */
 
@@ -744,6 +847,38 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 			PO;
 		}
 
+		/*
+		 * String literal matchers replace the literal load: the
+		 * field is in AX, and the comparator which follows the
+		 * literal is skipped.
+		 */
+		OP(FILTER_OP_EQ_STRING_MATCH):
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct filter_string_matcher *matcher;
+			uint16_t index;
+
+			memcpy(&index, insn->data, sizeof(index));
+			matcher = bytecode->matchers[index];
+			estack_ax_v = string_match(estack_ax(stack, top), matcher);
+			estack_ax_t = REG_S64;
+			next_pc += matcher->insn_len + sizeof(struct binary_op);
+			PO;
+		}
+		OP(FILTER_OP_NE_STRING_MATCH):
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct filter_string_matcher *matcher;
+			uint16_t index;
+
+			memcpy(&index, insn->data, sizeof(index));
+			matcher = bytecode->matchers[index];
+			estack_ax_v = !string_match(estack_ax(stack, top), matcher);
+			estack_ax_t = REG_S64;
+			next_pc += matcher->insn_len + sizeof(struct binary_op);
+			PO;
+		}
+
 		OP(FILTER_OP_EQ_S64):
 		{
 			int res;
@@ -1423,6 +1558,37 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 			PO;
 		}
 
+		/* sampling and rate limiting */
+		OP(FILTER_OP_SAMPLE):
+		{
+			struct sample_op *insn = (struct sample_op *) pc;
+
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = filter_sample(
+				filter_op_state(runtime, insn->state),
+				insn->period);
+			estack_ax_t = REG_S64;
+			dbg_printf("sample 1/%u: %" PRIi64 "\n",
+				insn->period, estack_ax_v);
+			next_pc += sizeof(struct sample_op);
+			PO;
+		}
+
+		OP(FILTER_OP_RATE_LIMIT):
+		{
+			struct rate_limit_op *insn = (struct rate_limit_op *) pc;
+
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = filter_rate_limit(
+				filter_op_state(runtime, insn->state),
+				insn->rate, insn->burst);
+			estack_ax_t = REG_S64;
+			dbg_printf("rate limit %u/s burst %u: %" PRIi64 "\n",
+				insn->rate, insn->burst, estack_ax_v);
+			next_pc += sizeof(struct rate_limit_op);
+			PO;
+		}
+
 	END_OP
 end:
 	/* return 0 (discard) on error */
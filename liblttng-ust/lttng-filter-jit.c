@@ -0,0 +1,696 @@
+/*
+ * lttng-filter-jit.c
+ *
+ * LTTng UST filter bytecode to native code compiler.
+ *
+ * Copyright (C) 2016 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <urcu-pointer.h>
+#include <lttng/bug.h>
+#include "lttng-filter.h"
+#include "getenv.h"
+
+#if defined(__x86_64__)
+
+/*
+ * The compiler handles bytecode made only of the ops known to the
+ * specializer: S64 and double loads, field and context refs, casts,
+ * unary ops, comparators, logical operators and return. Bytecode using
+ * any other op (strings, dynamically typed ops) stays interpreted.
+ *
+ * The stack depth and entry types are known statically at each
+ * instruction of specialized bytecode, so each stack entry is given a
+ * fixed 64-bit slot in the native stack frame, and no type check is
+ * performed at run time. Doubles are kept in their slot as raw bits.
+ *
+ * Registers:
+ *   r12: filter_stack_data
+ *   r13: filter_data (struct event_filter_runtime)
+ *   rax, rcx, xmm0, xmm1: scratch
+ */
+
+#define JIT_SLOT_DISP(slot)	((uint8_t) ((slot) * sizeof(int64_t)))
+/* Stack slots, plus padding keeping rsp 16-byte aligned for calls. */
+#define JIT_FRAME_LEN		(FILTER_STACK_LEN * sizeof(int64_t) + 8)
+/* Upper bound of native code emitted for one bytecode instruction. */
+#define JIT_MAX_INSN_LEN	48
+#define JIT_PROLOGUE_LEN	16
+#define JIT_EPILOGUE_LEN	16
+
+enum jit_cc {
+	JIT_CC_E = 0x4,
+	JIT_CC_NE = 0x5,
+	JIT_CC_A = 0x7,
+	JIT_CC_P = 0xA,
+	JIT_CC_NP = 0xB,
+	JIT_CC_AE = 0x3,
+	JIT_CC_L = 0xC,
+	JIT_CC_GE = 0xD,
+	JIT_CC_LE = 0xE,
+	JIT_CC_G = 0xF,
+};
+
+struct jit_fixup {
+	uint32_t pos;		/* rel32 position in native code */
+	uint16_t target;	/* bytecode offset */
+};
+
+struct jit_state {
+	uint8_t *code;
+	size_t len;
+	size_t alloc_len;
+	struct jit_fixup *fixups;
+	size_t nr_fixups;
+	uint32_t *native_offset;	/* per bytecode offset */
+	int16_t *target_depth;		/* -1 if not a branch target */
+	enum entry_type *target_type;	/* stack top type at target */
+	uint32_t *return_fixups;
+	size_t nr_return_fixups;
+};
+
+static
+int64_t jit_get_context_s64(struct event_filter_runtime *runtime,
+		unsigned int idx)
+{
+	struct lttng_ctx *ctx;
+	struct lttng_ctx_field *ctx_field;
+	struct lttng_ctx_value v;
+
+	ctx = rcu_dereference(runtime->p.session->ctx);
+	ctx_field = &ctx->fields[idx];
+	ctx_field->get_value(ctx_field, &v);
+	return v.u.s64;
+}
+
+static
+int64_t jit_get_context_double(struct event_filter_runtime *runtime,
+		unsigned int idx)
+{
+	struct lttng_ctx *ctx;
+	struct lttng_ctx_field *ctx_field;
+	struct lttng_ctx_value v;
+	int64_t raw;
+
+	ctx = rcu_dereference(runtime->p.session->ctx);
+	ctx_field = &ctx->fields[idx];
+	ctx_field->get_value(ctx_field, &v);
+	memcpy(&raw, &v.u.d, sizeof(raw));
+	return raw;
+}
+
+static
+void emit(struct jit_state *s, const uint8_t *bytes, size_t len)
+{
+	assert(s->len + len <= s->alloc_len);
+	memcpy(&s->code[s->len], bytes, len);
+	s->len += len;
+}
+
+#define EMIT(s, ...)							\
+	do {								\
+		const uint8_t __bytes[] = { __VA_ARGS__ };		\
+		emit(s, __bytes, sizeof(__bytes));			\
+	} while (0)
+
+static
+void emit_u32(struct jit_state *s, uint32_t v)
+{
+	emit(s, (const uint8_t *) &v, sizeof(v));
+}
+
+static
+void emit_u64(struct jit_state *s, uint64_t v)
+{
+	emit(s, (const uint8_t *) &v, sizeof(v));
+}
+
+/* mov rax, imm64 */
+static
+void emit_mov_rax_imm(struct jit_state *s, uint64_t v)
+{
+	EMIT(s, 0x48, 0xB8);
+	emit_u64(s, v);
+}
+
+/* mov rax, [rsp + slot] */
+static
+void emit_load_rax(struct jit_state *s, int slot)
+{
+	EMIT(s, 0x48, 0x8B, 0x44, 0x24, JIT_SLOT_DISP(slot));
+}
+
+/* mov [rsp + slot], rax */
+static
+void emit_store_rax(struct jit_state *s, int slot)
+{
+	EMIT(s, 0x48, 0x89, 0x44, 0x24, JIT_SLOT_DISP(slot));
+}
+
+/* movsd xmm0/xmm1, [rsp + slot], or cvtsi2sd if the slot is an s64. */
+static
+void emit_load_xmm(struct jit_state *s, int xmm, int slot,
+		enum entry_type type)
+{
+	uint8_t modrm = xmm ? 0x4C : 0x44;
+
+	if (type == REG_S64)
+		EMIT(s, 0xF2, 0x48, 0x0F, 0x2A, modrm, 0x24, JIT_SLOT_DISP(slot));
+	else
+		EMIT(s, 0xF2, 0x0F, 0x10, modrm, 0x24, JIT_SLOT_DISP(slot));
+}
+
+/* movzx eax, al ; mov [rsp + slot], rax */
+static
+void emit_store_bool(struct jit_state *s, int slot)
+{
+	EMIT(s, 0x0F, 0xB6, 0xC0);
+	emit_store_rax(s, slot);
+}
+
+/* Jump with a rel32 displacement to a bytecode offset. */
+static
+void emit_branch(struct jit_state *s, int cond, uint16_t target)
+{
+	if (cond >= 0)
+		EMIT(s, 0x0F, 0x80 | cond);	/* jcc rel32 */
+	else
+		EMIT(s, 0xE9);			/* jmp rel32 */
+	s->fixups[s->nr_fixups].pos = s->len;
+	s->fixups[s->nr_fixups].target = target;
+	s->nr_fixups++;
+	emit_u32(s, 0);
+}
+
+static
+void emit_s64_compare(struct jit_state *s, int slot, enum filter_op op)
+{
+	int cc;
+
+	switch (op) {
+	case FILTER_OP_EQ_S64:	cc = JIT_CC_E; break;
+	case FILTER_OP_NE_S64:	cc = JIT_CC_NE; break;
+	case FILTER_OP_GT_S64:	cc = JIT_CC_G; break;
+	case FILTER_OP_LT_S64:	cc = JIT_CC_L; break;
+	case FILTER_OP_GE_S64:	cc = JIT_CC_GE; break;
+	case FILTER_OP_LE_S64:	cc = JIT_CC_LE; break;
+	default:
+		abort();
+	}
+	/* bx is at slot - 1, ax at slot. */
+	emit_load_rax(s, slot - 1);
+	EMIT(s, 0x48, 0x3B, 0x44, 0x24, JIT_SLOT_DISP(slot));	/* cmp rax, ax */
+	EMIT(s, 0x0F, 0x90 | cc, 0xC0);				/* setcc al */
+	emit_store_bool(s, slot - 1);
+}
+
+/*
+ * Double comparisons follow C semantics with NaN: only != is true
+ * when either operand is NaN. ucomisd sets ZF, PF and CF on unordered
+ * operands, so "greater" comparisons use the unsigned above
+ * conditions, with operands swapped for "less" comparisons.
+ */
+static
+void emit_double_compare(struct jit_state *s, int slot, enum filter_op op,
+		enum entry_type bx_type, enum entry_type ax_type)
+{
+	emit_load_xmm(s, 0, slot - 1, bx_type);
+	emit_load_xmm(s, 1, slot, ax_type);
+	switch (op) {
+	case FILTER_OP_EQ_DOUBLE:
+	case FILTER_OP_EQ_DOUBLE_S64:
+	case FILTER_OP_EQ_S64_DOUBLE:
+		EMIT(s, 0x66, 0x0F, 0x2E, 0xC1);	/* ucomisd xmm0, xmm1 */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_E, 0xC0);	/* sete al */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_NP, 0xC1);	/* setnp cl */
+		EMIT(s, 0x20, 0xC8);			/* and al, cl */
+		break;
+	case FILTER_OP_NE_DOUBLE:
+	case FILTER_OP_NE_DOUBLE_S64:
+	case FILTER_OP_NE_S64_DOUBLE:
+		EMIT(s, 0x66, 0x0F, 0x2E, 0xC1);	/* ucomisd xmm0, xmm1 */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_NE, 0xC0);	/* setne al */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_P, 0xC1);	/* setp cl */
+		EMIT(s, 0x08, 0xC8);			/* or al, cl */
+		break;
+	case FILTER_OP_GT_DOUBLE:
+	case FILTER_OP_GT_DOUBLE_S64:
+	case FILTER_OP_GT_S64_DOUBLE:
+		EMIT(s, 0x66, 0x0F, 0x2E, 0xC1);	/* ucomisd xmm0, xmm1 */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_A, 0xC0);	/* seta al */
+		break;
+	case FILTER_OP_GE_DOUBLE:
+	case FILTER_OP_GE_DOUBLE_S64:
+	case FILTER_OP_GE_S64_DOUBLE:
+		EMIT(s, 0x66, 0x0F, 0x2E, 0xC1);	/* ucomisd xmm0, xmm1 */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_AE, 0xC0);	/* setae al */
+		break;
+	case FILTER_OP_LT_DOUBLE:
+	case FILTER_OP_LT_DOUBLE_S64:
+	case FILTER_OP_LT_S64_DOUBLE:
+		EMIT(s, 0x66, 0x0F, 0x2E, 0xC8);	/* ucomisd xmm1, xmm0 */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_A, 0xC0);	/* seta al */
+		break;
+	case FILTER_OP_LE_DOUBLE:
+	case FILTER_OP_LE_DOUBLE_S64:
+	case FILTER_OP_LE_S64_DOUBLE:
+		EMIT(s, 0x66, 0x0F, 0x2E, 0xC8);	/* ucomisd xmm1, xmm0 */
+		EMIT(s, 0x0F, 0x90 | JIT_CC_AE, 0xC0);	/* setae al */
+		break;
+	default:
+		abort();
+	}
+	emit_store_bool(s, slot - 1);
+}
+
+/* Call a context getter, storing its result in a slot. */
+static
+void emit_get_context(struct jit_state *s, int slot, uint16_t idx,
+		int64_t (*getter)(struct event_filter_runtime *, unsigned int))
+{
+	EMIT(s, 0x4C, 0x89, 0xEF);		/* mov rdi, r13 */
+	EMIT(s, 0xBE);				/* mov esi, imm32 */
+	emit_u32(s, idx);
+	emit_mov_rax_imm(s, (uint64_t) (uintptr_t) getter);
+	EMIT(s, 0xFF, 0xD0);			/* call rax */
+	emit_store_rax(s, slot);
+}
+
+/*
+ * Record the stack state expected at a branch target. All paths
+ * reaching a given instruction must agree on it.
+ */
+static
+int jit_set_target(struct jit_state *s, uint16_t target, int depth,
+		enum entry_type type)
+{
+	if (s->target_depth[target] < 0) {
+		s->target_depth[target] = depth;
+		s->target_type[target] = type;
+		return 0;
+	}
+	if (s->target_depth[target] != depth || s->target_type[target] != type)
+		return -EINVAL;
+	return 0;
+}
+
+static
+int jit_emit_bytecode(struct jit_state *s, struct bytecode_runtime *bytecode)
+{
+	char *start_pc = &bytecode->data[0], *pc, *next_pc;
+	enum entry_type type[FILTER_STACK_LEN];
+	int depth = 0, reachable = 1;
+	size_t i;
+
+	/* push r12 ; push r13 ; sub rsp, frame ; mov r12, rsi ; mov r13, rdi */
+	EMIT(s, 0x41, 0x54, 0x41, 0x55);
+	EMIT(s, 0x48, 0x83, 0xEC, JIT_FRAME_LEN);
+	EMIT(s, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xFD);
+
+	for (pc = next_pc = start_pc; pc - start_pc < bytecode->len;
+			pc = next_pc) {
+		uint16_t offset = pc - start_pc;
+		/* Slot of the top of stack (ax), bx is below. */
+		int ax = depth - 1;
+
+		if (s->target_depth[offset] >= 0) {
+			if (!reachable) {
+				depth = s->target_depth[offset];
+				ax = depth - 1;
+				if (ax >= 0)
+					type[ax] = s->target_type[offset];
+				reachable = 1;
+			} else if (s->target_depth[offset] != depth
+					|| (ax >= 0 && type[ax] != s->target_type[offset])) {
+				return -EINVAL;
+			}
+		}
+		if (!reachable)
+			return -EINVAL;
+		s->native_offset[offset] = s->len;
+
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_RETURN:
+			if (ax < 0 || type[ax] != REG_S64)
+				return -EINVAL;
+			emit_load_rax(s, ax);
+			EMIT(s, 0x48, 0x85, 0xC0);		/* test rax, rax */
+			EMIT(s, 0x0F, 0x90 | JIT_CC_NE, 0xC0);	/* setne al */
+			EMIT(s, 0x0F, 0xB6, 0xC0);		/* movzx eax, al */
+			EMIT(s, 0xE9);				/* jmp epilogue */
+			s->return_fixups[s->nr_return_fixups++] = s->len;
+			emit_u32(s, 0);
+			reachable = 0;
+			next_pc += sizeof(struct return_op);
+			break;
+
+		case FILTER_OP_EQ_S64:
+		case FILTER_OP_NE_S64:
+		case FILTER_OP_GT_S64:
+		case FILTER_OP_LT_S64:
+		case FILTER_OP_GE_S64:
+		case FILTER_OP_LE_S64:
+			if (ax < 1 || type[ax] != REG_S64 || type[ax - 1] != REG_S64)
+				return -EINVAL;
+			emit_s64_compare(s, ax, *(filter_opcode_t *) pc);
+			type[ax - 1] = REG_S64;
+			depth--;
+			next_pc += sizeof(struct binary_op);
+			break;
+
+		case FILTER_OP_EQ_DOUBLE:
+		case FILTER_OP_NE_DOUBLE:
+		case FILTER_OP_GT_DOUBLE:
+		case FILTER_OP_LT_DOUBLE:
+		case FILTER_OP_GE_DOUBLE:
+		case FILTER_OP_LE_DOUBLE:
+		case FILTER_OP_EQ_DOUBLE_S64:
+		case FILTER_OP_NE_DOUBLE_S64:
+		case FILTER_OP_GT_DOUBLE_S64:
+		case FILTER_OP_LT_DOUBLE_S64:
+		case FILTER_OP_GE_DOUBLE_S64:
+		case FILTER_OP_LE_DOUBLE_S64:
+		case FILTER_OP_EQ_S64_DOUBLE:
+		case FILTER_OP_NE_S64_DOUBLE:
+		case FILTER_OP_GT_S64_DOUBLE:
+		case FILTER_OP_LT_S64_DOUBLE:
+		case FILTER_OP_GE_S64_DOUBLE:
+		case FILTER_OP_LE_S64_DOUBLE:
+			if (ax < 1 || type[ax] == REG_STRING
+					|| type[ax - 1] == REG_STRING)
+				return -EINVAL;
+			emit_double_compare(s, ax, *(filter_opcode_t *) pc,
+				type[ax - 1], type[ax]);
+			type[ax - 1] = REG_S64;
+			depth--;
+			next_pc += sizeof(struct binary_op);
+			break;
+
+		case FILTER_OP_UNARY_PLUS_S64:
+		case FILTER_OP_UNARY_PLUS_DOUBLE:
+			if (ax < 0)
+				return -EINVAL;
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_MINUS_S64:
+			if (ax < 0 || type[ax] != REG_S64)
+				return -EINVAL;
+			/* neg qword [rsp + ax] */
+			EMIT(s, 0x48, 0xF7, 0x5C, 0x24, JIT_SLOT_DISP(ax));
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_MINUS_DOUBLE:
+			if (ax < 0 || type[ax] != REG_DOUBLE)
+				return -EINVAL;
+			/* Flip the sign bit: xor [rsp + ax], rax */
+			emit_mov_rax_imm(s, 1ULL << 63);
+			EMIT(s, 0x48, 0x31, 0x44, 0x24, JIT_SLOT_DISP(ax));
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_NOT_S64:
+			if (ax < 0 || type[ax] != REG_S64)
+				return -EINVAL;
+			/* cmp qword [rsp + ax], 0 ; sete al */
+			EMIT(s, 0x48, 0x83, 0x7C, 0x24, JIT_SLOT_DISP(ax), 0x00);
+			EMIT(s, 0x0F, 0x90 | JIT_CC_E, 0xC0);
+			emit_store_bool(s, ax);
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_NOT_DOUBLE:
+			if (ax < 0 || type[ax] != REG_DOUBLE)
+				return -EINVAL;
+			emit_load_xmm(s, 0, ax, REG_DOUBLE);
+			EMIT(s, 0x66, 0x0F, 0x57, 0xC9);	/* xorpd xmm1, xmm1 */
+			EMIT(s, 0x66, 0x0F, 0x2E, 0xC1);	/* ucomisd xmm0, xmm1 */
+			EMIT(s, 0x0F, 0x90 | JIT_CC_E, 0xC0);	/* sete al */
+			EMIT(s, 0x0F, 0x90 | JIT_CC_NP, 0xC1);	/* setnp cl */
+			EMIT(s, 0x20, 0xC8);			/* and al, cl */
+			emit_store_bool(s, ax);
+			type[ax] = REG_S64;
+			next_pc += sizeof(struct unary_op);
+			break;
+
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			if (ax < 0 || type[ax] != REG_S64)
+				return -EINVAL;
+			if (insn->skip_offset <= offset
+					|| insn->skip_offset >= bytecode->len)
+				return -EINVAL;
+			if (jit_set_target(s, insn->skip_offset, depth, REG_S64))
+				return -EINVAL;
+			emit_load_rax(s, ax);
+			EMIT(s, 0x48, 0x85, 0xC0);		/* test rax, rax */
+			if (*(filter_opcode_t *) pc == FILTER_OP_AND) {
+				/* If AX is 0, skip and evaluate to 0 */
+				emit_branch(s, JIT_CC_E, insn->skip_offset);
+			} else {
+				/* If AX is nonzero, skip and evaluate to 1 */
+				EMIT(s, 0x74, 14);		/* jz +14 */
+				/* mov qword [rsp + ax], 1 */
+				EMIT(s, 0x48, 0xC7, 0x44, 0x24, JIT_SLOT_DISP(ax));
+				emit_u32(s, 1);
+				emit_branch(s, -1, insn->skip_offset);
+			}
+			/* Pop 1 when jump not taken */
+			depth--;
+			next_pc += sizeof(struct logical_op);
+			break;
+		}
+
+		case FILTER_OP_LOAD_FIELD_REF_S64:
+		case FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct field_ref *ref = (struct field_ref *) insn->data;
+
+			if (depth >= FILTER_STACK_LEN)
+				return -EINVAL;
+			/* mov rax, [r12 + offset] */
+			EMIT(s, 0x49, 0x8B, 0x84, 0x24);
+			emit_u32(s, ref->offset);
+			emit_store_rax(s, depth);
+			type[depth] = *(filter_opcode_t *) pc == FILTER_OP_LOAD_FIELD_REF_S64 ?
+				REG_S64 : REG_DOUBLE;
+			depth++;
+			next_pc += sizeof(struct load_op) + sizeof(struct field_ref);
+			break;
+		}
+
+		case FILTER_OP_GET_CONTEXT_REF_S64:
+		case FILTER_OP_GET_CONTEXT_REF_DOUBLE:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct field_ref *ref = (struct field_ref *) insn->data;
+
+			if (depth >= FILTER_STACK_LEN)
+				return -EINVAL;
+			if (*(filter_opcode_t *) pc == FILTER_OP_GET_CONTEXT_REF_S64) {
+				emit_get_context(s, depth, ref->offset,
+					jit_get_context_s64);
+				type[depth] = REG_S64;
+			} else {
+				emit_get_context(s, depth, ref->offset,
+					jit_get_context_double);
+				type[depth] = REG_DOUBLE;
+			}
+			depth++;
+			next_pc += sizeof(struct load_op) + sizeof(struct field_ref);
+			break;
+		}
+
+		case FILTER_OP_LOAD_S64:
+		case FILTER_OP_LOAD_DOUBLE:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			uint64_t v;
+
+			if (depth >= FILTER_STACK_LEN)
+				return -EINVAL;
+			/* Both literals are 64-bit wide. */
+			memcpy(&v, insn->data, sizeof(v));
+			emit_mov_rax_imm(s, v);
+			emit_store_rax(s, depth);
+			if (*(filter_opcode_t *) pc == FILTER_OP_LOAD_S64) {
+				type[depth] = REG_S64;
+				next_pc += sizeof(struct load_op)
+						+ sizeof(struct literal_numeric);
+			} else {
+				type[depth] = REG_DOUBLE;
+				next_pc += sizeof(struct load_op)
+						+ sizeof(struct literal_double);
+			}
+			depth++;
+			break;
+		}
+
+		case FILTER_OP_CAST_DOUBLE_TO_S64:
+			if (ax < 0 || type[ax] != REG_DOUBLE)
+				return -EINVAL;
+			/* cvttsd2si rax, [rsp + ax] */
+			EMIT(s, 0xF2, 0x48, 0x0F, 0x2C, 0x44, 0x24, JIT_SLOT_DISP(ax));
+			emit_store_rax(s, ax);
+			type[ax] = REG_S64;
+			next_pc += sizeof(struct cast_op);
+			break;
+		case FILTER_OP_CAST_NOP:
+			next_pc += sizeof(struct cast_op);
+			break;
+
+		default:
+			dbg_printf("JIT: unsupported bytecode op %s\n",
+				print_op((unsigned int) *(filter_opcode_t *) pc));
+			return -ENOTSUP;
+		}
+		/* Leave room for the epilogue. */
+		if (s->len + JIT_MAX_INSN_LEN + JIT_EPILOGUE_LEN > s->alloc_len)
+			return -EINVAL;
+	}
+	/* Falling off the end of the bytecode discards the event. */
+	if (reachable)
+		EMIT(s, 0x31, 0xC0);		/* xor eax, eax */
+
+	/* Epilogue: add rsp, frame ; pop r13 ; pop r12 ; ret */
+	for (i = 0; i < s->nr_return_fixups; i++) {
+		uint32_t rel = s->len - (s->return_fixups[i] + sizeof(uint32_t));
+
+		memcpy(&s->code[s->return_fixups[i]], &rel, sizeof(rel));
+	}
+	EMIT(s, 0x48, 0x83, 0xC4, JIT_FRAME_LEN);
+	EMIT(s, 0x41, 0x5D, 0x41, 0x5C, 0xC3);
+
+	for (i = 0; i < s->nr_fixups; i++) {
+		uint16_t target = s->fixups[i].target;
+		uint32_t rel;
+
+		/* Targets are validated forward, thus already emitted. */
+		if (target >= bytecode->len || s->target_depth[target] < 0)
+			return -EINVAL;
+		rel = s->native_offset[target]
+			- (s->fixups[i].pos + sizeof(uint32_t));
+		memcpy(&s->code[s->fixups[i].pos], &rel, sizeof(rel));
+	}
+	return 0;
+}
+
+/* Opt-in: filters are interpreted unless LTTNG_UST_FILTER_JIT=1. */
+static
+int lttng_filter_jit_enabled(void)
+{
+	const char *str;
+
+	str = lttng_secure_getenv("LTTNG_UST_FILTER_JIT");
+	return str && !strcmp(str, "1");
+}
+
+int lttng_filter_jit_compile(struct bytecode_runtime *bytecode)
+{
+	struct jit_state s;
+	size_t nr_insn_max, page_size;
+	int ret;
+
+	/*
+	 * Stack slots are addressed with a signed 8-bit displacement
+	 * from rsp, and the frame is reserved with a signed 8-bit
+	 * immediate.
+	 */
+	LTTNG_BUILD_BUG_ON((FILTER_STACK_LEN - 1) * sizeof(int64_t) > INT8_MAX);
+	LTTNG_BUILD_BUG_ON(JIT_FRAME_LEN > INT8_MAX);
+
+	if (!lttng_filter_jit_enabled())
+		return -ENOTSUP;
+	if (!bytecode->len)
+		return -EINVAL;
+
+	memset(&s, 0, sizeof(s));
+	/* Every instruction is at least one byte long. */
+	nr_insn_max = bytecode->len;
+	page_size = sysconf(_SC_PAGE_SIZE);
+	s.alloc_len = JIT_PROLOGUE_LEN + nr_insn_max * JIT_MAX_INSN_LEN
+			+ JIT_EPILOGUE_LEN;
+	s.alloc_len = (s.alloc_len + page_size - 1) & ~(page_size - 1);
+	s.fixups = zmalloc(nr_insn_max * sizeof(*s.fixups));
+	s.return_fixups = zmalloc(nr_insn_max * sizeof(*s.return_fixups));
+	s.native_offset = zmalloc(bytecode->len * sizeof(*s.native_offset));
+	s.target_depth = malloc(bytecode->len * sizeof(*s.target_depth));
+	s.target_type = zmalloc(bytecode->len * sizeof(*s.target_type));
+	if (!s.fixups || !s.return_fixups || !s.native_offset
+			|| !s.target_depth || !s.target_type) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	memset(s.target_depth, 0xFF, bytecode->len * sizeof(*s.target_depth));
+
+	s.code = mmap(NULL, s.alloc_len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (s.code == MAP_FAILED) {
+		s.code = NULL;
+		ret = -ENOMEM;
+		goto end;
+	}
+	ret = jit_emit_bytecode(&s, bytecode);
+	if (ret)
+		goto error_unmap;
+	/* Never both writable and executable. */
+	if (mprotect(s.code, s.alloc_len, PROT_READ | PROT_EXEC)) {
+		ret = -errno;
+		goto error_unmap;
+	}
+	bytecode->jit_code = s.code;
+	bytecode->jit_len = s.alloc_len;
+	dbg_printf("JIT: compiled %u bytes of bytecode into %zu bytes\n",
+		(unsigned int) bytecode->len, s.len);
+	goto end;
+
+error_unmap:
+	(void) munmap(s.code, s.alloc_len);
+end:
+	free(s.fixups);
+	free(s.return_fixups);
+	free(s.native_offset);
+	free(s.target_depth);
+	free(s.target_type);
+	return ret;
+}
+
+void lttng_filter_jit_free(struct bytecode_runtime *bytecode)
+{
+	if (!bytecode->jit_code)
+		return;
+	(void) munmap(bytecode->jit_code, bytecode->jit_len);
+	bytecode->jit_code = NULL;
+	bytecode->jit_len = 0;
+}
+
+#else /* defined(__x86_64__) */
+
+int lttng_filter_jit_compile(struct bytecode_runtime *bytecode)
+{
+	return -ENOTSUP;
+}
+
+void lttng_filter_jit_free(struct bytecode_runtime *bytecode)
+{
+}
+
+#endif /* defined(__x86_64__) */
@@ -0,0 +1,617 @@
+/*
+ * lttng-filter-optimize.c
+ *
+ * LTTng UST filter bytecode optimizer.
+ *
+ * Copyright (C) 2016 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include "lttng-filter.h"
+
+/*
+ * The optimizer rebuilds the expression tree of validated bytecode,
+ * folds constant subexpressions and logical operators whose outcome is
+ * known, and emits the resulting bytecode in place. Folding always
+ * replaces a subtree containing at least one literal by a single
+ * literal or by one of its children, so the optimized bytecode is never
+ * longer than the original.
+ *
+ * Only folds preserving the interpreter semantics are done: operations
+ * which would fail at run time (e.g. on mismatching types) are left
+ * untouched, and so are subexpressions depending on a dynamically typed
+ * context, which may fail at run time and discard the event.
+ */
+
+struct opt_node {
+	char *insn;			/* Original instruction, NULL if folded */
+	size_t insn_len;
+	filter_opcode_t op;
+	struct opt_node *child[2];	/* Operands, bx then ax */
+	enum entry_type type;		/* Static type, REG_UNKNOWN if dynamic */
+	int dynamic;			/* Depends on a dynamically typed value */
+	int literal;			/* Numeric literal */
+	union {
+		int64_t v;
+		double d;
+	} u;
+};
+
+struct opt_state {
+	struct opt_node *nodes;
+	size_t nr_nodes;
+	struct opt_node **stack;
+	size_t top;
+};
+
+static
+size_t opt_insn_len(char *pc)
+{
+	switch (*(filter_opcode_t *) pc) {
+	case FILTER_OP_RETURN:
+		return sizeof(struct return_op);
+
+	case FILTER_OP_EQ:
+	case FILTER_OP_NE:
+	case FILTER_OP_GT:
+	case FILTER_OP_LT:
+	case FILTER_OP_GE:
+	case FILTER_OP_LE:
+	case FILTER_OP_EQ_STRING:
+	case FILTER_OP_NE_STRING:
+	case FILTER_OP_GT_STRING:
+	case FILTER_OP_LT_STRING:
+	case FILTER_OP_GE_STRING:
+	case FILTER_OP_LE_STRING:
+	case FILTER_OP_EQ_S64:
+	case FILTER_OP_NE_S64:
+	case FILTER_OP_GT_S64:
+	case FILTER_OP_LT_S64:
+	case FILTER_OP_GE_S64:
+	case FILTER_OP_LE_S64:
+	case FILTER_OP_EQ_DOUBLE:
+	case FILTER_OP_NE_DOUBLE:
+	case FILTER_OP_GT_DOUBLE:
+	case FILTER_OP_LT_DOUBLE:
+	case FILTER_OP_GE_DOUBLE:
+	case FILTER_OP_LE_DOUBLE:
+	case FILTER_OP_EQ_DOUBLE_S64:
+	case FILTER_OP_NE_DOUBLE_S64:
+	case FILTER_OP_GT_DOUBLE_S64:
+	case FILTER_OP_LT_DOUBLE_S64:
+	case FILTER_OP_GE_DOUBLE_S64:
+	case FILTER_OP_LE_DOUBLE_S64:
+	case FILTER_OP_EQ_S64_DOUBLE:
+	case FILTER_OP_NE_S64_DOUBLE:
+	case FILTER_OP_GT_S64_DOUBLE:
+	case FILTER_OP_LT_S64_DOUBLE:
+	case FILTER_OP_GE_S64_DOUBLE:
+	case FILTER_OP_LE_S64_DOUBLE:
+		return sizeof(struct binary_op);
+
+	case FILTER_OP_UNARY_PLUS:
+	case FILTER_OP_UNARY_MINUS:
+	case FILTER_OP_UNARY_NOT:
+	case FILTER_OP_UNARY_PLUS_S64:
+	case FILTER_OP_UNARY_MINUS_S64:
+	case FILTER_OP_UNARY_NOT_S64:
+	case FILTER_OP_UNARY_PLUS_DOUBLE:
+	case FILTER_OP_UNARY_MINUS_DOUBLE:
+	case FILTER_OP_UNARY_NOT_DOUBLE:
+		return sizeof(struct unary_op);
+
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+		return sizeof(struct logical_op);
+
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+	case FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+	case FILTER_OP_GET_CONTEXT_REF:
+	case FILTER_OP_GET_CONTEXT_REF_STRING:
+	case FILTER_OP_GET_CONTEXT_REF_S64:
+	case FILTER_OP_GET_CONTEXT_REF_DOUBLE:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+
+	case FILTER_OP_LOAD_STRING:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+
+		return sizeof(struct load_op) + strlen(insn->data) + 1;
+	}
+	case FILTER_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+	case FILTER_OP_LOAD_DOUBLE:
+		return sizeof(struct load_op) + sizeof(struct literal_double);
+
+	case FILTER_OP_CAST_TO_S64:
+	case FILTER_OP_CAST_DOUBLE_TO_S64:
+	case FILTER_OP_CAST_NOP:
+		return sizeof(struct cast_op);
+
+	case FILTER_OP_SAMPLE:
+		return sizeof(struct sample_op);
+	case FILTER_OP_RATE_LIMIT:
+		return sizeof(struct rate_limit_op);
+
+	default:
+		return 0;
+	}
+}
+
+/* Number of operands popped by an expression op. */
+static
+int opt_insn_arity(filter_opcode_t op)
+{
+	if (op >= FILTER_OP_MUL && op <= FILTER_OP_LE_S64_DOUBLE)
+		return 2;
+	if (op >= FILTER_OP_UNARY_PLUS && op <= FILTER_OP_UNARY_NOT_DOUBLE)
+		return 1;
+	if (op >= FILTER_OP_CAST_TO_S64 && op <= FILTER_OP_CAST_NOP)
+		return 1;
+	return 0;
+}
+
+static
+enum entry_type opt_leaf_type(filter_opcode_t op)
+{
+	switch (op) {
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+	case FILTER_OP_GET_CONTEXT_REF_S64:
+	case FILTER_OP_LOAD_S64:
+	case FILTER_OP_SAMPLE:
+	case FILTER_OP_RATE_LIMIT:
+		return REG_S64;
+	case FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+	case FILTER_OP_GET_CONTEXT_REF_DOUBLE:
+	case FILTER_OP_LOAD_DOUBLE:
+		return REG_DOUBLE;
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+	case FILTER_OP_GET_CONTEXT_REF_STRING:
+	case FILTER_OP_LOAD_STRING:
+		return REG_STRING;
+	default:
+		return REG_UNKNOWN;
+	}
+}
+
+static
+struct opt_node *opt_pop(struct opt_state *s)
+{
+	if (!s->top)
+		return NULL;
+	return s->stack[--s->top];
+}
+
+static
+struct opt_node *opt_new_node(struct opt_state *s, char *pc, size_t len)
+{
+	struct opt_node *node = &s->nodes[s->nr_nodes++];
+
+	node->insn = pc;
+	node->insn_len = len;
+	node->op = *(filter_opcode_t *) pc;
+	node->type = REG_UNKNOWN;
+	return node;
+}
+
+/*
+ * Build the expression tree of the bytecode. Returns the root, or NULL
+ * if the bytecode is not a single expression followed by a return.
+ */
+static
+struct opt_node *opt_build_tree(struct opt_state *s,
+		struct bytecode_runtime *bytecode)
+{
+	char *start_pc = &bytecode->data[0], *pc;
+	struct opt_node **logical;	/* Pending logical operators */
+	uint16_t *target;
+	size_t nr_logical = 0, len;
+	struct opt_node *root = NULL;
+
+	logical = calloc(bytecode->len, sizeof(*logical));
+	target = calloc(bytecode->len, sizeof(*target));
+	if (!logical || !target)
+		goto end;
+
+	for (pc = start_pc; pc - start_pc < bytecode->len; pc += len) {
+		uint16_t offset = pc - start_pc;
+		struct opt_node *node;
+
+		/* Reduce logical operators whose right operand ends here. */
+		while (nr_logical && target[nr_logical - 1] == offset) {
+			node = logical[--nr_logical];
+			node->child[1] = opt_pop(s);
+			if (!node->child[1])
+				goto error;
+			s->stack[s->top++] = node;
+		}
+		if (root)
+			goto error;	/* Code after return */
+		len = opt_insn_len(pc);
+		if (!len || pc + len > start_pc + bytecode->len)
+			goto error;
+		node = opt_new_node(s, pc, len);
+
+		switch (node->op) {
+		case FILTER_OP_RETURN:
+			root = opt_pop(s);
+			if (!root || s->top)
+				goto error;
+			continue;
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			node->child[0] = opt_pop(s);
+			if (!node->child[0] || insn->skip_offset <= offset)
+				goto error;
+			/* Nested operators end before the enclosing one. */
+			if (nr_logical && insn->skip_offset
+					> target[nr_logical - 1])
+				goto error;
+			target[nr_logical] = insn->skip_offset;
+			logical[nr_logical++] = node;
+			continue;
+		}
+		default:
+			break;
+		}
+
+		switch (opt_insn_arity(node->op)) {
+		case 2:
+			node->child[1] = opt_pop(s);
+			node->child[0] = opt_pop(s);
+			if (!node->child[0] || !node->child[1])
+				goto error;
+			break;
+		case 1:
+			node->child[1] = opt_pop(s);
+			if (!node->child[1])
+				goto error;
+			break;
+		default:
+			node->type = opt_leaf_type(node->op);
+			node->dynamic = node->type == REG_UNKNOWN;
+			if (node->op == FILTER_OP_LOAD_S64) {
+				node->literal = 1;
+				memcpy(&node->u.v, ((struct load_op *) pc)->data,
+					sizeof(node->u.v));
+			} else if (node->op == FILTER_OP_LOAD_DOUBLE) {
+				node->literal = 1;
+				memcpy(&node->u.d, ((struct load_op *) pc)->data,
+					sizeof(node->u.d));
+			}
+			break;
+		}
+		if (s->top >= bytecode->len)
+			goto error;
+		s->stack[s->top++] = node;
+	}
+	if (nr_logical)
+		goto error;
+	goto end;
+
+error:
+	root = NULL;
+end:
+	free(logical);
+	free(target);
+	return root;
+}
+
+static
+void opt_set_s64(struct opt_node *node, int64_t v)
+{
+	node->insn = NULL;
+	node->insn_len = sizeof(struct load_op) + sizeof(struct literal_numeric);
+	node->op = FILTER_OP_LOAD_S64;
+	node->child[0] = node->child[1] = NULL;
+	node->type = REG_S64;
+	node->dynamic = 0;
+	node->literal = 1;
+	node->u.v = v;
+}
+
+static
+void opt_set_double(struct opt_node *node, double d)
+{
+	node->insn = NULL;
+	node->insn_len = sizeof(struct load_op) + sizeof(struct literal_double);
+	node->op = FILTER_OP_LOAD_DOUBLE;
+	node->child[0] = node->child[1] = NULL;
+	node->type = REG_DOUBLE;
+	node->dynamic = 0;
+	node->literal = 1;
+	node->u.d = d;
+}
+
+static
+double opt_literal_double(struct opt_node *node)
+{
+	return node->type == REG_S64 ? (double) node->u.v : node->u.d;
+}
+
+/*
+ * Evaluate a comparison between numeric literals, as the interpreter
+ * does: integer comparison between S64, double comparison otherwise.
+ */
+static
+int opt_compare(filter_opcode_t op, struct opt_node *bx, struct opt_node *ax,
+		int64_t *res)
+{
+	int s64 = bx->type == REG_S64 && ax->type == REG_S64;
+	double bd = opt_literal_double(bx), ad = opt_literal_double(ax);
+
+	switch (op) {
+	case FILTER_OP_EQ:
+		*res = s64 ? bx->u.v == ax->u.v : bd == ad;
+		return 0;
+	case FILTER_OP_NE:
+		*res = s64 ? bx->u.v != ax->u.v : bd != ad;
+		return 0;
+	case FILTER_OP_GT:
+		*res = s64 ? bx->u.v > ax->u.v : bd > ad;
+		return 0;
+	case FILTER_OP_LT:
+		*res = s64 ? bx->u.v < ax->u.v : bd < ad;
+		return 0;
+	case FILTER_OP_GE:
+		*res = s64 ? bx->u.v >= ax->u.v : bd >= ad;
+		return 0;
+	case FILTER_OP_LE:
+		*res = s64 ? bx->u.v <= ax->u.v : bd <= ad;
+		return 0;
+	default:
+		/* Specialized comparators are not expected before specialization. */
+		return -EINVAL;
+	}
+}
+
+static
+void opt_fold(struct opt_node *node)
+{
+	struct opt_node *bx = node->child[0], *ax = node->child[1];
+
+	if (bx)
+		opt_fold(bx);
+	if (ax)
+		opt_fold(ax);
+	node->dynamic |= (bx && bx->dynamic) || (ax && ax->dynamic);
+
+	switch (node->op) {
+	case FILTER_OP_EQ:
+	case FILTER_OP_NE:
+	case FILTER_OP_GT:
+	case FILTER_OP_LT:
+	case FILTER_OP_GE:
+	case FILTER_OP_LE:
+	{
+		int64_t res;
+
+		node->type = REG_S64;
+		if (bx->literal && ax->literal
+				&& !opt_compare(node->op, bx, ax, &res))
+			opt_set_s64(node, res);
+		break;
+	}
+
+	case FILTER_OP_UNARY_PLUS:
+		node->type = ax->type;
+		if (ax->literal)
+			*node = *ax;
+		break;
+	case FILTER_OP_UNARY_MINUS:
+		node->type = ax->type;
+		if (ax->literal) {
+			if (ax->type == REG_S64)
+				opt_set_s64(node, -ax->u.v);
+			else
+				opt_set_double(node, -ax->u.d);
+		}
+		break;
+	case FILTER_OP_UNARY_NOT:
+		if (ax->type == REG_S64 || ax->type == REG_DOUBLE)
+			node->type = REG_S64;
+		if (ax->literal) {
+			if (ax->type == REG_S64)
+				opt_set_s64(node, !ax->u.v);
+			else
+				opt_set_s64(node, !ax->u.d);
+		}
+		break;
+	case FILTER_OP_CAST_TO_S64:
+		if (ax->type == REG_S64 || ax->type == REG_DOUBLE)
+			node->type = REG_S64;
+		if (ax->literal) {
+			if (ax->type == REG_S64)
+				*node = *ax;
+			else
+				opt_set_s64(node, (int64_t) ax->u.d);
+		}
+		break;
+	case FILTER_OP_CAST_NOP:
+		node->type = ax->type;
+		if (ax->literal)
+			*node = *ax;
+		break;
+
+	case FILTER_OP_EQ_STRING:
+	case FILTER_OP_NE_STRING:
+	case FILTER_OP_GT_STRING:
+	case FILTER_OP_LT_STRING:
+	case FILTER_OP_GE_STRING:
+	case FILTER_OP_LE_STRING:
+	case FILTER_OP_EQ_S64:
+	case FILTER_OP_NE_S64:
+	case FILTER_OP_GT_S64:
+	case FILTER_OP_LT_S64:
+	case FILTER_OP_GE_S64:
+	case FILTER_OP_LE_S64:
+	case FILTER_OP_EQ_DOUBLE:
+	case FILTER_OP_NE_DOUBLE:
+	case FILTER_OP_GT_DOUBLE:
+	case FILTER_OP_LT_DOUBLE:
+	case FILTER_OP_GE_DOUBLE:
+	case FILTER_OP_LE_DOUBLE:
+	case FILTER_OP_EQ_DOUBLE_S64:
+	case FILTER_OP_NE_DOUBLE_S64:
+	case FILTER_OP_GT_DOUBLE_S64:
+	case FILTER_OP_LT_DOUBLE_S64:
+	case FILTER_OP_GE_DOUBLE_S64:
+	case FILTER_OP_LE_DOUBLE_S64:
+	case FILTER_OP_EQ_S64_DOUBLE:
+	case FILTER_OP_NE_S64_DOUBLE:
+	case FILTER_OP_GT_S64_DOUBLE:
+	case FILTER_OP_LT_S64_DOUBLE:
+	case FILTER_OP_GE_S64_DOUBLE:
+	case FILTER_OP_LE_S64_DOUBLE:
+		node->type = REG_S64;
+		break;
+
+	/*
+	 * The left operand of a logical operator must be an S64 at run
+	 * time, else the filter fails. The value of the operator is the
+	 * left operand (0 for AND, set to 1 for OR) if the right operand
+	 * is skipped, else the right operand. A left operand is only
+	 * dropped if it cannot fail, i.e. it does not depend on a
+	 * dynamically typed value.
+	 */
+	case FILTER_OP_AND:
+		if (ax->type == REG_S64)
+			node->type = REG_S64;
+		if (bx->literal && bx->type == REG_S64) {
+			if (!bx->u.v)
+				opt_set_s64(node, 0);
+			else if (ax->type == REG_S64)
+				*node = *ax;
+		} else if (bx->type == REG_S64 && !bx->dynamic
+				&& ax->literal && ax->type == REG_S64
+				&& !ax->u.v) {
+			/* Either skipped on 0, or evaluates to 0. */
+			opt_set_s64(node, 0);
+		}
+		break;
+	case FILTER_OP_OR:
+		if (ax->type == REG_S64)
+			node->type = REG_S64;
+		if (bx->literal && bx->type == REG_S64) {
+			if (bx->u.v)
+				opt_set_s64(node, 1);
+			else if (ax->type == REG_S64)
+				*node = *ax;
+		} else if (bx->type == REG_S64 && !bx->dynamic
+				&& ax->literal && ax->type == REG_S64
+				&& ax->u.v == 1) {
+			/* Either skipped and set to 1, or evaluates to 1. */
+			opt_set_s64(node, 1);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static
+void opt_emit(struct opt_node *node, char *code, uint16_t *pos)
+{
+	switch (node->op) {
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+	{
+		struct logical_op *insn;
+
+		opt_emit(node->child[0], code, pos);
+		insn = (struct logical_op *) &code[*pos];
+		memcpy(insn, node->insn, node->insn_len);
+		*pos += node->insn_len;
+		opt_emit(node->child[1], code, pos);
+		insn->skip_offset = *pos;
+		return;
+	}
+	default:
+		break;
+	}
+	if (node->child[0])
+		opt_emit(node->child[0], code, pos);
+	if (node->child[1])
+		opt_emit(node->child[1], code, pos);
+	if (node->insn) {
+		memcpy(&code[*pos], node->insn, node->insn_len);
+	} else {
+		struct load_op *insn = (struct load_op *) &code[*pos];
+
+		insn->op = node->op;
+		memcpy(insn->data, &node->u, sizeof(node->u));
+	}
+	*pos += node->insn_len;
+}
+
+/*
+ * Fold constant subexpressions of validated bytecode. Sets
+ * const_false if the filter always evaluates to false. The bytecode is
+ * left untouched if its structure is not understood.
+ */
+int lttng_filter_optimize_bytecode(struct bytecode_runtime *bytecode)
+{
+	struct opt_state s;
+	struct opt_node *root;
+	struct return_op *ret_insn;
+	char *code = NULL;
+	uint16_t pos = 0;
+	int ret = 0;
+
+	memset(&s, 0, sizeof(s));
+	s.nodes = calloc(bytecode->len, sizeof(*s.nodes));
+	s.stack = calloc(bytecode->len, sizeof(*s.stack));
+	code = malloc(bytecode->len);
+	if (!s.nodes || !s.stack || !code) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	root = opt_build_tree(&s, bytecode);
+	if (!root) {
+		dbg_printf("Filter optimizer: bytecode left unoptimized\n");
+		goto end;
+	}
+	opt_fold(root);
+	if (root->literal && root->type == REG_S64 && !root->u.v)
+		bytecode->const_false = 1;
+
+	opt_emit(root, code, &pos);
+	ret_insn = (struct return_op *) &code[pos];
+	ret_insn->op = FILTER_OP_RETURN;
+	pos += sizeof(struct return_op);
+	assert(pos <= bytecode->len);
+	if (pos == bytecode->len && !memcmp(bytecode->data, code, pos))
+		goto end;
+	dbg_printf("Filter optimizer: bytecode length %u -> %u\n",
+		(unsigned int) bytecode->len, (unsigned int) pos);
+	memcpy(bytecode->data, code, pos);
+	bytecode->len = pos;
+	/* Check the rewritten bytecode as thoroughly as the original. */
+	ret = lttng_filter_validate_bytecode(bytecode);
+end:
+	free(s.nodes);
+	free(s.stack);
+	free(code);
+	return ret;
+}
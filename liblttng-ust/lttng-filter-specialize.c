@@ -22,9 +22,95 @@
 
 #include "lttng-filter.h"
 
+/*
+ * Replace a string literal compared for equality against a string field
+ * by a matcher pre-parsed once at link time. The rewritten LOAD_STRING
+ * instruction keeps its length and holds the matcher index; it compares
+ * the field and skips over the comparator which follows it. Only the
+ * "field == literal" form emitted by the filter compiler is handled.
+ */
+static
+int specialize_string_match(struct bytecode_runtime *bytecode,
+		void *field_pc, void *literal_pc, struct binary_op *insn)
+{
+	struct load_op *literal = literal_pc;
+	struct filter_string_matcher *matcher, **matchers;
+	size_t literal_len;
+	const char *p;
+	uint16_t index;
+
+	if (!field_pc || !literal_pc)
+		return 0;
+	if (literal->op != FILTER_OP_LOAD_STRING)
+		return 0;
+	switch (*(filter_opcode_t *) field_pc) {
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+	case FILTER_OP_GET_CONTEXT_REF_STRING:
+		break;
+	default:
+		return 0;
+	}
+	literal_len = strlen(literal->data);
+	/* The matcher index is stored over the literal. */
+	if (literal_len + 1 < sizeof(index)
+			|| bytecode->nr_matchers >= UINT16_MAX)
+		return 0;
+
+	matcher = zmalloc(sizeof(*matcher) + literal_len + 1);
+	if (!matcher)
+		return -ENOMEM;
+	matcher->type = FILTER_STRING_MATCH_EXACT;
+	for (p = literal->data; *p != '\0'; p++) {
+		if (*p == '*') {
+			/* Anything following the wildcard is ignored. */
+			matcher->type = FILTER_STRING_MATCH_PREFIX;
+			break;
+		}
+		if (*p == '\\') {
+			p++;
+			if (*p != '\\' && *p != '*') {
+				matcher->type = FILTER_STRING_MATCH_NONE;
+				break;
+			}
+		}
+		matcher->str[matcher->len++] = *p;
+	}
+	matcher->insn_len = sizeof(struct load_op) + literal_len + 1;
+
+	matchers = realloc(bytecode->matchers,
+			(bytecode->nr_matchers + 1) * sizeof(*matchers));
+	if (!matchers) {
+		free(matcher);
+		return -ENOMEM;
+	}
+	bytecode->matchers = matchers;
+	index = bytecode->nr_matchers;
+	matchers[bytecode->nr_matchers++] = matcher;
+
+	memcpy(literal->data, &index, sizeof(index));
+	if (insn->op == FILTER_OP_EQ_STRING)
+		literal->op = FILTER_OP_EQ_STRING_MATCH;
+	else
+		literal->op = FILTER_OP_NE_STRING_MATCH;
+	return 0;
+}
+
+void lttng_filter_free_string_matchers(struct bytecode_runtime *bytecode)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytecode->nr_matchers; i++)
+		free(bytecode->matchers[i]);
+	free(bytecode->matchers);
+	bytecode->matchers = NULL;
+	bytecode->nr_matchers = 0;
+}
+
 int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode)
 {
 	void *pc, *next_pc, *start_pc;
+	void *prev_pc = NULL, *prev2_pc = NULL;	/* Two previous insns. */
 	int ret = -EINVAL;
 	struct vstack _stack;
 	struct vstack *stack = &_stack;
@@ -76,6 +162,11 @@ int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode)
 				if (vstack_bx(stack)->type == REG_UNKNOWN)
 					break;
 				insn->op = FILTER_OP_EQ_STRING;
+				if (specialize_string_match(bytecode,
+						prev2_pc, prev_pc, insn)) {
+					ret = -ENOMEM;
+					goto end;
+				}
 				break;
 			case REG_S64:
 				if (vstack_bx(stack)->type == REG_UNKNOWN)
@@ -120,6 +211,11 @@ int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode)
 				if (vstack_bx(stack)->type == REG_UNKNOWN)
 					break;
 				insn->op = FILTER_OP_NE_STRING;
+				if (specialize_string_match(bytecode,
+						prev2_pc, prev_pc, insn)) {
+					ret = -ENOMEM;
+					goto end;
+				}
 				break;
 			case REG_S64:
 				if (vstack_bx(stack)->type == REG_UNKNOWN)
@@ -322,6 +418,21 @@ int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode)
 
 		case FILTER_OP_EQ_STRING:
 		case FILTER_OP_NE_STRING:
+		{
+			if (specialize_string_match(bytecode, prev2_pc,
+					prev_pc, (struct binary_op *) pc)) {
+				ret = -ENOMEM;
+				goto end;
+			}
+			/* Pop 2, push 1 */
+			if (vstack_pop(stack)) {
+				ret = -EINVAL;
+				goto end;
+			}
+			vstack_ax(stack)->type = REG_S64;
+			next_pc += sizeof(struct binary_op);
+			break;
+		}
 		case FILTER_OP_GT_STRING:
 		case FILTER_OP_LT_STRING:
 		case FILTER_OP_GE_STRING:
@@ -593,7 +704,37 @@ int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode)
 			break;
 		}
 
+		/* sampling and rate limiting: allocate per-event state */
+		case FILTER_OP_SAMPLE:
+		case FILTER_OP_RATE_LIMIT:
+		{
+			if (bytecode->nr_states >= UINT16_MAX) {
+				ERR("Too many sampling and rate limiting ops\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			if (vstack_push(stack)) {
+				ret = -EINVAL;
+				goto end;
+			}
+			vstack_ax(stack)->type = REG_S64;
+			if (*(filter_opcode_t *) pc == FILTER_OP_SAMPLE) {
+				struct sample_op *insn = (struct sample_op *) pc;
+
+				insn->state = bytecode->nr_states++;
+				next_pc += sizeof(struct sample_op);
+			} else {
+				struct rate_limit_op *insn = (struct rate_limit_op *) pc;
+
+				insn->state = bytecode->nr_states++;
+				next_pc += sizeof(struct rate_limit_op);
+			}
+			break;
+		}
+
 		}
+		prev2_pc = prev_pc;
+		prev_pc = pc;
 	}
 end:
 	return ret;
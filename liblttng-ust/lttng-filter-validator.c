@@ -24,6 +24,7 @@
 #include <urcu-bp.h>
 #include <time.h>
 #include "lttng-filter.h"
+#include "clock.h"
 
 #include <urcu/rculfhash.h>
 #include "lttng-hash-helper.h"
@@ -377,6 +378,23 @@ int bytecode_validate_overflow(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	case FILTER_OP_SAMPLE:
+	{
+		if (unlikely(pc + sizeof(struct sample_op)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+		}
+		break;
+	}
+	case FILTER_OP_RATE_LIMIT:
+	{
+		if (unlikely(pc + sizeof(struct rate_limit_op)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+		}
+		break;
+	}
+
 	}
 
 	return ret;
@@ -815,6 +833,39 @@ int validate_instruction_context(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	case FILTER_OP_SAMPLE:
+	{
+		struct sample_op *insn = (struct sample_op *) pc;
+
+		if (!insn->period) {
+			ERR("Sampling period cannot be 0\n");
+			ret = -EINVAL;
+			goto end;
+		}
+		break;
+	}
+	case FILTER_OP_RATE_LIMIT:
+	{
+		struct rate_limit_op *insn = (struct rate_limit_op *) pc;
+
+		if (!insn->burst) {
+			ERR("Rate limit burst cannot be 0\n");
+			ret = -EINVAL;
+			goto end;
+		}
+		/*
+		 * The token bucket holds up to burst * freq tokens, plus
+		 * one refill of as much: keep both within 64 bits.
+		 */
+		if (insn->burst > (UINT64_MAX >> 2) / trace_clock_freq()) {
+			ERR("Rate limit burst %u too large for the trace clock frequency\n",
+				insn->burst);
+			ret = -EINVAL;
+			goto end;
+		}
+		break;
+	}
+
 	}
 end:
 	return ret;
@@ -1156,6 +1207,21 @@ int exec_insn(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	case FILTER_OP_SAMPLE:
+	case FILTER_OP_RATE_LIMIT:
+	{
+		if (vstack_push(stack)) {
+			ret = -EINVAL;
+			goto end;
+		}
+		vstack_ax(stack)->type = REG_S64;
+		if (*(filter_opcode_t *) pc == FILTER_OP_SAMPLE)
+			next_pc += sizeof(struct sample_op);
+		else
+			next_pc += sizeof(struct rate_limit_op);
+		break;
+	}
+
 	}
 end:
 	*_next_pc = next_pc;
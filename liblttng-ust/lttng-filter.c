@@ -20,8 +20,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _GNU_SOURCE
 #include <urcu/rculist.h>
 #include "lttng-filter.h"
+#include "../libringbuffer/smp.h"
 
 static const char *opnames[] = {
 	[ FILTER_OP_UNKNOWN ] = "UNKNOWN",
@@ -124,6 +126,14 @@ static const char *opnames[] = {
 	[ FILTER_OP_GET_CONTEXT_REF_STRING ] = "GET_CONTEXT_REF_STRING",
 	[ FILTER_OP_GET_CONTEXT_REF_S64 ] = "GET_CONTEXT_REF_S64",
 	[ FILTER_OP_GET_CONTEXT_REF_DOUBLE ] = "GET_CONTEXT_REF_DOUBLE",
+
+	/* sampling and rate limiting */
+	[ FILTER_OP_SAMPLE ] = "SAMPLE",
+	[ FILTER_OP_RATE_LIMIT ] = "RATE_LIMIT",
+
+	/* string literal matchers */
+	[ FILTER_OP_EQ_STRING_MATCH ] = "EQ_STRING_MATCH",
+	[ FILTER_OP_NE_STRING_MATCH ] = "NE_STRING_MATCH",
 };
 
 const char *print_op(enum filter_op op)
@@ -135,20 +145,18 @@ const char *print_op(enum filter_op op)
 }
 
 static
-int apply_field_reloc(struct lttng_event *event,
-		struct bytecode_runtime *runtime,
-		uint32_t runtime_len,
-		uint32_t reloc_offset,
-		const char *field_name)
+int resolve_field_reloc(struct lttng_event *event,
+		const char *field_name,
+		struct filter_reloc *reloc,
+		uint64_t *field_mask)
 {
 	const struct lttng_event_desc *desc;
 	const struct lttng_event_field *fields, *field = NULL;
 	unsigned int nr_fields, i;
-	struct field_ref *field_ref;
-	struct load_op *op;
 	uint32_t field_offset = 0;
 
-	dbg_printf("Apply field reloc: %u %s\n", reloc_offset, field_name);
+	dbg_printf("Resolve field reloc: %u %s\n", reloc->reloc_offset,
+		field_name);
 
 	/* Lookup event by name */
 	desc = event->desc;
@@ -192,45 +200,41 @@ int apply_field_reloc(struct lttng_event *event,
 		return -EINVAL;
 
 	/* set type */
-	op = (struct load_op *) &runtime->data[reloc_offset];
-	field_ref = (struct field_ref *) op->data;
 	switch (field->type.atype) {
 	case atype_integer:
 	case atype_enum:
-		op->op = FILTER_OP_LOAD_FIELD_REF_S64;
+		reloc->op = FILTER_OP_LOAD_FIELD_REF_S64;
 		break;
 	case atype_array:
 	case atype_sequence:
-		op->op = FILTER_OP_LOAD_FIELD_REF_SEQUENCE;
+		reloc->op = FILTER_OP_LOAD_FIELD_REF_SEQUENCE;
 		break;
 	case atype_string:
-		op->op = FILTER_OP_LOAD_FIELD_REF_STRING;
+		reloc->op = FILTER_OP_LOAD_FIELD_REF_STRING;
 		break;
 	case atype_float:
-		op->op = FILTER_OP_LOAD_FIELD_REF_DOUBLE;
+		reloc->op = FILTER_OP_LOAD_FIELD_REF_DOUBLE;
 		break;
 	default:
 		return -EINVAL;
 	}
 	/* set offset */
-	field_ref->offset = (uint16_t) field_offset;
+	reloc->offset = (uint16_t) field_offset;
+	*field_mask |= LTTNG_FILTER_FIELD_BIT(i);
 	return 0;
 }
 
 static
-int apply_context_reloc(struct lttng_event *event,
-		struct bytecode_runtime *runtime,
-		uint32_t runtime_len,
-		uint32_t reloc_offset,
-		const char *context_name)
+int resolve_context_reloc(struct lttng_event *event,
+		const char *context_name,
+		struct filter_reloc *reloc)
 {
-	struct field_ref *field_ref;
-	struct load_op *op;
 	struct lttng_ctx_field *ctx_field;
 	int idx;
-	struct lttng_session *session = runtime->p.session;
+	struct lttng_session *session = event->chan->session;
 
-	dbg_printf("Apply context reloc: %u %s\n", reloc_offset, context_name);
+	dbg_printf("Resolve context reloc: %u %s\n", reloc->reloc_offset,
+		context_name);
 
 	/* Get context index */
 	idx = lttng_get_context_index(session->ctx, context_name);
@@ -256,56 +260,54 @@ int apply_context_reloc(struct lttng_event *event,
 
 	/* Get context return type */
 	ctx_field = &session->ctx->fields[idx];
-	op = (struct load_op *) &runtime->data[reloc_offset];
-	field_ref = (struct field_ref *) op->data;
 	switch (ctx_field->event_field.type.atype) {
 	case atype_integer:
 	case atype_enum:
-		op->op = FILTER_OP_GET_CONTEXT_REF_S64;
+		reloc->op = FILTER_OP_GET_CONTEXT_REF_S64;
 		break;
 		/* Sequence and array supported as string */
 	case atype_string:
 	case atype_array:
 	case atype_sequence:
-		op->op = FILTER_OP_GET_CONTEXT_REF_STRING;
+		reloc->op = FILTER_OP_GET_CONTEXT_REF_STRING;
 		break;
 	case atype_float:
-		op->op = FILTER_OP_GET_CONTEXT_REF_DOUBLE;
+		reloc->op = FILTER_OP_GET_CONTEXT_REF_DOUBLE;
 		break;
 	case atype_dynamic:
-		op->op = FILTER_OP_GET_CONTEXT_REF;
+		reloc->op = FILTER_OP_GET_CONTEXT_REF;
 		break;
 	default:
 		return -EINVAL;
 	}
 	/* set offset to context index within channel contexts */
-	field_ref->offset = (uint16_t) idx;
+	reloc->offset = (uint16_t) idx;
 	return 0;
 }
 
 static
-int apply_reloc(struct lttng_event *event,
-		struct bytecode_runtime *runtime,
-		uint32_t runtime_len,
+int resolve_reloc(struct lttng_event *event,
+		struct lttng_ust_filter_bytecode_node *filter_bytecode,
 		uint32_t reloc_offset,
-		const char *name)
+		const char *name,
+		struct filter_reloc *reloc,
+		uint64_t *field_mask)
 {
 	struct load_op *op;
 
-	dbg_printf("Apply reloc: %u %s\n", reloc_offset, name);
+	dbg_printf("Resolve reloc: %u %s\n", reloc_offset, name);
 
 	/* Ensure that the reloc is within the code */
-	if (runtime_len - reloc_offset < sizeof(uint16_t))
+	if (filter_bytecode->bc.reloc_offset - reloc_offset < sizeof(uint16_t))
 		return -EINVAL;
 
-	op = (struct load_op *) &runtime->data[reloc_offset];
+	reloc->reloc_offset = reloc_offset;
+	op = (struct load_op *) &filter_bytecode->bc.data[reloc_offset];
 	switch (op->op) {
 	case FILTER_OP_LOAD_FIELD_REF:
-		return apply_field_reloc(event, runtime, runtime_len,
-			reloc_offset, name);
+		return resolve_field_reloc(event, name, reloc, field_mask);
 	case FILTER_OP_GET_CONTEXT_REF:
-		return apply_context_reloc(event, runtime, runtime_len,
-			reloc_offset, name);
+		return resolve_context_reloc(event, name, reloc);
 	default:
 		ERR("Unknown reloc op type %u\n", op->op);
 		return -EINVAL;
@@ -313,6 +315,94 @@ int apply_reloc(struct lttng_event *event,
 	return 0;
 }
 
+/*
+ * Resolve the relocation table of a bytecode against the fields of an
+ * event. The result identifies the linked bytecode: events resolving
+ * to the same relocations share it. The fields referred to are added
+ * to field_mask.
+ */
+static
+int resolve_relocs(struct lttng_event *event,
+		struct lttng_ust_filter_bytecode_node *filter_bytecode,
+		struct filter_reloc **_relocs,
+		unsigned int *_nr_relocs,
+		uint64_t *field_mask)
+{
+	struct filter_reloc *relocs;
+	unsigned int nr_relocs = 0, i = 0;
+	int ret, offset, next_offset;
+
+	/*
+	 * Relocs are a uint16_t (offset in bytecode) followed by a
+	 * string (field name).
+	 */
+	for (offset = filter_bytecode->bc.reloc_offset;
+			offset < filter_bytecode->bc.len;
+			offset = next_offset) {
+		const char *name =
+			(const char *) &filter_bytecode->bc.data[offset + sizeof(uint16_t)];
+
+		next_offset = offset + sizeof(uint16_t) + strlen(name) + 1;
+		nr_relocs++;
+	}
+	if (nr_relocs) {
+		relocs = zmalloc(nr_relocs * sizeof(*relocs));
+		if (!relocs)
+			return -ENOMEM;
+	} else {
+		relocs = NULL;
+	}
+	for (offset = filter_bytecode->bc.reloc_offset;
+			offset < filter_bytecode->bc.len;
+			offset = next_offset) {
+		uint16_t reloc_offset =
+			*(uint16_t *) &filter_bytecode->bc.data[offset];
+		const char *name =
+			(const char *) &filter_bytecode->bc.data[offset + sizeof(uint16_t)];
+
+		ret = resolve_reloc(event, filter_bytecode, reloc_offset,
+				name, &relocs[i++], field_mask);
+		if (ret) {
+			free(relocs);
+			return ret;
+		}
+		next_offset = offset + sizeof(uint16_t) + strlen(name) + 1;
+	}
+	*_relocs = relocs;
+	*_nr_relocs = nr_relocs;
+	return 0;
+}
+
+static
+uint32_t relocs_hash(const struct filter_reloc *relocs,
+		unsigned int nr_relocs)
+{
+	uint32_t hash = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_relocs; i++)
+		hash = hash * 31 + (((uint32_t) relocs[i].op << 16)
+				| relocs[i].offset);
+	return hash;
+}
+
+static
+int relocs_match(const struct bytecode_runtime *runtime,
+		const struct filter_reloc *relocs,
+		unsigned int nr_relocs)
+{
+	unsigned int i;
+
+	if (runtime->nr_relocs != nr_relocs)
+		return 0;
+	for (i = 0; i < nr_relocs; i++) {
+		if (runtime->relocs[i].op != relocs[i].op
+				|| runtime->relocs[i].offset != relocs[i].offset)
+			return 0;
+	}
+	return 1;
+}
+
 static
 int bytecode_is_linked(struct lttng_ust_filter_bytecode_node *filter_bytecode,
 		struct lttng_event *event)
@@ -327,24 +417,35 @@ int bytecode_is_linked(struct lttng_ust_filter_bytecode_node *filter_bytecode,
 	return 0;
 }
 
+static
+uint64_t (*lttng_filter_runtime_func(struct bytecode_runtime *runtime))
+		(void *filter_data, const char *filter_stack_data)
+{
+	/* Never recorded: skip evaluating the filter. */
+	if (runtime->const_false)
+		return lttng_filter_false;
+	if (runtime->jit_code)
+		return (uint64_t (*)(void *, const char *)) runtime->jit_code;
+	return lttng_filter_interpret_bytecode;
+}
+
 /*
- * Take a bytecode with reloc table and link it to an event to create a
- * bytecode runtime.
+ * Create the linked bytecode for a resolved relocation table. Takes
+ * ownership of relocs. A bytecode which fails to validate is kept with
+ * link_failed set, so other events with the same layout do not try
+ * again.
  */
 static
-int _lttng_filter_event_link_bytecode(struct lttng_event *event,
+struct bytecode_runtime *bytecode_runtime_create(
 		struct lttng_ust_filter_bytecode_node *filter_bytecode,
-		struct cds_list_head *insert_loc)
+		struct filter_reloc *relocs,
+		unsigned int nr_relocs,
+		uint32_t hash)
 {
-	int ret, offset, next_offset;
-	struct bytecode_runtime *runtime = NULL;
+	struct bytecode_runtime *runtime;
 	size_t runtime_alloc_len;
-
-	if (!filter_bytecode)
-		return 0;
-	/* Bytecode already linked */
-	if (bytecode_is_linked(filter_bytecode, event))
-		return 0;
+	unsigned int i;
+	int ret;
 
 	dbg_printf("Linking...\n");
 
@@ -352,46 +453,169 @@ int _lttng_filter_event_link_bytecode(struct lttng_event *event,
 	runtime_alloc_len = sizeof(*runtime) + filter_bytecode->bc.reloc_offset;
 	runtime = zmalloc(runtime_alloc_len);
 	if (!runtime) {
-		ret = -ENOMEM;
-		goto alloc_error;
+		free(relocs);
+		return NULL;
 	}
-	runtime->p.bc = filter_bytecode;
-	runtime->p.session = event->chan->session;
+	runtime->bc = filter_bytecode;
+	runtime->relocs = relocs;
+	runtime->nr_relocs = nr_relocs;
+	runtime->reloc_hash = hash;
+	runtime->refcount = 1;
 	runtime->len = filter_bytecode->bc.reloc_offset;
 	/* copy original bytecode */
 	memcpy(runtime->data, filter_bytecode->bc.data, runtime->len);
-	/*
-	 * apply relocs. Those are a uint16_t (offset in bytecode)
-	 * followed by a string (field name).
-	 */
-	for (offset = filter_bytecode->bc.reloc_offset;
-			offset < filter_bytecode->bc.len;
-			offset = next_offset) {
-		uint16_t reloc_offset =
-			*(uint16_t *) &filter_bytecode->bc.data[offset];
-		const char *name =
-			(const char *) &filter_bytecode->bc.data[offset + sizeof(uint16_t)];
-
-		ret = apply_reloc(event, runtime, runtime->len, reloc_offset, name);
-		if (ret) {
-			goto link_error;
-		}
-		next_offset = offset + sizeof(uint16_t) + strlen(name) + 1;
+	/* apply relocs */
+	for (i = 0; i < nr_relocs; i++) {
+		struct load_op *op;
+		struct field_ref *field_ref;
+
+		op = (struct load_op *) &runtime->data[relocs[i].reloc_offset];
+		field_ref = (struct field_ref *) op->data;
+		op->op = relocs[i].op;
+		field_ref->offset = relocs[i].offset;
 	}
 	/* Validate bytecode */
 	ret = lttng_filter_validate_bytecode(runtime);
 	if (ret) {
 		goto link_error;
 	}
+	/* Fold constant expressions */
+	ret = lttng_filter_optimize_bytecode(runtime);
+	if (ret) {
+		goto link_error;
+	}
 	/* Specialize bytecode */
 	ret = lttng_filter_specialize_bytecode(runtime);
 	if (ret) {
 		goto link_error;
 	}
-	runtime->p.filter = lttng_filter_interpret_bytecode;
+	/* Compile to native code when possible, else interpret. */
+	ret = lttng_filter_jit_compile(runtime);
+	if (ret)
+		dbg_printf("Bytecode interpreted (%d).\n", ret);
+	dbg_printf("Linking successful.\n");
+	return runtime;
+
+link_error:
+	runtime->link_failed = 1;
+	dbg_printf("Linking failed.\n");
+	return runtime;
+}
+
+static
+void bytecode_runtime_put(struct bytecode_runtime *runtime)
+{
+	if (--runtime->refcount)
+		return;
+	cds_list_del(&runtime->node);
+	lttng_filter_jit_free(runtime);
+	lttng_filter_free_string_matchers(runtime);
+	free(runtime->relocs);
+	free(runtime);
+}
+
+/*
+ * Sampling and rate limiting state is per event, and per cpu so the
+ * tracing fast path does not share cache lines between cpus.
+ */
+static
+int event_filter_state_alloc(struct event_filter_runtime *runtime)
+{
+	unsigned int nr_states = runtime->shared->nr_states;
+	void *state;
+	size_t len;
+
+	if (!nr_states)
+		return 0;
+	runtime->nr_cpus = num_possible_cpus();
+	if (runtime->nr_cpus <= 0)
+		return -EINVAL;
+	runtime->state_stride = ((nr_states * sizeof(union filter_op_state))
+			+ CAA_CACHE_LINE_SIZE - 1) & ~(CAA_CACHE_LINE_SIZE - 1);
+	len = runtime->nr_cpus * runtime->state_stride;
+	if (posix_memalign(&state, CAA_CACHE_LINE_SIZE, len))
+		return -ENOMEM;
+	memset(state, 0, len);
+	runtime->state = state;
+	return 0;
+}
+
+/*
+ * Take a bytecode with reloc table and link it to an event to create a
+ * bytecode runtime. The linked bytecode is shared with the other events
+ * of the session which have the same layout for the fields it refers
+ * to.
+ */
+static
+int _lttng_filter_event_link_bytecode(struct lttng_event *event,
+		struct lttng_ust_filter_bytecode_node *filter_bytecode,
+		struct cds_list_head *insert_loc)
+{
+	struct lttng_session *session = event->chan->session;
+	struct event_filter_runtime *runtime;
+	struct bytecode_runtime *shared;
+	struct filter_reloc *relocs;
+	unsigned int nr_relocs;
+	uint64_t field_mask = 0;
+	uint32_t hash;
+	int ret;
+
+	if (!filter_bytecode)
+		return 0;
+	/* Bytecode already linked */
+	if (bytecode_is_linked(filter_bytecode, event))
+		return 0;
+
+	runtime = zmalloc(sizeof(*runtime));
+	if (!runtime) {
+		ret = -ENOMEM;
+		goto alloc_error;
+	}
+	runtime->p.bc = filter_bytecode;
+	runtime->p.session = session;
+	ret = resolve_relocs(event, filter_bytecode, &relocs, &nr_relocs,
+			&field_mask);
+	if (ret) {
+		goto link_error;
+	}
+	hash = relocs_hash(relocs, nr_relocs);
+	cds_list_for_each_entry(shared, &session->filter_runtime_head, node) {
+		if (shared->bc == filter_bytecode
+				&& shared->reloc_hash == hash
+				&& relocs_match(shared, relocs, nr_relocs)) {
+			dbg_printf("Sharing linked bytecode.\n");
+			free(relocs);
+			shared->refcount++;
+			goto found;
+		}
+	}
+	shared = bytecode_runtime_create(filter_bytecode, relocs,
+			nr_relocs, hash);
+	if (!shared) {
+		ret = -ENOMEM;
+		goto link_error;
+	}
+	cds_list_add(&shared->node, &session->filter_runtime_head);
+found:
+	runtime->shared = shared;
+	if (shared->link_failed) {
+		ret = -EINVAL;
+		goto link_error;
+	}
+	ret = event_filter_state_alloc(runtime);
+	if (ret) {
+		goto link_error;
+	}
+	runtime->p.filter = lttng_filter_runtime_func(shared);
 	runtime->p.link_failed = 0;
+	/*
+	 * The probe only computes the fields read by the filter. The
+	 * mask is published along with the runtime, and never changes
+	 * afterwards. A filter folded to a constant reads no field.
+	 */
+	if (!shared->const_false)
+		runtime->p.field_mask = field_mask;
 	cds_list_add_rcu(&runtime->p.node, insert_loc);
-	dbg_printf("Linking successful.\n");
 	return 0;
 
 link_error:
@@ -410,7 +634,9 @@ void lttng_filter_sync_state(struct lttng_bytecode_runtime *runtime)
 	if (!bc->enabler->enabled || runtime->link_failed)
 		runtime->filter = lttng_filter_false;
 	else
-		runtime->filter = lttng_filter_interpret_bytecode;
+		runtime->filter = lttng_filter_runtime_func(
+			caa_container_of(runtime, struct event_filter_runtime,
+				p)->shared);
 }
 
 /*
@@ -487,10 +713,13 @@ void lttng_free_enabler_filter_bytecode(struct lttng_enabler *enabler)
 
 void lttng_free_event_filter_runtime(struct lttng_event *event)
 {
-	struct bytecode_runtime *runtime, *tmp;
+	struct event_filter_runtime *runtime, *tmp;
 
 	cds_list_for_each_entry_safe(runtime, tmp,
 			&event->bytecode_runtime_head, p.node) {
+		if (runtime->shared)
+			bytecode_runtime_put(runtime->shared);
+		free(runtime->state);
 		free(runtime);
 	}
 }
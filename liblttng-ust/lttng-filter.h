@@ -68,13 +68,80 @@ do {								\
 } while (0)
 #endif
 
-/* Linked bytecode. Child of struct lttng_bytecode_runtime. */
+enum filter_string_match_type {
+	FILTER_STRING_MATCH_EXACT,	/* "abc" */
+	FILTER_STRING_MATCH_PREFIX,	/* "abc*" */
+	FILTER_STRING_MATCH_NONE,	/* Invalid escape: never equal. */
+};
+
+/*
+ * String literal pre-parsed at link time: escapes are resolved and the
+ * trailing wildcard is turned into a prefix match.
+ */
+struct filter_string_matcher {
+	enum filter_string_match_type type;
+	uint16_t insn_len;	/* Length of the rewritten LOAD_STRING. */
+	size_t len;
+	char str[];
+};
+
+/* Result of a relocation: load op and field offset or context index. */
+struct filter_reloc {
+	uint16_t reloc_offset;
+	uint16_t offset;
+	filter_opcode_t op;
+};
+
+/*
+ * Linked bytecode. Shared by all the events of a session which resolve
+ * the relocations of a filter bytecode to the same field layout.
+ */
 struct bytecode_runtime {
-	struct lttng_bytecode_runtime p;
+	struct cds_list_head node;	/* Session linked bytecode list. */
+	struct lttng_ust_filter_bytecode_node *bc;
+	struct filter_reloc *relocs;
+	unsigned int nr_relocs;
+	uint32_t reloc_hash;
+	int refcount;
+	int link_failed;
+	void *jit_code;		/* Native code, NULL if interpreted. */
+	size_t jit_len;
+	int const_false;	/* Folded to constant false. */
+	struct filter_string_matcher **matchers;
+	unsigned int nr_matchers;
+	unsigned int nr_states;	/* Sampling and rate limiting ops. */
 	uint16_t len;
 	char data[0];
 };
 
+/*
+ * State of a sampling or rate limiting op, for one cpu. Zeroed state is
+ * initialized on first use.
+ */
+union filter_op_state {
+	struct {
+		uint64_t x;		/* xorshift64 generator state. */
+	} sample;
+	struct {
+		uint64_t last;		/* Last refill, trace clock. */
+		uint64_t tokens;	/* Events, scaled by clock freq. */
+		uint64_t max_delta;	/* Time to fill the bucket. */
+	} rate_limit;
+};
+
+/* Filter of an event. Child of struct lttng_bytecode_runtime. */
+struct event_filter_runtime {
+	struct lttng_bytecode_runtime p;
+	struct bytecode_runtime *shared;	/* NULL if relocation failed. */
+	/*
+	 * Per-cpu state of the sampling and rate limiting ops, one
+	 * cache line aligned block of state_stride bytes per cpu.
+	 */
+	char *state;
+	size_t state_stride;
+	int nr_cpus;
+};
+
 enum entry_type {
 	REG_S64,
 	REG_DOUBLE,
@@ -206,7 +273,12 @@ struct estack {
 const char *print_op(enum filter_op op);
 
 int lttng_filter_validate_bytecode(struct bytecode_runtime *bytecode);
+int lttng_filter_optimize_bytecode(struct bytecode_runtime *bytecode);
 int lttng_filter_specialize_bytecode(struct bytecode_runtime *bytecode);
+void lttng_filter_free_string_matchers(struct bytecode_runtime *bytecode);
+
+int lttng_filter_jit_compile(struct bytecode_runtime *bytecode);
+void lttng_filter_jit_free(struct bytecode_runtime *bytecode);
 
 uint64_t lttng_filter_false(void *filter_data,
 		const char *filter_stack_data);
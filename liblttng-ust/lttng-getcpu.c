@@ -33,6 +33,54 @@ int (*lttng_get_cpu)(void);
 static
 void *getcpu_handle;
 
+#ifdef LTTNG_UST_HAVE_RSEQ
+
+DEFINE_URCU_TLS(const struct rseq *, lttng_ust_rseq_abi);
+
+/* Used by threads which cannot use rseq. */
+static const struct rseq rseq_unavailable = {
+	.cpu_id = RSEQ_CPU_ID_REGISTRATION_FAILED,
+};
+
+/*
+ * Look up the rseq area registered by the C library for the current
+ * thread. liblttng-ust never registers an area itself: a registration
+ * lasts until the thread exits, which the library may not outlive, and
+ * only one area can be registered per thread. __rseq_size is 0 when the
+ * C library does not register rseq (disabled by the glibc.pthread.rseq
+ * tunable, or unsupported by the kernel).
+ */
+int lttng_ust_rseq_register_get_cpu(void)
+{
+	const struct rseq *rseq_abi = &rseq_unavailable;
+	int cpu;
+
+	if (__rseq_size)
+		rseq_abi = (const struct rseq *)
+			((char *) __builtin_thread_pointer() + __rseq_offset);
+	CMM_STORE_SHARED(URCU_TLS(lttng_ust_rseq_abi), rseq_abi);
+	cpu = (int) CMM_LOAD_SHARED(rseq_abi->cpu_id);
+	if (caa_unlikely(cpu < 0))
+		return lttng_ust_get_cpu_internal();
+	return cpu;
+}
+
+/*
+ * Force a read (imply TLS fixup for dlopen) of TLS variables.
+ */
+void lttng_fixup_rseq_tls(void)
+{
+	asm volatile ("" : : "m" (URCU_TLS(lttng_ust_rseq_abi)));
+}
+
+#else	/* LTTNG_UST_HAVE_RSEQ */
+
+void lttng_fixup_rseq_tls(void)
+{
+}
+
+#endif	/* LTTNG_UST_HAVE_RSEQ */
+
 int lttng_ust_getcpu_override(int (*getcpu)(void))
 {
 	CMM_STORE_SHARED(lttng_get_cpu, getcpu);
@@ -21,7 +21,9 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <urcu-bp.h>
 #include <urcu/list.h>
 #include <urcu/hlist.h>
 #include <lttng/ust-events.h>
@@ -52,6 +54,182 @@ static CDS_LIST_HEAD(lazy_probe_init);
  */
 static int lazy_nesting;
 
+/*
+ * Name index of the event descriptors of registered probes, used to
+ * find the events matching an enabler without scanning every event of
+ * every probe. Exact names are looked up in a hash table. Wildcard
+ * enablers select a prefix, which is a contiguous range of the array
+ * of event descriptors sorted by name. Protected by the ust mutex.
+ *
+ * The hash table is a plain hlist table, like the session hash
+ * tables: it is only used with the ust mutex held, and probes register
+ * from constructors, so it must not spawn resize threads.
+ */
+struct event_desc_node {
+	struct cds_hlist_node hlist;
+	const struct lttng_event_desc *desc;
+};
+
+static struct lttng_ust_ht event_desc_ht;
+static const struct lttng_event_desc **event_desc_sorted;
+static size_t nr_event_desc;
+
+static
+uint32_t event_desc_hash(const char *name)
+{
+	return jhash(name, strlen(name), 0);
+}
+
+static
+uint32_t event_desc_hash_node(struct cds_hlist_node *node)
+{
+	struct event_desc_node *e =
+		caa_container_of(node, struct event_desc_node, hlist);
+
+	return event_desc_hash(e->desc->name);
+}
+
+static
+int event_desc_cmp(const void *a, const void *b)
+{
+	const struct lttng_event_desc * const *da = a, * const *db = b;
+
+	return strcmp((*da)->name, (*db)->name);
+}
+
+/*
+ * Index of the first event descriptor of the sorted array whose name,
+ * comparing at most len characters, is not lower than name (upper == 0)
+ * or is greater than name (upper != 0).
+ */
+static
+size_t event_desc_lower_bound(const char *name, size_t len, int upper)
+{
+	size_t low = 0, high = nr_event_desc;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		int cmp = strncmp(event_desc_sorted[mid]->name, name, len);
+
+		if (cmp < 0 || (upper && !cmp))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static
+void event_desc_index_remove_ht(const struct lttng_event_desc *event_desc)
+{
+	struct cds_hlist_head *head;
+	struct cds_hlist_node *node;
+	struct event_desc_node *e;
+
+	head = lttng_ust_ht_bucket(&event_desc_ht,
+			event_desc_hash(event_desc->name));
+	cds_hlist_for_each_entry(e, node, head, hlist) {
+		if (e->desc != event_desc)
+			continue;
+		lttng_ust_ht_del(&event_desc_ht, &e->hlist);
+		free(e);
+		return;
+	}
+}
+
+/*
+ * Add the events of a probe to the name index.
+ * Called under ust lock.
+ */
+static
+int event_desc_index_add(struct lttng_probe_desc *desc)
+{
+	const struct lttng_event_desc **new_events, **merged;
+	size_t i, j, k;
+	int ret;
+
+	if (!event_desc_ht.table) {
+		ret = lttng_ust_ht_init(&event_desc_ht);
+		if (ret)
+			return ret;
+	}
+	if (!desc->nr_events)
+		return 0;
+	new_events = zmalloc(desc->nr_events * sizeof(*new_events));
+	merged = zmalloc((nr_event_desc + desc->nr_events) * sizeof(*merged));
+	if (!new_events || !merged) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < desc->nr_events; i++) {
+		struct event_desc_node *e;
+
+		e = zmalloc(sizeof(*e));
+		if (!e) {
+			ret = -ENOMEM;
+			goto error_ht;
+		}
+		e->desc = desc->event_desc[i];
+		lttng_ust_ht_add(&event_desc_ht, &e->hlist,
+			event_desc_hash(e->desc->name), event_desc_hash_node);
+		new_events[i] = desc->event_desc[i];
+	}
+	qsort(new_events, desc->nr_events, sizeof(*new_events),
+		event_desc_cmp);
+	/* Merge the sorted events of the probe within the index. */
+	for (i = 0, j = 0, k = 0; i < nr_event_desc || j < desc->nr_events; k++) {
+		if (j == desc->nr_events || (i < nr_event_desc
+				&& event_desc_cmp(&event_desc_sorted[i],
+					&new_events[j]) < 0))
+			merged[k] = event_desc_sorted[i++];
+		else
+			merged[k] = new_events[j++];
+	}
+	free(event_desc_sorted);
+	event_desc_sorted = merged;
+	nr_event_desc = k;
+	free(new_events);
+	return 0;
+
+error_ht:
+	while (i-- > 0)
+		event_desc_index_remove_ht(desc->event_desc[i]);
+error:
+	free(merged);
+	free(new_events);
+	return ret;
+}
+
+/*
+ * Remove the events of a probe from the name index.
+ * Called under ust lock.
+ */
+static
+void event_desc_index_remove(struct lttng_probe_desc *desc)
+{
+	size_t i;
+
+	if (!event_desc_ht.table)
+		return;
+	for (i = 0; i < desc->nr_events; i++) {
+		const struct lttng_event_desc *event_desc = desc->event_desc[i];
+		size_t pos;
+
+		event_desc_index_remove_ht(event_desc);
+		pos = event_desc_lower_bound(event_desc->name,
+				LTTNG_UST_SYM_NAME_LEN, 0);
+		while (pos < nr_event_desc && event_desc_sorted[pos] != event_desc
+				&& !strcmp(event_desc_sorted[pos]->name,
+					event_desc->name))
+			pos++;
+		if (pos == nr_event_desc || event_desc_sorted[pos] != event_desc)
+			continue;
+		memmove(&event_desc_sorted[pos], &event_desc_sorted[pos + 1],
+			(nr_event_desc - pos - 1) * sizeof(*event_desc_sorted));
+		nr_event_desc--;
+	}
+}
+
 /*
  * Called under ust lock.
  */
@@ -111,6 +289,8 @@ void lttng_lazy_probe_register(struct lttng_probe_desc *desc)
 	/* We should be added at the head of the list */
 	cds_list_add(&desc->head, probe_list);
 desc_added:
+	if (event_desc_index_add(desc))
+		ERR("Unable to index the events of probe %s", desc->provider);
 	DBG("just registered probe %s containing %u events",
 		desc->provider, desc->nr_events);
 }
@@ -122,6 +302,7 @@ static
 void fixup_lazy_probes(void)
 {
 	struct lttng_probe_desc *iter, *tmp;
+	CDS_LIST_HEAD(new_probes);
 	int ret;
 
 	lazy_nesting++;
@@ -130,9 +311,14 @@ void fixup_lazy_probes(void)
 		lttng_lazy_probe_register(iter);
 		iter->lazy = 0;
 		cds_list_del(&iter->lazy_init_head);
+		cds_list_add_tail(&iter->lazy_init_head, &new_probes);
 	}
-	ret = lttng_fix_pending_events();
+	/* Only the events of the new probes need to be synchronized. */
+	ret = lttng_fix_pending_events(&new_probes);
 	assert(!ret);
+	cds_list_for_each_entry_safe(iter, tmp,
+			&new_probes, lazy_init_head)
+		cds_list_del(&iter->lazy_init_head);
 	lazy_nesting--;
 }
 
@@ -146,6 +332,51 @@ struct cds_list_head *lttng_get_probe_list_head(void)
 	return &_probe_list;
 }
 
+/*
+ * Find the event descriptor of a registered probe by name.
+ * Called under ust lock.
+ */
+const struct lttng_event_desc *lttng_probes_find_event_desc(const char *name)
+{
+	struct cds_hlist_head *head;
+	struct cds_hlist_node *node;
+	struct event_desc_node *e;
+
+	(void) lttng_get_probe_list_head();
+	if (!event_desc_ht.table)
+		return NULL;
+	head = lttng_ust_ht_bucket(&event_desc_ht, event_desc_hash(name));
+	cds_hlist_for_each_entry(e, node, head, hlist) {
+		if (!strcmp(e->desc->name, name))
+			return e->desc;
+	}
+	return NULL;
+}
+
+/*
+ * Get the event descriptors of registered probes whose name begins
+ * with the first len characters of prefix, sorted by name. The
+ * returned array is valid until the next probe registration or
+ * unregistration.
+ * Called under ust lock.
+ */
+const struct lttng_event_desc * const *
+	lttng_probes_find_event_desc_prefix(const char *prefix, size_t len,
+		size_t *count)
+{
+	size_t begin, end;
+
+	(void) lttng_get_probe_list_head();
+	if (!len) {
+		*count = nr_event_desc;
+		return event_desc_sorted;
+	}
+	begin = event_desc_lower_bound(prefix, len, 0);
+	end = event_desc_lower_bound(prefix, len, 1);
+	*count = end - begin;
+	return &event_desc_sorted[begin];
+}
+
 static
 const struct lttng_probe_desc *find_provider(const char *provider)
 {
@@ -238,10 +469,12 @@ void lttng_probe_unregister(struct lttng_probe_desc *desc)
 		return;
 
 	ust_lock_nocheck();
-	if (!desc->lazy)
+	if (!desc->lazy) {
 		cds_list_del(&desc->head);
-	else
+		event_desc_index_remove(desc);
+	} else {
 		cds_list_del(&desc->lazy_init_head);
+	}
 	DBG("just unregistered probe %s", desc->provider);
 	ust_unlock();
 }
@@ -0,0 +1,42 @@
+/*
+ * lttng-ring-buffer-client-discard-per-thread.c
+ *
+ * LTTng lib ring buffer client (discard mode) for per-thread buffers.
+ *
+ * Copyright (C) 2010-2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; only
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include "lttng-tracer.h"
+
+#define RING_BUFFER_MODE_TEMPLATE		RING_BUFFER_DISCARD
+#define RING_BUFFER_MODE_TEMPLATE_STRING	"discard-per-thread"
+#define RING_BUFFER_MODE_TEMPLATE_INIT	\
+	lttng_ring_buffer_client_discard_per_thread_init
+#define RING_BUFFER_MODE_TEMPLATE_EXIT	\
+	lttng_ring_buffer_client_discard_per_thread_exit
+#define LTTNG_CLIENT_TYPE			LTTNG_CLIENT_DISCARD_PER_THREAD
+#define LTTNG_CLIENT_CALLBACKS			lttng_client_callbacks_discard_per_thread
+#define LTTNG_CLIENT_WAKEUP			RING_BUFFER_WAKEUP_BY_WRITER
+#define LTTNG_CLIENT_ALLOC			RING_BUFFER_ALLOC_PER_THREAD
+/*
+ * Streams are shared by several threads when the pool is exhausted, and
+ * the switch timer and flush switch sub-buffers of streams owned by
+ * other threads, so writes are not owner-only: synchronize globally.
+ */
+#define LTTNG_CLIENT_SYNC			RING_BUFFER_SYNC_GLOBAL
+#include "lttng-ring-buffer-client.h"
@@ -635,8 +635,8 @@ static const struct lttng_ust_lib_ring_buffer_config client_config = {
 	.cb.packet_size_field = client_packet_size_field,
 
 	.tsc_bits = LTTNG_COMPACT_TSC_BITS,
-	.alloc = RING_BUFFER_ALLOC_PER_CPU,
-	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.alloc = LTTNG_CLIENT_ALLOC,
+	.sync = LTTNG_CLIENT_SYNC,
 	.mode = RING_BUFFER_MODE_TEMPLATE,
 	.backend = RING_BUFFER_PAGE,
 	.output = RING_BUFFER_MMAP,
@@ -658,7 +658,8 @@ struct lttng_channel *_channel_create(const char *name,
 				unsigned int read_timer_interval,
 				unsigned char *uuid,
 				uint32_t chan_id,
-				const int *stream_fds, int nr_stream_fds)
+				const int *stream_fds, int nr_stream_fds,
+				unsigned int shm_flags)
 {
 	struct lttng_channel chan_priv_init;
 	struct lttng_ust_shm_handle *handle;
@@ -674,7 +675,7 @@ struct lttng_channel *_channel_create(const char *name,
 			&chan_priv_init,
 			buf_addr, subbuf_size, num_subbuf,
 			switch_timer_interval, read_timer_interval,
-			stream_fds, nr_stream_fds);
+			stream_fds, nr_stream_fds, shm_flags);
 	if (!handle)
 		return NULL;
 	lttng_chan = priv;
@@ -689,17 +690,11 @@ void lttng_channel_destroy(struct lttng_channel *chan)
 	channel_destroy(chan->chan, chan->handle, 1);
 }
 
-static
-int lttng_event_reserve(struct lttng_ust_lib_ring_buffer_ctx *ctx,
-		      uint32_t event_id)
+static inline
+void lttng_event_id_rflags(struct lttng_ust_lib_ring_buffer_ctx *ctx,
+		uint32_t event_id)
 {
 	struct lttng_channel *lttng_chan = channel_get_private(ctx->chan);
-	int ret, cpu;
-
-	cpu = lib_ring_buffer_get_cpu(&client_config);
-	if (cpu < 0)
-		return -EPERM;
-	ctx->cpu = cpu;
 
 	switch (lttng_chan->header_type) {
 	case 1:	/* compact */
@@ -713,6 +708,20 @@ int lttng_event_reserve(struct lttng_ust_lib_ring_buffer_ctx *ctx,
 	default:
 		WARN_ON_ONCE(1);
 	}
+}
+
+static
+int lttng_event_reserve(struct lttng_ust_lib_ring_buffer_ctx *ctx,
+		      uint32_t event_id)
+{
+	int ret, cpu;
+
+	cpu = lib_ring_buffer_get_cpu(&client_config);
+	if (cpu < 0)
+		return -EPERM;
+	ctx->cpu = cpu;
+
+	lttng_event_id_rflags(ctx, event_id);
 
 	ret = lib_ring_buffer_reserve(&client_config, ctx);
 	if (ret)
@@ -731,6 +740,45 @@ void lttng_event_commit(struct lttng_ust_lib_ring_buffer_ctx *ctx)
 	lib_ring_buffer_put_cpu(&client_config);
 }
 
+static
+int lttng_event_reserve_batch(struct lttng_ust_lib_ring_buffer_ctx *ctx,
+		uint32_t event_id, const size_t *data_sizes,
+		unsigned int nr)
+{
+	int ret, cpu;
+
+	cpu = lib_ring_buffer_get_cpu(&client_config);
+	if (cpu < 0)
+		return -EPERM;
+	ctx->cpu = cpu;
+
+	lttng_event_id_rflags(ctx, event_id);
+
+	ret = lib_ring_buffer_reserve_batch(&client_config, ctx,
+			data_sizes, nr);
+	if (ret < 0)
+		goto put;
+	return ret;
+put:
+	lib_ring_buffer_put_cpu(&client_config);
+	return ret;
+}
+
+static
+void lttng_event_batch_next(struct lttng_ust_lib_ring_buffer_ctx *ctx,
+		uint32_t event_id, size_t data_size)
+{
+	lib_ring_buffer_batch_next(&client_config, ctx, data_size);
+	lttng_write_event_header(&client_config, ctx, event_id);
+}
+
+static
+void lttng_event_commit_batch(struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	lib_ring_buffer_commit_batch(&client_config, ctx);
+	lib_ring_buffer_put_cpu(&client_config);
+}
+
 static
 void lttng_event_write(struct lttng_ust_lib_ring_buffer_ctx *ctx, const void *src,
 		     size_t len)
@@ -777,7 +825,7 @@ int lttng_flush_buffer(struct channel *chan, struct lttng_ust_shm_handle *handle
 	struct lttng_ust_lib_ring_buffer *buf;
 	int cpu;
 
-	for_each_channel_cpu(cpu, chan) {
+	for_each_channel_stream(cpu, chan) {
 		int shm_fd, wait_fd, wakeup_fd;
 		uint64_t memory_map_size;
 
@@ -796,6 +844,7 @@ static struct lttng_transport lttng_relay_transport = {
 		.channel_create = _channel_create,
 		.channel_destroy = lttng_channel_destroy,
 		.u.has_strcpy = 1,
+		.u.has_filter_field_mask = 1,
 		.event_reserve = lttng_event_reserve,
 		.event_commit = lttng_event_commit,
 		.event_write = lttng_event_write,
@@ -806,6 +855,9 @@ static struct lttng_transport lttng_relay_transport = {
 		.is_disabled = lttng_is_disabled,
 		.flush_buffer = lttng_flush_buffer,
 		.event_strcpy = lttng_event_strcpy,
+		.event_reserve_batch = lttng_event_reserve_batch,
+		.event_batch_next = lttng_event_batch_next,
+		.event_commit_batch = lttng_event_commit_batch,
 	},
 	.client_config = &client_config,
 };
@@ -36,6 +36,9 @@ struct lttng_event;
 struct lttng_ctx_field;
 struct lttng_ust_lib_ring_buffer_ctx;
 struct lttng_ctx_value;
+struct lttng_ust_ht;
+struct cds_hlist_head;
+struct cds_hlist_node;
 
 int ust_lock(void) __attribute__ ((warn_unused_result));
 void ust_lock_nocheck(void);
@@ -44,6 +47,9 @@ void ust_unlock(void);
 void lttng_fixup_event_tls(void);
 void lttng_fixup_vtid_tls(void);
 void lttng_fixup_procname_tls(void);
+void lttng_fixup_tracef_tls(void);
+void lttng_tracef_buffer_init(void);
+void lttng_tracef_buffer_exit(void);
 
 const char *lttng_ust_obj_get_name(int id);
 
@@ -63,4 +69,12 @@ void lttng_ust_dummy_get_value(struct lttng_ctx_field *field,
 		struct lttng_ctx_value *value);
 int lttng_context_is_app(const char *name);
 
+int lttng_ust_ht_init(struct lttng_ust_ht *ht);
+void lttng_ust_ht_fini(struct lttng_ust_ht *ht);
+struct cds_hlist_head *lttng_ust_ht_bucket(struct lttng_ust_ht *ht,
+		uint32_t hash);
+void lttng_ust_ht_add(struct lttng_ust_ht *ht, struct cds_hlist_node *node,
+		uint32_t hash, uint32_t (*hash_node)(struct cds_hlist_node *node));
+void lttng_ust_ht_del(struct lttng_ust_ht *ht, struct cds_hlist_node *node);
+
 #endif /* _LTTNG_TRACER_CORE_H */
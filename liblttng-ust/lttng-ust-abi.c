@@ -417,6 +417,7 @@ int lttng_abi_map_channel(int session_objd,
 
 	switch (type) {
 	case LTTNG_UST_CHAN_PER_CPU:
+	case LTTNG_UST_CHAN_PER_THREAD:
 		break;
 	default:
 		ret = -EINVAL;
@@ -467,6 +468,20 @@ int lttng_abi_map_channel(int session_objd,
 		}
 		chan_name = "channel";
 		break;
+	case LTTNG_UST_CHAN_PER_THREAD:
+		if (config->output == RING_BUFFER_MMAP
+				&& config->alloc == RING_BUFFER_ALLOC_PER_THREAD) {
+			if (config->mode == RING_BUFFER_OVERWRITE) {
+				transport_name = "relay-overwrite-per-thread-mmap";
+			} else {
+				transport_name = "relay-discard-per-thread-mmap";
+			}
+		} else {
+			ret = -EINVAL;
+			goto notransport;
+		}
+		chan_name = "channel";
+		break;
 	default:
 		ret = -EINVAL;
 		goto notransport;
@@ -330,11 +330,15 @@ extern void lttng_ring_buffer_client_overwrite_init(void);
 extern void lttng_ring_buffer_client_overwrite_rt_init(void);
 extern void lttng_ring_buffer_client_discard_init(void);
 extern void lttng_ring_buffer_client_discard_rt_init(void);
+extern void lttng_ring_buffer_client_discard_per_thread_init(void);
+extern void lttng_ring_buffer_client_overwrite_per_thread_init(void);
 extern void lttng_ring_buffer_metadata_client_init(void);
 extern void lttng_ring_buffer_client_overwrite_exit(void);
 extern void lttng_ring_buffer_client_overwrite_rt_exit(void);
 extern void lttng_ring_buffer_client_discard_exit(void);
 extern void lttng_ring_buffer_client_discard_rt_exit(void);
+extern void lttng_ring_buffer_client_discard_per_thread_exit(void);
+extern void lttng_ring_buffer_client_overwrite_per_thread_exit(void);
 extern void lttng_ring_buffer_metadata_client_exit(void);
 
 ssize_t lttng_ust_read(int fd, void *buf, size_t len)
@@ -1577,10 +1581,12 @@ void __attribute__((constructor)) lttng_ust_init(void)
 	 */
 	lttng_fixup_urcu_bp_tls();
 	lttng_fixup_ringbuffer_tls();
+	lttng_fixup_rseq_tls();
 	lttng_fixup_vtid_tls();
 	lttng_fixup_nest_count_tls();
 	lttng_fixup_procname_tls();
 	lttng_fixup_ust_mutex_nest_tls();
+	lttng_fixup_tracef_tls();
 
 	lttng_ust_loaded = 1;
 
@@ -1600,7 +1606,11 @@ void __attribute__((constructor)) lttng_ust_init(void)
 	lttng_ring_buffer_client_overwrite_rt_init();
 	lttng_ring_buffer_client_discard_init();
 	lttng_ring_buffer_client_discard_rt_init();
+	lttng_ring_buffer_client_overwrite_per_thread_init();
+	lttng_ring_buffer_client_discard_per_thread_init();
+	lib_ring_buffer_thread_init();
 	lttng_perf_counter_init();
+	lttng_tracef_buffer_init();
 	/*
 	 * Invoke ust malloc wrapper init before starting other threads.
 	 */
@@ -1726,6 +1736,10 @@ void lttng_ust_cleanup(int exiting)
 	lttng_ust_abi_exit();
 	lttng_ust_events_exit();
 	lttng_perf_counter_exit();
+	lttng_tracef_buffer_exit();
+	lib_ring_buffer_thread_exit();
+	lttng_ring_buffer_client_discard_per_thread_exit();
+	lttng_ring_buffer_client_overwrite_per_thread_exit();
 	lttng_ring_buffer_client_discard_rt_exit();
 	lttng_ring_buffer_client_discard_exit();
 	lttng_ring_buffer_client_overwrite_rt_exit();
@@ -1866,6 +1880,8 @@ void ust_after_fork_child(sigset_t *restore_sigset)
 	if (URCU_TLS(lttng_ust_nest_count))
 		return;
 	lttng_context_vtid_reset();
+	lib_ring_buffer_thread_reset();
+	lib_ring_buffer_timer_after_fork_child();
 	DBG("process %d", getpid());
 	/* Release urcu mutexes */
 	rcu_bp_after_fork_child();
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <wchar.h>
+
+#define TRACEPOINT_CREATE_PROBES
+#define TRACEPOINT_DEFINE
+#include "lttng-ust-tracef-binary-provider.h"
+#include "tracef-binary.h"
+
+/*
+ * Binary tracef() and tracelog() events record the address of the
+ * format string and the values of the arguments rather than the
+ * formatted message, which is only produced when reading the trace.
+ *
+ * Each argument is stored in the native representation of the type
+ * va_arg() reads it with, without padding, in the order in which the
+ * format consumes them: "*" field widths and precisions as int, integer
+ * conversions as int, long, long long, intmax_t, size_t or ptrdiff_t
+ * depending on their length modifier, %c as int (wint_t for %lc), %p as
+ * a pointer, floating point conversions as double or long double, and
+ * %m as the int value of errno. %s arguments are stored as the bytes of
+ * the string including its terminating '\0' ("(null)" for NULL), and %ls
+ * arguments as the wchar_t of the string including the terminating
+ * L'\0'. Strings are cut at the precision of their conversion, if any,
+ * as printf() never reads beyond it. %n arguments are consumed, but
+ * nothing is stored.
+ *
+ * When the arguments do not fit, the last string is truncated and the
+ * following arguments are left out. Formats using positional parameters
+ * or conversions unknown to the C library cannot be described this way:
+ * the event is not recorded.
+ */
+
+enum tracef_length {
+	TRACEF_LENGTH_NONE,
+	TRACEF_LENGTH_CHAR,		/* hh */
+	TRACEF_LENGTH_SHORT,		/* h */
+	TRACEF_LENGTH_LONG,		/* l */
+	TRACEF_LENGTH_LONG_LONG,	/* ll, q */
+	TRACEF_LENGTH_LONG_DOUBLE,	/* L */
+	TRACEF_LENGTH_INTMAX,		/* j */
+	TRACEF_LENGTH_SIZE,		/* z, Z */
+	TRACEF_LENGTH_PTRDIFF,		/* t */
+};
+
+struct tracef_args {
+	uint8_t *buf;
+	size_t len;
+	size_t pos;
+};
+
+static
+int pack(struct tracef_args *args, const void *src, size_t len)
+{
+	if (len > args->len - args->pos)
+		return -1;
+	memcpy(&args->buf[args->pos], src, len);
+	args->pos += len;
+	return 0;
+}
+
+/*
+ * Pack a string read by a conversion of precision @prec, or without
+ * precision if @prec is negative.
+ */
+static
+int pack_string(struct tracef_args *args, const char *str, int prec)
+{
+	size_t len, max;
+
+	if (args->pos == args->len)
+		return -1;
+	if (!str)
+		str = "(null)";
+	max = args->len - args->pos - 1;
+	if (prec >= 0 && (size_t) prec < max)
+		max = prec;
+	len = strnlen(str, max);
+	memcpy(&args->buf[args->pos], str, len);
+	args->buf[args->pos + len] = '\0';
+	args->pos += len + 1;
+	return 0;
+}
+
+/*
+ * The precision of a wide string conversion is a number of output
+ * bytes, and each wide character is converted to at least one byte:
+ * printf() reads at most @prec wide characters.
+ */
+static
+int pack_wide_string(struct tracef_args *args, const wchar_t *str, int prec)
+{
+	const wchar_t nul = L'\0';
+	size_t len, max;
+
+	if (args->len - args->pos < sizeof(wchar_t))
+		return -1;
+	if (!str)
+		str = L"(null)";
+	max = (args->len - args->pos) / sizeof(wchar_t) - 1;
+	if (prec >= 0 && (size_t) prec < max)
+		max = prec;
+	len = wcsnlen(str, max);
+	memcpy(&args->buf[args->pos], str, len * sizeof(wchar_t));
+	args->pos += len * sizeof(wchar_t);
+	return pack(args, &nul, sizeof(nul));
+}
+
+#define PACK_ARG(args, ap, type)					\
+	({								\
+		type __v = va_arg(ap, type);				\
+		pack(args, &__v, sizeof(__v));				\
+	})
+
+/*
+ * Parse the digits of a field width or precision, or read its value
+ * from the arguments, and store it in @value. Returns -1 if the format
+ * uses positional parameters, 1 if the arguments are full.
+ */
+static
+int pack_width(struct tracef_args *args, const char **p, va_list *ap,
+		int *value)
+{
+	if (**p == '*') {
+		(*p)++;
+		if (**p >= '0' && **p <= '9')
+			return -1;	/* "*m$" */
+		*value = va_arg(*ap, int);
+		return pack(args, value, sizeof(*value)) ? 1 : 0;
+	}
+	*value = 0;
+	while (**p >= '0' && **p <= '9') {
+		if (*value <= (INT_MAX - 9) / 10)
+			*value = *value * 10 + (**p - '0');
+		(*p)++;
+	}
+	if (**p == '$')
+		return -1;
+	return 0;
+}
+
+/*
+ * Pack the arguments described by @fmt into @buf. Returns the number of
+ * bytes used, or -1 if the arguments cannot be described.
+ */
+ssize_t lttng_ust_tracef_pack_args(uint8_t *buf, size_t len,
+		const char *fmt, va_list ap)
+{
+	struct tracef_args args = {
+		.buf = buf,
+		.len = len,
+		.pos = 0,
+	};
+	int saved_errno = errno;
+	const char *p;
+	va_list aq;
+	ssize_t ret;
+
+	/*
+	 * @ap is a pointer if va_list is an array type: copy it so it can
+	 * be passed by address.
+	 */
+	va_copy(aq, ap);
+	for (p = fmt; *p; p++) {
+		enum tracef_length length = TRACEF_LENGTH_NONE;
+		int width, prec = -1, full = 0;
+
+		if (*p != '%')
+			continue;
+		p++;
+		if (*p == '%')
+			continue;
+		/* Flags */
+		while (*p && strchr("-+ #0'I", *p))
+			p++;
+		/* Field width, or argument number */
+		switch (pack_width(&args, &p, &aq, &width)) {
+		case -1:
+			goto unsupported;
+		case 1:
+			goto end;
+		}
+		/* Precision, ignored if negative */
+		if (*p == '.') {
+			p++;
+			switch (pack_width(&args, &p, &aq, &prec)) {
+			case -1:
+				goto unsupported;
+			case 1:
+				goto end;
+			}
+		}
+		/* Length modifier */
+		switch (*p) {
+		case 'h':
+			if (*++p == 'h') {
+				length = TRACEF_LENGTH_CHAR;
+				p++;
+			} else {
+				length = TRACEF_LENGTH_SHORT;
+			}
+			break;
+		case 'l':
+			if (*++p == 'l') {
+				length = TRACEF_LENGTH_LONG_LONG;
+				p++;
+			} else {
+				length = TRACEF_LENGTH_LONG;
+			}
+			break;
+		case 'q':
+			length = TRACEF_LENGTH_LONG_LONG;
+			p++;
+			break;
+		case 'L':
+			length = TRACEF_LENGTH_LONG_DOUBLE;
+			p++;
+			break;
+		case 'j':
+			length = TRACEF_LENGTH_INTMAX;
+			p++;
+			break;
+		case 'z':
+		case 'Z':
+			length = TRACEF_LENGTH_SIZE;
+			p++;
+			break;
+		case 't':
+			length = TRACEF_LENGTH_PTRDIFF;
+			p++;
+			break;
+		}
+		/* Conversion */
+		switch (*p) {
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			switch (length) {
+			case TRACEF_LENGTH_LONG:
+				full = PACK_ARG(&args, aq, long);
+				break;
+			case TRACEF_LENGTH_LONG_LONG:
+			case TRACEF_LENGTH_LONG_DOUBLE:
+				full = PACK_ARG(&args, aq, long long);
+				break;
+			case TRACEF_LENGTH_INTMAX:
+				full = PACK_ARG(&args, aq, intmax_t);
+				break;
+			case TRACEF_LENGTH_SIZE:
+				full = PACK_ARG(&args, aq, size_t);
+				break;
+			case TRACEF_LENGTH_PTRDIFF:
+				full = PACK_ARG(&args, aq, ptrdiff_t);
+				break;
+			default:
+				full = PACK_ARG(&args, aq, int);
+				break;
+			}
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (length == TRACEF_LENGTH_LONG_DOUBLE)
+				full = PACK_ARG(&args, aq, long double);
+			else
+				full = PACK_ARG(&args, aq, double);
+			break;
+		case 'c':
+			if (length == TRACEF_LENGTH_LONG)
+				full = PACK_ARG(&args, aq, wint_t);
+			else
+				full = PACK_ARG(&args, aq, int);
+			break;
+		case 'C':
+			full = PACK_ARG(&args, aq, wint_t);
+			break;
+		case 's':
+			if (length == TRACEF_LENGTH_LONG)
+				full = pack_wide_string(&args,
+					va_arg(aq, const wchar_t *), prec);
+			else
+				full = pack_string(&args,
+					va_arg(aq, const char *), prec);
+			break;
+		case 'S':
+			full = pack_wide_string(&args,
+				va_arg(aq, const wchar_t *), prec);
+			break;
+		case 'p':
+			full = PACK_ARG(&args, aq, void *);
+			break;
+		case 'n':
+			(void) va_arg(aq, void *);
+			break;
+		case 'm':
+			full = pack(&args, &saved_errno, sizeof(saved_errno));
+			break;
+		case '\0':
+			goto end;
+		default:
+			goto unsupported;
+		}
+		if (full)
+			goto end;
+	}
+end:
+	ret = args.pos;
+	va_end(aq);
+	return ret;
+
+unsupported:
+	va_end(aq);
+	return -1;
+}
+
+void lttng_ust_tracef_binary(const char *fmt, va_list ap, void *ip)
+{
+	uint8_t args[LTTNG_UST_TRACEF_BINARY_ARGS_LEN];
+	ssize_t len;
+
+	if (caa_likely(!__tracepoint_lttng_ust_tracef_binary___event.state))
+		return;
+	len = lttng_ust_tracef_pack_args(args, sizeof(args), fmt, ap);
+	if (len < 0)
+		return;
+	__tracepoint_cb_lttng_ust_tracef_binary___event(fmt, args, len, ip);
+}
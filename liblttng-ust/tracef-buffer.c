@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/tls-compat.h>
+#include <ust_snprintf.h>
+#include <helper.h>
+#include <usterr-signal-safe.h>
+#include "lttng-tracer-core.h"
+#include "tracef-buffer.h"
+
+/*
+ * tracef() and tracelog() format their message in per-thread buffers,
+ * one per nesting level so a signal handler does not overwrite the
+ * message of the call it interrupted. The buffers of a thread are
+ * allocated by its first call, grow to fit the longest message
+ * formatted at their level, and are freed at thread exit.
+ */
+struct tracef_buf {
+	char *data;
+	size_t len;
+};
+
+struct tracef_bufs {
+	struct tracef_buf level[LTTNG_UST_TRACEF_NESTING];
+};
+
+static pthread_key_t tracef_bufs_key;
+static int tracef_bufs_key_ready;
+static DEFINE_URCU_TLS(struct tracef_bufs *, tracef_bufs);
+static DEFINE_URCU_TLS(int, tracef_nesting);
+
+/*
+ * ust_safe_vsnprintf() is async-signal-safe, but does not implement
+ * floating point, wide character and %m conversions, nor the glibc
+ * specific I flag and Z length modifier. It also formats some
+ * conversions differently from the C library: %p (0x0 rather than
+ * (nil) for NULL), the ' flag (no locale grouping) and the BSD %D, %O
+ * and %U conversions. Only use it for formats made of the conversions
+ * both format alike.
+ *
+ * The other formats are formatted by vsnprintf(), which is not
+ * async-signal-safe: tracef() and tracelog() calls using them must not
+ * be made from signal handlers.
+ */
+static
+int format_is_safe(const char *fmt)
+{
+	const char *p = fmt;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		p++;
+		p += strspn(p, "-+ #0123456789.*$hlqjzt");
+		if (*p == '\0' || !strchr("diouxXcsn%", *p))
+			return 0;
+		if ((*p == 'c' || *p == 's') && p[-1] == 'l')
+			return 0;
+		p++;
+	}
+	return 1;
+}
+
+static
+int format_msg(struct tracef_buf *buf, const char *fmt, va_list ap)
+{
+	va_list aq;
+	int ret;
+
+	va_copy(aq, ap);
+	if (format_is_safe(fmt))
+		ret = ust_safe_vsnprintf(buf->data, buf->len, fmt, aq);
+	else
+		ret = vsnprintf(buf->data, buf->len, fmt, aq);
+	va_end(aq);
+	return ret;
+}
+
+static
+void free_tracef_bufs(void *arg)
+{
+	struct tracef_bufs *bufs = arg;
+	int i;
+
+	URCU_TLS(tracef_bufs) = NULL;
+	for (i = 0; i < LTTNG_UST_TRACEF_NESTING; i++)
+		free(bufs->level[i].data);
+	free(bufs);
+}
+
+/*
+ * The buffers are allocated and grown with signals blocked, so a
+ * nested call from a signal handler does not enter malloc while it is
+ * running.
+ */
+static
+int block_signals(sigset_t *oldmask)
+{
+	sigset_t newmask;
+
+	if (sigfillset(&newmask))
+		return -1;
+	return pthread_sigmask(SIG_BLOCK, &newmask, oldmask) ? -1 : 0;
+}
+
+static
+void restore_signals(const sigset_t *oldmask)
+{
+	if (pthread_sigmask(SIG_SETMASK, oldmask, NULL))
+		abort();
+}
+
+static
+struct tracef_bufs *alloc_tracef_bufs(void)
+{
+	struct tracef_bufs *bufs;
+	sigset_t oldmask;
+	int i;
+
+	if (!CMM_LOAD_SHARED(tracef_bufs_key_ready))
+		return NULL;
+	if (block_signals(&oldmask))
+		return NULL;
+	/* Check again with signals blocked. */
+	bufs = URCU_TLS(tracef_bufs);
+	if (bufs)
+		goto end;
+	bufs = zmalloc(sizeof(*bufs));
+	if (!bufs)
+		goto end;
+	for (i = 0; i < LTTNG_UST_TRACEF_NESTING; i++) {
+		bufs->level[i].data = malloc(LTTNG_UST_TRACEF_BUF_LEN);
+		if (!bufs->level[i].data)
+			goto error;
+		bufs->level[i].len = LTTNG_UST_TRACEF_BUF_LEN;
+	}
+	if (pthread_setspecific(tracef_bufs_key, bufs))
+		goto error;
+	URCU_TLS(tracef_bufs) = bufs;
+end:
+	restore_signals(&oldmask);
+	return bufs;
+
+error:
+	free_tracef_bufs(bufs);
+	restore_signals(&oldmask);
+	return NULL;
+}
+
+static
+int grow_tracef_buf(struct tracef_buf *buf, size_t len)
+{
+	size_t new_len = buf->len;
+	sigset_t oldmask;
+	char *data;
+
+	while (new_len < len)
+		new_len <<= 1;
+	if (block_signals(&oldmask))
+		return -1;
+	data = realloc(buf->data, new_len);
+	if (data) {
+		buf->data = data;
+		buf->len = new_len;
+	}
+	restore_signals(&oldmask);
+	return data ? 0 : -1;
+}
+
+/*
+ * Format @fmt in a per-thread buffer, or allocate the message if it is
+ * too long to be kept around. Returns the message, and its length
+ * without the final '\0' in @len, or NULL on error. The message must be
+ * released with lttng_ust_tracef_put().
+ *
+ * Allocating or growing the buffers is not async-signal-safe: calls
+ * from signal handlers are only safe once the buffers of the thread fit
+ * their message.
+ */
+char *lttng_ust_tracef_format(int *len, const char *fmt, va_list ap)
+{
+	struct tracef_bufs *bufs;
+	struct tracef_buf *buf;
+	char *msg;
+	int nesting, ret;
+
+	nesting = URCU_TLS(tracef_nesting)++;
+	cmm_barrier();
+	if (caa_unlikely(nesting >= LTTNG_UST_TRACEF_NESTING))
+		goto alloc;
+	bufs = URCU_TLS(tracef_bufs);
+	if (caa_unlikely(!bufs)) {
+		bufs = alloc_tracef_bufs();
+		if (!bufs)
+			goto alloc;
+	}
+	buf = &bufs->level[nesting];
+	ret = format_msg(buf, fmt, ap);
+	if (caa_unlikely(ret < 0))
+		goto error;
+	if (caa_unlikely((size_t) ret >= buf->len)) {
+		if (ret >= LTTNG_UST_TRACEF_BUF_MAX_LEN
+				|| grow_tracef_buf(buf, ret + 1))
+			goto alloc;
+		ret = format_msg(buf, fmt, ap);
+		if (caa_unlikely(ret < 0))
+			goto error;
+		if (caa_unlikely((size_t) ret >= buf->len))
+			goto alloc;
+	}
+	*len = ret;
+	return buf->data;
+
+alloc:
+	/* Message too long, out of memory, or too many nested calls. */
+	ret = vasprintf(&msg, fmt, ap);
+	if (ret < 0)
+		goto error;
+	*len = ret;
+	return msg;
+
+error:
+	cmm_barrier();
+	URCU_TLS(tracef_nesting)--;
+	return NULL;
+}
+
+void lttng_ust_tracef_put(char *msg)
+{
+	struct tracef_bufs *bufs = URCU_TLS(tracef_bufs);
+	int nesting = URCU_TLS(tracef_nesting) - 1;
+
+	if (caa_unlikely(nesting >= LTTNG_UST_TRACEF_NESTING || !bufs
+			|| msg != bufs->level[nesting].data))
+		free(msg);
+	cmm_barrier();
+	URCU_TLS(tracef_nesting)--;
+}
+
+void lttng_tracef_buffer_init(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&tracef_bufs_key, free_tracef_bufs);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_key_create");
+		return;
+	}
+	CMM_STORE_SHARED(tracef_bufs_key_ready, 1);
+}
+
+void lttng_tracef_buffer_exit(void)
+{
+	int ret;
+
+	if (!tracef_bufs_key_ready)
+		return;
+	CMM_STORE_SHARED(tracef_bufs_key_ready, 0);
+	ret = pthread_key_delete(tracef_bufs_key);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_key_delete");
+	}
+}
+
+/*
+ * Force a read (imply TLS fixup for dlopen) of TLS variables.
+ */
+void lttng_fixup_tracef_tls(void)
+{
+	asm volatile ("" : : "m" (URCU_TLS(tracef_bufs)));
+	asm volatile ("" : : "m" (URCU_TLS(tracef_nesting)));
+}
@@ -0,0 +1,41 @@
+#ifndef _LTTNG_UST_TRACEF_BUFFER_H
+#define _LTTNG_UST_TRACEF_BUFFER_H
+
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdarg.h>
+
+/*
+ * Number of nested tracef() or tracelog() calls (e.g. from signal
+ * handlers) formatting their message in per-thread buffers, initial
+ * size of those buffers, and longest message kept in them. Longer
+ * messages, and messages of deeper nested calls, are allocated.
+ */
+#define LTTNG_UST_TRACEF_NESTING	4
+#define LTTNG_UST_TRACEF_BUF_LEN	512
+#define LTTNG_UST_TRACEF_BUF_MAX_LEN	65536
+
+char *lttng_ust_tracef_format(int *len, const char *fmt, va_list ap);
+void lttng_ust_tracef_put(char *msg);
+
+#endif /* _LTTNG_UST_TRACEF_BUFFER_H */
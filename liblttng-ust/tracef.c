@@ -28,6 +28,8 @@
 #define TRACEPOINT_CREATE_PROBES
 #define TRACEPOINT_DEFINE
 #include "lttng-ust-tracef-provider.h"
+#include "tracef-binary.h"
+#include "tracef-buffer.h"
 
 void _lttng_ust_tracef(const char *fmt, ...)
 {
@@ -36,13 +38,16 @@ void _lttng_ust_tracef(const char *fmt, ...)
 	int len;
 
 	va_start(ap, fmt);
-	len = vasprintf(&msg, fmt, ap);
+	lttng_ust_tracef_binary(fmt, ap, LTTNG_UST_CALLER_IP());
+	if (caa_likely(!__tracepoint_lttng_ust_tracef___event.state))
+		goto end;
+	msg = lttng_ust_tracef_format(&len, fmt, ap);
 	/* len does not include the final \0 */
-	if (len < 0)
+	if (!msg)
 		goto end;
 	__tracepoint_cb_lttng_ust_tracef___event(msg, len,
 		LTTNG_UST_CALLER_IP());
-	free(msg);
+	lttng_ust_tracef_put(msg);
 end:
 	va_end(ap);
 }
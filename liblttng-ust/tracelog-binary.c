@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include <stdio.h>
+
+#define TRACEPOINT_CREATE_PROBES
+#define TRACEPOINT_DEFINE
+#include "lttng-ust-tracelog-binary-provider.h"
+#include "tracef-binary.h"
+
+#define TRACELOG_BINARY_CB(level) \
+	void lttng_ust_tracelog_binary_##level(const char *file, \
+			int line, const char *func, const char *fmt, \
+			va_list ap, void *ip) \
+	{ \
+		uint8_t args[LTTNG_UST_TRACEF_BINARY_ARGS_LEN]; \
+		ssize_t len; \
+		\
+		if (caa_likely(!__tracepoint_lttng_ust_tracelog_binary___##level.state)) \
+			return; \
+		len = lttng_ust_tracef_pack_args(args, sizeof(args), \
+			fmt, ap); \
+		if (len < 0) \
+			return; \
+		__tracepoint_cb_lttng_ust_tracelog_binary___##level(file, \
+			line, func, fmt, args, len, ip); \
+	}
+
+TRACELOG_BINARY_CB(TRACE_EMERG)
+TRACELOG_BINARY_CB(TRACE_ALERT)
+TRACELOG_BINARY_CB(TRACE_CRIT)
+TRACELOG_BINARY_CB(TRACE_ERR)
+TRACELOG_BINARY_CB(TRACE_WARNING)
+TRACELOG_BINARY_CB(TRACE_NOTICE)
+TRACELOG_BINARY_CB(TRACE_INFO)
+TRACELOG_BINARY_CB(TRACE_DEBUG_SYSTEM)
+TRACELOG_BINARY_CB(TRACE_DEBUG_PROGRAM)
+TRACELOG_BINARY_CB(TRACE_DEBUG_PROCESS)
+TRACELOG_BINARY_CB(TRACE_DEBUG_MODULE)
+TRACELOG_BINARY_CB(TRACE_DEBUG_UNIT)
+TRACELOG_BINARY_CB(TRACE_DEBUG_FUNCTION)
+TRACELOG_BINARY_CB(TRACE_DEBUG_LINE)
+TRACELOG_BINARY_CB(TRACE_DEBUG)
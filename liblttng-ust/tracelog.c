@@ -28,6 +28,8 @@
 #define TRACEPOINT_CREATE_PROBES
 #define TRACEPOINT_DEFINE
 #include "lttng-ust-tracelog-provider.h"
+#include "tracef-binary.h"
+#include "tracef-buffer.h"
 
 #define TRACELOG_CB(level) \
 	void _lttng_ust_tracelog_##level(const char *file, \
@@ -39,14 +41,18 @@
 		int len; \
 		\
 		va_start(ap, fmt); \
-		len = vasprintf(&msg, fmt, ap); \
+		lttng_ust_tracelog_binary_##level(file, line, func, \
+			fmt, ap, LTTNG_UST_CALLER_IP()); \
+		if (caa_likely(!__tracepoint_lttng_ust_tracelog___##level.state)) \
+			goto end; \
+		msg = lttng_ust_tracef_format(&len, fmt, ap); \
 		/* len does not include the final \0 */ \
-		if (len < 0) \
+		if (!msg) \
 			goto end; \
 		__tracepoint_cb_lttng_ust_tracelog___##level(file, \
 			line, func, msg, len, \
 			LTTNG_UST_CALLER_IP()); \
-		free(msg); \
+		lttng_ust_tracef_put(msg); \
 	end: \
 		va_end(ap); \
 	}
@@ -25,11 +25,23 @@
 
 #define TRACE_DEFAULT	TRACE_DEBUG_LINE
 
+/* Static branch call site of a registered library. */
+struct tracepoint_branch {
+	unsigned long site;
+	struct lttng_ust_tracepoint *tracepoint;
+	/* Next call site to patch at the end of the update. */
+	struct tracepoint_branch *next_pending;
+	int pending;
+};
+
 struct tracepoint_lib {
 	struct cds_list_head list;	/* list of registered libs */
 	struct lttng_ust_tracepoint * const *tracepoints_start;
 	int tracepoints_count;
 	struct cds_list_head callsites;
+	/* Static branch call sites, sorted by tracepoint address. */
+	struct tracepoint_branch *branches;
+	int branches_count;
 };
 
 extern int tracepoint_probe_register_noupdate(const char *name,
@@ -20,14 +20,20 @@
  */
 
 #define _LGPL_SOURCE
+#include <assert.h>
 #include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <urcu/arch.h>
 #include <urcu-bp.h>
-#include <urcu/hlist.h>
+#include <urcu/rculfhash.h>
 #include <urcu/uatomic.h>
 #include <urcu/compiler.h>
 #include <urcu/system.h>
@@ -74,6 +80,17 @@ static pthread_mutex_t tracepoint_mutex = PTHREAD_MUTEX_INITIALIZER;
  */
 static CDS_LIST_HEAD(libs);
 
+/*
+ * Libraries registered while no probe is connected to any tracepoint.
+ * Their callsites cannot be enabled yet, so their registration is
+ * deferred until the first probe is registered (typically when the
+ * first session is enabled), and then performed in a single pass.
+ * Only ever non-empty while the tracepoint hash table is empty.
+ * Protected by tracepoint mutex.
+ */
+static CDS_LIST_HEAD(pending_libs);
+static unsigned long nr_pending_callsites;
+
 /*
  * The tracepoint mutex protects the library tracepoints, the hash table, and
  * the library list.
@@ -83,12 +100,29 @@ static CDS_LIST_HEAD(libs);
  */
 
 /*
- * Tracepoint hash table, containing the active tracepoints.
- * Protected by tracepoint mutex.
+ * Initial and minimum number of buckets of the tracepoint and callsite
+ * hash tables. They are grown as tracepoints and callsites are added.
+ * Populating 8192 buckets or more at once makes the resize spawn worker
+ * threads, which must not happen from library constructors with the
+ * tracepoint mutex held: libraries registered from their constructors
+ * grow the callsite hash table up to TRACEPOINT_HT_CTOR_MAX_SIZE only.
+ * The rest of the growth is done when a probe is registered, from the
+ * thread enabling events, along with the deferred library registration.
+ */
+#define TRACEPOINT_HT_MIN_SIZE		256
+#define TRACEPOINT_HT_CTOR_MAX_SIZE	4096
+
+/*
+ * Tracepoint hash table, containing the active tracepoints, keyed by
+ * the hash of the tracepoint name.
+ *
+ * Protected by tracepoint mutex. Lookups, updates and resizes are all
+ * serialized by the tracepoint mutex, so the table is never
+ * concurrently resized. Therefore, we can use it without holding RCU
+ * read-side lock and free nodes without using call_rcu.
  */
-#define TRACEPOINT_HASH_BITS 12
-#define TRACEPOINT_TABLE_SIZE (1 << TRACEPOINT_HASH_BITS)
-static struct cds_hlist_head tracepoint_table[TRACEPOINT_TABLE_SIZE];
+static struct cds_lfht *tracepoint_ht;
+static unsigned long tracepoint_ht_size, nr_tracepoint_entries;
 
 static CDS_LIST_HEAD(old_probes);
 static int need_update;
@@ -103,7 +137,7 @@ static int release_queue_need_update;
  * Tracepoint entries modifications are protected by the tracepoint mutex.
  */
 struct tracepoint_entry {
-	struct cds_hlist_node hlist;
+	struct cds_lfht_node node;	/* hash table node */
 	struct lttng_ust_tracepoint_probe *probes;
 	int refcount;	/* Number of times armed. 0 if disarmed. */
 	int callsite_refcount;	/* how many libs use this tracepoint */
@@ -121,19 +155,86 @@ struct tp_probes {
 };
 
 /*
- * Callsite hash table, containing the tracepoint call sites.
- * Protected by tracepoint mutex.
+ * Callsite hash table, containing the tracepoint call sites, keyed by
+ * the hash of the tracepoint name. Many callsites can share the same
+ * name. Same locking rules as the tracepoint hash table.
  */
-#define CALLSITE_HASH_BITS 12
-#define CALLSITE_TABLE_SIZE (1 << CALLSITE_HASH_BITS)
-static struct cds_hlist_head callsite_table[CALLSITE_TABLE_SIZE];
+static struct cds_lfht *callsite_ht;
+static unsigned long callsite_ht_size, nr_callsite_entries;
 
 struct callsite_entry {
-	struct cds_hlist_node hlist;	/* hash table node */
-	struct cds_list_head node;	/* lib list of callsites node */
+	struct cds_lfht_node node;	/* hash table node */
+	struct cds_list_head lib_node;	/* lib list of callsites node */
 	struct lttng_ust_tracepoint *tp;
+	struct tracepoint_lib *lib;
 };
 
+static uint32_t tracepoint_name_hash(const char *name)
+{
+	size_t name_len = strlen(name);
+
+	if (name_len > LTTNG_UST_SYM_NAME_LEN - 1) {
+		WARN("Truncating tracepoint name %s which exceeds size limits of %u chars", name, LTTNG_UST_SYM_NAME_LEN - 1);
+		name_len = LTTNG_UST_SYM_NAME_LEN - 1;
+	}
+	return jhash(name, name_len, 0);
+}
+
+static int tracepoint_ht_match(struct cds_lfht_node *node, const void *key)
+{
+	struct tracepoint_entry *e =
+		caa_container_of(node, struct tracepoint_entry, node);
+
+	return !strncmp(key, e->name, LTTNG_UST_SYM_NAME_LEN - 1);
+}
+
+static int callsite_ht_match(struct cds_lfht_node *node, const void *key)
+{
+	struct callsite_entry *e =
+		caa_container_of(node, struct callsite_entry, node);
+
+	return !strncmp(key, e->tp->name, LTTNG_UST_SYM_NAME_LEN - 1);
+}
+
+/*
+ * Create the hash table on first use: tracepoint_register_lib() can be
+ * called from library constructors before anything else is set up.
+ * Must be called with tracepoint mutex held.
+ */
+static struct cds_lfht *ht_get(struct cds_lfht **ht, unsigned long *size)
+{
+	if (!*ht) {
+		*ht = cds_lfht_new(TRACEPOINT_HT_MIN_SIZE,
+				TRACEPOINT_HT_MIN_SIZE, 0, 0, NULL);
+		if (!*ht)
+			return NULL;
+		*size = TRACEPOINT_HT_MIN_SIZE;
+	}
+	return *ht;
+}
+
+/*
+ * Grow the hash table so it keeps at most one node per bucket on
+ * average for @count nodes, within @max_size buckets (0 for no limit).
+ * The table does not auto-resize: cds_lfht_resize() resizes it
+ * synchronously in the caller, so resizes are serialized by the
+ * tracepoint mutex. Must be called with tracepoint mutex held.
+ */
+static void ht_reserve(struct cds_lfht *ht, unsigned long *size,
+		unsigned long count, unsigned long max_size)
+{
+	unsigned long new_size = *size;
+
+	while (new_size < count && (!max_size || new_size < max_size))
+		new_size <<= 1;
+	if (new_size == *size)
+		return;
+	DBG("Resizing tracepoint hash table from %lu to %lu buckets",
+		*size, new_size);
+	cds_lfht_resize(ht, new_size);
+	*size = new_size;
+}
+
 /* coverity[+alloc] */
 static void *allocate_probes(int count)
 {
@@ -254,23 +355,17 @@ tracepoint_entry_remove_probe(struct tracepoint_entry *entry,
  */
 static struct tracepoint_entry *get_tracepoint(const char *name)
 {
-	struct cds_hlist_head *head;
-	struct cds_hlist_node *node;
-	struct tracepoint_entry *e;
-	size_t name_len = strlen(name);
-	uint32_t hash;
-
-	if (name_len > LTTNG_UST_SYM_NAME_LEN - 1) {
-		WARN("Truncating tracepoint name %s which exceeds size limits of %u chars", name, LTTNG_UST_SYM_NAME_LEN - 1);
-		name_len = LTTNG_UST_SYM_NAME_LEN - 1;
-	}
-	hash = jhash(name, name_len, 0);
-	head = &tracepoint_table[hash & (TRACEPOINT_TABLE_SIZE - 1)];
-	cds_hlist_for_each_entry(e, node, head, hlist) {
-		if (!strncmp(name, e->name, LTTNG_UST_SYM_NAME_LEN - 1))
-			return e;
-	}
-	return NULL;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	if (!tracepoint_ht)
+		return NULL;
+	cds_lfht_lookup(tracepoint_ht, tracepoint_name_hash(name),
+			tracepoint_ht_match, name, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (!node)
+		return NULL;
+	return caa_container_of(node, struct tracepoint_entry, node);
 }
 
 /*
@@ -280,24 +375,16 @@ static struct tracepoint_entry *get_tracepoint(const char *name)
 static struct tracepoint_entry *add_tracepoint(const char *name,
 		const char *signature)
 {
-	struct cds_hlist_head *head;
-	struct cds_hlist_node *node;
+	struct cds_lfht *ht;
+	struct cds_lfht_node *node;
 	struct tracepoint_entry *e;
 	size_t name_len = strlen(name);
-	uint32_t hash;
 
-	if (name_len > LTTNG_UST_SYM_NAME_LEN - 1) {
-		WARN("Truncating tracepoint name %s which exceeds size limits of %u chars", name, LTTNG_UST_SYM_NAME_LEN - 1);
+	if (name_len > LTTNG_UST_SYM_NAME_LEN - 1)
 		name_len = LTTNG_UST_SYM_NAME_LEN - 1;
-	}
-	hash = jhash(name, name_len, 0);
-	head = &tracepoint_table[hash & (TRACEPOINT_TABLE_SIZE - 1)];
-	cds_hlist_for_each_entry(e, node, head, hlist) {
-		if (!strncmp(name, e->name, LTTNG_UST_SYM_NAME_LEN - 1)) {
-			DBG("tracepoint %s busy", name);
-			return ERR_PTR(-EEXIST);	/* Already there */
-		}
-	}
+	ht = ht_get(&tracepoint_ht, &tracepoint_ht_size);
+	if (!ht)
+		return ERR_PTR(-ENOMEM);
 	/*
 	 * Using zmalloc here to allocate a variable length element. Could
 	 * cause some memory fragmentation if overused.
@@ -311,7 +398,14 @@ static struct tracepoint_entry *add_tracepoint(const char *name,
 	e->refcount = 0;
 	e->callsite_refcount = 0;
 	e->signature = signature;
-	cds_hlist_add_head(&e->hlist, head);
+	node = cds_lfht_add_unique(ht, tracepoint_name_hash(name),
+			tracepoint_ht_match, e->name, &e->node);
+	if (node != &e->node) {
+		DBG("tracepoint %s busy", name);
+		free(e);
+		return ERR_PTR(-EEXIST);	/* Already there */
+	}
+	ht_reserve(ht, &tracepoint_ht_size, ++nr_tracepoint_entries, 0);
 	return e;
 }
 
@@ -321,14 +415,298 @@ static struct tracepoint_entry *add_tracepoint(const char *name,
  */
 static void remove_tracepoint(struct tracepoint_entry *e)
 {
-	cds_hlist_del(&e->hlist);
+	int ret;
+
+	ret = cds_lfht_del(tracepoint_ht, &e->node);
+	assert(!ret);
+	nr_tracepoint_entries--;
 	free(e);
 }
 
+#ifdef __x86_64__
+
+#define BRANCH_INSN_DISABLED	0x3d	/* cmp $imm32, %eax */
+#define BRANCH_INSN_ENABLED	0xe9	/* jmp rel32 */
+
+#ifndef MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE
+#define MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE		(1 << 5)
+#define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE	(1 << 6)
+#endif
+
+/*
+ * Whether call sites can be patched. 0: unknown, 1: available, -1: not
+ * available, call sites are left in their jmp form, which checks the
+ * tracepoint state.
+ */
+static int branch_patch_state;
+static long branch_page_size;
+
+/*
+ * Call sites whose tracepoint state changed during the current update.
+ * They are all patched at once by branch_patch_commit() before the
+ * tracepoint mutex is released.
+ */
+static struct tracepoint_branch *branch_pending;
+
+/*
+ * Serialize the instruction stream of all the threads of the process,
+ * so none of them keeps executing a stale version of a call site.
+ */
+static int branch_sync_core(void)
+{
+#ifdef __NR_membarrier
+	if (syscall(__NR_membarrier,
+			MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0))
+		return -errno;
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/*
+ * Call sites are only patched if the kernel can serialize the
+ * instruction stream of the other threads. Otherwise they are left in
+ * their jmp form. Must be called with tracepoint mutex held.
+ */
+static int branch_patch_available(void)
+{
+	if (!branch_patch_state) {
+		branch_patch_state = -1;
+		branch_page_size = sysconf(_SC_PAGE_SIZE);
+#ifdef __NR_membarrier
+		if (branch_page_size > 0
+				&& !syscall(__NR_membarrier,
+					MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0))
+			branch_patch_state = 1;
+#endif
+		if (branch_patch_state < 0)
+			DBG("Core serializing membarrier unavailable: tracepoint call sites check the tracepoint state");
+	}
+	return branch_patch_state > 0;
+}
+
+/*
+ * Restore the protection of the text page made writable by
+ * branch_write(), if any.
+ */
+static void branch_page_release(unsigned long *page)
+{
+	if (!*page)
+		return;
+	if (mprotect((void *) *page, branch_page_size, PROT_READ | PROT_EXEC))
+		ERR("Unable to restore protection of tracepoint call sites at %p: %s",
+			(void *) *page, strerror(errno));
+	*page = 0;
+}
+
+/*
+ * Write the first byte of a call site. Its text page is made writable
+ * and kept so in @page until branch_page_release() or the write of a
+ * call site in another page, since call sites tend to be grouped.
+ */
+static int branch_write(unsigned long *page, unsigned long site,
+		unsigned char insn)
+{
+	unsigned long site_page;
+	int ret;
+
+	site_page = site & ~((unsigned long) branch_page_size - 1);
+	if (*page != site_page) {
+		branch_page_release(page);
+		if (mprotect((void *) site_page, branch_page_size,
+				PROT_READ | PROT_WRITE | PROT_EXEC)) {
+			ret = -errno;
+			ERR("Unable to make tracepoint call site %p writable: %s",
+				(void *) site, strerror(-ret));
+			return ret;
+		}
+		*page = site_page;
+	}
+	CMM_STORE_SHARED(*(unsigned char *) site, insn);
+	return 0;
+}
+
+/*
+ * Stop patching call sites, and put those in the disabled form back in
+ * the jmp form, which stays correct whatever the tracepoint state. Must
+ * be called with tracepoint mutex held.
+ */
+static void branch_patch_disable(void)
+{
+	struct tracepoint_lib *lib;
+	unsigned long page = 0;
+	int i;
+
+	branch_patch_state = -1;
+	cds_list_for_each_entry(lib, &libs, list) {
+		for (i = 0; i < lib->branches_count; i++) {
+			unsigned long site = lib->branches[i].site;
+
+			if (*(unsigned char *) site == BRANCH_INSN_DISABLED)
+				(void) branch_write(&page, site,
+					BRANCH_INSN_ENABLED);
+		}
+	}
+	branch_page_release(&page);
+	(void) branch_sync_core();
+	ERR("Tracepoint call sites are no longer patched, they check the tracepoint state");
+}
+
+/*
+ * Patch the call sites queued during the current update to match the
+ * state of their tracepoint. Must be called with tracepoint mutex held,
+ * after updating the tracepoints and before releasing the mutex.
+ *
+ * The disabled and enabled forms share their 32-bit operand, so only
+ * the first byte of a call site is ever written. As for the first step
+ * of the kernel text_poke_bp(), which writes an int3 the same way, a
+ * single byte store is observed atomically by the instruction fetch of
+ * other threads: a thread executing the call site concurrently runs
+ * either the old or the new instruction, and both are harmless. A
+ * thread still running the disabled form right after enabling skips an
+ * event, and one running the enabled form right after disabling checks
+ * the tracepoint state. A single core serializing membarrier then makes
+ * sure no thread keeps running a stale form of any of the call sites
+ * once the update returns.
+ */
+static void branch_patch_commit(void)
+{
+	struct tracepoint_branch *b, *next;
+	unsigned long page = 0;
+	int ret = 0, modified = 0;
+
+	for (b = branch_pending; b; b = next) {
+		unsigned char *insn = (unsigned char *) b->site;
+		unsigned char new_insn;
+
+		next = b->next_pending;
+		b->next_pending = NULL;
+		b->pending = 0;
+		if (ret)
+			continue;
+		new_insn = CMM_LOAD_SHARED(b->tracepoint->state) ?
+			BRANCH_INSN_ENABLED : BRANCH_INSN_DISABLED;
+		if (*insn == new_insn)
+			continue;
+		if (*insn != BRANCH_INSN_ENABLED
+				&& *insn != BRANCH_INSN_DISABLED) {
+			/* E.g. a breakpoint inserted by a debugger. */
+			ERR("Unexpected instruction 0x%x at tracepoint call site %p",
+				*insn, insn);
+			ret = -EINVAL;
+			continue;
+		}
+		ret = branch_write(&page, b->site, new_insn);
+		if (!ret)
+			modified = 1;
+	}
+	branch_pending = NULL;
+	branch_page_release(&page);
+	if (modified && !ret) {
+		ret = branch_sync_core();
+		if (ret)
+			ERR("Unable to serialize tracepoint call sites: %s",
+				strerror(-ret));
+	}
+	if (ret)
+		branch_patch_disable();
+}
+
+static int branch_cmp(const void *a, const void *b)
+{
+	const struct tracepoint_branch *ba = a, *bb = b;
+
+	if (ba->tracepoint < bb->tracepoint)
+		return -1;
+	if (ba->tracepoint > bb->tracepoint)
+		return 1;
+	return 0;
+}
+
+/*
+ * Queue the static branch call sites of a tracepoint within @lib, so
+ * branch_patch_commit() makes them match its state. Must be called with
+ * tracepoint mutex held.
+ */
+static void lib_update_branches(struct tracepoint_lib *lib,
+		struct lttng_ust_tracepoint *elem)
+{
+	int low = 0, high = lib->branches_count, i;
+
+	if (!lib->branches_count || !branch_patch_available())
+		return;
+	/* Find the first branch of elem. */
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+
+		if (lib->branches[mid].tracepoint < elem)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	for (i = low; i < lib->branches_count
+			&& lib->branches[i].tracepoint == elem; i++) {
+		struct tracepoint_branch *b = &lib->branches[i];
+
+		if (b->pending)
+			continue;
+		b->pending = 1;
+		b->next_pending = branch_pending;
+		branch_pending = b;
+	}
+}
+
+/*
+ * Keep a copy of the static branch table of a library, sorted by
+ * tracepoint address. Call sites are initially in the jmp form.
+ */
+static int lib_init_branches(struct tracepoint_lib *lib,
+		struct lttng_ust_tracepoint_branch *branches_start,
+		int branches_count)
+{
+	int i;
+
+	if (!branches_count)
+		return 0;
+	lib->branches = zmalloc(branches_count * sizeof(*lib->branches));
+	if (!lib->branches)
+		return -ENOMEM;
+	for (i = 0; i < branches_count; i++) {
+		lib->branches[i].site = branches_start[i].site;
+		lib->branches[i].tracepoint = branches_start[i].tracepoint;
+	}
+	qsort(lib->branches, branches_count, sizeof(*lib->branches),
+		branch_cmp);
+	lib->branches_count = branches_count;
+	return 0;
+}
+
+#else /* __x86_64__ */
+
+static void branch_patch_commit(void)
+{
+}
+
+static void lib_update_branches(struct tracepoint_lib *lib,
+		struct lttng_ust_tracepoint *elem)
+{
+}
+
+static int lib_init_branches(struct tracepoint_lib *lib,
+		struct lttng_ust_tracepoint_branch *branches_start,
+		int branches_count)
+{
+	return 0;
+}
+
+#endif /* __x86_64__ */
+
 /*
  * Sets the probe callback corresponding to one tracepoint.
  */
-static void set_tracepoint(struct tracepoint_entry **entry,
+static void set_tracepoint(struct tracepoint_lib *lib,
+	struct tracepoint_entry **entry,
 	struct lttng_ust_tracepoint *elem, int active)
 {
 	WARN_ON(strncmp((*entry)->name, elem->name, LTTNG_UST_SYM_NAME_LEN - 1) != 0);
@@ -359,6 +737,7 @@ static void set_tracepoint(struct tracepoint_entry **entry,
 	 */
 	rcu_assign_pointer(elem->probes, (*entry)->probes);
 	CMM_STORE_SHARED(elem->state, active);
+	lib_update_branches(lib, elem);
 }
 
 /*
@@ -367,9 +746,11 @@ static void set_tracepoint(struct tracepoint_entry **entry,
  * function insures that the original callback is not used anymore. This insured
  * by preempt_disable around the call site.
  */
-static void disable_tracepoint(struct lttng_ust_tracepoint *elem)
+static void disable_tracepoint(struct tracepoint_lib *lib,
+		struct lttng_ust_tracepoint *elem)
 {
 	CMM_STORE_SHARED(elem->state, 0);
+	lib_update_branches(lib, elem);
 	rcu_assign_pointer(elem->probes, NULL);
 }
 
@@ -379,27 +760,26 @@ static void disable_tracepoint(struct lttng_ust_tracepoint *elem)
  */
 static void add_callsite(struct tracepoint_lib * lib, struct lttng_ust_tracepoint *tp)
 {
-	struct cds_hlist_head *head;
+	struct cds_lfht *ht;
 	struct callsite_entry *e;
 	const char *name = tp->name;
-	size_t name_len = strlen(name);
-	uint32_t hash;
 	struct tracepoint_entry *tp_entry;
 
-	if (name_len > LTTNG_UST_SYM_NAME_LEN - 1) {
-		WARN("Truncating tracepoint name %s which exceeds size limits of %u chars", name, LTTNG_UST_SYM_NAME_LEN - 1);
-		name_len = LTTNG_UST_SYM_NAME_LEN - 1;
+	ht = ht_get(&callsite_ht, &callsite_ht_size);
+	if (!ht) {
+		ERR("Unable to allocate callsite hash table");
+		return;
 	}
-	hash = jhash(name, name_len, 0);
-	head = &callsite_table[hash & (CALLSITE_TABLE_SIZE - 1)];
 	e = zmalloc(sizeof(struct callsite_entry));
 	if (!e) {
 		PERROR("Unable to add callsite for tracepoint \"%s\"", name);
 		return;
 	}
-	cds_hlist_add_head(&e->hlist, head);
 	e->tp = tp;
-	cds_list_add(&e->node, &lib->callsites);
+	e->lib = lib;
+	cds_lfht_add(ht, tracepoint_name_hash(name), &e->node);
+	nr_callsite_entries++;
+	cds_list_add(&e->lib_node, &lib->callsites);
 
 	tp_entry = get_tracepoint(name);
 	if (!tp_entry)
@@ -414,15 +794,18 @@ static void add_callsite(struct tracepoint_lib * lib, struct lttng_ust_tracepoin
 static void remove_callsite(struct callsite_entry *e)
 {
 	struct tracepoint_entry *tp_entry;
+	int ret;
 
 	tp_entry = get_tracepoint(e->tp->name);
 	if (tp_entry) {
 		tp_entry->callsite_refcount--;
 		if (tp_entry->callsite_refcount == 0)
-			disable_tracepoint(e->tp);
+			disable_tracepoint(e->lib, e->tp);
 	}
-	cds_hlist_del(&e->hlist);
-	cds_list_del(&e->node);
+	ret = cds_lfht_del(callsite_ht, &e->node);
+	assert(!ret);
+	nr_callsite_entries--;
+	cds_list_del(&e->lib_node);
 	free(e);
 }
 
@@ -433,43 +816,38 @@ static void remove_callsite(struct callsite_entry *e)
  */
 static void tracepoint_sync_callsites(const char *name)
 {
-	struct cds_hlist_head *head;
-	struct cds_hlist_node *node;
+	struct cds_lfht_iter iter;
 	struct callsite_entry *e;
-	size_t name_len = strlen(name);
-	uint32_t hash;
 	struct tracepoint_entry *tp_entry;
 
+	if (!callsite_ht)
+		return;
 	tp_entry = get_tracepoint(name);
-	if (name_len > LTTNG_UST_SYM_NAME_LEN - 1) {
-		WARN("Truncating tracepoint name %s which exceeds size limits of %u chars", name, LTTNG_UST_SYM_NAME_LEN - 1);
-		name_len = LTTNG_UST_SYM_NAME_LEN - 1;
-	}
-	hash = jhash(name, name_len, 0);
-	head = &callsite_table[hash & (CALLSITE_TABLE_SIZE - 1)];
-	cds_hlist_for_each_entry(e, node, head, hlist) {
+	cds_lfht_for_each_entry_duplicate(callsite_ht,
+			tracepoint_name_hash(name), callsite_ht_match,
+			name, &iter, e, node) {
 		struct lttng_ust_tracepoint *tp = e->tp;
 
-		if (strncmp(name, tp->name, LTTNG_UST_SYM_NAME_LEN - 1))
-			continue;
 		if (tp_entry) {
-			set_tracepoint(&tp_entry, tp,
+			set_tracepoint(e->lib, &tp_entry, tp,
 					!!tp_entry->refcount);
 		} else {
-			disable_tracepoint(tp);
+			disable_tracepoint(e->lib, tp);
 		}
 	}
 }
 
 /**
  * tracepoint_update_probe_range - Update a probe range
+ * @lib: library containing the range
  * @begin: beginning of the range
  * @end: end of the range
  *
  * Updates the probe callback corresponding to a range of tracepoints.
  */
 static
-void tracepoint_update_probe_range(struct lttng_ust_tracepoint * const *begin,
+void tracepoint_update_probe_range(struct tracepoint_lib *lib,
+				   struct lttng_ust_tracepoint * const *begin,
 				   struct lttng_ust_tracepoint * const *end)
 {
 	struct lttng_ust_tracepoint * const *iter;
@@ -479,22 +857,22 @@ void tracepoint_update_probe_range(struct lttng_ust_tracepoint * const *begin,
 		if (!*iter)
 			continue;	/* skip dummy */
 		if (!(*iter)->name) {
-			disable_tracepoint(*iter);
+			disable_tracepoint(lib, *iter);
 			continue;
 		}
 		mark_entry = get_tracepoint((*iter)->name);
 		if (mark_entry) {
-			set_tracepoint(&mark_entry, *iter,
+			set_tracepoint(lib, &mark_entry, *iter,
 					!!mark_entry->refcount);
 		} else {
-			disable_tracepoint(*iter);
+			disable_tracepoint(lib, *iter);
 		}
 	}
 }
 
 static void lib_update_tracepoints(struct tracepoint_lib *lib)
 {
-	tracepoint_update_probe_range(lib->tracepoints_start,
+	tracepoint_update_probe_range(lib, lib->tracepoints_start,
 			lib->tracepoints_start + lib->tracepoints_count);
 }
 
@@ -521,10 +899,62 @@ static void lib_unregister_callsites(struct tracepoint_lib *lib)
 {
 	struct callsite_entry *callsite, *tmp;
 
-	cds_list_for_each_entry_safe(callsite, tmp, &lib->callsites, node)
+	cds_list_for_each_entry_safe(callsite, tmp, &lib->callsites, lib_node)
 		remove_callsite(callsite);
 }
 
+/*
+ * Insert the library in the library list, register its callsites and
+ * connect them to their probes. Must be called with tracepoint mutex
+ * held.
+ */
+static void lib_add(struct tracepoint_lib *pl)
+{
+	struct tracepoint_lib *iter;
+
+	/*
+	 * We sort the libs by struct lib pointer address.
+	 */
+	cds_list_for_each_entry_reverse(iter, &libs, list) {
+		BUG_ON(iter == pl);    /* Should never be in the list twice */
+		if (iter < pl) {
+			/* We belong to the location right after iter. */
+			cds_list_add(&pl->list, &iter->list);
+			goto lib_added;
+		}
+	}
+	/* We should be added at the head of the list */
+	cds_list_add(&pl->list, &libs);
+lib_added:
+	lib_register_callsites(pl);
+	lib_update_tracepoints(pl);
+}
+
+/*
+ * Complete the registration of all deferred libraries. The callsite
+ * hash table is sized once for all of them, and for the callsites of
+ * libraries registered past TRACEPOINT_HT_CTOR_MAX_SIZE from their
+ * constructors. Called on probe registration, which happens when events
+ * are enabled, usually from the lttng-ust listener thread, so the table
+ * size is not limited here. Must be called with tracepoint mutex held.
+ */
+static void lib_register_pending(void)
+{
+	struct tracepoint_lib *pl, *tmp;
+
+	if (ht_get(&callsite_ht, &callsite_ht_size))
+		ht_reserve(callsite_ht, &callsite_ht_size,
+			nr_callsite_entries + nr_pending_callsites, 0);
+	if (cds_list_empty(&pending_libs))
+		return;
+	DBG("registering callsites of deferred tracepoint libraries");
+	cds_list_for_each_entry_safe(pl, tmp, &pending_libs, list) {
+		cds_list_del(&pl->list);
+		lib_add(pl);
+	}
+	nr_pending_callsites = 0;
+}
+
 /*
  * Update probes, removing the faulty probes.
  */
@@ -544,6 +974,8 @@ tracepoint_add_probe(const char *name, void (*probe)(void), void *data,
 	struct tracepoint_entry *entry;
 	struct lttng_ust_tracepoint_probe *old;
 
+	/* First probe: callsites of deferred libraries are now needed. */
+	lib_register_pending();
 	entry = get_tracepoint(name);
 	if (!entry) {
 		entry = add_tracepoint(name, signature);
@@ -593,6 +1025,7 @@ int __tracepoint_probe_register(const char *name, void (*probe)(void),
 	tracepoint_sync_callsites(name);
 	release_probes(old);
 end:
+	branch_patch_commit();
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return ret;
 }
@@ -620,6 +1053,7 @@ int __tracepoint_probe_register_queue_release(const char *name,
 	tracepoint_sync_callsites(name);
 	tracepoint_release_queue_add_old_probes(old);
 end:
+	branch_patch_commit();
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return ret;
 }
@@ -664,6 +1098,7 @@ int __tracepoint_probe_unregister(const char *name, void (*probe)(void),
 	tracepoint_sync_callsites(name);
 	release_probes(old);
 end:
+	branch_patch_commit();
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return ret;
 }
@@ -690,6 +1125,7 @@ int __tracepoint_probe_unregister_queue_release(const char *name,
 	tracepoint_sync_callsites(name);
 	tracepoint_release_queue_add_old_probes(old);
 end:
+	branch_patch_commit();
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return ret;
 }
@@ -750,6 +1186,7 @@ int tracepoint_probe_register_noupdate(const char *name, void (*probe)(void),
 	}
 	tracepoint_add_old_probes(old);
 end:
+	branch_patch_commit();
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return ret;
 }
@@ -778,6 +1215,7 @@ int tracepoint_probe_unregister_noupdate(const char *name, void (*probe)(void),
 	}
 	tracepoint_add_old_probes(old);
 end:
+	branch_patch_commit();
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return ret;
 }
@@ -799,6 +1237,7 @@ void tracepoint_probe_update_all(void)
 	need_update = 0;
 
 	tracepoint_update_probes();
+	branch_patch_commit();
 	/* Wait for grace period between update_probes and free. */
 	synchronize_rcu();
 	cds_list_for_each_entry_safe(pos, next, &release_probes, u.list) {
@@ -827,10 +1266,13 @@ static void new_tracepoints(struct lttng_ust_tracepoint * const *start,
 	}
 }
 
-int tracepoint_register_lib(struct lttng_ust_tracepoint * const *tracepoints_start,
-			    int tracepoints_count)
+static
+int lib_register(struct lttng_ust_tracepoint * const *tracepoints_start,
+		int tracepoints_count,
+		struct lttng_ust_tracepoint_branch *branches_start,
+		int branches_count)
 {
-	struct tracepoint_lib *pl, *iter;
+	struct tracepoint_lib *pl;
 
 	init_tracepoint();
 
@@ -842,29 +1284,40 @@ int tracepoint_register_lib(struct lttng_ust_tracepoint * const *tracepoints_sta
 	pl->tracepoints_start = tracepoints_start;
 	pl->tracepoints_count = tracepoints_count;
 	CDS_INIT_LIST_HEAD(&pl->callsites);
+	if (lib_init_branches(pl, branches_start, branches_count)) {
+		PERROR("Unable to register tracepoint lib static branches");
+		free(pl);
+		return -1;
+	}
 
 	pthread_mutex_lock(&tracepoint_mutex);
-	/*
-	 * We sort the libs by struct lib pointer address.
-	 */
-	cds_list_for_each_entry_reverse(iter, &libs, list) {
-		BUG_ON(iter == pl);    /* Should never be in the list twice */
-		if (iter < pl) {
-			/* We belong to the location right after iter. */
-			cds_list_add(&pl->list, &iter->list);
-			goto lib_added;
-		}
-	}
-	/* We should be added at the head of the list */
-	cds_list_add(&pl->list, &libs);
-lib_added:
 	new_tracepoints(tracepoints_start, tracepoints_start + tracepoints_count);
-	lib_register_callsites(pl);
-	lib_update_tracepoints(pl);
+	if (!nr_tracepoint_entries) {
+		/*
+		 * No probe is registered, so none of the callsites of
+		 * this library can be enabled: defer their registration.
+		 * This keeps constructor-time registration of many
+		 * libraries constant-time per library.
+		 */
+		cds_list_add_tail(&pl->list, &pending_libs);
+		nr_pending_callsites += tracepoints_count;
+	} else {
+		/*
+		 * Size the callsite hash table once for the whole
+		 * library rather than growing it step by step while its
+		 * callsites are added.
+		 */
+		if (ht_get(&callsite_ht, &callsite_ht_size))
+			ht_reserve(callsite_ht, &callsite_ht_size,
+				nr_callsite_entries + tracepoints_count,
+				TRACEPOINT_HT_CTOR_MAX_SIZE);
+		lib_add(pl);
+		branch_patch_commit();
+	}
 	pthread_mutex_unlock(&tracepoint_mutex);
 
-	DBG("just registered a tracepoints section from %p and having %d tracepoints",
-		tracepoints_start, tracepoints_count);
+	DBG("just registered a tracepoints section from %p and having %d tracepoints and %d static branches",
+		tracepoints_start, tracepoints_count, branches_count);
 	if (ust_debug()) {
 		int i;
 
@@ -876,11 +1329,39 @@ lib_added:
 	return 0;
 }
 
+int tracepoint_register_lib(struct lttng_ust_tracepoint * const *tracepoints_start,
+			    int tracepoints_count)
+{
+	return lib_register(tracepoints_start, tracepoints_count, NULL, 0);
+}
+
+int tracepoint_register_lib_branches(struct lttng_ust_tracepoint * const *tracepoints_start,
+			    int tracepoints_count,
+			    struct lttng_ust_tracepoint_branch *branches_start,
+			    int branches_count)
+{
+	return lib_register(tracepoints_start, tracepoints_count,
+			branches_start, branches_count);
+}
+
 int tracepoint_unregister_lib(struct lttng_ust_tracepoint * const *tracepoints_start)
 {
 	struct tracepoint_lib *lib;
 
 	pthread_mutex_lock(&tracepoint_mutex);
+	cds_list_for_each_entry(lib, &pending_libs, list) {
+		if (lib->tracepoints_start != tracepoints_start)
+			continue;
+
+		/* Deferred library: no callsite registered yet. */
+		cds_list_del(&lib->list);
+		nr_pending_callsites -= lib->tracepoints_count;
+		DBG("just unregistered a tracepoints section from %p",
+			lib->tracepoints_start);
+		free(lib->branches);
+		free(lib);
+		goto end;
+	}
 	cds_list_for_each_entry(lib, &libs, list) {
 		if (lib->tracepoints_start != tracepoints_start)
 			continue;
@@ -893,11 +1374,15 @@ int tracepoint_unregister_lib(struct lttng_ust_tracepoint * const *tracepoints_s
 		 * the reference count drops to zero.
 		 */
 		lib_unregister_callsites(lib);
+		/* Do not leave call sites of the library queued. */
+		branch_patch_commit();
 		DBG("just unregistered a tracepoints section from %p",
 			lib->tracepoints_start);
+		free(lib->branches);
 		free(lib);
 		break;
 	}
+end:
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return 0;
 }
@@ -19,8 +19,11 @@
  */
 
 #include <stdlib.h>
+#include <errno.h>
+#include <urcu/hlist.h>
 #include <lttng/ust-events.h>
 #include <usterr-signal-safe.h>
+#include <helper.h>
 #include "lttng-tracer-core.h"
 #include "jhash.h"
 
@@ -59,6 +62,91 @@ void lttng_transport_unregister(struct lttng_transport *transport)
 	cds_list_del(&transport->node);
 }
 
+/*
+ * Initial number of buckets of the session hash tables. Tables are
+ * doubled in size as entries are added, so the average chain length
+ * stays below one.
+ */
+#define LTTNG_UST_HT_MIN_SIZE	256
+
+int lttng_ust_ht_init(struct lttng_ust_ht *ht)
+{
+	ht->table = zmalloc(LTTNG_UST_HT_MIN_SIZE * sizeof(*ht->table));
+	if (!ht->table)
+		return -ENOMEM;
+	ht->size = LTTNG_UST_HT_MIN_SIZE;
+	ht->count = 0;
+	return 0;
+}
+
+void lttng_ust_ht_fini(struct lttng_ust_ht *ht)
+{
+	free(ht->table);
+	ht->table = NULL;
+	ht->size = 0;
+	ht->count = 0;
+}
+
+struct cds_hlist_head *lttng_ust_ht_bucket(struct lttng_ust_ht *ht,
+		uint32_t hash)
+{
+	return &ht->table[hash & (ht->size - 1)];
+}
+
+/*
+ * Move all entries of the table into a table twice as large. On
+ * allocation failure, the table keeps its current size: lookups stay
+ * correct, only chains get longer.
+ */
+static
+void lttng_ust_ht_grow(struct lttng_ust_ht *ht,
+		uint32_t (*hash_node)(struct cds_hlist_node *node))
+{
+	struct cds_hlist_head *new_table;
+	unsigned long new_size = ht->size << 1, i;
+
+	new_table = zmalloc(new_size * sizeof(*new_table));
+	if (!new_table)
+		return;
+	for (i = 0; i < ht->size; i++) {
+		struct cds_hlist_node *node, *next;
+
+		for (node = ht->table[i].next; node; node = next) {
+			uint32_t hash = hash_node(node);
+
+			next = node->next;
+			cds_hlist_add_head(node,
+				&new_table[hash & (new_size - 1)]);
+		}
+	}
+	free(ht->table);
+	ht->table = new_table;
+	ht->size = new_size;
+}
+
+/*
+ * Add a node to the hash table, growing the table when its load factor
+ * exceeds 1. hash_node() computes the hash of nodes already in the
+ * table. Called with ust_lock held.
+ */
+void lttng_ust_ht_add(struct lttng_ust_ht *ht, struct cds_hlist_node *node,
+		uint32_t hash, uint32_t (*hash_node)(struct cds_hlist_node *node))
+{
+	cds_hlist_add_head(node, lttng_ust_ht_bucket(ht, hash));
+	if (++ht->count > ht->size)
+		lttng_ust_ht_grow(ht, hash_node);
+}
+
+/*
+ * Remove a node from the hash table. The table is never shrunk.
+ * Called with ust_lock held.
+ */
+void lttng_ust_ht_del(struct lttng_ust_ht *ht, struct cds_hlist_node *node)
+{
+	cds_hlist_del(node);
+	ht->count--;
+}
+
 /*
  * Needed by comm layer.
  */
@@ -72,7 +160,7 @@ struct lttng_enum *lttng_ust_enum_get(struct lttng_session *session,
 	uint32_t hash;
 
 	hash = jhash(enum_name, name_len, 0);
-	head = &session->enums_ht.table[hash & (LTTNG_UST_ENUM_HT_SIZE - 1)];
+	head = lttng_ust_ht_bucket(&session->enums_ht, hash);
 	cds_hlist_for_each_entry(_enum, node, head, hlist) {
 		assert(_enum->desc);
 		if (!strncmp(_enum->desc->name, enum_name,
@@ -105,32 +105,6 @@ void lib_ring_buffer_write(const struct lttng_ust_lib_ring_buffer_config *config
 	ctx->buf_offset += len;
 }
 
-/*
- * Copy up to @len string bytes from @src to @dest. Stop whenever a NULL
- * terminating character is found in @src. Returns the number of bytes
- * copied. Does *not* terminate @dest with NULL terminating character.
- */
-static inline
-size_t lib_ring_buffer_do_strcpy(const struct lttng_ust_lib_ring_buffer_config *config,
-		char *dest, const char *src, size_t len)
-{
-	size_t count;
-
-	for (count = 0; count < len; count++) {
-		char c;
-
-		/*
-		 * Only read source character once, in case it is
-		 * modified concurrently.
-		 */
-		c = CMM_LOAD_SHARED(src[count]);
-		if (!c)
-			break;
-		lib_ring_buffer_do_copy(config, &dest[count], &c, 1);
-	}
-	return count;
-}
-
 /**
  * lib_ring_buffer_strcpy - write string data to a buffer backend
  * @config : ring buffer instance configuration
@@ -145,6 +119,11 @@ size_t lib_ring_buffer_do_strcpy(const struct lttng_ust_lib_ring_buffer_config *
  * buffer backend-specific strncpy() operation. If a terminating '\0'
  * character is found in @src before @len - 1 characters are copied, pad
  * the buffer with @pad characters (e.g. '#').
+ *
+ * @len is the length measured by the caller, so the string is copied
+ * at once rather than character by character. A string modified
+ * concurrently may contain a '\0' within those bytes: the copy is then
+ * padded from that character.
  */
 static inline
 void lib_ring_buffer_strcpy(const struct lttng_ust_lib_ring_buffer_config *config,
@@ -154,10 +133,11 @@ void lib_ring_buffer_strcpy(const struct lttng_ust_lib_ring_buffer_config *confi
 	struct lttng_ust_lib_ring_buffer_backend *bufb = &ctx->buf->backend;
 	struct channel_backend *chanb = &ctx->chan->backend;
 	struct lttng_ust_shm_handle *handle = ctx->handle;
-	size_t sbidx, count;
+	size_t sbidx;
 	size_t offset = ctx->buf_offset;
 	struct lttng_ust_lib_ring_buffer_backend_pages_shmp *rpages;
 	unsigned long sb_bindex, id;
+	char *dest, *end;
 
 	if (caa_unlikely(!len))
 		return;
@@ -174,24 +154,15 @@ void lib_ring_buffer_strcpy(const struct lttng_ust_lib_ring_buffer_config *confi
 	 * subbuffers.
 	 */
 	CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
-	count = lib_ring_buffer_do_strcpy(config,
-			shmp_index(handle, shmp(handle, rpages->shmp)->p,
-				offset & (chanb->subbuf_size - 1)),
-			src, len - 1);
-	offset += count;
+	dest = shmp_index(handle, shmp(handle, rpages->shmp)->p,
+			offset & (chanb->subbuf_size - 1));
+	lib_ring_buffer_do_copy(config, dest, src, len - 1);
 	/* Padding */
-	if (caa_unlikely(count < len - 1)) {
-		size_t pad_len = len - 1 - count;
-
-		lib_ring_buffer_do_memset(shmp_index(handle, shmp(handle, rpages->shmp)->p,
-				offset & (chanb->subbuf_size - 1)),
-			pad, pad_len);
-		offset += pad_len;
-	}
+	end = memchr(dest, '\0', len - 1);
+	if (caa_unlikely(end))
+		lib_ring_buffer_do_memset(end, pad, dest + len - 1 - end);
 	/* Final '\0' */
-	lib_ring_buffer_do_memset(shmp_index(handle, shmp(handle, rpages->shmp)->p,
-				offset & (chanb->subbuf_size - 1)),
-			'\0', 1);
+	dest[len - 1] = '\0';
 	ctx->buf_offset += len;
 }
 
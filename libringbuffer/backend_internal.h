@@ -46,7 +46,8 @@ int channel_backend_init(struct channel_backend *chanb,
 			 const struct lttng_ust_lib_ring_buffer_config *config,
 			 size_t subbuf_size,
 			 size_t num_subbuf, struct lttng_ust_shm_handle *handle,
-			 const int *stream_fds);
+			 const int *stream_fds,
+			 unsigned int shm_flags);
 void channel_backend_free(struct channel_backend *chanb,
 			  struct lttng_ust_shm_handle *handle);
 
@@ -207,6 +208,18 @@ void subbuffer_count_record(const struct lttng_ust_lib_ring_buffer_config *confi
 	v_inc(config, &shmp(handle, shmp_index(handle, bufb->array, sb_bindex)->shmp)->records_commit);
 }
 
+static inline
+void subbuffer_count_records(const struct lttng_ust_lib_ring_buffer_config *config,
+			     struct lttng_ust_lib_ring_buffer_backend *bufb,
+			     unsigned long idx, unsigned long nr_records,
+			     struct lttng_ust_shm_handle *handle)
+{
+	unsigned long sb_bindex;
+
+	sb_bindex = subbuffer_id_get_index(config, shmp_index(handle, bufb->buf_wsb, idx)->id);
+	v_add(config, nr_records, &shmp(handle, shmp_index(handle, bufb->array, sb_bindex)->shmp)->records_commit);
+}
+
 /*
  * Reader has exclusive subbuffer access for record consumption. No need to
  * perform the decrement atomically.
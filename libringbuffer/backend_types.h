@@ -88,7 +88,7 @@ struct lttng_ust_lib_ring_buffer_shmp {
 	DECLARE_SHMP(struct lttng_ust_lib_ring_buffer, shmp); /* Channel per-cpu buffers */
 };
 
-#define RB_BACKEND_CHANNEL_PADDING	64
+#define RB_BACKEND_CHANNEL_PADDING	60
 struct channel_backend {
 	unsigned long buf_size;		/* Size of the buffer */
 	unsigned long subbuf_size;	/* Sub-buffer size */
@@ -104,6 +104,7 @@ struct channel_backend {
 	DECLARE_SHMP(void *, priv_data);/* Client-specific information */
 	struct lttng_ust_lib_ring_buffer_config config; /* Ring buffer configuration */
 	char name[NAME_MAX];		/* Channel name */
+	unsigned int shm_flags;		/* Stream shm backing flags */
 	char padding[RB_BACKEND_CHANNEL_PADDING];
 	struct lttng_ust_lib_ring_buffer_shmp buf[];
 };
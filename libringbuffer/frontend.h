@@ -65,7 +65,8 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_lib_ring_buff
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
 				unsigned int read_timer_interval,
-				const int *stream_fds, int nr_stream_fds);
+				const int *stream_fds, int nr_stream_fds,
+				unsigned int shm_flags);
 
 /*
  * channel_destroy finalizes all channel's buffers, waits for readers to
@@ -87,6 +88,13 @@ void channel_destroy(struct channel *chan, struct lttng_ust_shm_handle *handle,
 #define for_each_channel_cpu(cpu, chan)					\
 	for_each_possible_cpu(cpu)
 
+/*
+ * Iterate on all channel streams: one per possible cpu for per-cpu
+ * channels, the stream pool for per-thread channels.
+ */
+#define for_each_channel_stream(stream, chan)				\
+	for ((stream) = 0; (stream) < (chan)->nr_streams; (stream)++)
+
 extern struct lttng_ust_lib_ring_buffer *channel_get_ring_buffer(
 				const struct lttng_ust_lib_ring_buffer_config *config,
 				struct channel *chan, int cpu,
@@ -112,18 +120,21 @@ int ring_buffer_stream_close_wakeup_fd(const struct lttng_ust_lib_ring_buffer_co
 		struct channel *chan,
 		struct lttng_ust_shm_handle *handle,
 		int cpu);
+extern
+int ring_buffer_channel_drain_wait_fd(const struct lttng_ust_lib_ring_buffer_config *config,
+			struct channel *chan,
+			struct lttng_ust_shm_handle *handle);
+extern
+int ring_buffer_stream_drain_wait_fd(const struct lttng_ust_lib_ring_buffer_config *config,
+		struct channel *chan,
+		struct lttng_ust_shm_handle *handle,
+		int cpu);
 
 extern int lib_ring_buffer_open_read(struct lttng_ust_lib_ring_buffer *buf,
 				     struct lttng_ust_shm_handle *handle);
 extern void lib_ring_buffer_release_read(struct lttng_ust_lib_ring_buffer *buf,
 					 struct lttng_ust_shm_handle *handle);
 
-/*
- * Initialize signals for ring buffer. Should be called early e.g. by
- * main() in the program to affect all threads.
- */
-void lib_ringbuffer_signal_init(void);
-
 /*
  * Read sequence: snapshot, many get_subbuf/put_subbuf, move_consumer.
  */
@@ -78,6 +78,39 @@ void lib_ring_buffer_put_cpu(const struct lttng_ust_lib_ring_buffer_config *conf
 	rcu_read_unlock();
 }
 
+/*
+ * lib_ring_buffer_thread_get_stream - Get the stream owned by the current
+ * thread for a per-thread channel.
+ *
+ * Claims a stream from the channel pool on first use. When all streams
+ * of the pool are owned by other threads, the thread shares one of them
+ * for a while before trying to claim a stream again. Returns the stream
+ * index, or -1 if the channel streams are not available.
+ */
+static inline
+int lib_ring_buffer_thread_get_stream(const struct lttng_ust_lib_ring_buffer_config *config,
+				      struct channel *chan,
+				      struct lttng_ust_shm_handle *handle)
+{
+	struct lib_ring_buffer_thread_cache *entry;
+	struct lttng_ust_lib_ring_buffer *buf;
+	pid_t tid;
+
+	tid = URCU_TLS(lib_ring_buffer_thread_state).tid;
+	entry = lib_ring_buffer_thread_cache_entry(handle);
+	if (caa_likely(tid && entry->handle == handle
+			&& entry->stream < chan->nr_streams)) {
+		if (caa_unlikely(entry->shared)) {
+			entry->shared--;
+			return entry->stream;
+		}
+		buf = shmp(handle, chan->backend.buf[entry->stream].shmp);
+		if (caa_likely(buf && CMM_LOAD_SHARED(buf->owner) == tid))
+			return entry->stream;
+	}
+	return lib_ring_buffer_thread_claim(chan, handle);
+}
+
 /*
  * lib_ring_buffer_try_reserve is called by lib_ring_buffer_reserve(). It is not
  * part of the API per se.
@@ -137,6 +170,41 @@ int lib_ring_buffer_try_reserve(const struct lttng_ust_lib_ring_buffer_config *c
 	return 0;
 }
 
+/*
+ * lib_ring_buffer_reserve_buf - Select the buffer to reserve into.
+ *
+ * Sets ctx->buf. Returns 0 on success, or the error codes of
+ * lib_ring_buffer_reserve().
+ */
+static inline
+int lib_ring_buffer_reserve_buf(const struct lttng_ust_lib_ring_buffer_config *config,
+				struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	struct channel *chan = ctx->chan;
+	struct lttng_ust_shm_handle *handle = ctx->handle;
+	struct lttng_ust_lib_ring_buffer *buf;
+
+	if (uatomic_read(&chan->record_disabled))
+		return -EAGAIN;
+
+	if (config->alloc == RING_BUFFER_ALLOC_PER_THREAD) {
+		int stream;
+
+		stream = lib_ring_buffer_thread_get_stream(config, chan, handle);
+		if (caa_unlikely(stream < 0))
+			return -EIO;
+		ctx->cpu = stream;
+	}
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL)
+		buf = shmp(handle, chan->backend.buf[ctx->cpu].shmp);
+	else
+		buf = shmp(handle, chan->backend.buf[0].shmp);
+	if (uatomic_read(&buf->record_disabled))
+		return -EAGAIN;
+	ctx->buf = buf;
+	return 0;
+}
+
 /**
  * lib_ring_buffer_reserve - Reserve space in a ring buffer.
  * @config: ring buffer instance configuration.
@@ -159,20 +227,13 @@ int lib_ring_buffer_reserve(const struct lttng_ust_lib_ring_buffer_config *confi
 {
 	struct channel *chan = ctx->chan;
 	struct lttng_ust_shm_handle *handle = ctx->handle;
-	struct lttng_ust_lib_ring_buffer *buf;
 	unsigned long o_begin, o_end, o_old;
 	size_t before_hdr_pad = 0;
+	int ret;
 
-	if (uatomic_read(&chan->record_disabled))
-		return -EAGAIN;
-
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		buf = shmp(handle, chan->backend.buf[ctx->cpu].shmp);
-	else
-		buf = shmp(handle, chan->backend.buf[0].shmp);
-	if (uatomic_read(&buf->record_disabled))
-		return -EAGAIN;
-	ctx->buf = buf;
+	ret = lib_ring_buffer_reserve_buf(config, ctx);
+	if (caa_unlikely(ret))
+		return ret;
 
 	/*
 	 * Perform retryable operations.
@@ -211,6 +272,122 @@ slow_path:
 	return lib_ring_buffer_reserve_slow(ctx);
 }
 
+/**
+ * lib_ring_buffer_reserve_batch - Reserve space for several records at once.
+ * @config: ring buffer instance configuration.
+ * @ctx: ring buffer context. (input and output) Must be already initialized.
+ * @data_sizes: payload size of each record.
+ * @nr: number of records.
+ *
+ * Reserves, with a single update of the write offset, the leading records
+ * of @data_sizes which fit in the current sub-buffer. All records share the
+ * context alignment and time-stamp, and each record gets its own header.
+ * Falls back on lib_ring_buffer_reserve() for the first record when the
+ * batch cannot be reserved at once (sub-buffer boundary, concurrent writer).
+ *
+ * Each record is then written after a call to lib_ring_buffer_batch_next(),
+ * and the whole batch is committed with lib_ring_buffer_commit_batch().
+ *
+ * Return :
+ *  number of records reserved (at least 1) on success.
+ *  error codes of lib_ring_buffer_reserve() on failure.
+ */
+static inline
+int lib_ring_buffer_reserve_batch(const struct lttng_ust_lib_ring_buffer_config *config,
+				  struct lttng_ust_lib_ring_buffer_ctx *ctx,
+				  const size_t *data_sizes, unsigned int nr)
+{
+	struct channel *chan = ctx->chan;
+	struct lttng_ust_lib_ring_buffer *buf;
+	unsigned long o_begin, o_end, o_old;
+	unsigned int rflags = ctx->rflags, count;
+	int ret;
+
+	if (nr < 2)
+		goto single;
+	ret = lib_ring_buffer_reserve_buf(config, ctx);
+	if (caa_unlikely(ret))
+		return ret;
+	buf = ctx->buf;
+
+	o_begin = v_read(config, &buf->offset);
+	o_old = o_begin;
+	if (caa_unlikely(subbuf_offset(o_begin, chan) == 0))
+		goto single;
+	ctx->tsc = lib_ring_buffer_clock_read(chan);
+	if ((int64_t) ctx->tsc == -EIO)
+		goto single;
+	if (last_tsc_overflow(config, buf, ctx->tsc))
+		ctx->rflags |= RING_BUFFER_RFLAG_FULL_TSC;
+
+	o_end = o_begin;
+	for (count = 0; count < nr; count++) {
+		size_t before_hdr_pad, slot_size;
+
+		ctx->data_size = data_sizes[count];
+		slot_size = record_header_size(config, chan, o_end,
+					       &before_hdr_pad, ctx);
+		slot_size += lib_ring_buffer_align(o_end + slot_size,
+				ctx->largest_align) + ctx->data_size;
+		/* Keep the end of the batch within the current sub-buffer. */
+		if (subbuf_offset(o_begin, chan) + (o_end - o_begin) + slot_size
+				>= chan->backend.subbuf_size)
+			break;
+		o_end += slot_size;
+	}
+	if (caa_unlikely(!count))
+		goto single;
+
+	if (caa_unlikely(v_cmpxchg(config, &buf->offset, o_old, o_end)
+		     != o_old))
+		goto single;
+
+	save_last_tsc(config, buf, ctx->tsc);
+	lib_ring_buffer_reserve_push_reader(buf, chan, o_end - 1);
+	lib_ring_buffer_clear_noref(config, &buf->backend,
+				subbuf_index(o_end - 1, chan), ctx->handle);
+
+	ctx->slot_size = o_end - o_begin;
+	ctx->pre_offset = o_begin;
+	ctx->buf_offset = o_begin;
+	ctx->batch_nr = count;
+	return count;
+
+single:
+	ctx->rflags = rflags;
+	ctx->data_size = data_sizes[0];
+	ret = lib_ring_buffer_reserve(config, ctx);
+	if (ret)
+		return ret;
+	/* lib_ring_buffer_batch_next() adds the header padding. */
+	ctx->buf_offset = ctx->pre_offset;
+	ctx->batch_nr = 1;
+	return 1;
+}
+
+/**
+ * lib_ring_buffer_batch_next - Move to the next record of a batch.
+ * @config: ring buffer instance configuration.
+ * @ctx: ring buffer context, as set by lib_ring_buffer_reserve_batch().
+ * @data_size: payload size of the next record, as passed to
+ *             lib_ring_buffer_reserve_batch().
+ *
+ * Skips the padding preceding the next record header, where the context
+ * is then positioned for writing the record header and payload.
+ */
+static inline
+void lib_ring_buffer_batch_next(const struct lttng_ust_lib_ring_buffer_config *config,
+				struct lttng_ust_lib_ring_buffer_ctx *ctx,
+				size_t data_size)
+{
+	size_t before_hdr_pad;
+
+	ctx->data_size = data_size;
+	(void) record_header_size(config, ctx->chan, ctx->buf_offset,
+				  &before_hdr_pad, ctx);
+	ctx->buf_offset += before_hdr_pad;
+}
+
 /**
  * lib_ring_buffer_switch - Perform a sub-buffer switch for a per-cpu buffer.
  * @config: ring buffer instance configuration.
@@ -297,6 +474,28 @@ void lib_ring_buffer_commit(const struct lttng_ust_lib_ring_buffer_config *confi
 			offset_end, commit_count, handle);
 }
 
+/**
+ * lib_ring_buffer_commit_batch - Commit the records of a batch.
+ * @config: ring buffer instance configuration.
+ * @ctx: ring buffer context, once all records of the batch are written.
+ *
+ * Commits all records reserved by lib_ring_buffer_reserve_batch() with a
+ * single commit count update.
+ */
+static inline
+void lib_ring_buffer_commit_batch(const struct lttng_ust_lib_ring_buffer_config *config,
+				  const struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	struct lttng_ust_lib_ring_buffer *buf = ctx->buf;
+	unsigned long endidx = subbuf_index(ctx->buf_offset - 1, ctx->chan);
+
+	/* lib_ring_buffer_commit() counts the last record. */
+	if (ctx->batch_nr > 1)
+		subbuffer_count_records(config, &buf->backend, endidx,
+					ctx->batch_nr - 1, ctx->handle);
+	lib_ring_buffer_commit(config, ctx);
+}
+
 /**
  * lib_ring_buffer_try_discard_reserve - Try discarding a record.
  * @config: ring buffer instance configuration.
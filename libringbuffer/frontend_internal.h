@@ -165,6 +165,10 @@ void lib_ring_buffer_switch_slow(struct lttng_ust_lib_ring_buffer *buf,
 				 enum switch_mode mode,
 				 struct lttng_ust_shm_handle *handle);
 
+extern
+int lib_ring_buffer_thread_claim(struct channel *chan,
+				 struct lttng_ust_shm_handle *handle);
+
 /* Buffer write helpers */
 
 static inline
@@ -301,15 +305,37 @@ int lib_ring_buffer_reserve_committed(const struct lttng_ust_lib_ring_buffer_con
 }
 
 static inline
-void lib_ring_buffer_wakeup(struct lttng_ust_lib_ring_buffer *buf,
-		struct lttng_ust_shm_handle *handle)
+void lib_ring_buffer_wakeup_eventfd(int wakeup_fd)
+{
+	uint64_t one = 1;
+	ssize_t ret;
+
+	/*
+	 * Add one to the eventfd counter (non-blocking). Wakeups
+	 * coalesce into the counter until the consumer reads it, so it
+	 * only fails if the counter is about to overflow, in which case
+	 * a wakeup is already pending.
+	 */
+	do {
+		ret = write(wakeup_fd, &one, sizeof(one));
+	} while (ret == -1L && errno == EINTR);
+}
+
+static inline
+void lib_ring_buffer_wakeup_fd(struct lttng_ust_shm_handle *handle,
+		struct shm_ref *ref)
 {
-	int wakeup_fd = shm_get_wakeup_fd(handle, &buf->self._ref);
 	sigset_t sigpipe_set, pending_set, old_set;
 	int ret, sigpipe_was_pending = 0;
+	int wakeup_fd;
 
+	wakeup_fd = shm_get_wakeup_fd(handle, ref);
 	if (wakeup_fd < 0)
 		return;
+	if (shm_wait_fd_is_eventfd(handle, ref)) {
+		lib_ring_buffer_wakeup_eventfd(wakeup_fd);
+		return;
+	}
 
 	/*
 	 * Wake-up the other end by writing a null byte in the pipe
@@ -365,6 +391,13 @@ void lib_ring_buffer_wakeup(struct lttng_ust_lib_ring_buffer *buf,
 	}
 }
 
+static inline
+void lib_ring_buffer_wakeup(struct lttng_ust_lib_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	lib_ring_buffer_wakeup_fd(handle, &buf->self._ref);
+}
+
 /*
  * Receive end of subbuffer TSC as parameter. It has been read in the
  * space reservation loop of either reserve or switch, which ensures it
@@ -537,4 +570,38 @@ extern void lib_ring_buffer_free(struct lttng_ust_lib_ring_buffer *buf,
 /* Keep track of trap nesting inside ring buffer code */
 extern DECLARE_URCU_TLS(unsigned int, lib_ring_buffer_nesting);
 
+/*
+ * Per-thread allocation: cache of the streams owned by the current
+ * thread, indexed by channel handle. Entries are only hints, validated
+ * against the buffer owner field before use.
+ */
+#define LIB_RING_BUFFER_THREAD_CACHE_SIZE	8
+/* Reservations into a shared stream before trying to claim one again */
+#define LIB_RING_BUFFER_THREAD_SHARED_RETRY	1024
+
+struct lib_ring_buffer_thread_cache {
+	struct lttng_ust_shm_handle *handle;
+	unsigned int stream;
+	unsigned int shared;		/* Shared stream, retry countdown */
+};
+
+struct lib_ring_buffer_thread_state {
+	pid_t tid;			/* Cached thread ID, 0 if unset */
+	struct lib_ring_buffer_thread_cache cache[LIB_RING_BUFFER_THREAD_CACHE_SIZE];
+};
+
+extern DECLARE_URCU_TLS(struct lib_ring_buffer_thread_state,
+	lib_ring_buffer_thread_state);
+
+static inline
+struct lib_ring_buffer_thread_cache *
+	lib_ring_buffer_thread_cache_entry(struct lttng_ust_shm_handle *handle)
+{
+	unsigned long hash = (unsigned long) handle;
+
+	hash ^= hash >> 12;
+	return &URCU_TLS(lib_ring_buffer_thread_state).cache[(hash >> 4)
+			& (LIB_RING_BUFFER_THREAD_CACHE_SIZE - 1)];
+}
+
 #endif /* _LTTNG_RING_BUFFER_FRONTEND_INTERNAL_H */
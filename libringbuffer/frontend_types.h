@@ -29,7 +29,6 @@
  */
 
 #include <string.h>
-#include <time.h>	/* for timer_t */
 
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
@@ -48,7 +47,7 @@
 enum switch_mode { SWITCH_ACTIVE, SWITCH_FLUSH };
 
 /* channel: collection of per-cpu ring buffers. */
-#define RB_CHANNEL_PADDING		32
+#define RB_CHANNEL_PADDING		(32 - 2 * sizeof(unsigned long))
 struct channel {
 	int record_disabled;
 	unsigned long commit_count_mask;	/*
@@ -59,17 +58,20 @@ struct channel {
 						 */
 
 	unsigned long switch_timer_interval;	/* Buffer flush (us) */
-	timer_t switch_timer;
+	struct lib_ring_buffer_timer *switch_timer;
 	int switch_timer_enabled;
 
 	unsigned long read_timer_interval;	/* Reader wakeup (us) */
-	timer_t read_timer;
+	struct lib_ring_buffer_timer *read_timer;
 	int read_timer_enabled;
 
 	int finalized;				/* Has channel been finalized */
 	size_t priv_data_offset;
 	unsigned int nr_streams;		/* Number of streams */
 	struct lttng_ust_shm_handle *handle;
+	/* NUMA placement of per-cpu streams, sampled at creation */
+	unsigned long numa_local_pages;		/* Sampled pages on cpu node */
+	unsigned long numa_sampled_pages;	/* Sampled pages */
 	char padding[RB_CHANNEL_PADDING];
 	/*
 	 * Associated backend contains a variable-length array. Needs to
@@ -95,7 +97,7 @@ struct commit_counters_cold {
 
 /* ring buffer state */
 #define RB_CRASH_DUMP_ABI_LEN		256
-#define RB_RING_BUFFER_PADDING		60
+#define RB_RING_BUFFER_PADDING		52
 
 #define RB_CRASH_DUMP_ABI_MAGIC_LEN	16
 
@@ -214,6 +216,12 @@ struct lttng_ust_lib_ring_buffer {
 	unsigned int get_subbuf:1;	/* Sub-buffer being held by reader */
 	/* shmp pointer to self */
 	DECLARE_SHMP(struct lttng_ust_lib_ring_buffer, self);
+	int active;			/*
+					 * Has been written to. Set by the
+					 * first sub-buffer switch.
+					 */
+	/* Per-thread allocation only */
+	int owner;			/* Owner thread ID, 0 if free */
 	char padding[RB_RING_BUFFER_PADDING];
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
@@ -22,9 +22,11 @@
 #include <urcu/compiler.h>
 #include <urcu/system.h>
 #include <urcu/arch.h>
+#include <urcu/tls-compat.h>
 #include <config.h>
 
 void lttng_ust_getcpu_init(void);
+void lttng_fixup_rseq_tls(void);
 
 extern int (*lttng_get_cpu)(void);
 
@@ -100,12 +102,43 @@ int lttng_ust_get_cpu_internal(void)
 
 #endif
 
+/*
+ * Restartable sequences: the kernel keeps the current CPU number up to
+ * date in a per-thread area registered with the rseq system call, so
+ * reading it costs a TLS load instead of a vDSO call or a system call.
+ * Each thread looks up the area registered by the C library (glibc 2.35
+ * and later) on its first call to lttng_ust_get_cpu(). Only the cpu_id
+ * field is read. Without an area registered by the C library, fall back
+ * on lttng_ust_get_cpu_internal().
+ */
+#if defined(HAVE_SYS_RSEQ_H) && defined(HAVE_BUILTIN_THREAD_POINTER) \
+	&& defined(__linux__) && !defined(LTTNG_UST_DEBUG_VALGRIND)
+#include <sys/rseq.h>
+
+#define LTTNG_UST_HAVE_RSEQ
+
+/* Registered rseq area of the current thread, NULL until looked up. */
+extern DECLARE_URCU_TLS(const struct rseq *, lttng_ust_rseq_abi);
+
+int lttng_ust_rseq_register_get_cpu(void);
+#endif
+
 static inline
 int lttng_ust_get_cpu(void)
 {
 	int (*getcpu)(void) = CMM_LOAD_SHARED(lttng_get_cpu);
 
 	if (caa_likely(!getcpu)) {
+#ifdef LTTNG_UST_HAVE_RSEQ
+		const struct rseq *rseq_abi = URCU_TLS(lttng_ust_rseq_abi);
+		int cpu;
+
+		if (caa_unlikely(!rseq_abi))
+			return lttng_ust_rseq_register_get_cpu();
+		cpu = (int) CMM_LOAD_SHARED(rseq_abi->cpu_id);
+		if (caa_likely(cpu >= 0))
+			return cpu;
+#endif
 		return lttng_ust_get_cpu_internal();
 	} else {
 		return getcpu();
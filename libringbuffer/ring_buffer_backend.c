@@ -254,6 +254,8 @@ void channel_backend_reset(struct channel_backend *chanb)
  * @num_subbuf: number of sub-buffers (power of 2)
  * @lttng_ust_shm_handle: shared memory handle
  * @stream_fds: stream file descriptors.
+ * @shm_flags: stream shared memory backing (enum
+ *             lttng_ust_lib_ring_buffer_shm_flags).
  *
  * Returns channel pointer if successful, %NULL otherwise.
  *
@@ -268,7 +270,8 @@ int channel_backend_init(struct channel_backend *chanb,
 			 const struct lttng_ust_lib_ring_buffer_config *config,
 			 size_t subbuf_size, size_t num_subbuf,
 			 struct lttng_ust_shm_handle *handle,
-			 const int *stream_fds)
+			 const int *stream_fds,
+			 unsigned int shm_flags)
 {
 	struct channel *chan = caa_container_of(chanb, struct channel, backend);
 	unsigned int i;
@@ -314,6 +317,7 @@ int channel_backend_init(struct channel_backend *chanb,
 	chanb->extra_reader_sb =
 			(config->mode == RING_BUFFER_OVERWRITE) ? 1 : 0;
 	chanb->num_subbuf = num_subbuf;
+	chanb->shm_flags = shm_flags;
 	strncpy(chanb->name, name, NAME_MAX);
 	chanb->name[NAME_MAX - 1] = '\0';
 	memcpy(&chanb->config, config, sizeof(*config));
@@ -339,18 +343,28 @@ int channel_backend_init(struct channel_backend *chanb,
 	shmsize += offset_align(shmsize, __alignof__(struct commit_counters_cold));
 	shmsize += sizeof(struct commit_counters_cold) * num_subbuf;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
 		struct lttng_ust_lib_ring_buffer *buf;
 		/*
-		 * We need to allocate for all possible cpus.
+		 * We need to allocate for all possible cpus, or for each
+		 * stream of the per-thread pool.
 		 */
-		for_each_possible_cpu(i) {
+		for_each_channel_stream(i, chan) {
 			struct shm_object *shmobj;
 
+			/*
+			 * Per-cpu buffers are allocated on the memory node
+			 * of their cpu.
+			 */
 			shmobj = shm_object_table_alloc(handle->table, shmsize,
-					SHM_OBJECT_SHM, stream_fds[i]);
+					SHM_OBJECT_SHM, stream_fds[i],
+					shm_flags,
+					config->alloc == RING_BUFFER_ALLOC_PER_CPU ?
+						(int) i : -1);
 			if (!shmobj)
 				goto end;
+			shm_object_numa_stats(shmobj, &chan->numa_local_pages,
+					&chan->numa_sampled_pages);
 			align_shm(shmobj, __alignof__(struct lttng_ust_lib_ring_buffer));
 			set_shmp(chanb->buf[i].shmp, zalloc_shm(shmobj, sizeof(struct lttng_ust_lib_ring_buffer)));
 			buf = shmp(handle, chanb->buf[i].shmp);
@@ -367,7 +381,8 @@ int channel_backend_init(struct channel_backend *chanb,
 		struct lttng_ust_lib_ring_buffer *buf;
 
 		shmobj = shm_object_table_alloc(handle->table, shmsize,
-					SHM_OBJECT_SHM, stream_fds[0]);
+					SHM_OBJECT_SHM, stream_fds[0],
+					shm_flags, -1);
 		if (!shmobj)
 			goto end;
 		align_shm(shmobj, __alignof__(struct lttng_ust_lib_ring_buffer));
@@ -381,6 +396,10 @@ int channel_backend_init(struct channel_backend *chanb,
 		if (ret)
 			goto free_bufs;
 	}
+	if (chan->numa_sampled_pages)
+		DBG("Channel %s NUMA placement: %lu of %lu sampled pages on their cpu node",
+			chanb->name, chan->numa_local_pages,
+			chan->numa_sampled_pages);
 	chanb->start_tsc = config->cb.ring_buffer_clock_read(chan);
 
 	return 0;
@@ -63,7 +63,10 @@
 #include <urcu/ref.h>
 #include <urcu/tls-compat.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <helper.h>
+#include <lttng/ust-tid.h>
 
 #include "smp.h"
 #include <lttng/ringbuffer-config.h>
@@ -77,10 +80,8 @@
 /* Print DBG() messages about events lost only every 1048576 hits */
 #define DBG_PRINT_NR_LOST	(1UL << 20)
 
-#define LTTNG_UST_RB_SIG_FLUSH		SIGRTMIN
-#define LTTNG_UST_RB_SIG_READ		SIGRTMIN + 1
-#define LTTNG_UST_RB_SIG_TEARDOWN	SIGRTMIN + 2
 #define CLOCKID		CLOCK_MONOTONIC
+#define LTTNG_UST_RB_TIMER_MAX_EVENTS		64
 #define LTTNG_UST_RING_BUFFER_GET_RETRY		10
 #define LTTNG_UST_RING_BUFFER_RETRY_DELAY_MS	10
 
@@ -117,34 +118,71 @@ struct switch_offsets {
 
 DEFINE_URCU_TLS(unsigned int, lib_ring_buffer_nesting);
 
+DEFINE_URCU_TLS(struct lib_ring_buffer_thread_state,
+	lib_ring_buffer_thread_state);
+
 /*
  * wakeup_fd_mutex protects wakeup fd use by timer from concurrent
  * close.
  */
 static pthread_mutex_t wakeup_fd_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * thread_handle_mutex protects the list of per-thread channel handles
+ * walked at thread exit to release the streams owned by the exiting
+ * thread, from concurrent channel teardown.
+ */
+static pthread_mutex_t thread_handle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CDS_LIST_HEAD(thread_handle_list);
+static pthread_key_t thread_key;
+static int thread_key_ready;
+
 static
 void lib_ring_buffer_print_errors(struct channel *chan,
 				struct lttng_ust_lib_ring_buffer *buf, int cpu,
 				struct lttng_ust_shm_handle *handle);
 
+enum lib_ring_buffer_timer_type {
+	LIB_RING_BUFFER_TIMER_SWITCH,
+	LIB_RING_BUFFER_TIMER_READ,
+};
+
 /*
- * Handle timer teardown race wrt memory free of private data by
- * ring buffer signals are handled by a single thread, which permits
- * a synchronization point between handling of each signal.
- * Protected by the lock within the structure.
+ * Channel timers of the same type and period are coalesced into a
+ * group sharing a single timerfd. All timerfds are waited on by a
+ * single timer thread with epoll.
  */
-struct timer_signal_data {
-	pthread_t tid;	/* thread id managing signals */
+struct lib_ring_buffer_timer_group {
+	int fd;					/* timerfd */
+	int registered;				/* In the engine epoll set */
+	enum lib_ring_buffer_timer_type type;
+	unsigned long interval;			/* Period (us) */
+	struct cds_list_head timers;		/* Channel timers */
+	struct cds_list_head node;		/* timer_engine groups */
+};
+
+struct lib_ring_buffer_timer {
+	struct channel *chan;
+	struct lib_ring_buffer_timer_group *group;
+	struct cds_list_head node;		/* Group timers */
+};
+
+/*
+ * The timer thread handles expired groups with the engine lock held,
+ * so removing a channel timer with the lock held ensures the timer
+ * thread is not using the channel anymore.
+ */
+struct timer_engine_data {
+	int epoll_fd;
 	int setup_done;
-	int qs_done;
+	struct cds_list_head groups;
 	pthread_mutex_t lock;
 };
 
-static struct timer_signal_data timer_signal = {
-	.tid = 0,
+static struct timer_engine_data timer_engine = {
+	.epoll_fd = -1,
 	.setup_done = 0,
-	.qs_done = 0,
+	.groups = CDS_LIST_HEAD_INIT(timer_engine.groups),
 	.lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
@@ -377,16 +415,12 @@ free_chanbuf:
 }
 
 static
-void lib_ring_buffer_channel_switch_timer(int sig, siginfo_t *si, void *uc)
+void lib_ring_buffer_channel_switch_timer(struct channel *chan)
 {
 	const struct lttng_ust_lib_ring_buffer_config *config;
 	struct lttng_ust_shm_handle *handle;
-	struct channel *chan;
 	int cpu;
 
-	assert(CMM_LOAD_SHARED(timer_signal.tid) == pthread_self());
-
-	chan = si->si_value.sival_ptr;
 	handle = chan->handle;
 	config = &chan->backend.config;
 
@@ -396,8 +430,8 @@ void lib_ring_buffer_channel_switch_timer(int sig, siginfo_t *si, void *uc)
 	 * Only flush buffers periodically if readers are active.
 	 */
 	pthread_mutex_lock(&wakeup_fd_mutex);
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		for_each_possible_cpu(cpu) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_stream(cpu, chan) {
 			struct lttng_ust_lib_ring_buffer *buf =
 				shmp(handle, chan->backend.buf[cpu].shmp);
 
@@ -435,8 +469,8 @@ void lib_ring_buffer_channel_do_read(struct channel *chan)
 	 * Only flush buffers periodically if readers are active.
 	 */
 	pthread_mutex_lock(&wakeup_fd_mutex);
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		for_each_possible_cpu(cpu) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_stream(cpu, chan) {
 			struct lttng_ust_lib_ring_buffer *buf =
 				shmp(handle, chan->backend.buf[cpu].shmp);
 
@@ -464,206 +498,296 @@ void lib_ring_buffer_channel_do_read(struct channel *chan)
 }
 
 static
-void lib_ring_buffer_channel_read_timer(int sig, siginfo_t *si, void *uc)
+void lib_ring_buffer_timer_group_expire(struct lib_ring_buffer_timer_group *group)
 {
-	struct channel *chan;
+	struct lib_ring_buffer_timer_group *iter;
+	struct lib_ring_buffer_timer *timer;
+	uint64_t expirations;
+	ssize_t len;
 
-	assert(CMM_LOAD_SHARED(timer_signal.tid) == pthread_self());
-	chan = si->si_value.sival_ptr;
-	DBG("Read timer for channel %p\n", chan);
-	lib_ring_buffer_channel_do_read(chan);
+	/*
+	 * The group may have been removed after epoll_wait() returned
+	 * its event.
+	 */
+	cds_list_for_each_entry(iter, &timer_engine.groups, node) {
+		if (iter == group)
+			goto found;
+	}
 	return;
-}
-
-static
-void rb_setmask(sigset_t *mask)
-{
-	int ret;
 
-	ret = sigemptyset(mask);
-	if (ret) {
-		PERROR("sigemptyset");
-	}
-	ret = sigaddset(mask, LTTNG_UST_RB_SIG_FLUSH);
-	if (ret) {
-		PERROR("sigaddset");
-	}
-	ret = sigaddset(mask, LTTNG_UST_RB_SIG_READ);
-	if (ret) {
-		PERROR("sigaddset");
+found:
+	len = read(group->fd, &expirations, sizeof(expirations));
+	if (len < 0) {
+		if (errno != EAGAIN)
+			PERROR("read timerfd");
+		return;
 	}
-	ret = sigaddset(mask, LTTNG_UST_RB_SIG_TEARDOWN);
-	if (ret) {
-		PERROR("sigaddset");
+	cds_list_for_each_entry(timer, &group->timers, node) {
+		switch (group->type) {
+		case LIB_RING_BUFFER_TIMER_SWITCH:
+			lib_ring_buffer_channel_switch_timer(timer->chan);
+			break;
+		case LIB_RING_BUFFER_TIMER_READ:
+			DBG("Read timer for channel %p\n", timer->chan);
+			lib_ring_buffer_channel_do_read(timer->chan);
+			break;
+		}
 	}
 }
 
 static
-void *sig_thread(void *arg)
+void *timer_thread(void *arg)
 {
-	sigset_t mask;
-	siginfo_t info;
-	int signr;
-
-	/* Only self thread will receive signal mask. */
-	rb_setmask(&mask);
-	CMM_STORE_SHARED(timer_signal.tid, pthread_self());
+	struct epoll_event events[LTTNG_UST_RB_TIMER_MAX_EVENTS];
+	int nr_events, i;
 
 	for (;;) {
-		signr = sigwaitinfo(&mask, &info);
-		if (signr == -1) {
+		nr_events = epoll_wait(timer_engine.epoll_fd, events,
+				LTTNG_UST_RB_TIMER_MAX_EVENTS, -1);
+		if (nr_events < 0) {
 			if (errno != EINTR)
-				PERROR("sigwaitinfo");
+				PERROR("epoll_wait");
 			continue;
 		}
-		if (signr == LTTNG_UST_RB_SIG_FLUSH) {
-			lib_ring_buffer_channel_switch_timer(info.si_signo,
-					&info, NULL);
-		} else if (signr == LTTNG_UST_RB_SIG_READ) {
-			lib_ring_buffer_channel_read_timer(info.si_signo,
-					&info, NULL);
-		} else if (signr == LTTNG_UST_RB_SIG_TEARDOWN) {
-			cmm_smp_mb();
-			CMM_STORE_SHARED(timer_signal.qs_done, 1);
-			cmm_smp_mb();
-		} else {
-			ERR("Unexptected signal %d\n", info.si_signo);
-		}
+		pthread_mutex_lock(&timer_engine.lock);
+		for (i = 0; i < nr_events; i++)
+			lib_ring_buffer_timer_group_expire(events[i].data.ptr);
+		pthread_mutex_unlock(&timer_engine.lock);
 	}
 	return NULL;
 }
 
 /*
- * Ensure only a single thread listens on the timer signal.
+ * Ensure only a single thread handles the timers. Called with the
+ * engine lock held.
  */
 static
-void lib_ring_buffer_setup_timer_thread(void)
+int lib_ring_buffer_setup_timer_thread(void)
 {
+	sigset_t mask, old_mask;
 	pthread_t thread;
 	int ret;
 
-	pthread_mutex_lock(&timer_signal.lock);
-	if (timer_signal.setup_done)
-		goto end;
+	if (timer_engine.setup_done)
+		return 0;
 
-	ret = pthread_create(&thread, NULL, &sig_thread, NULL);
+	timer_engine.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (timer_engine.epoll_fd < 0) {
+		PERROR("epoll_create1");
+		return -1;
+	}
+	/* The timer thread does not handle any signal. */
+	ret = sigfillset(&mask);
+	if (ret) {
+		PERROR("sigfillset");
+	}
+	ret = pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
 	if (ret) {
 		errno = ret;
-		PERROR("pthread_create");
+		PERROR("pthread_sigmask");
 	}
-	ret = pthread_detach(thread);
+	ret = pthread_create(&thread, NULL, &timer_thread, NULL);
 	if (ret) {
 		errno = ret;
-		PERROR("pthread_detach");
+		PERROR("pthread_create");
+	} else {
+		ret = pthread_detach(thread);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_detach");
+		}
+		ret = 0;
 	}
-	timer_signal.setup_done = 1;
-end:
-	pthread_mutex_unlock(&timer_signal.lock);
+	(void) pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (ret) {
+		(void) close(timer_engine.epoll_fd);
+		timer_engine.epoll_fd = -1;
+		return -1;
+	}
+	timer_engine.setup_done = 1;
+	return 0;
 }
 
 /*
- * Wait for signal-handling thread quiescent state.
+ * Find or create the timer group of the given type and period. Called
+ * with the engine lock held.
  */
 static
-void lib_ring_buffer_wait_signal_thread_qs(unsigned int signr)
+struct lib_ring_buffer_timer_group *
+	lib_ring_buffer_timer_group_get(enum lib_ring_buffer_timer_type type,
+		unsigned long interval)
 {
-	sigset_t pending_set;
+	struct lib_ring_buffer_timer_group *group;
+	struct epoll_event event;
+	struct itimerspec its;
 	int ret;
 
-	/*
-	 * We need to be the only thread interacting with the thread
-	 * that manages signals for teardown synchronization.
-	 */
-	pthread_mutex_lock(&timer_signal.lock);
+	cds_list_for_each_entry(group, &timer_engine.groups, node) {
+		if (group->type == type && group->interval == interval)
+			return group;
+	}
 
-	/*
-	 * Ensure we don't have any signal queued for this channel.
-	 */
-	for (;;) {
-		ret = sigemptyset(&pending_set);
-		if (ret == -1) {
-			PERROR("sigemptyset");
-		}
-		ret = sigpending(&pending_set);
-		if (ret == -1) {
-			PERROR("sigpending");
-		}
-		if (!sigismember(&pending_set, signr))
-			break;
-		caa_cpu_relax();
+	group = zmalloc(sizeof(*group));
+	if (!group)
+		return NULL;
+	group->type = type;
+	group->interval = interval;
+	CDS_INIT_LIST_HEAD(&group->timers);
+	group->fd = timerfd_create(CLOCKID, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (group->fd < 0) {
+		PERROR("timerfd_create");
+		goto error_timerfd;
 	}
 
-	/*
-	 * From this point, no new signal handler will be fired that
-	 * would try to access "chan". However, we still need to wait
-	 * for any currently executing handler to complete.
-	 */
-	cmm_smp_mb();
-	CMM_STORE_SHARED(timer_signal.qs_done, 0);
-	cmm_smp_mb();
+	its.it_value.tv_sec = interval / 1000000;
+	its.it_value.tv_nsec = (interval % 1000000) * 1000;
+	its.it_interval.tv_sec = its.it_value.tv_sec;
+	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+	ret = timerfd_settime(group->fd, 0, &its, NULL);
+	if (ret) {
+		PERROR("timerfd_settime");
+		goto error_settime;
+	}
 
-	/*
-	 * Kill with LTTNG_UST_RB_SIG_TEARDOWN, so signal management
-	 * thread wakes up.
-	 */
-	kill(getpid(), LTTNG_UST_RB_SIG_TEARDOWN);
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = group;
+	ret = epoll_ctl(timer_engine.epoll_fd, EPOLL_CTL_ADD, group->fd,
+			&event);
+	if (ret) {
+		PERROR("epoll_ctl");
+		goto error_settime;
+	}
+	group->registered = 1;
+	cds_list_add(&group->node, &timer_engine.groups);
+	return group;
 
-	while (!CMM_LOAD_SHARED(timer_signal.qs_done))
-		caa_cpu_relax();
-	cmm_smp_mb();
+error_settime:
+	ret = close(group->fd);
+	if (ret) {
+		PERROR("close");
+	}
+error_timerfd:
+	free(group);
+	return NULL;
+}
+
+static
+struct lib_ring_buffer_timer *
+	lib_ring_buffer_timer_add(struct channel *chan,
+		enum lib_ring_buffer_timer_type type,
+		unsigned long interval)
+{
+	struct lib_ring_buffer_timer_group *group;
+	struct lib_ring_buffer_timer *timer;
 
-	pthread_mutex_unlock(&timer_signal.lock);
+	timer = zmalloc(sizeof(*timer));
+	if (!timer)
+		return NULL;
+	timer->chan = chan;
+
+	pthread_mutex_lock(&timer_engine.lock);
+	if (lib_ring_buffer_setup_timer_thread())
+		goto error;
+	group = lib_ring_buffer_timer_group_get(type, interval);
+	if (!group)
+		goto error;
+	timer->group = group;
+	cds_list_add(&timer->node, &group->timers);
+	pthread_mutex_unlock(&timer_engine.lock);
+	return timer;
+
+error:
+	pthread_mutex_unlock(&timer_engine.lock);
+	free(timer);
+	return NULL;
 }
 
+/*
+ * Once this returns, the timer thread does not use the channel of the
+ * timer anymore.
+ */
 static
-void lib_ring_buffer_channel_switch_timer_start(struct channel *chan)
+void lib_ring_buffer_timer_remove(struct lib_ring_buffer_timer *timer)
 {
-	struct sigevent sev;
-	struct itimerspec its;
+	struct lib_ring_buffer_timer_group *group = timer->group;
 	int ret;
 
-	if (!chan->switch_timer_interval || chan->switch_timer_enabled)
-		return;
-
-	chan->switch_timer_enabled = 1;
+	pthread_mutex_lock(&timer_engine.lock);
+	cds_list_del(&timer->node);
+	if (cds_list_empty(&group->timers)) {
+		cds_list_del(&group->node);
+		/*
+		 * Closing the timerfd does not remove it from the epoll set
+		 * while a forked child holds a copy of it, and the timer
+		 * thread would keep getting events for a freed group.
+		 */
+		if (group->registered) {
+			ret = epoll_ctl(timer_engine.epoll_fd, EPOLL_CTL_DEL,
+					group->fd, NULL);
+			if (ret) {
+				PERROR("epoll_ctl");
+			}
+		}
+		ret = close(group->fd);
+		if (ret) {
+			PERROR("close");
+		}
+		free(group);
+	}
+	pthread_mutex_unlock(&timer_engine.lock);
+	free(timer);
+}
 
-	lib_ring_buffer_setup_timer_thread();
+/*
+ * After fork, the child has no timer thread, and shares the epoll set of
+ * the parent. Leave it to the parent: the groups inherited by the child
+ * are only closed when the inherited channels are torn down, and new
+ * channels get a new timer thread and new groups.
+ */
+void lib_ring_buffer_timer_after_fork_child(void)
+{
+	struct lib_ring_buffer_timer_group *group, *tmp;
+	int ret;
 
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = LTTNG_UST_RB_SIG_FLUSH;
-	sev.sigev_value.sival_ptr = chan;
-	ret = timer_create(CLOCKID, &sev, &chan->switch_timer);
-	if (ret == -1) {
-		PERROR("timer_create");
+	pthread_mutex_init(&timer_engine.lock, NULL);
+	cds_list_for_each_entry_safe(group, tmp, &timer_engine.groups, node) {
+		group->registered = 0;
+		cds_list_del_init(&group->node);
+	}
+	if (timer_engine.epoll_fd >= 0) {
+		ret = close(timer_engine.epoll_fd);
+		if (ret) {
+			PERROR("close");
+		}
+		timer_engine.epoll_fd = -1;
 	}
+	timer_engine.setup_done = 0;
+}
 
-	its.it_value.tv_sec = chan->switch_timer_interval / 1000000;
-	its.it_value.tv_nsec = (chan->switch_timer_interval % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+static
+void lib_ring_buffer_channel_switch_timer_start(struct channel *chan)
+{
+	if (!chan->switch_timer_interval || chan->switch_timer_enabled)
+		return;
 
-	ret = timer_settime(chan->switch_timer, 0, &its, NULL);
-	if (ret == -1) {
-		PERROR("timer_settime");
-	}
+	chan->switch_timer = lib_ring_buffer_timer_add(chan,
+			LIB_RING_BUFFER_TIMER_SWITCH,
+			chan->switch_timer_interval);
+	if (!chan->switch_timer)
+		return;
+	chan->switch_timer_enabled = 1;
 }
 
 static
 void lib_ring_buffer_channel_switch_timer_stop(struct channel *chan)
 {
-	int ret;
-
 	if (!chan->switch_timer_interval || !chan->switch_timer_enabled)
 		return;
 
-	ret = timer_delete(chan->switch_timer);
-	if (ret == -1) {
-		PERROR("timer_delete");
-	}
-
-	lib_ring_buffer_wait_signal_thread_qs(LTTNG_UST_RB_SIG_FLUSH);
+	lib_ring_buffer_timer_remove(chan->switch_timer);
 
-	chan->switch_timer = 0;
+	chan->switch_timer = NULL;
 	chan->switch_timer_enabled = 0;
 }
 
@@ -671,51 +795,29 @@ static
 void lib_ring_buffer_channel_read_timer_start(struct channel *chan)
 {
 	const struct lttng_ust_lib_ring_buffer_config *config = &chan->backend.config;
-	struct sigevent sev;
-	struct itimerspec its;
-	int ret;
 
 	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
 			|| !chan->read_timer_interval || chan->read_timer_enabled)
 		return;
 
+	chan->read_timer = lib_ring_buffer_timer_add(chan,
+			LIB_RING_BUFFER_TIMER_READ,
+			chan->read_timer_interval);
+	if (!chan->read_timer)
+		return;
 	chan->read_timer_enabled = 1;
-
-	lib_ring_buffer_setup_timer_thread();
-
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = LTTNG_UST_RB_SIG_READ;
-	sev.sigev_value.sival_ptr = chan;
-	ret = timer_create(CLOCKID, &sev, &chan->read_timer);
-	if (ret == -1) {
-		PERROR("timer_create");
-	}
-
-	its.it_value.tv_sec = chan->read_timer_interval / 1000000;
-	its.it_value.tv_nsec = (chan->read_timer_interval % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
-
-	ret = timer_settime(chan->read_timer, 0, &its, NULL);
-	if (ret == -1) {
-		PERROR("timer_settime");
-	}
 }
 
 static
 void lib_ring_buffer_channel_read_timer_stop(struct channel *chan)
 {
 	const struct lttng_ust_lib_ring_buffer_config *config = &chan->backend.config;
-	int ret;
 
 	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
 			|| !chan->read_timer_interval || !chan->read_timer_enabled)
 		return;
 
-	ret = timer_delete(chan->read_timer);
-	if (ret == -1) {
-		PERROR("timer_delete");
-	}
+	lib_ring_buffer_timer_remove(chan->read_timer);
 
 	/*
 	 * do one more check to catch data that has been written in the last
@@ -723,9 +825,7 @@ void lib_ring_buffer_channel_read_timer_stop(struct channel *chan)
 	 */
 	lib_ring_buffer_channel_do_read(chan);
 
-	lib_ring_buffer_wait_signal_thread_qs(LTTNG_UST_RB_SIG_READ);
-
-	chan->read_timer = 0;
+	chan->read_timer = NULL;
 	chan->read_timer_enabled = 0;
 }
 
@@ -743,8 +843,8 @@ static void channel_print_errors(struct channel *chan,
 			&chan->backend.config;
 	int cpu;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		for_each_possible_cpu(cpu) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_stream(cpu, chan) {
 			struct lttng_ust_lib_ring_buffer *buf =
 				shmp(handle, chan->backend.buf[cpu].shmp);
 			lib_ring_buffer_print_errors(chan, buf, cpu, handle);
@@ -760,6 +860,11 @@ static void channel_print_errors(struct channel *chan,
 static void channel_free(struct channel *chan,
 		struct lttng_ust_shm_handle *handle)
 {
+	if (chan->backend.config.alloc == RING_BUFFER_ALLOC_PER_THREAD) {
+		pthread_mutex_lock(&thread_handle_mutex);
+		cds_list_del(&handle->thread_node);
+		pthread_mutex_unlock(&thread_handle_mutex);
+	}
 	channel_backend_free(&chan->backend, handle);
 	/* chan is freed by shm teardown */
 	shm_object_table_destroy(handle->table);
@@ -783,7 +888,14 @@ static void channel_free(struct channel *chan,
  *                         Used for live streaming.
  * @read_timer_interval: Time interval (in us) to wake up pending readers.
  * @stream_fds: array of stream file descriptors.
- * @nr_stream_fds: number of file descriptors in array.
+ * @nr_stream_fds: number of file descriptors in array. Per-cpu channels
+ *                 expect one stream per possible cpu, global channels a
+ *                 single stream. For per-thread channels, it sets the
+ *                 number of streams in the pool shared by traced threads.
+ * @shm_flags: stream shared memory backing (enum
+ *             lttng_ust_lib_ring_buffer_shm_flags). Streams backed by
+ *             memory files (RING_BUFFER_SHM_MEMFD) ignore @stream_fds,
+ *             which can be -1.
  *
  * Holds cpu hotplug.
  * Returns NULL on failure.
@@ -797,7 +909,8 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_lib_ring_buff
 		   void *buf_addr, size_t subbuf_size,
 		   size_t num_subbuf, unsigned int switch_timer_interval,
 		   unsigned int read_timer_interval,
-		   const int *stream_fds, int nr_stream_fds)
+		   const int *stream_fds, int nr_stream_fds,
+		   unsigned int shm_flags)
 {
 	int ret;
 	size_t shmsize, chansize;
@@ -806,10 +919,19 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_lib_ring_buff
 	struct shm_object *shmobj;
 	unsigned int nr_streams;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+	switch (config->alloc) {
+	case RING_BUFFER_ALLOC_PER_CPU:
 		nr_streams = num_possible_cpus();
-	else
+		break;
+	case RING_BUFFER_ALLOC_PER_THREAD:
+		if (nr_stream_fds <= 0)
+			return NULL;
+		nr_streams = nr_stream_fds;
+		break;
+	default:
 		nr_streams = 1;
+		break;
+	}
 
 	if (nr_stream_fds != nr_streams)
 		return NULL;
@@ -821,9 +943,10 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_lib_ring_buff
 	handle = zmalloc(sizeof(struct lttng_ust_shm_handle));
 	if (!handle)
 		return NULL;
+	CDS_INIT_LIST_HEAD(&handle->thread_node);
 
 	/* Allocate table for channel + per-cpu buffers */
-	handle->table = shm_object_table_create(1 + num_possible_cpus());
+	handle->table = shm_object_table_create(1 + nr_streams);
 	if (!handle->table)
 		goto error_table_alloc;
 
@@ -836,9 +959,13 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_lib_ring_buff
 		shmsize += offset_align(shmsize, priv_data_align);
 	shmsize += priv_data_size;
 
-	/* Allocate normal memory for channel (not shared) */
+	/*
+	 * Allocate normal memory for channel (not shared). Its wait fd
+	 * follows the wakeup mode of the streams, as the application
+	 * side does.
+	 */
 	shmobj = shm_object_table_alloc(handle->table, shmsize, SHM_OBJECT_MEM,
-			-1);
+			-1, shm_flags & RING_BUFFER_SHM_EVENTFD, -1);
 	if (!shmobj)
 		goto error_append;
 	/* struct channel is at object 0, offset 0 (hardcoded) */
@@ -869,7 +996,7 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_lib_ring_buff
 
 	ret = channel_backend_init(&chan->backend, name, config,
 				   subbuf_size, num_subbuf, handle,
-				   stream_fds);
+				   stream_fds, shm_flags);
 	if (ret)
 		goto error_backend_init;
 
@@ -897,23 +1024,39 @@ struct lttng_ust_shm_handle *channel_handle_create(void *data,
 {
 	struct lttng_ust_shm_handle *handle;
 	struct shm_object *object;
+	struct channel *chan = data;
+	unsigned int nr_streams;
+
+	/* The channel carries its stream array after struct channel. */
+	if (memory_map_size < sizeof(struct channel))
+		return NULL;
+	nr_streams = chan->nr_streams;
+	if (!nr_streams || nr_streams > (memory_map_size - sizeof(struct channel))
+			/ sizeof(struct lttng_ust_lib_ring_buffer_shmp))
+		return NULL;
 
 	handle = zmalloc(sizeof(struct lttng_ust_shm_handle));
 	if (!handle)
 		return NULL;
+	CDS_INIT_LIST_HEAD(&handle->thread_node);
 
 	/* Allocate table for channel + per-cpu buffers */
-	handle->table = shm_object_table_create(1 + num_possible_cpus());
+	handle->table = shm_object_table_create(1 + nr_streams);
 	if (!handle->table)
 		goto error_table_alloc;
 	/* Add channel object */
 	object = shm_object_table_append_mem(handle->table, data,
-			memory_map_size, wakeup_fd);
+			memory_map_size, wakeup_fd, chan->backend.shm_flags);
 	if (!object)
 		goto error_table_object;
 	/* struct channel is at object 0, offset 0 (hardcoded) */
 	handle->chan._ref.index = 0;
 	handle->chan._ref.offset = 0;
+	if (chan->backend.config.alloc == RING_BUFFER_ALLOC_PER_THREAD) {
+		pthread_mutex_lock(&thread_handle_mutex);
+		cds_list_add(&handle->thread_node, &thread_handle_list);
+		pthread_mutex_unlock(&thread_handle_mutex);
+	}
 	return handle;
 
 error_table_object:
@@ -927,12 +1070,15 @@ int channel_handle_add_stream(struct lttng_ust_shm_handle *handle,
 		int shm_fd, int wakeup_fd, uint32_t stream_nr,
 		uint64_t memory_map_size)
 {
+	struct channel *chan = shmp(handle, handle->chan);
 	struct shm_object *object;
 
+	if (!chan)
+		return -EINVAL;
 	/* Add stream object */
 	object = shm_object_table_append_shm(handle->table,
 			shm_fd, wakeup_fd, stream_nr,
-			memory_map_size);
+			memory_map_size, chan->backend.shm_flags);
 	if (!object)
 		return -EINVAL;
 	return 0;
@@ -996,7 +1142,7 @@ struct lttng_ust_lib_ring_buffer *channel_get_ring_buffer(
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		cpu = 0;
 	} else {
-		if (cpu >= num_possible_cpus())
+		if (cpu >= chan->nr_streams)
 			return NULL;
 	}
 	ref = &chan->backend.buf[cpu].shmp._ref;
@@ -1038,7 +1184,7 @@ int ring_buffer_stream_close_wait_fd(const struct lttng_ust_lib_ring_buffer_conf
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		cpu = 0;
 	} else {
-		if (cpu >= num_possible_cpus())
+		if (cpu >= chan->nr_streams)
 			return -EINVAL;
 	}
 	ref = &chan->backend.buf[cpu].shmp._ref;
@@ -1056,7 +1202,7 @@ int ring_buffer_stream_close_wakeup_fd(const struct lttng_ust_lib_ring_buffer_co
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		cpu = 0;
 	} else {
-		if (cpu >= num_possible_cpus())
+		if (cpu >= chan->nr_streams)
 			return -EINVAL;
 	}
 	ref = &chan->backend.buf[cpu].shmp._ref;
@@ -1066,6 +1212,33 @@ int ring_buffer_stream_close_wakeup_fd(const struct lttng_ust_lib_ring_buffer_co
 	return ret;
 }
 
+int ring_buffer_channel_drain_wait_fd(const struct lttng_ust_lib_ring_buffer_config *config,
+			struct channel *chan,
+			struct lttng_ust_shm_handle *handle)
+{
+	struct shm_ref *ref;
+
+	ref = &handle->chan._ref;
+	return shm_drain_wait_fd(handle, ref);
+}
+
+int ring_buffer_stream_drain_wait_fd(const struct lttng_ust_lib_ring_buffer_config *config,
+			struct channel *chan,
+			struct lttng_ust_shm_handle *handle,
+			int cpu)
+{
+	struct shm_ref *ref;
+
+	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
+		cpu = 0;
+	} else {
+		if (cpu >= chan->nr_streams)
+			return -EINVAL;
+	}
+	ref = &chan->backend.buf[cpu].shmp._ref;
+	return shm_drain_wait_fd(handle, ref);
+}
+
 int lib_ring_buffer_open_read(struct lttng_ust_lib_ring_buffer *buf,
 			      struct lttng_ust_shm_handle *handle)
 {
@@ -1557,6 +1730,21 @@ void lib_ring_buffer_switch_old_end(struct lttng_ust_lib_ring_buffer *buf,
 			offsets->old + padding_size, commit_count, handle);
 }
 
+/*
+ * Mark a stream as written to. Streams of lazily populated channels
+ * wake up the channel wait fd so the consumer can start handling them.
+ */
+static
+void lib_ring_buffer_set_active(struct lttng_ust_lib_ring_buffer *buf,
+				struct channel *chan,
+				struct lttng_ust_shm_handle *handle)
+{
+	if (uatomic_cmpxchg(&buf->active, 0, 1) != 0)
+		return;
+	if (chan->backend.shm_flags & RING_BUFFER_SHM_LAZY)
+		lib_ring_buffer_wakeup_fd(handle, &handle->chan._ref);
+}
+
 /*
  * lib_ring_buffer_switch_new_start: Populate new subbuffer.
  *
@@ -1575,6 +1763,8 @@ void lib_ring_buffer_switch_new_start(struct lttng_ust_lib_ring_buffer *buf,
 	unsigned long beginidx = subbuf_index(offsets->begin, chan);
 	unsigned long commit_count;
 
+	if (caa_unlikely(!CMM_LOAD_SHARED(buf->active)))
+		lib_ring_buffer_set_active(buf, chan, handle);
 	config->cb.buffer_begin(buf, tsc, beginidx, handle);
 
 	/*
@@ -1785,6 +1975,170 @@ void lib_ring_buffer_switch_slow(struct lttng_ust_lib_ring_buffer *buf, enum swi
 	lib_ring_buffer_switch_old_end(buf, chan, &offsets, tsc, handle);
 }
 
+/*
+ * Whether the thread owning a per-thread stream is gone without giving it
+ * back, e.g. because its process crashed while sharing per-UID buffers.
+ * A thread ID recycled in the meantime keeps the stream held until the
+ * new thread exits.
+ */
+static
+int lib_ring_buffer_owner_dead(pid_t owner)
+{
+	int ret, saved_errno = errno;
+
+	ret = kill(owner, 0) < 0 && errno == ESRCH;
+	errno = saved_errno;
+	return ret;
+}
+
+/*
+ * Find the stream owned by the current thread within a per-thread
+ * channel, or claim one from the pool: a free stream first, then a
+ * stream whose owner died. If every stream is owned by a live thread,
+ * the current thread writes into the stream it hashes to, along with
+ * its owner, for LIB_RING_BUFFER_THREAD_SHARED_RETRY reservations. Global
+ * buffer synchronization makes this safe. Returns the stream index, -1
+ * if the channel streams are not available.
+ */
+int lib_ring_buffer_thread_claim(struct channel *chan,
+				 struct lttng_ust_shm_handle *handle)
+{
+	struct lib_ring_buffer_thread_state *state =
+			&URCU_TLS(lib_ring_buffer_thread_state);
+	struct lib_ring_buffer_thread_cache *entry;
+	struct lttng_ust_lib_ring_buffer *buf;
+	unsigned int i, start, stream, shared = 0;
+	pid_t tid;
+
+	if (caa_unlikely(!state->tid))
+		state->tid = gettid();
+	tid = state->tid;
+	start = (unsigned int) tid % chan->nr_streams;
+
+	/* The cache may have been evicted by another channel. */
+	for (i = 0; i < chan->nr_streams; i++) {
+		stream = (start + i) % chan->nr_streams;
+		buf = shmp(handle, chan->backend.buf[stream].shmp);
+		if (!buf)
+			return -1;
+		if (CMM_LOAD_SHARED(buf->owner) == tid)
+			goto found;
+	}
+
+	for (i = 0; i < chan->nr_streams; i++) {
+		int owner;
+
+		stream = (start + i) % chan->nr_streams;
+		buf = shmp(handle, chan->backend.buf[stream].shmp);
+		/*
+		 * A signal handler nested over this thread may have
+		 * claimed the stream before us.
+		 */
+		owner = uatomic_cmpxchg(&buf->owner, 0, tid);
+		if (owner == 0 || owner == tid)
+			goto claimed;
+	}
+
+	for (i = 0; i < chan->nr_streams; i++) {
+		int owner;
+
+		stream = (start + i) % chan->nr_streams;
+		buf = shmp(handle, chan->backend.buf[stream].shmp);
+		owner = CMM_LOAD_SHARED(buf->owner);
+		if (owner <= 0 || !lib_ring_buffer_owner_dead(owner))
+			continue;
+		if (uatomic_cmpxchg(&buf->owner, owner, tid) == owner)
+			goto claimed;
+	}
+
+	/* Pool exhausted. */
+	stream = start;
+	shared = LIB_RING_BUFFER_THREAD_SHARED_RETRY;
+	goto found;
+
+claimed:
+	/* Release the streams owned by this thread when it exits. */
+	if (CMM_LOAD_SHARED(thread_key_ready) && !pthread_getspecific(thread_key))
+		(void) pthread_setspecific(thread_key, (void *) (long) tid);
+found:
+	entry = lib_ring_buffer_thread_cache_entry(handle);
+	entry->handle = handle;
+	entry->stream = stream;
+	entry->shared = shared;
+	return stream;
+}
+
+/*
+ * Thread exit: deliver the pending data of the streams owned by the
+ * exiting thread and give them back to the pool.
+ */
+static
+void lib_ring_buffer_thread_release(void *arg)
+{
+	pid_t tid = (pid_t) (long) arg;
+	struct lttng_ust_shm_handle *handle;
+
+	pthread_mutex_lock(&thread_handle_mutex);
+	pthread_mutex_lock(&wakeup_fd_mutex);
+	cds_list_for_each_entry(handle, &thread_handle_list, thread_node) {
+		struct channel *chan = shmp(handle, handle->chan);
+		unsigned int stream;
+
+		if (!chan)
+			continue;
+		for_each_channel_stream(stream, chan) {
+			struct lttng_ust_lib_ring_buffer *buf =
+				shmp(handle, chan->backend.buf[stream].shmp);
+
+			if (!buf || CMM_LOAD_SHARED(buf->owner) != tid)
+				continue;
+			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE, handle);
+			cmm_smp_mb();
+			uatomic_set(&buf->owner, 0);
+		}
+	}
+	pthread_mutex_unlock(&wakeup_fd_mutex);
+	pthread_mutex_unlock(&thread_handle_mutex);
+}
+
+void lib_ring_buffer_thread_init(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&thread_key, lib_ring_buffer_thread_release);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_key_create");
+		return;
+	}
+	CMM_STORE_SHARED(thread_key_ready, 1);
+}
+
+void lib_ring_buffer_thread_exit(void)
+{
+	int ret;
+
+	if (!thread_key_ready)
+		return;
+	CMM_STORE_SHARED(thread_key_ready, 0);
+	ret = pthread_key_delete(thread_key);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_key_delete");
+	}
+}
+
+/*
+ * Upon fork or clone, the TID assigned to our thread is not the same as
+ * we kept in cache, and the streams owned by the parent thread must not
+ * be used by the child.
+ */
+void lib_ring_buffer_thread_reset(void)
+{
+	memset(&URCU_TLS(lib_ring_buffer_thread_state), 0,
+		sizeof(URCU_TLS(lib_ring_buffer_thread_state)));
+}
+
 /*
  * Returns :
  * 0 if ok
@@ -1987,7 +2341,7 @@ int lib_ring_buffer_reserve_slow(struct lttng_ust_lib_ring_buffer_ctx *ctx)
 	struct switch_offsets offsets;
 	int ret;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL)
 		buf = shmp(handle, chan->backend.buf[ctx->cpu].shmp);
 	else
 		buf = shmp(handle, chan->backend.buf[0].shmp);
@@ -2055,21 +2409,5 @@ int lib_ring_buffer_reserve_slow(struct lttng_ust_lib_ring_buffer_ctx *ctx)
 void lttng_fixup_ringbuffer_tls(void)
 {
 	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_nesting)));
-}
-
-void lib_ringbuffer_signal_init(void)
-{
-	sigset_t mask;
-	int ret;
-
-	/*
-	 * Block signal for entire process, so only our thread processes
-	 * it.
-	 */
-	rb_setmask(&mask);
-	ret = pthread_sigmask(SIG_BLOCK, &mask, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_sigmask");
-	}
+	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_thread_state)));
 }
@@ -18,20 +18,106 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _GNU_SOURCE
+#include <config.h>
 #include "shm.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>	/* For mode constants */
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #include <fcntl.h>	/* For O_* constants */
 #include <assert.h>
 #include <stdio.h>
 #include <signal.h>
 #include <dirent.h>
+#include <poll.h>
 #include <lttng/align.h>
+#include <lttng/ringbuffer-config.h>
 #include <limits.h>
 #include <helper.h>
+#include <urcu/system.h>
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#include <linux/mempolicy.h>
+#endif
+#include "smp.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC	0x0001U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB	0x0004U
+#endif
+
+#define SHM_MEMFD_NAME	"lttng-ust-stream"
+
+/* Number of pages sampled per stream for NUMA placement statistics. */
+#define SHM_NUMA_SAMPLES	64
+
+#if defined(HAVE_LINUX_MEMPOLICY_H) && defined(__NR_set_mempolicy) \
+	&& defined(__NR_get_mempolicy) && defined(__NR_move_pages)
+#define SHM_NUMA
+#define SHM_NUMA_MAX_NODES	1024
+#define SHM_NUMA_LONG_BITS	(CHAR_BIT * sizeof(unsigned long))
+/* The memory policy system calls use maxnode - 1 bits of the node masks. */
+#define SHM_NUMA_MAXNODE	(SHM_NUMA_MAX_NODES + 1)
+
+struct shm_mempolicy {
+	int mode;
+	unsigned long nodemask[SHM_NUMA_MAX_NODES / SHM_NUMA_LONG_BITS];
+};
+
+/*
+ * Make the current thread allocate memory on @node when possible,
+ * saving its memory policy into @old. Stream pages are allocated
+ * under this policy when the stream shm is first written to, which
+ * binds the per-cpu buffers to the memory of their cpu.
+ *
+ * MPOL_PREFERRED rather than MPOL_BIND, so a full node does not fail
+ * the channel creation.
+ */
+static
+int shm_numa_prefer_node(int node, struct shm_mempolicy *old)
+{
+	unsigned long nodemask[SHM_NUMA_MAX_NODES / SHM_NUMA_LONG_BITS];
+
+	if (node < 0 || node >= SHM_NUMA_MAX_NODES)
+		return -1;
+	if (syscall(__NR_get_mempolicy, &old->mode, old->nodemask,
+			SHM_NUMA_MAXNODE, NULL, 0UL))
+		return -1;
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[node / SHM_NUMA_LONG_BITS] |= 1UL << (node % SHM_NUMA_LONG_BITS);
+	if (syscall(__NR_set_mempolicy, MPOL_PREFERRED, nodemask,
+			SHM_NUMA_MAXNODE))
+		return -1;
+	return 0;
+}
+
+static
+void shm_numa_restore(const struct shm_mempolicy *old)
+{
+	if (syscall(__NR_set_mempolicy, old->mode, old->nodemask,
+			SHM_NUMA_MAXNODE))
+		PERROR("set_mempolicy");
+}
+
+/*
+ * Store the NUMA node of each of the @count pages at @pages into
+ * @nodes. Unlike get_mempolicy(MPOL_F_ADDR), this does not fault the
+ * pages in: pages not mapped yet get a negative error code instead.
+ */
+static
+int shm_numa_page_nodes(void **pages, int *nodes, unsigned long count)
+{
+	return syscall(__NR_move_pages, 0, count, pages, NULL, nodes, 0);
+}
+#endif /* SHM_NUMA */
 
 /*
  * Ensure we have the required amount of space available by writing 0
@@ -71,6 +157,215 @@ error:
 	return ret;
 }
 
+static
+int lttng_memfd_create(const char *name, unsigned int flags)
+{
+#if defined(HAVE_MEMFD_CREATE)
+	return memfd_create(name, flags);
+#elif defined(__NR_memfd_create)
+	return syscall(__NR_memfd_create, name, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * Default huge page size, from /proc/meminfo. Returns 0 if huge pages
+ * are not available.
+ */
+static
+size_t get_hugepage_size(void)
+{
+	char line[128];
+	unsigned long size_kb = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "Hugepagesize: %lu kB", &size_kb) == 1)
+			break;
+	}
+	fclose(fp);
+	return (size_t) size_kb * 1024;
+}
+
+/*
+ * Create an anonymous memory file backing a stream. With
+ * RING_BUFFER_SHM_HUGEPAGE, *memory_map_size is rounded up to the huge
+ * page size, and the file is taken from the hugetlb pool if it can
+ * hold the whole object. Otherwise, a regular memory file is created,
+ * and transparent huge pages are requested when mapping it.
+ *
+ * The file space is allocated upfront so running out of memory is
+ * reported here rather than by SIGBUS on first write, unless @lazy is
+ * set. Huge pages come from the reserved hugetlb pool, so they are
+ * allocated upfront even for lazy streams. Transparent huge pages are
+ * only used for pages faulted in through a mapping advised with
+ * MADV_HUGEPAGE, so in that case the file space is left unallocated and
+ * *populate is set: the caller allocates it through the mapping.
+ */
+static
+int create_memfd(size_t *memory_map_size, unsigned int shm_flags, int lazy,
+		int *populate)
+{
+	size_t len = *memory_map_size;
+	int fd, ret;
+
+	*populate = 0;
+
+	if (shm_flags & RING_BUFFER_SHM_HUGEPAGE) {
+		size_t hugepage_size = get_hugepage_size();
+
+		if (hugepage_size) {
+			len = ALIGN(len, hugepage_size);
+			fd = lttng_memfd_create(SHM_MEMFD_NAME,
+					MFD_CLOEXEC | MFD_HUGETLB);
+			if (fd >= 0) {
+				if (!fallocate(fd, 0, 0, len))
+					goto end;
+				DBG("Not enough huge pages in hugetlb pool, falling back on transparent huge pages");
+				ret = close(fd);
+				if (ret) {
+					PERROR("close");
+				}
+			}
+		}
+	}
+	fd = lttng_memfd_create(SHM_MEMFD_NAME, MFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (lazy || (shm_flags & RING_BUFFER_SHM_HUGEPAGE)) {
+		ret = ftruncate(fd, len);
+		if (ret) {
+			PERROR("ftruncate");
+			goto error;
+		}
+		*populate = !lazy;
+		goto end;
+	}
+	ret = fallocate(fd, 0, 0, len);
+	if (ret && errno == EOPNOTSUPP) {
+		ret = zero_file(fd, len);
+		if (!ret)
+			ret = ftruncate(fd, len);
+	}
+	if (ret) {
+		PERROR("fallocate");
+		goto error;
+	}
+end:
+	*memory_map_size = len;
+	return fd;
+
+error:
+	ret = close(fd);
+	if (ret) {
+		PERROR("close");
+	}
+	return -1;
+}
+
+/*
+ * Best-effort check that the file system holding a lazily populated
+ * stream has room for it. Running out of space when the stream pages
+ * are populated raises SIGBUS in the traced application.
+ */
+static
+int check_free_space(int fd, size_t len)
+{
+	struct statvfs stat;
+
+	/* Unlimited file systems report no blocks. */
+	if (fstatvfs(fd, &stat) || !stat.f_blocks)
+		return 0;
+	if ((uint64_t) stat.f_bavail * stat.f_frsize < len) {
+		errno = ENOSPC;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Fault in all pages of a mapping, so tracing does not take page
+ * faults on first write.
+ */
+static
+void shm_populate(char *memory_map, size_t memory_map_size)
+{
+	long page_size;
+	size_t offset;
+
+#ifdef MADV_POPULATE_READ
+	if (!madvise(memory_map, memory_map_size, MADV_POPULATE_READ))
+		return;
+#endif
+	page_size = sysconf(_SC_PAGE_SIZE);
+	if (page_size <= 0)
+		return;
+	for (offset = 0; offset < memory_map_size; offset += page_size)
+		(void) CMM_LOAD_SHARED(memory_map[offset]);
+}
+
+/*
+ * Allocate the pages of a memory file through its mapping, by faulting
+ * them in for write. Returns -1 if memory is exhausted.
+ */
+static
+int shm_populate_write(char *memory_map, size_t memory_map_size)
+{
+	long page_size;
+	size_t offset;
+
+#ifdef MADV_POPULATE_WRITE
+	if (!madvise(memory_map, memory_map_size, MADV_POPULATE_WRITE))
+		return 0;
+	if (errno != EINVAL)
+		return -1;
+#endif
+	page_size = sysconf(_SC_PAGE_SIZE);
+	if (page_size <= 0)
+		return 0;
+	/* The file content is zero already. */
+	for (offset = 0; offset < memory_map_size; offset += page_size)
+		CMM_STORE_SHARED(memory_map[offset], 0);
+	return 0;
+}
+
+/*
+ * Map a stream shm object, applying the huge page and pre-faulting
+ * requests of shm_flags.
+ */
+static
+char *shm_mmap(int shm_fd, size_t memory_map_size, unsigned int shm_flags)
+{
+	int mmap_flags = MAP_SHARED;
+	char *memory_map;
+
+	/*
+	 * Transparent huge pages need to be requested before the pages
+	 * are faulted in.
+	 */
+	if ((shm_flags & RING_BUFFER_SHM_POPULATE)
+			&& !(shm_flags & RING_BUFFER_SHM_HUGEPAGE))
+		mmap_flags |= MAP_POPULATE;
+	memory_map = mmap(NULL, memory_map_size, PROT_READ | PROT_WRITE,
+			  mmap_flags, shm_fd, 0);
+	if (memory_map == MAP_FAILED)
+		return memory_map;
+	if (shm_flags & RING_BUFFER_SHM_HUGEPAGE) {
+#ifdef MADV_HUGEPAGE
+		/* Fails on hugetlb mappings, which are huge already. */
+		(void) madvise(memory_map, memory_map_size, MADV_HUGEPAGE);
+#endif
+		if (shm_flags & RING_BUFFER_SHM_POPULATE)
+			shm_populate(memory_map, memory_map_size);
+	}
+	return memory_map;
+}
+
 struct shm_object_table *shm_object_table_create(size_t max_nb_obj)
 {
 	struct shm_object_table *table;
@@ -83,26 +378,43 @@ struct shm_object_table *shm_object_table_create(size_t max_nb_obj)
 	return table;
 }
 
+/*
+ * Create the wait/wakeup fd pair of a shm object. With a pipe, each
+ * wakeup writes a byte, and the wait end is hung up when the last
+ * wakeup end is closed. With an eventfd, both ends refer to the same
+ * eventfd counter, so wakeups coalesce until the consumer reads them,
+ * but the consumer holding the wait end keeps the eventfd open: it is
+ * never notified of application exit through it.
+ */
 static
-struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
-					   size_t memory_map_size,
-					   int stream_fd)
+int create_wait_fd(int waitfd[2], int eventfd_mode)
 {
-	int shmfd, waitfd[2], ret, i;
-	struct shm_object *obj;
-	char *memory_map;
-
-	if (stream_fd < 0)
-		return NULL;
-	if (table->allocated_len >= table->size)
-		return NULL;
-	obj = &table->objects[table->allocated_len];
+	int ret, i;
+
+	if (eventfd_mode) {
+#ifdef HAVE_EVENTFD
+		waitfd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (waitfd[0] < 0) {
+			PERROR("eventfd");
+			return -1;
+		}
+		waitfd[1] = fcntl(waitfd[0], F_DUPFD_CLOEXEC, 0);
+		if (waitfd[1] < 0) {
+			PERROR("fcntl");
+			goto error_close;
+		}
+		return 0;
+#else
+		errno = ENOSYS;
+		PERROR("eventfd");
+		return -1;
+#endif
+	}
 
-	/* wait_fd: create pipe */
 	ret = pipe(waitfd);
 	if (ret < 0) {
 		PERROR("pipe");
-		goto error_pipe;
+		return -1;
 	}
 	for (i = 0; i < 2; i++) {
 		ret = fcntl(waitfd[i], F_SETFD, FD_CLOEXEC);
@@ -117,31 +429,115 @@ struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
 		PERROR("fcntl");
 		goto error_fcntl;
 	}
-	memcpy(obj->wait_fd, waitfd, sizeof(waitfd));
-
-	/* create shm */
+	return 0;
 
-	shmfd = stream_fd;
-	ret = zero_file(shmfd, memory_map_size);
+error_fcntl:
+	ret = close(waitfd[1]);
 	if (ret) {
-		PERROR("zero_file");
-		goto error_zero_file;
+		PERROR("close");
+		assert(0);
 	}
-	ret = ftruncate(shmfd, memory_map_size);
+#ifdef HAVE_EVENTFD
+error_close:
+#endif
+	ret = close(waitfd[0]);
 	if (ret) {
-		PERROR("ftruncate");
-		goto error_ftruncate;
+		PERROR("close");
+		assert(0);
+	}
+	return -1;
+}
+
+static
+struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
+					   size_t memory_map_size,
+					   int stream_fd,
+					   unsigned int shm_flags,
+					   int cpu)
+{
+	int shmfd, waitfd[2], ret, i, populate = 0;
+	struct shm_object *obj;
+	char *memory_map;
+#ifdef SHM_NUMA
+	struct shm_mempolicy old_policy;
+	int numa_policy_set = 0;
+#endif
+
+	/* Memory file backed streams do not use the stream fd. */
+	if (stream_fd < 0 && !(shm_flags & RING_BUFFER_SHM_MEMFD))
+		return NULL;
+	if (table->allocated_len >= table->size)
+		return NULL;
+	obj = &table->objects[table->allocated_len];
+
+	/* wait_fd: create pipe or eventfd */
+	obj->wait_eventfd = !!(shm_flags & RING_BUFFER_SHM_EVENTFD);
+	ret = create_wait_fd(waitfd, obj->wait_eventfd);
+	if (ret < 0)
+		goto error_pipe;
+	memcpy(obj->wait_fd, waitfd, sizeof(waitfd));
+
+	/* create shm */
+
+	/* Only per-cpu streams are populated lazily. */
+	obj->lazy = (shm_flags & RING_BUFFER_SHM_LAZY) && cpu >= 0;
+	obj->numa_node = cpu >= 0 ? cpu_to_node(cpu) : -1;
+#ifdef SHM_NUMA
+	if (obj->numa_node >= 0 && !shm_numa_prefer_node(obj->numa_node,
+			&old_policy))
+		numa_policy_set = 1;
+#endif
+	if (shm_flags & RING_BUFFER_SHM_MEMFD) {
+		shmfd = create_memfd(&memory_map_size, shm_flags, obj->lazy,
+				&populate);
+		if (shmfd < 0) {
+			PERROR("memfd_create");
+			goto error_memfd;
+		}
+		obj->shm_fd_ownership = 1;
+	} else {
+		shmfd = stream_fd;
+		if (obj->lazy) {
+			ret = check_free_space(shmfd, memory_map_size);
+			if (ret) {
+				PERROR("check_free_space");
+				goto error_zero_file;
+			}
+		} else {
+			ret = zero_file(shmfd, memory_map_size);
+			if (ret) {
+				PERROR("zero_file");
+				goto error_zero_file;
+			}
+		}
+		ret = ftruncate(shmfd, memory_map_size);
+		if (ret) {
+			PERROR("ftruncate");
+			goto error_ftruncate;
+		}
+		obj->shm_fd_ownership = 0;
 	}
-	obj->shm_fd_ownership = 0;
 	obj->shm_fd = shmfd;
 
 	/* memory_map: mmap */
-	memory_map = mmap(NULL, memory_map_size, PROT_READ | PROT_WRITE,
-			  MAP_SHARED, shmfd, 0);
+	memory_map = shm_mmap(shmfd, memory_map_size, shm_flags);
 	if (memory_map == MAP_FAILED) {
 		PERROR("mmap");
 		goto error_mmap;
 	}
+	if (populate && shm_populate_write(memory_map, memory_map_size)) {
+		PERROR("shm_populate_write");
+		ret = munmap(memory_map, memory_map_size);
+		if (ret) {
+			PERROR("munmap");
+			assert(0);
+		}
+		goto error_mmap;
+	}
+#ifdef SHM_NUMA
+	if (numa_policy_set)
+		shm_numa_restore(&old_policy);
+#endif
 	obj->type = SHM_OBJECT_SHM;
 	obj->memory_map = memory_map;
 	obj->memory_map_size = memory_map_size;
@@ -151,9 +547,20 @@ struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
 	return obj;
 
 error_mmap:
+	if (obj->shm_fd_ownership) {
+		ret = close(shmfd);
+		if (ret) {
+			PERROR("close");
+			assert(0);
+		}
+	}
 error_ftruncate:
 error_zero_file:
-error_fcntl:
+error_memfd:
+#ifdef SHM_NUMA
+	if (numa_policy_set)
+		shm_numa_restore(&old_policy);
+#endif
 	for (i = 0; i < 2; i++) {
 		ret = close(waitfd[i]);
 		if (ret) {
@@ -167,11 +574,12 @@ error_pipe:
 
 static
 struct shm_object *_shm_object_table_alloc_mem(struct shm_object_table *table,
-					   size_t memory_map_size)
+					   size_t memory_map_size,
+					   unsigned int shm_flags)
 {
 	struct shm_object *obj;
 	void *memory_map;
-	int waitfd[2], i, ret;
+	int waitfd[2], ret;
 
 	if (table->allocated_len >= table->size)
 		return NULL;
@@ -181,30 +589,18 @@ struct shm_object *_shm_object_table_alloc_mem(struct shm_object_table *table,
 	if (!memory_map)
 		goto alloc_error;
 
-	/* wait_fd: create pipe */
-	ret = pipe(waitfd);
-	if (ret < 0) {
-		PERROR("pipe");
+	/* wait_fd: create pipe or eventfd */
+	obj->wait_eventfd = !!(shm_flags & RING_BUFFER_SHM_EVENTFD);
+	ret = create_wait_fd(waitfd, obj->wait_eventfd);
+	if (ret < 0)
 		goto error_pipe;
-	}
-	for (i = 0; i < 2; i++) {
-		ret = fcntl(waitfd[i], F_SETFD, FD_CLOEXEC);
-		if (ret < 0) {
-			PERROR("fcntl");
-			goto error_fcntl;
-		}
-	}
-	/* The write end of the pipe needs to be non-blocking */
-	ret = fcntl(waitfd[1], F_SETFL, O_NONBLOCK);
-	if (ret < 0) {
-		PERROR("fcntl");
-		goto error_fcntl;
-	}
 	memcpy(obj->wait_fd, waitfd, sizeof(waitfd));
 
 	/* no shm_fd */
 	obj->shm_fd = -1;
 	obj->shm_fd_ownership = 0;
+	obj->numa_node = -1;
+	obj->lazy = 0;
 
 	obj->type = SHM_OBJECT_MEM;
 	obj->memory_map = memory_map;
@@ -214,14 +610,6 @@ struct shm_object *_shm_object_table_alloc_mem(struct shm_object_table *table,
 
 	return obj;
 
-error_fcntl:
-	for (i = 0; i < 2; i++) {
-		ret = close(waitfd[i]);
-		if (ret) {
-			PERROR("close");
-			assert(0);
-		}
-	}
 error_pipe:
 	free(memory_map);
 alloc_error:
@@ -231,23 +619,66 @@ alloc_error:
 struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 			size_t memory_map_size,
 			enum shm_object_type type,
-			int stream_fd)
+			int stream_fd,
+			unsigned int shm_flags,
+			int cpu)
 {
 	switch (type) {
 	case SHM_OBJECT_SHM:
 		return _shm_object_table_alloc_shm(table, memory_map_size,
-				stream_fd);
+				stream_fd, shm_flags, cpu);
 	case SHM_OBJECT_MEM:
-		return _shm_object_table_alloc_mem(table, memory_map_size);
+		return _shm_object_table_alloc_mem(table, memory_map_size,
+				shm_flags);
 	default:
 		assert(0);
 	}
 	return NULL;
 }
 
+/*
+ * Sample the NUMA node of pages evenly spread over a stream shm
+ * object, adding the number of sampled pages located on the object
+ * preferred node to @local_pages, and the number of sampled pages to
+ * @sampled_pages. Objects without preferred node are not sampled, nor
+ * are pages not mapped in yet, as sampling must not fault them in.
+ */
+void shm_object_numa_stats(struct shm_object *obj,
+			unsigned long *local_pages,
+			unsigned long *sampled_pages)
+{
+#ifdef SHM_NUMA
+	void *pages[SHM_NUMA_SAMPLES];
+	int nodes[SHM_NUMA_SAMPLES];
+	unsigned long i, count = 0;
+	size_t offset, stride;
+	long page_size;
+
+	if (obj->type != SHM_OBJECT_SHM || obj->numa_node < 0)
+		return;
+	page_size = sysconf(_SC_PAGE_SIZE);
+	if (page_size <= 0)
+		return;
+	stride = max_t(size_t, page_size,
+			obj->memory_map_size / SHM_NUMA_SAMPLES);
+	for (offset = 0; offset < obj->memory_map_size
+			&& count < SHM_NUMA_SAMPLES; offset += stride)
+		pages[count++] = obj->memory_map + offset;
+	if (shm_numa_page_nodes(pages, nodes, count))
+		return;
+	for (i = 0; i < count; i++) {
+		if (nodes[i] < 0)
+			continue;
+		if (nodes[i] == obj->numa_node)
+			(*local_pages)++;
+		(*sampled_pages)++;
+	}
+#endif /* SHM_NUMA */
+}
+
 struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 			int shm_fd, int wakeup_fd, uint32_t stream_nr,
-			size_t memory_map_size)
+			size_t memory_map_size, unsigned int shm_flags)
 {
 	struct shm_object *obj;
 	char *memory_map;
@@ -266,6 +697,9 @@ struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 	obj->wait_fd[1] = wakeup_fd;
 	obj->shm_fd = shm_fd;
 	obj->shm_fd_ownership = 1;
+	obj->numa_node = -1;
+	obj->lazy = 0;
+	obj->wait_eventfd = !!(shm_flags & RING_BUFFER_SHM_EVENTFD);
 
 	ret = fcntl(obj->wait_fd[1], F_SETFD, FD_CLOEXEC);
 	if (ret < 0) {
@@ -280,8 +714,7 @@ struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 	}
 
 	/* memory_map: mmap */
-	memory_map = mmap(NULL, memory_map_size, PROT_READ | PROT_WRITE,
-			  MAP_SHARED, shm_fd, 0);
+	memory_map = shm_mmap(shm_fd, memory_map_size, shm_flags);
 	if (memory_map == MAP_FAILED) {
 		PERROR("mmap");
 		goto error_mmap;
@@ -303,7 +736,8 @@ error_mmap:
  * Passing ownership of mem to object.
  */
 struct shm_object *shm_object_table_append_mem(struct shm_object_table *table,
-			void *mem, size_t memory_map_size, int wakeup_fd)
+			void *mem, size_t memory_map_size, int wakeup_fd,
+			unsigned int shm_flags)
 {
 	struct shm_object *obj;
 	int ret;
@@ -316,6 +750,9 @@ struct shm_object *shm_object_table_append_mem(struct shm_object_table *table,
 	obj->wait_fd[1] = wakeup_fd;
 	obj->shm_fd = -1;
 	obj->shm_fd_ownership = 0;
+	obj->numa_node = -1;
+	obj->lazy = 0;
+	obj->wait_eventfd = !!(shm_flags & RING_BUFFER_SHM_EVENTFD);
 
 	ret = fcntl(obj->wait_fd[1], F_SETFD, FD_CLOEXEC);
 	if (ret < 0) {
@@ -341,6 +778,67 @@ error_fcntl:
 	return NULL;
 }
 
+/*
+ * Consume the pending wakeups of a shm object wait fd without
+ * blocking. Returns the number of coalesced wakeups (eventfd counter,
+ * or bytes read from the pipe), 0 if none is pending, or a negative
+ * error value.
+ */
+int shm_drain_wait_fd(struct lttng_ust_shm_handle *handle,
+		struct shm_ref *ref)
+{
+	struct shm_object_table *table = handle->table;
+	struct shm_object *obj;
+	uint64_t count = 0;
+	size_t index;
+	ssize_t len;
+
+	index = (size_t) ref->index;
+	if (caa_unlikely(index >= table->allocated_len))
+		return -EPERM;
+	obj = &table->objects[index];
+	if (obj->wait_fd[0] < 0)
+		return -ENOENT;
+
+	if (obj->wait_eventfd) {
+		/* A single read fetches and resets the counter. */
+		do {
+			len = read(obj->wait_fd[0], &count, sizeof(count));
+		} while (len < 0 && errno == EINTR);
+		if (len < 0)
+			return errno == EAGAIN ? 0 : -errno;
+	} else {
+		/* The read end of the pipe is blocking. */
+		for (;;) {
+			struct pollfd pfd = {
+				.fd = obj->wait_fd[0],
+				.events = POLLIN,
+			};
+			char buf[256];
+			int ret;
+
+			ret = poll(&pfd, 1, 0);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				return -errno;
+			}
+			if (!ret || !(pfd.revents & POLLIN))
+				break;
+			len = read(obj->wait_fd[0], buf, sizeof(buf));
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				return -errno;
+			}
+			count += len;
+			if (len < sizeof(buf))
+				break;
+		}
+	}
+	return count > INT_MAX ? INT_MAX : (int) count;
+}
+
 static
 void shmp_object_destroy(struct shm_object *obj)
 {
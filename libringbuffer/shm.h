@@ -89,13 +89,19 @@ struct shm_object_table *shm_object_table_create(size_t max_nb_obj);
 struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 			size_t memory_map_size,
 			enum shm_object_type type,
-			const int stream_fd);
+			const int stream_fd,
+			unsigned int shm_flags,
+			int cpu);
+void shm_object_numa_stats(struct shm_object *obj,
+			unsigned long *local_pages,
+			unsigned long *sampled_pages);
 struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 			int shm_fd, int wakeup_fd, uint32_t stream_nr,
-			size_t memory_map_size);
+			size_t memory_map_size, unsigned int shm_flags);
 /* mem ownership is passed to shm_object_table_append_mem(). */
 struct shm_object *shm_object_table_append_mem(struct shm_object_table *table,
-			void *mem, size_t memory_map_size, int wakeup_fd);
+			void *mem, size_t memory_map_size, int wakeup_fd,
+			unsigned int shm_flags);
 void shm_object_table_destroy(struct shm_object_table *table);
 
 /*
@@ -136,6 +142,22 @@ int shm_get_wakeup_fd(struct lttng_ust_shm_handle *handle, struct shm_ref *ref)
 	return obj->wait_fd[1];
 }
 
+static inline
+int shm_wait_fd_is_eventfd(struct lttng_ust_shm_handle *handle,
+		struct shm_ref *ref)
+{
+	struct shm_object_table *table = handle->table;
+	size_t index;
+
+	index = (size_t) ref->index;
+	if (caa_unlikely(index >= table->allocated_len))
+		return 0;
+	return table->objects[index].wait_eventfd;
+}
+
+int shm_drain_wait_fd(struct lttng_ust_shm_handle *handle,
+		struct shm_ref *ref);
+
 static inline
 int shm_close_wait_fd(struct lttng_ust_shm_handle *handle,
 		struct shm_ref *ref)
@@ -23,6 +23,7 @@
 
 #include <stdint.h>
 #include <limits.h>
+#include <urcu/list.h>
 #include "shm_internal.h"
 
 struct channel;
@@ -41,6 +42,9 @@ struct shm_object {
 	size_t memory_map_size;
 	uint64_t allocated_len;
 	int shm_fd_ownership;
+	int numa_node;	/* preferred NUMA node, -1 if none */
+	int lazy;	/* pages populated on first write */
+	int wait_eventfd;	/* wait_fd[] share an eventfd */
 };
 
 struct shm_object_table {
@@ -52,6 +56,7 @@ struct shm_object_table {
 struct lttng_ust_shm_handle {
 	struct shm_object_table *table;
 	DECLARE_SHMP(struct channel, chan);
+	struct cds_list_head thread_node;	/* Per-thread channel list */
 };
 
 #endif /* _LIBRINGBUFFER_SHM_TYPES_H */
@@ -21,6 +21,9 @@
 #define _GNU_SOURCE
 #include <unistd.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <limits.h>
+#include <dirent.h>
 #include "smp.h"
 
 int __num_possible_cpus;
@@ -42,3 +45,23 @@ void _get_num_possible_cpus(void)
 		return;
 	__num_possible_cpus = result;
 }
+
+int cpu_to_node(int cpu)
+{
+	char path[PATH_MAX];
+	struct dirent *entry;
+	DIR *dir;
+	int node = -1;
+
+	/* The cpu directory holds a link to its node directory. */
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	while ((entry = readdir(dir)) != NULL) {
+		if (sscanf(entry->d_name, "node%d", &node) == 1)
+			break;
+	}
+	closedir(dir);
+	return node;
+}
@@ -40,6 +40,11 @@ int num_possible_cpus(void)
 	return __num_possible_cpus;
 }
 
+/*
+ * Returns the NUMA node of a cpu, or -1 if unknown.
+ */
+extern int cpu_to_node(int cpu);
+
 #define for_each_possible_cpu(cpu)		\
 	for ((cpu) = 0; (cpu) < num_possible_cpus(); (cpu)++)
 
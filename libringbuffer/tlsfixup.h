@@ -23,4 +23,12 @@
 
 void lttng_fixup_ringbuffer_tls(void);
 
+/* Per-thread buffer ownership state, see frontend_internal.h. */
+void lib_ring_buffer_thread_init(void);
+void lib_ring_buffer_thread_exit(void);
+void lib_ring_buffer_thread_reset(void);
+
+/* Channel timer engine, see ring_buffer_frontend.c. */
+void lib_ring_buffer_timer_after_fork_child(void);
+
 #endif /* _LTTNG_UST_LIB_RINGBUFFER_TLS_FIXUP_H */
@@ -0,0 +1,458 @@
+/*
+ * bench_filter.c
+ *
+ * LTTng Userspace Tracer (UST) - filter engine microbenchmark
+ *
+ * Copyright (C) 2016 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Link representative filter bytecode programs to a fake event, then
+ * time their evaluation over a table of payloads, both through
+ * lttng_filter_interpret_bytecode() and through the function selected
+ * at link time (native code when the JIT is available). Branch misses
+ * are counted with perf when available.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <lttng/ust-events.h>
+#include "lttng-filter.h"
+
+#ifdef LTTNG_UST_HAVE_PERF_EVENT
+#include <linux/perf_event.h>
+#endif
+
+#define NR_PAYLOADS	1024	/* Power of 2 */
+#define DEFAULT_ITERS	10000000UL
+
+/* Filter stack data layout of the benchmark event. */
+struct payload {
+	int64_t intfield;
+	double dblfield;
+	const char *strfield;
+};
+
+static const struct lttng_event_field fields[] = {
+	{ .name = "intfield", .type = { .atype = atype_integer } },
+	{ .name = "dblfield", .type = { .atype = atype_float } },
+	{ .name = "strfield", .type = { .atype = atype_string } },
+};
+
+static const struct lttng_event_desc desc = {
+	.name = "bench_filter:event",
+	.fields = fields,
+	.nr_fields = sizeof(fields) / sizeof(fields[0]),
+};
+
+static const char *strings[] = {
+	"hello world", "hello there", "abc", "abcdef", "bench", "zzz",
+};
+
+static struct payload payloads[NR_PAYLOADS];
+
+struct prog {
+	char code[FILTER_BYTECODE_MAX_LEN / 64];
+	uint16_t len;
+	char relocs[FILTER_BYTECODE_MAX_LEN / 64];
+	uint16_t relocs_len;
+};
+
+static
+void emit(struct prog *p, const void *data, size_t len)
+{
+	if (p->len + len > sizeof(p->code))
+		abort();
+	memcpy(&p->code[p->len], data, len);
+	p->len += len;
+}
+
+static
+void emit_op(struct prog *p, filter_opcode_t op)
+{
+	emit(p, &op, sizeof(op));
+}
+
+static
+void emit_ref(struct prog *p, filter_opcode_t op, const char *name)
+{
+	uint16_t reloc_offset = p->len, zero = 0;
+	size_t name_len = strlen(name) + 1;
+
+	emit_op(p, op);
+	emit(p, &zero, sizeof(zero));
+	if (p->relocs_len + sizeof(reloc_offset) + name_len > sizeof(p->relocs))
+		abort();
+	memcpy(&p->relocs[p->relocs_len], &reloc_offset, sizeof(reloc_offset));
+	p->relocs_len += sizeof(reloc_offset);
+	memcpy(&p->relocs[p->relocs_len], name, name_len);
+	p->relocs_len += name_len;
+}
+
+static
+void emit_field(struct prog *p, const char *name)
+{
+	emit_ref(p, FILTER_OP_LOAD_FIELD_REF, name);
+}
+
+static
+void emit_context(struct prog *p, const char *name)
+{
+	emit_ref(p, FILTER_OP_GET_CONTEXT_REF, name);
+}
+
+static
+void emit_s64(struct prog *p, int64_t v)
+{
+	emit_op(p, FILTER_OP_LOAD_S64);
+	emit(p, &v, sizeof(v));
+}
+
+static
+void emit_double(struct prog *p, double v)
+{
+	emit_op(p, FILTER_OP_LOAD_DOUBLE);
+	emit(p, &v, sizeof(v));
+}
+
+static
+void emit_string(struct prog *p, const char *str)
+{
+	emit_op(p, FILTER_OP_LOAD_STRING);
+	emit(p, str, strlen(str) + 1);
+}
+
+/* Returns the offset of the logical op, to patch with end_logical(). */
+static
+uint16_t emit_logical(struct prog *p, filter_opcode_t op)
+{
+	uint16_t offset = p->len, skip = 0;
+
+	emit_op(p, op);
+	emit(p, &skip, sizeof(skip));
+	return offset;
+}
+
+static
+void end_logical(struct prog *p, uint16_t offset)
+{
+	uint16_t skip = p->len;
+
+	memcpy(&p->code[offset + sizeof(filter_opcode_t)], &skip, sizeof(skip));
+}
+
+/* intfield == 42 */
+static
+void build_s64_eq(struct prog *p)
+{
+	emit_field(p, "intfield");
+	emit_s64(p, 42);
+	emit_op(p, FILTER_OP_EQ);
+}
+
+/* intfield > 10 && intfield < 100 */
+static
+void build_s64_range(struct prog *p)
+{
+	uint16_t and;
+
+	emit_field(p, "intfield");
+	emit_s64(p, 10);
+	emit_op(p, FILTER_OP_GT);
+	and = emit_logical(p, FILTER_OP_AND);
+	emit_field(p, "intfield");
+	emit_s64(p, 100);
+	emit_op(p, FILTER_OP_LT);
+	end_logical(p, and);
+}
+
+/* dblfield > 1.5 */
+static
+void build_double_gt(struct prog *p)
+{
+	emit_field(p, "dblfield");
+	emit_double(p, 1.5);
+	emit_op(p, FILTER_OP_GT);
+}
+
+/* strfield == "hello world" */
+static
+void build_string_eq(struct prog *p)
+{
+	emit_field(p, "strfield");
+	emit_string(p, "hello world");
+	emit_op(p, FILTER_OP_EQ);
+}
+
+/* "hello world" == strfield: literal first, generic string compare */
+static
+void build_string_eq_rev(struct prog *p)
+{
+	emit_string(p, "hello world");
+	emit_field(p, "strfield");
+	emit_op(p, FILTER_OP_EQ);
+}
+
+/* strfield == "hello*" */
+static
+void build_string_wildcard(struct prog *p)
+{
+	emit_field(p, "strfield");
+	emit_string(p, "hello*");
+	emit_op(p, FILTER_OP_EQ);
+}
+
+/* $ctx.vtid != 0 */
+static
+void build_context_s64(struct prog *p)
+{
+	emit_context(p, "$ctx.vtid");
+	emit_s64(p, 0);
+	emit_op(p, FILTER_OP_NE);
+}
+
+/* $ctx.procname == "bench*" */
+static
+void build_context_string(struct prog *p)
+{
+	emit_context(p, "$ctx.procname");
+	emit_string(p, "bench*");
+	emit_op(p, FILTER_OP_EQ);
+}
+
+/*
+ * (intfield > 10 && intfield < 100)
+ *	|| (dblfield > 1.5 && strfield == "abc*")
+ */
+static
+void build_nested(struct prog *p)
+{
+	uint16_t or, and;
+
+	build_s64_range(p);
+	or = emit_logical(p, FILTER_OP_OR);
+	build_double_gt(p);
+	and = emit_logical(p, FILTER_OP_AND);
+	emit_field(p, "strfield");
+	emit_string(p, "abc*");
+	emit_op(p, FILTER_OP_EQ);
+	end_logical(p, and);
+	end_logical(p, or);
+}
+
+/* 1 == 1 && intfield == 2: constant folded */
+static
+void build_folded(struct prog *p)
+{
+	uint16_t and;
+
+	emit_s64(p, 1);
+	emit_s64(p, 1);
+	emit_op(p, FILTER_OP_EQ);
+	and = emit_logical(p, FILTER_OP_AND);
+	emit_field(p, "intfield");
+	emit_s64(p, 2);
+	emit_op(p, FILTER_OP_EQ);
+	end_logical(p, and);
+}
+
+static const struct {
+	const char *name;
+	void (*build)(struct prog *p);
+} shapes[] = {
+	{ "s64 ==", build_s64_eq },
+	{ "s64 range (&&)", build_s64_range },
+	{ "double >", build_double_gt },
+	{ "string == literal", build_string_eq },
+	{ "literal == string", build_string_eq_rev },
+	{ "string == wildcard", build_string_wildcard },
+	{ "context s64", build_context_s64 },
+	{ "context string wildcard", build_context_string },
+	{ "nested && ||", build_nested },
+	{ "constant folded", build_folded },
+};
+
+#define NR_SHAPES	(sizeof(shapes) / sizeof(shapes[0]))
+
+#ifdef LTTNG_UST_HAVE_PERF_EVENT
+static
+int branch_misses_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#else
+static
+int branch_misses_open(void)
+{
+	return -1;
+}
+#endif
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+void run(const char *name, struct lttng_bytecode_runtime *runtime,
+		uint64_t (*filter)(void *filter_data,
+			const char *filter_stack_data),
+		unsigned long iters, int perf_fd)
+{
+	uint64_t start, end, misses = 0, recorded = 0;
+	unsigned long i;
+
+	/* Warm up. */
+	for (i = 0; i < NR_PAYLOADS; i++)
+		recorded += filter(runtime, (const char *) &payloads[i]);
+	recorded = 0;
+#ifdef LTTNG_UST_HAVE_PERF_EVENT
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+	start = now_ns();
+	for (i = 0; i < iters; i++)
+		recorded += filter(runtime,
+			(const char *) &payloads[i & (NR_PAYLOADS - 1)]);
+	end = now_ns();
+#ifdef LTTNG_UST_HAVE_PERF_EVENT
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+			misses = 0;
+	}
+#endif
+	printf("%-26s %-8s %8.2f", name,
+		filter == lttng_filter_interpret_bytecode ? "interp" : "linked",
+		(double) (end - start) / iters);
+	if (perf_fd >= 0)
+		printf(" %10.4f", (double) misses / iters);
+	else
+		printf(" %10s", "-");
+	printf(" %7.1f%%\n", 100.0 * recorded / iters);
+}
+
+int main(int argc, char **argv)
+{
+	struct lttng_session session;
+	struct lttng_channel chan;
+	unsigned long iters = DEFAULT_ITERS;
+	const char *env;
+	unsigned int i;
+	int perf_fd;
+
+	env = getenv("ITERS");
+	if (env)
+		iters = strtoul(env, NULL, 10);
+	if (!iters)
+		iters = DEFAULT_ITERS;
+
+	srand(42);
+	for (i = 0; i < NR_PAYLOADS; i++) {
+		payloads[i].intfield = rand() % 200;
+		payloads[i].dblfield = (rand() % 400) / 100.0;
+		payloads[i].strfield =
+			strings[rand() % (sizeof(strings) / sizeof(strings[0]))];
+	}
+
+	memset(&session, 0, sizeof(session));
+	memset(&chan, 0, sizeof(chan));
+	CDS_INIT_LIST_HEAD(&session.filter_runtime_head);
+	if (lttng_session_context_init(&session.ctx)) {
+		fprintf(stderr, "Cannot initialize session contexts\n");
+		exit(EXIT_FAILURE);
+	}
+	chan.session = &session;
+
+	perf_fd = branch_misses_open();
+	if (perf_fd < 0)
+		fprintf(stderr, "Branch miss counter unavailable\n");
+
+	printf("%-26s %-8s %8s %10s %8s\n", "program", "engine", "ns/eval",
+		"br-miss", "record");
+	for (i = 0; i < NR_SHAPES; i++) {
+		struct lttng_ust_filter_bytecode_node *node;
+		struct lttng_bytecode_runtime *runtime;
+		struct lttng_enabler enabler;
+		struct lttng_event event;
+		struct prog prog;
+
+		memset(&prog, 0, sizeof(prog));
+		shapes[i].build(&prog);
+		emit_op(&prog, FILTER_OP_RETURN);
+
+		node = calloc(1, sizeof(*node) + prog.len + prog.relocs_len);
+		if (!node)
+			exit(EXIT_FAILURE);
+		memcpy(node->bc.data, prog.code, prog.len);
+		memcpy(&node->bc.data[prog.len], prog.relocs, prog.relocs_len);
+		node->bc.len = prog.len + prog.relocs_len;
+		node->bc.reloc_offset = prog.len;
+
+		memset(&enabler, 0, sizeof(enabler));
+		enabler.enabled = 1;
+		CDS_INIT_LIST_HEAD(&enabler.filter_bytecode_head);
+		node->enabler = &enabler;
+		cds_list_add(&node->node, &enabler.filter_bytecode_head);
+
+		memset(&event, 0, sizeof(event));
+		event.desc = &desc;
+		event.chan = &chan;
+		CDS_INIT_LIST_HEAD(&event.bytecode_runtime_head);
+		lttng_enabler_event_link_bytecode(&event, &enabler);
+
+		runtime = cds_list_entry(event.bytecode_runtime_head.next,
+				struct lttng_bytecode_runtime, node);
+		if (runtime->link_failed) {
+			printf("%-26s link failed\n", shapes[i].name);
+		} else {
+			run(shapes[i].name, runtime,
+				lttng_filter_interpret_bytecode, iters,
+				perf_fd);
+			run(shapes[i].name, runtime, runtime->filter, iters,
+				perf_fd);
+		}
+		lttng_free_event_filter_runtime(&event);
+		free(node);
+	}
+	if (perf_fd >= 0)
+		close(perf_fd);
+	lttng_destroy_context(session.ctx);
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * bench_session_ht.c
+ *
+ * LTTng Userspace Tracer (UST) - session hash table microbenchmark
+ *
+ * Copyright (C) 2016 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Insert and look up event names in the hash table used by sessions to
+ * index their events and enumerations, performing the same name
+ * comparisons as lttng_event_create(), for an increasing number of
+ * events per session. The same work is done on a table with the
+ * former fixed number of buckets (LTTNG_UST_EVENT_HT_SIZE) for
+ * comparison: the cost per operation of the resizable table should stay
+ * flat as the number of events grows.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <urcu/hlist.h>
+#include <lttng/ust-events.h>
+#include "lttng-tracer-core.h"
+#include "jhash.h"
+
+#define DEFAULT_NR_EVENTS	100000UL
+
+struct bench_event {
+	char name[LTTNG_UST_SYM_NAME_LEN];
+	struct cds_hlist_node hlist;
+};
+
+static struct bench_event *events;
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+uint32_t bench_event_hash_node(struct cds_hlist_node *node)
+{
+	struct bench_event *event =
+		caa_container_of(node, struct bench_event, hlist);
+
+	return jhash(event->name, strlen(event->name), 0);
+}
+
+static
+struct bench_event *lookup(struct cds_hlist_head *head, const char *name)
+{
+	struct bench_event *event;
+	struct cds_hlist_node *node;
+
+	cds_hlist_for_each_entry(event, node, head, hlist) {
+		if (!strncmp(event->name, name, LTTNG_UST_SYM_NAME_LEN - 1))
+			return event;
+	}
+	return NULL;
+}
+
+/*
+ * Returns the number of lookups which did not find their event, which
+ * should be 0.
+ */
+static
+unsigned long bench_resizable(unsigned long nr, double *add_ns,
+		double *lookup_ns)
+{
+	struct lttng_ust_ht ht;
+	unsigned long i, missed = 0;
+	uint64_t start;
+
+	if (lttng_ust_ht_init(&ht)) {
+		fprintf(stderr, "Cannot allocate hash table\n");
+		exit(EXIT_FAILURE);
+	}
+	start = now_ns();
+	for (i = 0; i < nr; i++) {
+		struct bench_event *event = &events[i];
+		uint32_t hash = jhash(event->name, strlen(event->name), 0);
+
+		/* Like lttng_event_create(), check for a duplicate first. */
+		if (lookup(lttng_ust_ht_bucket(&ht, hash), event->name))
+			abort();
+		lttng_ust_ht_add(&ht, &event->hlist, hash,
+			bench_event_hash_node);
+	}
+	*add_ns = (double) (now_ns() - start) / nr;
+	start = now_ns();
+	for (i = 0; i < nr; i++) {
+		const char *name = events[(i * 7919) % nr].name;
+		uint32_t hash = jhash(name, strlen(name), 0);
+
+		if (!lookup(lttng_ust_ht_bucket(&ht, hash), name))
+			missed++;
+	}
+	*lookup_ns = (double) (now_ns() - start) / nr;
+	lttng_ust_ht_fini(&ht);
+	return missed;
+}
+
+static
+unsigned long bench_fixed(unsigned long nr, double *add_ns,
+		double *lookup_ns)
+{
+	struct lttng_ust_event_ht *ht;
+	unsigned long i, missed = 0;
+	uint64_t start;
+
+	ht = calloc(1, sizeof(*ht));
+	if (!ht) {
+		fprintf(stderr, "Cannot allocate hash table\n");
+		exit(EXIT_FAILURE);
+	}
+	start = now_ns();
+	for (i = 0; i < nr; i++) {
+		struct bench_event *event = &events[i];
+		uint32_t hash = jhash(event->name, strlen(event->name), 0);
+		struct cds_hlist_head *head;
+
+		head = &ht->table[hash & (LTTNG_UST_EVENT_HT_SIZE - 1)];
+		if (lookup(head, event->name))
+			abort();
+		cds_hlist_add_head(&event->hlist, head);
+	}
+	*add_ns = (double) (now_ns() - start) / nr;
+	start = now_ns();
+	for (i = 0; i < nr; i++) {
+		const char *name = events[(i * 7919) % nr].name;
+		uint32_t hash = jhash(name, strlen(name), 0);
+
+		if (!lookup(&ht->table[hash & (LTTNG_UST_EVENT_HT_SIZE - 1)],
+				name))
+			missed++;
+	}
+	*lookup_ns = (double) (now_ns() - start) / nr;
+	free(ht);
+	return missed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long max_events = DEFAULT_NR_EVENTS, nr, i;
+	const char *env;
+
+	env = getenv("NR_EVENTS");
+	if (env)
+		max_events = strtoul(env, NULL, 10);
+	if (!max_events)
+		max_events = DEFAULT_NR_EVENTS;
+
+	events = calloc(max_events, sizeof(*events));
+	if (!events) {
+		fprintf(stderr, "Cannot allocate events\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < max_events; i++)
+		snprintf(events[i].name, sizeof(events[i].name),
+			"bench_provider_%lu:event_%lu", i % 100, i);
+
+	printf("%-10s %-10s %10s %10s\n", "events", "table",
+		"ns/add", "ns/lookup");
+	for (nr = 1000; ; nr *= 10) {
+		double add_ns, lookup_ns;
+
+		if (nr > max_events)
+			nr = max_events;
+		if (bench_resizable(nr, &add_ns, &lookup_ns))
+			abort();
+		printf("%-10lu %-10s %10.1f %10.1f\n", nr, "resizable",
+			add_ns, lookup_ns);
+		if (bench_fixed(nr, &add_ns, &lookup_ns))
+			abort();
+		printf("%-10lu %-10s %10.1f %10.1f\n", nr, "fixed",
+			add_ns, lookup_ns);
+		if (nr == max_events)
+			break;
+	}
+	free(events);
+	return 0;
+}
@@ -0,0 +1,928 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Filter bytecode linking: expressions are built as relocated bytecode,
+ * then validated, optimized and specialized as lttng-filter.c does.
+ * Constant folding must not change the outcome of the filter, and the
+ * native code compiled from them must evaluate exactly as the
+ * interpreter for every input. String literals compared with a string
+ * field are pre-parsed at link time, and must match the same strings
+ * as the generic string comparison. Sampling and rate limiting are
+ * checked against a fake trace clock. Events sharing the layout of the
+ * fields a filter reads share its linked bytecode.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <lttng/ust-clock.h>
+#include "lttng-filter.h"
+#include "tap.h"
+
+#define NUM_TESTS	(2 * NR_JIT_EXPR + 1 + 3 * NR_OPT_EXPR + 7 + 8 + 5)
+#define MAX_TOKENS	32
+
+enum token_type {
+	TOK_END = 0,
+	TOK_S64,
+	TOK_DOUBLE,
+	TOK_STRING,
+	TOK_SAMPLE,
+	TOK_RATE_LIMIT,
+	TOK_REF,	/* Field or context reference */
+	TOK_OP,		/* Operator, applied to the operands before it */
+	TOK_LOGICAL,	/* AND/OR, between its operands */
+	TOK_LOGICAL_END,	/* End of the right operand of a logical op */
+};
+
+struct token {
+	enum token_type type;
+	filter_opcode_t op;
+	int64_t v;
+	double d;
+	const char *s;
+	uint32_t burst;
+};
+
+#define S64(_v)		{ .type = TOK_S64, .v = (_v) }
+#define DBL(_d)		{ .type = TOK_DOUBLE, .d = (_d) }
+#define STR(_s)		{ .type = TOK_STRING, .s = (_s) }
+#define SAMPLE(_p)	{ .type = TOK_SAMPLE, .v = (_p) }
+#define RATE_LIMIT(_r, _b)	{ .type = TOK_RATE_LIMIT, .v = (_r), .burst = (_b) }
+#define OP(_op)		{ .type = TOK_OP, .op = FILTER_OP_##_op }
+#define AND		{ .type = TOK_LOGICAL, .op = FILTER_OP_AND }
+#define OR		{ .type = TOK_LOGICAL, .op = FILTER_OP_OR }
+#define LEND		{ .type = TOK_LOGICAL_END }
+
+/* Event fields, at their offset in the filter stack data. */
+#define FIELD_A		{ .type = TOK_REF, .op = FILTER_OP_LOAD_FIELD_REF_S64, .v = 0 }
+#define FIELD_B		{ .type = TOK_REF, .op = FILTER_OP_LOAD_FIELD_REF_S64, .v = 8 }
+#define FIELD_D		{ .type = TOK_REF, .op = FILTER_OP_LOAD_FIELD_REF_DOUBLE, .v = 16 }
+#define FIELD_S		{ .type = TOK_REF, .op = FILTER_OP_LOAD_FIELD_REF_STRING, .v = 24 }
+#define FIELD_SEQ	{ .type = TOK_REF, .op = FILTER_OP_LOAD_FIELD_REF_SEQUENCE, .v = 32 }
+/* Field "x" of the event, relocated when linked to an event. */
+#define FIELD_X		{ .type = TOK_REF, .op = FILTER_OP_LOAD_FIELD_REF }
+/* Session context fields, at their index in the context. */
+#define CTX_S64		{ .type = TOK_REF, .op = FILTER_OP_GET_CONTEXT_REF_S64, .v = 0 }
+#define CTX_DOUBLE	{ .type = TOK_REF, .op = FILTER_OP_GET_CONTEXT_REF_DOUBLE, .v = 1 }
+#define CTX_DYNAMIC	{ .type = TOK_REF, .op = FILTER_OP_GET_CONTEXT_REF, .v = 2 }
+
+struct expr {
+	const char *str;
+	struct token tok[MAX_TOKENS];
+};
+
+static const struct expr jit_expr[] = {
+	{ "a == 5", { FIELD_A, S64(5), OP(EQ) } },
+	{ "a > b && b < 10", { FIELD_A, FIELD_B, OP(GT), AND,
+		FIELD_B, S64(10), OP(LT), LEND } },
+	{ "a < 0 || d > 1.5", { FIELD_A, S64(0), OP(LT), OR,
+		FIELD_D, DBL(1.5), OP(GT), LEND } },
+	{ "-a >= b", { FIELD_A, OP(UNARY_MINUS), FIELD_B, OP(GE) } },
+	{ "!a || a != 3", { FIELD_A, OP(UNARY_NOT), OR,
+		FIELD_A, S64(3), OP(NE), LEND } },
+	{ "d <= a", { FIELD_D, FIELD_A, OP(LE) } },
+	{ "b == d", { FIELD_B, FIELD_D, OP(EQ) } },
+	{ "!d", { FIELD_D, OP(UNARY_NOT) } },
+	{ "(a == 1 || b == 2) && d != 0.0", { FIELD_A, S64(1), OP(EQ), OR,
+		FIELD_B, S64(2), OP(EQ), LEND, AND,
+		FIELD_D, DBL(0.0), OP(NE), LEND } },
+	{ "(s64) d == a", { FIELD_D, OP(CAST_TO_S64), FIELD_A, OP(EQ) } },
+	{ "$ctx.s > a && $ctx.d < d", { CTX_S64, FIELD_A, OP(GT), AND,
+		CTX_DOUBLE, FIELD_D, OP(LT), LEND } },
+};
+#define NR_JIT_EXPR	(sizeof(jit_expr) / sizeof(jit_expr[0]))
+
+struct opt_expr {
+	struct expr expr;
+	int folded;		/* Expected to be folded to a literal */
+	uint64_t s64_result;	/* With an S64 dynamic context */
+	uint64_t string_result;	/* With a string dynamic context */
+};
+
+static const struct opt_expr opt_expr[] = {
+	{ { "a == 1 || 1", { FIELD_A, S64(1), OP(EQ), OR, S64(1), LEND } },
+		1, 1, 1 },
+	{ { "a == 1 && 0", { FIELD_A, S64(1), OP(EQ), AND, S64(0), LEND } },
+		1, 0, 0 },
+	{ { "1 || $ctx.dyn", { S64(1), OR, CTX_DYNAMIC, LEND } },
+		1, 1, 1 },
+	{ { "$ctx.dyn || 1", { CTX_DYNAMIC, OR, S64(1), LEND } },
+		0, 1, 0 },
+	{ { "$ctx.dyn == 1 || 1", { CTX_DYNAMIC, S64(1), OP(EQ), OR,
+		S64(1), LEND } },
+		0, 1, 0 },
+	{ { "!($ctx.dyn > 2) || 1", { CTX_DYNAMIC, S64(2), OP(GT),
+		OP(UNARY_NOT), OR, S64(1), LEND } },
+		0, 1, 0 },
+	{ { "$ctx.dyn == 1 && 0", { CTX_DYNAMIC, S64(1), OP(EQ), AND,
+		S64(0), LEND } },
+		0, 0, 0 },
+};
+#define NR_OPT_EXPR	(sizeof(opt_expr) / sizeof(opt_expr[0]))
+
+static const int64_t s64_values[] = {
+	INT64_MIN, -3, -1, 0, 1, 2, 3, 5, 10, INT64_MAX,
+};
+#define NR_S64_VALUES	(sizeof(s64_values) / sizeof(s64_values[0]))
+
+static double double_values[] = {
+	-1.5, 0.0, 1.0, 1.5, 2.0, 3.0, 5.0, 1e300, 0.0 /* NaN */,
+};
+#define NR_DOUBLE_VALUES	(sizeof(double_values) / sizeof(double_values[0]))
+
+static int64_t ctx_s64;
+static double ctx_double;
+static int ctx_dynamic_string;
+
+static
+void get_ctx_s64(struct lttng_ctx_field *field, struct lttng_ctx_value *value)
+{
+	value->sel = LTTNG_UST_DYNAMIC_TYPE_S64;
+	value->u.s64 = ctx_s64;
+}
+
+static
+void get_ctx_double(struct lttng_ctx_field *field,
+		struct lttng_ctx_value *value)
+{
+	value->sel = LTTNG_UST_DYNAMIC_TYPE_DOUBLE;
+	value->u.d = ctx_double;
+}
+
+/* Either an S64 or a string, as an application context may be. */
+static
+void get_ctx_dynamic(struct lttng_ctx_field *field,
+		struct lttng_ctx_value *value)
+{
+	if (ctx_dynamic_string) {
+		value->sel = LTTNG_UST_DYNAMIC_TYPE_STRING;
+		value->u.str = "abc";
+	} else {
+		value->sel = LTTNG_UST_DYNAMIC_TYPE_S64;
+		value->u.s64 = 1;
+	}
+}
+
+static struct lttng_ctx_field ctx_fields[] = {
+	{ .get_value = get_ctx_s64 },
+	{ .get_value = get_ctx_double },
+	{ .get_value = get_ctx_dynamic },
+};
+
+static struct lttng_ctx ctx = {
+	.fields = ctx_fields,
+	.nr_fields = sizeof(ctx_fields) / sizeof(ctx_fields[0]),
+};
+
+static struct lttng_session session;
+
+static
+void emit(char *data, uint16_t *len, const void *p, size_t p_len)
+{
+	memcpy(&data[*len], p, p_len);
+	*len += p_len;
+}
+
+/*
+ * Emit the bytecode of an expression followed by a return, as the
+ * session daemon does, with the relocations already applied.
+ */
+static
+uint16_t build_bytecode(const struct expr *expr, char *data)
+{
+	uint16_t len = 0, logical[MAX_TOKENS];
+	unsigned int i, nr_logical = 0;
+	filter_opcode_t op;
+
+	for (i = 0; i < MAX_TOKENS && expr->tok[i].type != TOK_END; i++) {
+		const struct token *tok = &expr->tok[i];
+
+		switch (tok->type) {
+		case TOK_S64:
+			op = FILTER_OP_LOAD_S64;
+			emit(data, &len, &op, sizeof(op));
+			emit(data, &len, &tok->v, sizeof(tok->v));
+			break;
+		case TOK_DOUBLE:
+			op = FILTER_OP_LOAD_DOUBLE;
+			emit(data, &len, &op, sizeof(op));
+			emit(data, &len, &tok->d, sizeof(tok->d));
+			break;
+		case TOK_STRING:
+			op = FILTER_OP_LOAD_STRING;
+			emit(data, &len, &op, sizeof(op));
+			emit(data, &len, tok->s, strlen(tok->s) + 1);
+			break;
+		case TOK_SAMPLE:
+		{
+			struct sample_op insn = {
+				.op = FILTER_OP_SAMPLE,
+				.period = tok->v,
+			};
+
+			emit(data, &len, &insn, sizeof(insn));
+			break;
+		}
+		case TOK_RATE_LIMIT:
+		{
+			struct rate_limit_op insn = {
+				.op = FILTER_OP_RATE_LIMIT,
+				.rate = tok->v,
+				.burst = tok->burst,
+			};
+
+			emit(data, &len, &insn, sizeof(insn));
+			break;
+		}
+		case TOK_REF:
+		{
+			uint16_t offset = tok->v;
+
+			emit(data, &len, &tok->op, sizeof(tok->op));
+			emit(data, &len, &offset, sizeof(offset));
+			break;
+		}
+		case TOK_OP:
+			emit(data, &len, &tok->op, sizeof(tok->op));
+			break;
+		case TOK_LOGICAL:
+		{
+			struct logical_op insn = { .op = tok->op };
+
+			logical[nr_logical++] = len;
+			emit(data, &len, &insn, sizeof(insn));
+			break;
+		}
+		case TOK_LOGICAL_END:
+		{
+			struct logical_op *insn;
+
+			insn = (struct logical_op *) &data[logical[--nr_logical]];
+			insn->skip_offset = len;
+			break;
+		}
+		default:
+			abort();
+		}
+	}
+	op = FILTER_OP_RETURN;
+	emit(data, &len, &op, sizeof(op));
+	return len;
+}
+
+/* Link an expression as lttng-filter.c does, without native code. */
+static
+struct bytecode_runtime *link_expr(const struct expr *expr)
+{
+	struct bytecode_runtime *runtime;
+	char data[512];
+	uint16_t len;
+
+	len = build_bytecode(expr, data);
+	runtime = calloc(1, sizeof(*runtime) + len);
+	if (!runtime)
+		return NULL;
+	runtime->len = len;
+	memcpy(runtime->data, data, len);
+	if (lttng_filter_validate_bytecode(runtime)
+			|| lttng_filter_optimize_bytecode(runtime)
+			|| lttng_filter_specialize_bytecode(runtime)) {
+		free(runtime);
+		return NULL;
+	}
+	return runtime;
+}
+
+static
+void set_stack_data(char *stack_data, int64_t a, int64_t b, double d)
+{
+	memcpy(&stack_data[0], &a, sizeof(a));
+	memcpy(&stack_data[8], &b, sizeof(b));
+	memcpy(&stack_data[16], &d, sizeof(d));
+}
+
+/* Number of inputs for which native code and interpreter disagree. */
+static
+unsigned int jit_mismatches(struct event_filter_runtime *filter,
+		const struct expr *expr)
+{
+	uint64_t (*jit)(void *filter_data, const char *filter_stack_data);
+	unsigned int ia, ib, id, nr = 0;
+	char stack_data[24];
+
+	jit = (uint64_t (*)(void *, const char *)) filter->shared->jit_code;
+	for (ia = 0; ia < NR_S64_VALUES; ia++) {
+		for (ib = 0; ib < NR_S64_VALUES; ib++) {
+			for (id = 0; id < NR_DOUBLE_VALUES; id++) {
+				uint64_t expected, result;
+
+				set_stack_data(stack_data, s64_values[ia],
+					s64_values[ib], double_values[id]);
+				ctx_s64 = s64_values[ib];
+				ctx_double = double_values[NR_DOUBLE_VALUES - 1 - id];
+				expected = lttng_filter_interpret_bytecode(filter,
+					stack_data);
+				result = jit(filter, stack_data);
+				if (result != expected) {
+					diag("%s: a=%" PRId64 " b=%" PRId64
+						" d=%g: expected %" PRIu64
+						", got %" PRIu64, expr->str,
+						s64_values[ia], s64_values[ib],
+						double_values[id], expected,
+						result);
+					nr++;
+				}
+			}
+		}
+	}
+	return nr;
+}
+
+/* Result of the linked filter, as the probe sees it. */
+static
+uint64_t run_filter(struct bytecode_runtime *runtime)
+{
+	struct event_filter_runtime filter;
+	char stack_data[24];
+
+	if (runtime->const_false)
+		return 0;
+	memset(&filter, 0, sizeof(filter));
+	filter.p.session = &session;
+	filter.shared = runtime;
+	set_stack_data(stack_data, 0, 0, 0.0);
+	return lttng_filter_interpret_bytecode(&filter, stack_data);
+}
+
+static
+void test_optimize(void)
+{
+	struct bytecode_runtime *runtime;
+	unsigned int i;
+
+	for (i = 0; i < NR_OPT_EXPR; i++) {
+		const struct opt_expr *e = &opt_expr[i];
+		char data[512];
+		uint16_t len;
+
+		len = build_bytecode(&e->expr, data);
+		runtime = link_expr(&e->expr);
+		if (!runtime) {
+			fail("Link \"%s\"", e->expr.str);
+			skip(2, "Link failed");
+			continue;
+		}
+		/* A literal and a return are left once folded. */
+		ok((runtime->len < len) == e->folded,
+			"\"%s\" is %s", e->expr.str,
+			e->folded ? "folded" : "not folded");
+		ctx_dynamic_string = 0;
+		ok(run_filter(runtime) == e->s64_result,
+			"\"%s\" is %" PRIu64 " with an S64 context",
+			e->expr.str, e->s64_result);
+		ctx_dynamic_string = 1;
+		ok(run_filter(runtime) == e->string_result,
+			"\"%s\" is %" PRIu64 " with a string context",
+			e->expr.str, e->string_result);
+		free(runtime);
+	}
+}
+
+static
+void test_jit(void)
+{
+	struct event_filter_runtime filter;
+	struct bytecode_runtime *runtime;
+	unsigned int i;
+
+	runtime = link_expr(&jit_expr[0]);
+	ok(runtime && lttng_filter_jit_compile(runtime) == -ENOTSUP,
+		"Filters are interpreted unless LTTNG_UST_FILTER_JIT=1");
+	free(runtime);
+
+	setenv("LTTNG_UST_FILTER_JIT", "1", 1);
+	for (i = 0; i < NR_JIT_EXPR; i++) {
+		runtime = link_expr(&jit_expr[i]);
+		ok(runtime && !lttng_filter_jit_compile(runtime)
+			&& runtime->jit_code,
+			"Compile \"%s\" to native code", jit_expr[i].str);
+		if (!runtime || !runtime->jit_code) {
+			fail("Native code of \"%s\" matches the interpreter",
+				jit_expr[i].str);
+			free(runtime);
+			continue;
+		}
+		memset(&filter, 0, sizeof(filter));
+		filter.p.session = &session;
+		filter.shared = runtime;
+		ok(jit_mismatches(&filter, &jit_expr[i]) == 0,
+			"Native code of \"%s\" matches the interpreter",
+			jit_expr[i].str);
+		lttng_filter_jit_free(runtime);
+		free(runtime);
+	}
+	unsetenv("LTTNG_UST_FILTER_JIT");
+}
+
+/* String literals, in the filter language (escapes not yet parsed). */
+static const char *exact_literals[] = {
+	"abc", "a", "abcdef", "xyz",
+};
+static const char *prefix_literals[] = {
+	"ab*", "*", "abc*", "abc*def", "a*",
+};
+static const char *escape_literals[] = {
+	"a\\*c", "a\\\\c", "\\*", "\\\\", "ab\\**",
+};
+static const char *invalid_escape_literals[] = {
+	"a\\qc", "\\n", "ab\\c*",
+};
+static const char *trailing_backslash_literals[] = {
+	"abc\\", "\\", "a\\\\\\",
+};
+
+static const char *subjects[] = {
+	"", "a", "ab", "abc", "abcd", "abcdef", "abd", "xyz", "a*c", "a\\c",
+	"aqc", "a\\qc", "abc\\", "\\", "*", "a\\", "ab*", "ab*c", "\\n",
+};
+#define NR_SUBJECTS	(sizeof(subjects) / sizeof(subjects[0]))
+
+/* Sequences are not null-terminated within their length. */
+static const struct {
+	const char *str;
+	unsigned long len;
+} sequences[] = {
+	{ "abcXYZ", 3 }, { "abc", 3 }, { "abc", 2 }, { "abcdef", 6 },
+	{ "a*cdef", 3 }, { "a\\c", 3 }, { "abc\\", 4 }, { "", 0 },
+	{ "ab\0cd", 5 },
+};
+#define NR_SEQUENCES	(sizeof(sequences) / sizeof(sequences[0]))
+
+static
+uint64_t run_string_filter(struct bytecode_runtime *runtime, const char *str,
+		unsigned long seq_len)
+{
+	struct event_filter_runtime filter;
+	char stack_data[48];
+
+	memset(&filter, 0, sizeof(filter));
+	filter.p.session = &session;
+	filter.shared = runtime;
+	set_stack_data(stack_data, 0, 0, 0.0);
+	memcpy(&stack_data[24], &str, sizeof(str));
+	memcpy(&stack_data[32], &seq_len, sizeof(seq_len));
+	memcpy(&stack_data[40], &str, sizeof(str));
+	return lttng_filter_interpret_bytecode(&filter, stack_data);
+}
+
+/*
+ * Compare "field op literal", where the literal is pre-parsed into a
+ * matcher, with "literal op field", which is left to the generic
+ * string comparison, for each subject. Returns the number of subjects
+ * for which they disagree, or -1 if the literal is not pre-parsed.
+ */
+static
+int string_match_mismatches(const char *literal, filter_opcode_t op,
+		int sequence)
+{
+	struct expr matched = { literal }, compared = { literal };
+	struct bytecode_runtime *match_rt, *cmp_rt;
+	struct token field = FIELD_S, lit = STR(literal),
+		cmp = { .type = TOK_OP, .op = op };
+	unsigned int i;
+	int nr = 0;
+
+	if (sequence)
+		field = (struct token) FIELD_SEQ;
+	matched.tok[0] = field;
+	matched.tok[1] = lit;
+	matched.tok[2] = cmp;
+	compared.tok[0] = lit;
+	compared.tok[1] = field;
+	compared.tok[2] = cmp;
+	match_rt = link_expr(&matched);
+	cmp_rt = link_expr(&compared);
+	if (!match_rt || !cmp_rt || match_rt->nr_matchers != 1
+			|| cmp_rt->nr_matchers) {
+		diag("\"%s\" is not pre-parsed", literal);
+		nr = -1;
+		goto end;
+	}
+	for (i = 0; i < (sequence ? NR_SEQUENCES : NR_SUBJECTS); i++) {
+		const char *str = sequence ? sequences[i].str : subjects[i];
+		unsigned long len = sequence ? sequences[i].len : strlen(str);
+		uint64_t expected, result;
+
+		expected = run_string_filter(cmp_rt, str, len);
+		result = run_string_filter(match_rt, str, len);
+		if (result != expected) {
+			diag("\"%.*s\" %s \"%s\": expected %" PRIu64
+				", got %" PRIu64, (int) len, str,
+				op == FILTER_OP_EQ ? "==" : "!=", literal,
+				expected, result);
+			nr++;
+		}
+	}
+end:
+	lttng_filter_free_string_matchers(match_rt);
+	free(match_rt);
+	free(cmp_rt);
+	return nr;
+}
+
+static
+int literals_match(const char **literals, size_t nr_literals,
+		filter_opcode_t op, int sequence)
+{
+	size_t i;
+	int match = 1;
+
+	for (i = 0; i < nr_literals; i++) {
+		if (string_match_mismatches(literals[i], op, sequence))
+			match = 0;
+	}
+	return match;
+}
+
+#define LITERALS(_l)	(_l), sizeof(_l) / sizeof((_l)[0])
+
+static
+void test_string_match(void)
+{
+	ok(literals_match(LITERALS(exact_literals), FILTER_OP_EQ, 0),
+		"Exact literals match as with the string comparison");
+	ok(literals_match(LITERALS(prefix_literals), FILTER_OP_EQ, 0),
+		"Wildcard literals match as with the string comparison");
+	ok(literals_match(LITERALS(escape_literals), FILTER_OP_EQ, 0),
+		"Literals with \\* and \\\\ escapes match as with the string comparison");
+	ok(literals_match(LITERALS(invalid_escape_literals), FILTER_OP_EQ, 0),
+		"Literals with invalid escapes match as with the string comparison");
+	ok(literals_match(LITERALS(trailing_backslash_literals), FILTER_OP_EQ, 0),
+		"Literals with a trailing backslash match as with the string comparison");
+	ok(literals_match(LITERALS(exact_literals), FILTER_OP_EQ, 1)
+		&& literals_match(LITERALS(prefix_literals), FILTER_OP_EQ, 1)
+		&& literals_match(LITERALS(escape_literals), FILTER_OP_EQ, 1)
+		&& literals_match(LITERALS(trailing_backslash_literals),
+			FILTER_OP_EQ, 1),
+		"Sequence fields match as with the string comparison");
+	ok(literals_match(LITERALS(exact_literals), FILTER_OP_NE, 0)
+		&& literals_match(LITERALS(prefix_literals), FILTER_OP_NE, 0)
+		&& literals_match(LITERALS(escape_literals), FILTER_OP_NE, 0)
+		&& literals_match(LITERALS(invalid_escape_literals),
+			FILTER_OP_NE, 0)
+		&& literals_match(LITERALS(exact_literals), FILTER_OP_NE, 1),
+		"\"!=\" literals match as with the string comparison");
+}
+
+/* Fake trace clock, in milliseconds unless changed. */
+static uint64_t clock_now = 1000, clock_freq = 1000;
+
+static
+uint64_t fake_clock_read64(void)
+{
+	return clock_now;
+}
+
+static
+uint64_t fake_clock_freq(void)
+{
+	return clock_freq;
+}
+
+static
+const char *fake_clock_name(void)
+{
+	return "fake";
+}
+
+static
+const char *fake_clock_description(void)
+{
+	return "Fake clock, set by the test";
+}
+
+static
+int use_fake_clock(void)
+{
+	return lttng_ust_trace_clock_set_read64_cb(fake_clock_read64)
+		|| lttng_ust_trace_clock_set_freq_cb(fake_clock_freq)
+		|| lttng_ust_trace_clock_set_name_cb(fake_clock_name)
+		|| lttng_ust_trace_clock_set_description_cb(fake_clock_description)
+		|| lttng_ust_enable_trace_clock_override();
+}
+
+/*
+ * Filter with its per-event state, on a single cpu. Returns NULL if
+ * the expression does not link.
+ */
+static
+struct event_filter_runtime *state_filter_create(const struct expr *expr)
+{
+	struct event_filter_runtime *filter;
+	struct bytecode_runtime *runtime;
+
+	runtime = link_expr(expr);
+	if (!runtime)
+		return NULL;
+	filter = calloc(1, sizeof(*filter));
+	if (!filter)
+		goto error;
+	filter->p.session = &session;
+	filter->shared = runtime;
+	filter->nr_cpus = 1;
+	filter->state_stride = runtime->nr_states
+		* sizeof(union filter_op_state);
+	filter->state = calloc(1, filter->state_stride);
+	if (!filter->state)
+		goto error;
+	return filter;
+error:
+	if (filter)
+		free(filter->state);
+	free(filter);
+	free(runtime);
+	return NULL;
+}
+
+static
+void state_filter_destroy(struct event_filter_runtime *filter)
+{
+	if (!filter)
+		return;
+	free(filter->shared);
+	free(filter->state);
+	free(filter);
+}
+
+/* Number of events recorded out of nr, without moving the clock. */
+static
+unsigned int state_filter_run(struct event_filter_runtime *filter,
+		unsigned int nr)
+{
+	char stack_data[24];
+	unsigned int i, recorded = 0;
+
+	set_stack_data(stack_data, 0, 0, 0.0);
+	for (i = 0; i < nr; i++) {
+		if (lttng_filter_interpret_bytecode(filter, stack_data))
+			recorded++;
+	}
+	return recorded;
+}
+
+#define NR_SAMPLED	100000
+
+static
+void test_sample(void)
+{
+	const struct expr every = { "sample(1)", { SAMPLE(1) } },
+		quarter = { "sample(4)", { SAMPLE(4) } };
+	struct event_filter_runtime *filter;
+	unsigned int recorded;
+
+	filter = state_filter_create(&every);
+	ok(filter && state_filter_run(filter, NR_SAMPLED) == NR_SAMPLED,
+		"A sampling period of 1 records every event");
+	state_filter_destroy(filter);
+
+	filter = state_filter_create(&quarter);
+	recorded = filter ? state_filter_run(filter, NR_SAMPLED) : 0;
+	diag("sample(4) recorded %u events out of %u", recorded, NR_SAMPLED);
+	ok(recorded > NR_SAMPLED / 4 - NR_SAMPLED / 100
+		&& recorded < NR_SAMPLED / 4 + NR_SAMPLED / 100,
+		"A sampling period of 4 records about a quarter of the events");
+	state_filter_destroy(filter);
+}
+
+static
+void test_rate_limit(void)
+{
+	const struct expr limit = { "rate_limit(10, 5)",
+		{ RATE_LIMIT(10, 5) } },
+		huge_burst = { "rate_limit(1, UINT32_MAX)",
+		{ RATE_LIMIT(1, UINT32_MAX) } };
+	struct event_filter_runtime *filter;
+	struct bytecode_runtime *runtime;
+
+	filter = state_filter_create(&limit);
+	if (!filter) {
+		fail("Link \"%s\"", limit.str);
+		skip(3, "Link failed");
+	} else {
+		ok(state_filter_run(filter, 20) == 5,
+			"A full bucket records a burst of events");
+		clock_now += 100;
+		ok(state_filter_run(filter, 20) == 1,
+			"The bucket is refilled at the rate");
+		clock_now += 10000;
+		ok(state_filter_run(filter, 20) == 5,
+			"The bucket is refilled up to the burst");
+		clock_now += 1ULL << 62;
+		ok(state_filter_run(filter, 20) == 5,
+			"A large clock step refills the bucket up to the burst");
+	}
+	state_filter_destroy(filter);
+
+	runtime = link_expr(&huge_burst);
+	ok(runtime != NULL, "A burst of UINT32_MAX is accepted at 1 kHz");
+	free(runtime);
+	clock_freq = 1000000000000ULL;
+	runtime = link_expr(&huge_burst);
+	ok(runtime == NULL,
+		"A burst overflowing with the clock frequency is rejected");
+	free(runtime);
+	clock_freq = 1000;
+}
+
+/*
+ * Field "x" is at offset 16 and index 1 of event_a, at offset 16 and
+ * index 2 of event_b, and at offset 0 and index 0 of event_c.
+ */
+static const struct lttng_event_field fields_a[] = {
+	{ .name = "seq", .type = { .atype = atype_sequence } },
+	{ .name = "x", .type = { .atype = atype_integer } },
+};
+static const struct lttng_event_field fields_b[] = {
+	{ .name = "s", .type = { .atype = atype_string } },
+	{ .name = "d", .type = { .atype = atype_float } },
+	{ .name = "x", .type = { .atype = atype_integer } },
+};
+static const struct lttng_event_field fields_c[] = {
+	{ .name = "x", .type = { .atype = atype_integer } },
+	{ .name = "y", .type = { .atype = atype_integer } },
+};
+
+#define EVENT_DESC(_fields)						\
+	{								\
+		.name = #_fields,					\
+		.fields = _fields,					\
+		.nr_fields = sizeof(_fields) / sizeof((_fields)[0]),	\
+	}
+
+static const struct lttng_event_desc event_descs[] = {
+	EVENT_DESC(fields_a),
+	EVENT_DESC(fields_b),
+	EVENT_DESC(fields_c),
+};
+#define NR_EVENTS	(sizeof(event_descs) / sizeof(event_descs[0]))
+
+/*
+ * Filter bytecode as received from the session daemon, with its
+ * relocation table: the field reference comes first, at offset 0.
+ */
+static
+struct lttng_ust_filter_bytecode_node *build_reloc_bytecode(
+		const struct expr *expr, struct lttng_enabler *enabler)
+{
+	struct lttng_ust_filter_bytecode_node *node;
+	char data[512];
+	uint16_t len, reloc_offset = 0;
+
+	len = build_bytecode(expr, data);
+	node = calloc(1, sizeof(*node) + len + sizeof(reloc_offset) + 2);
+	if (!node)
+		return NULL;
+	node->enabler = enabler;
+	memcpy(node->bc.data, data, len);
+	node->bc.reloc_offset = len;
+	memcpy(&node->bc.data[len], &reloc_offset, sizeof(reloc_offset));
+	memcpy(&node->bc.data[len + sizeof(reloc_offset)], "x", 2);
+	node->bc.len = len + sizeof(reloc_offset) + 2;
+	return node;
+}
+
+static
+struct event_filter_runtime *event_filter(struct lttng_event *event)
+{
+	if (cds_list_empty(&event->bytecode_runtime_head))
+		return NULL;
+	return caa_container_of(event->bytecode_runtime_head.next,
+			struct event_filter_runtime, p.node);
+}
+
+/* Result of the filter of an event, with x at the given offset. */
+static
+uint64_t run_event_filter(struct event_filter_runtime *filter,
+		uint16_t offset, int64_t x)
+{
+	char stack_data[32];
+
+	memset(stack_data, 0, sizeof(stack_data));
+	memcpy(&stack_data[offset], &x, sizeof(x));
+	return filter->p.filter(filter, stack_data);
+}
+
+static
+void test_shared_runtime(void)
+{
+	const struct expr expr = { "x == 5 && sample(1)",
+		{ FIELD_X, S64(5), OP(EQ), AND, SAMPLE(1), LEND } };
+	static const uint16_t x_offset[NR_EVENTS] = { 16, 16, 0 };
+	struct lttng_event events[NR_EVENTS];
+	struct event_filter_runtime *filter[NR_EVENTS];
+	struct lttng_ust_filter_bytecode_node *bc;
+	struct lttng_enabler enabler;
+	struct lttng_channel chan;
+	unsigned int i;
+	int evaluates = 1;
+
+	memset(&enabler, 0, sizeof(enabler));
+	enabler.enabled = 1;
+	CDS_INIT_LIST_HEAD(&enabler.filter_bytecode_head);
+	memset(&chan, 0, sizeof(chan));
+	chan.session = &session;
+	CDS_INIT_LIST_HEAD(&session.filter_runtime_head);
+	memset(events, 0, sizeof(events));
+	bc = build_reloc_bytecode(&expr, &enabler);
+	if (!bc) {
+		fail("Build \"%s\"", expr.str);
+		skip(4, "No bytecode");
+		return;
+	}
+	cds_list_add(&bc->node, &enabler.filter_bytecode_head);
+	for (i = 0; i < NR_EVENTS; i++) {
+		events[i].chan = &chan;
+		events[i].desc = &event_descs[i];
+		CDS_INIT_LIST_HEAD(&events[i].bytecode_runtime_head);
+		lttng_enabler_event_link_bytecode(&events[i], &enabler);
+		filter[i] = event_filter(&events[i]);
+		if (!filter[i] || filter[i]->p.link_failed) {
+			fail("Link \"%s\" to %s", expr.str,
+				event_descs[i].name);
+			skip(4, "Link failed");
+			goto end;
+		}
+	}
+
+	ok(filter[0]->shared == filter[1]->shared
+		&& filter[0]->shared->refcount == 2,
+		"Events with the same field layout share the linked bytecode");
+	ok(filter[2]->shared != filter[0]->shared
+		&& filter[2]->shared->refcount == 1,
+		"An event with a different field offset has its own linked bytecode");
+	ok(filter[0]->state && filter[1]->state
+		&& filter[0]->state != filter[1]->state,
+		"Events sharing the linked bytecode have their own state");
+	ok(filter[0]->p.field_mask == LTTNG_FILTER_FIELD_BIT(1)
+		&& filter[1]->p.field_mask == LTTNG_FILTER_FIELD_BIT(2)
+		&& filter[2]->p.field_mask == LTTNG_FILTER_FIELD_BIT(0),
+		"Events sharing the linked bytecode have their own field mask");
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (run_event_filter(filter[i], x_offset[i], 5) != 1
+				|| run_event_filter(filter[i], x_offset[i], 4))
+			evaluates = 0;
+	}
+	ok(evaluates, "Each event filter reads x at its offset");
+end:
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (events[i].chan)
+			lttng_free_event_filter_runtime(&events[i]);
+	}
+	free(bc);
+}
+
+int main(void)
+{
+	plan_tests(NUM_TESTS);
+
+	double_values[NR_DOUBLE_VALUES - 1] = NAN;
+	session.ctx = &ctx;
+
+	test_optimize();
+	test_string_match();
+	if (use_fake_clock()) {
+		fail("Use a fake trace clock");
+		skip(7, "No fake trace clock");
+	} else {
+		test_sample();
+		test_rate_limit();
+	}
+	test_shared_runtime();
+#if defined(__x86_64__)
+	test_jit();
+#else
+	skip(2 * NR_JIT_EXPR + 1, "Filters are only compiled on x86-64");
+#endif
+	return exit_status();
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Current CPU number: read from the rseq area registered by the C
+ * library when there is one, with sched_getcpu() otherwise, unless an
+ * override is installed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <lttng/ust-getcpu.h>
+#include "getcpu.h"
+#include "tap.h"
+
+#define NUM_TESTS	5
+#define MAX_CPUS	64
+#define OVERRIDE_CPU	1234
+
+struct thread_result {
+	int looked_up;
+	const void *rseq_abi;
+};
+
+static
+int override_get_cpu(void)
+{
+	return OVERRIDE_CPU;
+}
+
+/*
+ * Pin the current thread on each CPU it is allowed to run on, and
+ * check the CPU number read on each of them.
+ */
+static
+int check_each_cpu(void)
+{
+	cpu_set_t allowed, pinned;
+	int cpu, nr_checked = 0, match = 1;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return 0;
+	for (cpu = 0; cpu < CPU_SETSIZE && nr_checked < MAX_CPUS; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+		CPU_ZERO(&pinned);
+		CPU_SET(cpu, &pinned);
+		if (sched_setaffinity(0, sizeof(pinned), &pinned))
+			continue;
+		if (lttng_ust_get_cpu() != cpu)
+			match = 0;
+		nr_checked++;
+	}
+	sched_setaffinity(0, sizeof(allowed), &allowed);
+	return match && nr_checked;
+}
+
+#ifdef LTTNG_UST_HAVE_RSEQ
+static
+const void *libc_rseq_area(void)
+{
+	if (!__rseq_size)
+		return NULL;
+	return (char *) __builtin_thread_pointer() + __rseq_offset;
+}
+
+static
+void *lookup_thread(void *arg)
+{
+	struct thread_result *result = arg;
+
+	result->looked_up = !URCU_TLS(lttng_ust_rseq_abi);
+	(void) lttng_ust_get_cpu();
+	result->looked_up &= !!URCU_TLS(lttng_ust_rseq_abi);
+	result->rseq_abi = URCU_TLS(lttng_ust_rseq_abi);
+	return NULL;
+}
+
+static
+void test_rseq(void)
+{
+	struct thread_result result;
+	const struct rseq *rseq_abi;
+	pthread_t thread;
+
+	(void) lttng_ust_get_cpu();
+	rseq_abi = URCU_TLS(lttng_ust_rseq_abi);
+	if (__rseq_size) {
+		ok(rseq_abi == libc_rseq_area(),
+			"The rseq area registered by the C library is used");
+	} else {
+		diag("The C library did not register rseq");
+		ok(rseq_abi && (int) rseq_abi->cpu_id < 0,
+			"Without a C library rseq area, sched_getcpu() is used");
+	}
+
+	if (pthread_create(&thread, NULL, lookup_thread, &result)
+			|| pthread_join(thread, NULL)) {
+		fail("Each thread looks up its own rseq area");
+		return;
+	}
+	ok(result.looked_up && (!__rseq_size || result.rseq_abi != rseq_abi),
+		"Each thread looks up its own rseq area");
+}
+#else
+static
+void test_rseq(void)
+{
+	skip(2, "rseq support not built");
+}
+#endif
+
+int main(void)
+{
+	plan_tests(NUM_TESTS);
+
+	ok(check_each_cpu(), "The CPU number is read on each allowed CPU");
+	test_rseq();
+
+	lttng_ust_getcpu_override(override_get_cpu);
+	ok(lttng_ust_get_cpu() == OVERRIDE_CPU,
+		"An installed override provides the CPU number");
+	lttng_ust_getcpu_override(NULL);
+	ok(check_each_cpu(), "The CPU number is read again once the override is removed");
+	return exit_status();
+}
@@ -73,6 +73,8 @@ int init_int_handler(void)
 
 void test_inc_count(void);
 
+#define BATCH_LEN	32
+
 int main(int argc, char **argv)
 {
 	int i, netint;
@@ -82,6 +84,8 @@ int main(int argc, char **argv)
 	float flt = 2222.0;
 	int delay = 0;
 	bool mybool = 123;	/* should print "1" */
+	int batch_int[BATCH_LEN];
+	char *batch_text[BATCH_LEN];
 
 	init_int_handler();
 
@@ -99,6 +103,12 @@ int main(int argc, char **argv)
 			   text, strlen(text), dbl, flt, mybool);
 		//usleep(100000);
 	}
+	for (i = 0; i < BATCH_LEN; i++) {
+		batch_int[i] = i;
+		batch_text[i] = text;
+	}
+	tracepoint_batch(ust_tests_hello, tptest_batch, BATCH_LEN,
+			 batch_int, batch_text);
 	fprintf(stderr, " done.\n");
 	return 0;
 }
@@ -70,6 +70,17 @@ TRACEPOINT_EVENT(ust_tests_hello, tptest_sighandler,
 	TP_FIELDS()
 )
 
+TRACEPOINT_EVENT(ust_tests_hello, tptest_batch,
+	TP_ARGS(int, anint, char *, text),
+	TP_FIELDS(
+		ctf_integer(int, intfield, anint)
+		ctf_string(stringfield, text)
+	)
+)
+
+TRACEPOINT_EVENT_BATCH(ust_tests_hello, tptest_batch,
+	TP_ARGS(int, anint, char *, text))
+
 #endif /* _TRACEPOINT_UST_TESTS_HELLO_H */
 
 #undef TRACEPOINT_INCLUDE
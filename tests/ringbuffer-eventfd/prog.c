@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Wait/wakeup notification: channels are created as the consumer does
+ * with eventfd or pipe wait fds, and written to as the application
+ * does. Wakeups accumulate until the consumer drains them, in a single
+ * read of the eventfd counter or by emptying the pipe.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <poll.h>
+
+#include <lttng/ringbuffer-config.h>
+#include "frontend_types.h"
+#include "shm.h"
+#include "tap.h"
+
+#define NUM_TESTS	14
+#define SUBBUF_SIZE	4096
+#define NUM_SUBBUF	4
+#define NR_WAKEUPS	3	/* less than NUM_SUBBUF, nothing is discarded */
+
+struct subbuffer_header {
+	uint64_t tsc;
+	uint64_t data_size;
+};
+
+static uint64_t test_clock;
+
+static inline uint64_t lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return uatomic_add_return(&test_clock, 1);
+}
+
+static inline
+size_t record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+			  struct channel *chan, size_t offset,
+			  size_t *pre_header_padding,
+			  struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "api.h"
+
+static
+uint64_t client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static
+size_t client_packet_header_size(void)
+{
+	return sizeof(struct subbuffer_header);
+}
+
+static
+void client_buffer_begin(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+			 unsigned int subbuf_idx,
+			 struct lttng_ust_shm_handle *handle)
+{
+}
+
+static
+void client_buffer_end(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+		       unsigned int subbuf_idx, unsigned long data_size,
+		       struct lttng_ust_shm_handle *handle)
+{
+}
+
+static const struct lttng_ust_lib_ring_buffer_config client_config = {
+	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
+	.cb.record_header_size = client_record_header_size,
+	.cb.subbuffer_header_size = client_packet_header_size,
+	.cb.buffer_begin = client_buffer_begin,
+	.cb.buffer_end = client_buffer_end,
+
+	.tsc_bits = 0,
+	.alloc = RING_BUFFER_ALLOC_PER_CPU,
+	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.mode = RING_BUFFER_DISCARD,
+	.backend = RING_BUFFER_PAGE,
+	.output = RING_BUFFER_MMAP,
+	.oops = RING_BUFFER_OOPS_CONSISTENCY,
+	.ipi = RING_BUFFER_NO_IPI_BARRIER,
+	.wakeup = RING_BUFFER_WAKEUP_BY_WRITER,
+};
+
+/* Consumer and application views of a channel. */
+struct test_channel {
+	struct lttng_ust_shm_handle *consumer_handle, *app_handle;
+};
+
+/*
+ * The application gets the wakeup fds of the consumer, and wakes up
+ * the consumer through them.
+ */
+static
+int create_channel(struct test_channel *tc, unsigned int shm_flags)
+{
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	struct shm_object *obj;
+	void *chan_data;
+	int *stream_fds;
+
+	memset(tc, 0, sizeof(*tc));
+	stream_fds = calloc(nr_streams, sizeof(*stream_fds));
+	if (!stream_fds)
+		return -1;
+	for (i = 0; i < nr_streams; i++) {
+		char path[] = "/tmp/lttng-ust-test-XXXXXX";
+
+		stream_fds[i] = mkstemp(path);
+		if (stream_fds[i] < 0)
+			goto end;
+		(void) unlink(path);
+	}
+	tc->consumer_handle = channel_create(&client_config, "eventfd",
+		NULL, 0, 0, NULL, NULL, SUBBUF_SIZE, NUM_SUBBUF, 0, 0,
+		stream_fds, nr_streams, shm_flags);
+	if (!tc->consumer_handle)
+		goto end;
+
+	obj = &tc->consumer_handle->table->objects[0];
+	chan_data = malloc(obj->memory_map_size);
+	if (!chan_data)
+		goto end;
+	memcpy(chan_data, obj->memory_map, obj->memory_map_size);
+	tc->app_handle = channel_handle_create(chan_data, obj->memory_map_size,
+		dup(obj->wait_fd[1]));
+	if (!tc->app_handle)
+		goto end;
+	for (i = 0; i < nr_streams; i++) {
+		obj = &tc->consumer_handle->table->objects[1 + i];
+		if (channel_handle_add_stream(tc->app_handle, dup(obj->shm_fd),
+				dup(obj->wait_fd[1]), i,
+				obj->memory_map_size))
+			goto end;
+	}
+	ret = 0;
+end:
+	free(stream_fds);
+	return ret;
+}
+
+static
+void destroy_channel(struct test_channel *tc)
+{
+	if (tc->app_handle)
+		channel_destroy(shmp(tc->app_handle, tc->app_handle->chan),
+			tc->app_handle, 0);
+	if (tc->consumer_handle)
+		channel_destroy(shmp(tc->consumer_handle,
+				tc->consumer_handle->chan),
+			tc->consumer_handle, 1);
+}
+
+static
+struct lttng_ust_lib_ring_buffer *stream_buf(struct lttng_ust_shm_handle *handle)
+{
+	struct channel *chan = shmp(handle, handle->chan);
+
+	return shmp(handle, chan->backend.buf[0].shmp);
+}
+
+/* Returns 1 if both ends of the wait fds of @obj have type @type. */
+static
+int wait_fds_are(struct shm_object *obj, const char *type)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		char path[PATH_MAX], target[64];
+		ssize_t len;
+
+		snprintf(path, sizeof(path), "/proc/self/fd/%d",
+			obj->wait_fd[i]);
+		len = readlink(path, target, sizeof(target) - 1);
+		if (len < 0)
+			return 0;
+		target[len] = '\0';
+		if (strncmp(target, type, strlen(type)))
+			return 0;
+	}
+	return 1;
+}
+
+static
+int woken_up(struct shm_object *obj)
+{
+	struct pollfd fd = {
+		.fd = obj->wait_fd[0],
+		.events = POLLIN,
+	};
+
+	return poll(&fd, 1, 0) == 1 && (fd.revents & POLLIN);
+}
+
+/*
+ * Deliver @count sub-buffers of the stream of cpu 0 from the
+ * application, each of them waking up the consumer.
+ */
+static
+int deliver_subbufs(struct test_channel *tc, int count)
+{
+	struct lttng_ust_shm_handle *handle = tc->app_handle;
+	struct lttng_ust_lib_ring_buffer_ctx ctx;
+	uint32_t value = 42;
+	int i, ret;
+
+	for (i = 0; i < count; i++) {
+		lib_ring_buffer_ctx_init(&ctx, shmp(handle, handle->chan),
+			NULL, sizeof(value), sizeof(value), 0, handle, NULL);
+		ret = lib_ring_buffer_reserve(&client_config, &ctx);
+		if (ret)
+			return ret;
+		lib_ring_buffer_write(&client_config, &ctx, &value,
+			sizeof(value));
+		lib_ring_buffer_commit(&client_config, &ctx);
+		lib_ring_buffer_switch_slow(stream_buf(handle), SWITCH_ACTIVE,
+			handle);
+	}
+	return 0;
+}
+
+static
+int drain_stream(struct test_channel *tc)
+{
+	struct lttng_ust_shm_handle *handle = tc->consumer_handle;
+
+	return ring_buffer_stream_drain_wait_fd(&client_config,
+		shmp(handle, handle->chan), handle, 0);
+}
+
+static
+int drain_channel(struct test_channel *tc)
+{
+	struct lttng_ust_shm_handle *handle = tc->consumer_handle;
+
+	return ring_buffer_channel_drain_wait_fd(&client_config,
+		shmp(handle, handle->chan), handle);
+}
+
+/*
+ * Lazily populated channels wake up the channel wait fd on the first
+ * write to a stream, which exercises the channel wait fd as well.
+ */
+static
+void test_wakeup(unsigned int shm_flags, const char *fd_type,
+		const char *mode)
+{
+	struct lttng_ust_lib_ring_buffer *buf;
+	struct shm_object *stream_obj;
+	struct test_channel tc;
+	int ret;
+
+	if (create_channel(&tc, shm_flags | RING_BUFFER_SHM_LAZY)) {
+		fail("Create channel with %s wait fds", mode);
+		skip(6, "No channel");
+		destroy_channel(&tc);
+		return;
+	}
+	pass("Create channel with %s wait fds", mode);
+	stream_obj = &tc.consumer_handle->table->objects[1];
+	ok(wait_fds_are(&tc.consumer_handle->table->objects[0], fd_type)
+			&& wait_fds_are(stream_obj, fd_type),
+		"Channel and stream wait fds are %s", mode);
+	ok(!woken_up(stream_obj) && drain_stream(&tc) == 0,
+		"Nothing to drain before the first wakeup (%s)", mode);
+
+	/* Sub-buffers are only delivered to streams being read. */
+	buf = stream_buf(tc.consumer_handle);
+	if (lib_ring_buffer_open_read(buf, tc.consumer_handle)) {
+		fail("Delivered sub-buffers wake up the stream (%s)", mode);
+		skip(3, "Stream not readable");
+		destroy_channel(&tc);
+		return;
+	}
+	ok(!deliver_subbufs(&tc, NR_WAKEUPS) && woken_up(stream_obj),
+		"Delivered sub-buffers wake up the stream (%s)", mode);
+	ret = drain_stream(&tc);
+	ok(ret == NR_WAKEUPS && !woken_up(stream_obj),
+		"A single drain consumes every pending stream wakeup (%s)",
+		mode);
+	if (ret != NR_WAKEUPS)
+		diag("Drained %d wakeups, expected %d", ret, NR_WAKEUPS);
+	ok(drain_channel(&tc) == 1
+			&& !woken_up(&tc.consumer_handle->table->objects[0]),
+		"The first write wakes up the channel once (%s)", mode);
+	ok(!lib_ring_buffer_get_next_subbuf(buf, tc.consumer_handle),
+		"Draining leaves the delivered data in place (%s)", mode);
+	lib_ring_buffer_put_next_subbuf(buf, tc.consumer_handle);
+	lib_ring_buffer_release_read(buf, tc.consumer_handle);
+	destroy_channel(&tc);
+}
+
+int main(void)
+{
+	plan_tests(NUM_TESTS);
+
+	test_wakeup(RING_BUFFER_SHM_EVENTFD, "anon_inode:[eventfd]",
+		"eventfd");
+	test_wakeup(0, "pipe:", "pipe");
+	return exit_status();
+}
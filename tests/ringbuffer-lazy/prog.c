@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Lazily populated per-cpu streams: every stream of the channel is
+ * created and mapped, but the file space of a stream is only allocated
+ * once its cpu writes to it. Only stream 0 is written to here.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <lttng/ringbuffer-config.h>
+#include "frontend_types.h"
+#include "shm.h"
+#include "tap.h"
+
+#define NUM_TESTS	9
+#define SUBBUF_SIZE	65536
+#define NUM_SUBBUF	4
+
+struct subbuffer_header {
+	uint64_t tsc;
+	uint64_t data_size;
+};
+
+static uint64_t test_clock;
+
+static inline uint64_t lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return uatomic_add_return(&test_clock, 1);
+}
+
+static inline
+size_t record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+			  struct channel *chan, size_t offset,
+			  size_t *pre_header_padding,
+			  struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "api.h"
+
+static
+uint64_t client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static
+size_t client_packet_header_size(void)
+{
+	return sizeof(struct subbuffer_header);
+}
+
+static
+void client_buffer_begin(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+			 unsigned int subbuf_idx,
+			 struct lttng_ust_shm_handle *handle)
+{
+}
+
+static
+void client_buffer_end(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+		       unsigned int subbuf_idx, unsigned long data_size,
+		       struct lttng_ust_shm_handle *handle)
+{
+}
+
+static const struct lttng_ust_lib_ring_buffer_config client_config = {
+	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
+	.cb.record_header_size = client_record_header_size,
+	.cb.subbuffer_header_size = client_packet_header_size,
+	.cb.buffer_begin = client_buffer_begin,
+	.cb.buffer_end = client_buffer_end,
+
+	.tsc_bits = 0,
+	.alloc = RING_BUFFER_ALLOC_PER_CPU,
+	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.mode = RING_BUFFER_DISCARD,
+	.backend = RING_BUFFER_PAGE,
+	.output = RING_BUFFER_MMAP,
+	.oops = RING_BUFFER_OOPS_CONSISTENCY,
+	.ipi = RING_BUFFER_NO_IPI_BARRIER,
+	.wakeup = RING_BUFFER_WAKEUP_BY_WRITER,
+};
+
+static
+struct lttng_ust_shm_handle *create_channel(unsigned int shm_flags)
+{
+	struct lttng_ust_shm_handle *handle;
+	int nr_streams = num_possible_cpus(), i;
+	int *stream_fds;
+
+	stream_fds = calloc(nr_streams, sizeof(*stream_fds));
+	if (!stream_fds)
+		return NULL;
+	for (i = 0; i < nr_streams; i++) {
+		char path[] = "/tmp/lttng-ust-test-XXXXXX";
+
+		stream_fds[i] = mkstemp(path);
+		if (stream_fds[i] < 0) {
+			free(stream_fds);
+			return NULL;
+		}
+		(void) unlink(path);
+	}
+	handle = channel_create(&client_config, "per-cpu",
+		NULL, 0, 0, NULL, NULL, SUBBUF_SIZE, NUM_SUBBUF, 0, 0,
+		stream_fds, nr_streams, shm_flags);
+	free(stream_fds);
+	return handle;
+}
+
+static
+struct lttng_ust_lib_ring_buffer *stream_buf(struct lttng_ust_shm_handle *handle,
+		int stream)
+{
+	struct channel *chan = shmp(handle, handle->chan);
+
+	return shmp(handle, chan->backend.buf[stream].shmp);
+}
+
+/*
+ * A stream is populated when its file space is allocated. The buffer
+ * control structures are written to at creation, but they do not fill
+ * a sub-buffer.
+ */
+static
+int stream_populated(struct lttng_ust_shm_handle *handle, int stream)
+{
+	struct shm_object *obj = &handle->table->objects[1 + stream];
+	struct stat st;
+
+	if (fstat(obj->shm_fd, &st))
+		return -1;
+	if ((size_t) st.st_size < obj->memory_map_size)
+		return -1;
+	return (size_t) st.st_blocks * 512 >= SUBBUF_SIZE;
+}
+
+/* Returns 1 if all streams from @first on are unpopulated and inactive. */
+static
+int streams_unused(struct lttng_ust_shm_handle *handle, int first)
+{
+	int i;
+
+	for (i = first; i < num_possible_cpus(); i++) {
+		if (stream_populated(handle, i) != 0
+				|| CMM_LOAD_SHARED(stream_buf(handle, i)->active))
+			return 0;
+	}
+	return 1;
+}
+
+static
+int channel_woken_up(struct lttng_ust_shm_handle *handle)
+{
+	struct pollfd fd = {
+		.fd = handle->table->objects[0].wait_fd[0],
+		.events = POLLIN,
+	};
+
+	return poll(&fd, 1, 0) == 1 && (fd.revents & POLLIN);
+}
+
+/* Write more than a sub-buffer to @stream, and flush it. */
+static
+int write_stream(struct lttng_ust_shm_handle *handle, int stream)
+{
+	struct lttng_ust_lib_ring_buffer_ctx ctx;
+	uint32_t value[SUBBUF_SIZE / 4 / sizeof(uint32_t)];
+	int i, ret;
+
+	memset(value, 0x5a, sizeof(value));
+	for (i = 0; i < 5; i++) {
+		lib_ring_buffer_ctx_init(&ctx, shmp(handle, handle->chan),
+			NULL, sizeof(value), sizeof(uint32_t), stream, handle,
+			NULL);
+		ret = lib_ring_buffer_reserve(&client_config, &ctx);
+		if (ret)
+			return ret;
+		lib_ring_buffer_write(&client_config, &ctx, value,
+			sizeof(value));
+		lib_ring_buffer_commit(&client_config, &ctx);
+	}
+	lib_ring_buffer_switch_slow(stream_buf(handle, stream), SWITCH_ACTIVE,
+		handle);
+	return 0;
+}
+
+static
+int read_subbuf(struct lttng_ust_shm_handle *handle, int stream)
+{
+	struct lttng_ust_lib_ring_buffer *buf = stream_buf(handle, stream);
+	int ret;
+
+	ret = lib_ring_buffer_get_next_subbuf(buf, handle);
+	if (!ret)
+		lib_ring_buffer_put_next_subbuf(buf, handle);
+	return ret;
+}
+
+int main(void)
+{
+	struct lttng_ust_shm_handle *handle;
+
+	plan_tests(NUM_TESTS);
+
+	handle = create_channel(RING_BUFFER_SHM_LAZY);
+	if (!handle) {
+		fail("Create lazily populated per-cpu channel");
+		return exit_status();
+	}
+	pass("Create lazily populated per-cpu channel");
+	ok(streams_unused(handle, 0),
+		"The streams of all cpus are sized, but neither populated nor active");
+	ok(!channel_woken_up(handle),
+		"The channel is not woken up before the first write");
+
+	ok(!write_stream(handle, 0), "Write to the stream of cpu 0");
+	ok(CMM_LOAD_SHARED(stream_buf(handle, 0)->active)
+			&& stream_populated(handle, 0) == 1,
+		"The written stream is populated and active");
+	ok(channel_woken_up(handle),
+		"The first write to a stream wakes up the channel");
+	ok(!read_subbuf(handle, 0), "The written data is delivered");
+	if (num_possible_cpus() > 1) {
+		ok(streams_unused(handle, 1),
+			"The streams of the other cpus stay unpopulated and inactive");
+	} else {
+		skip(1, "Single possible cpu");
+	}
+	channel_destroy(shmp(handle, handle->chan), handle, 1);
+
+	/* Streams of regular channels are populated at creation. */
+	handle = create_channel(0);
+	if (!handle) {
+		fail("Streams of a regular channel are populated at creation");
+		return exit_status();
+	}
+	ok(stream_populated(handle, 0) == 1,
+		"Streams of a regular channel are populated at creation");
+	channel_destroy(shmp(handle, handle->chan), handle, 1);
+	return exit_status();
+}
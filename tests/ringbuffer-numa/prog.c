@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * NUMA placement of per-cpu streams: the memory node of each cpu is
+ * looked up in sysfs, and the stream of each cpu is allocated on it
+ * while the channel is created, without changing the memory policy of
+ * the creating thread. Per-thread streams have no preferred node.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+
+#include <lttng/ringbuffer-config.h>
+#include "frontend_types.h"
+#include "shm.h"
+#include "smp.h"
+#include "tap.h"
+
+#define NUM_TESTS	7
+#define SUBBUF_SIZE	65536
+#define NUM_SUBBUF	4
+#define NR_THREAD_STREAMS	2
+
+#if defined(__linux__) && defined(__NR_get_mempolicy) \
+	&& defined(__NR_set_mempolicy)
+#define TEST_MEMPOLICY
+#define MAX_NODES	1024
+#define LONG_BITS	(8 * sizeof(unsigned long))
+
+struct thread_mempolicy {
+	int mode;
+	unsigned long nodemask[MAX_NODES / LONG_BITS];
+};
+#endif
+
+struct subbuffer_header {
+	uint64_t tsc;
+	uint64_t data_size;
+};
+
+static uint64_t test_clock;
+
+static inline uint64_t lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return uatomic_add_return(&test_clock, 1);
+}
+
+static inline
+size_t record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+			  struct channel *chan, size_t offset,
+			  size_t *pre_header_padding,
+			  struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "api.h"
+
+static
+uint64_t client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static
+size_t client_packet_header_size(void)
+{
+	return sizeof(struct subbuffer_header);
+}
+
+static
+void client_buffer_begin(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+			 unsigned int subbuf_idx,
+			 struct lttng_ust_shm_handle *handle)
+{
+}
+
+static
+void client_buffer_end(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+		       unsigned int subbuf_idx, unsigned long data_size,
+		       struct lttng_ust_shm_handle *handle)
+{
+}
+
+#define CLIENT_CONFIG(_alloc)						\
+	{								\
+		.cb.ring_buffer_clock_read = client_ring_buffer_clock_read, \
+		.cb.record_header_size = client_record_header_size,	\
+		.cb.subbuffer_header_size = client_packet_header_size,	\
+		.cb.buffer_begin = client_buffer_begin,			\
+		.cb.buffer_end = client_buffer_end,			\
+									\
+		.tsc_bits = 0,						\
+		.alloc = _alloc,					\
+		.sync = RING_BUFFER_SYNC_GLOBAL,			\
+		.mode = RING_BUFFER_DISCARD,				\
+		.backend = RING_BUFFER_PAGE,				\
+		.output = RING_BUFFER_MMAP,				\
+		.oops = RING_BUFFER_OOPS_CONSISTENCY,			\
+		.ipi = RING_BUFFER_NO_IPI_BARRIER,			\
+		.wakeup = RING_BUFFER_WAKEUP_BY_WRITER,			\
+	}
+
+static const struct lttng_ust_lib_ring_buffer_config per_cpu_config =
+	CLIENT_CONFIG(RING_BUFFER_ALLOC_PER_CPU);
+static const struct lttng_ust_lib_ring_buffer_config per_thread_config =
+	CLIENT_CONFIG(RING_BUFFER_ALLOC_PER_THREAD);
+
+static
+struct lttng_ust_shm_handle *create_channel(
+		const struct lttng_ust_lib_ring_buffer_config *config,
+		int nr_streams, unsigned int shm_flags)
+{
+	struct lttng_ust_shm_handle *handle = NULL;
+	int *stream_fds, i;
+
+	stream_fds = calloc(nr_streams, sizeof(*stream_fds));
+	if (!stream_fds)
+		return NULL;
+	for (i = 0; i < nr_streams; i++) {
+		char path[] = "/tmp/lttng-ust-test-XXXXXX";
+
+		stream_fds[i] = mkstemp(path);
+		if (stream_fds[i] < 0)
+			goto end;
+		(void) unlink(path);
+	}
+	handle = channel_create(config, "numa",
+		NULL, 0, 0, NULL, NULL, SUBBUF_SIZE, NUM_SUBBUF, 0, 0,
+		stream_fds, nr_streams, shm_flags);
+end:
+	free(stream_fds);
+	return handle;
+}
+
+static
+void destroy_channel(struct lttng_ust_shm_handle *handle)
+{
+	channel_destroy(shmp(handle, handle->chan), handle, 1);
+}
+
+/* Node of @cpu, from the cpu links of the sysfs node directories. */
+static
+int sysfs_cpu_node(int cpu)
+{
+	struct dirent *entry;
+	int node, found = -1;
+	DIR *dir;
+
+	dir = opendir("/sys/devices/system/node");
+	if (!dir)
+		return -1;
+	while ((entry = readdir(dir)) != NULL) {
+		char path[PATH_MAX];
+		struct stat st;
+
+		if (sscanf(entry->d_name, "node%d", &node) != 1)
+			continue;
+		snprintf(path, sizeof(path),
+			"/sys/devices/system/node/node%d/cpu%d", node, cpu);
+		if (!stat(path, &st)) {
+			found = node;
+			break;
+		}
+	}
+	closedir(dir);
+	return found;
+}
+
+static
+void test_cpu_to_node(void)
+{
+	int cpu, match = 1;
+
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		int node = cpu_to_node(cpu);
+
+		if (node != sysfs_cpu_node(cpu)) {
+			diag("cpu %d: node %d, expected %d", cpu, node,
+				sysfs_cpu_node(cpu));
+			match = 0;
+		}
+	}
+	ok(match, "The node of each cpu matches the sysfs node directories");
+	ok(cpu_to_node(1 << 20) == -1,
+		"There is no node for a cpu which does not exist");
+}
+
+#ifdef TEST_MEMPOLICY
+static
+int get_thread_mempolicy(struct thread_mempolicy *policy)
+{
+	memset(policy, 0, sizeof(*policy));
+	return syscall(__NR_get_mempolicy, &policy->mode, policy->nodemask,
+		MAX_NODES + 1, NULL, 0UL);
+}
+
+/*
+ * Interleave the allocations of the thread on the node of cpu 0, so
+ * the policy differs from the default one.
+ */
+static
+int set_test_mempolicy(void)
+{
+	unsigned long nodemask[MAX_NODES / LONG_BITS];
+	int node = cpu_to_node(0);
+
+	if (node < 0 || node >= MAX_NODES)
+		return -1;
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[node / LONG_BITS] |= 1UL << (node % LONG_BITS);
+	return syscall(__NR_set_mempolicy, MPOL_INTERLEAVE, nodemask,
+		MAX_NODES + 1);
+}
+#endif /* TEST_MEMPOLICY */
+
+static
+void test_per_cpu(void)
+{
+	struct lttng_ust_shm_handle *handle;
+	struct channel *chan;
+	int cpu, preferred = 1;
+#ifdef TEST_MEMPOLICY
+	struct thread_mempolicy before, after;
+	int policy_ret;
+
+	if (set_test_mempolicy())
+		diag("Cannot set the memory policy of the thread");
+	policy_ret = get_thread_mempolicy(&before);
+#endif
+
+	/* Placement is only sampled on pages already mapped in. */
+	handle = create_channel(&per_cpu_config, num_possible_cpus(),
+		RING_BUFFER_SHM_POPULATE);
+	if (!handle) {
+		fail("Create per-cpu channel");
+		skip(3, "No channel");
+		return;
+	}
+	pass("Create per-cpu channel");
+
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		if (handle->table->objects[1 + cpu].numa_node
+				!= cpu_to_node(cpu))
+			preferred = 0;
+	}
+	ok(preferred, "The stream of each cpu prefers the node of the cpu");
+
+	chan = shmp(handle, handle->chan);
+	if (chan->numa_sampled_pages) {
+		ok(chan->numa_local_pages == chan->numa_sampled_pages,
+			"Sampled stream pages are on the node of their cpu");
+	} else {
+		skip(1, "NUMA placement not sampled");
+	}
+
+#ifdef TEST_MEMPOLICY
+	if (!policy_ret && !get_thread_mempolicy(&after)) {
+		ok(before.mode == after.mode
+				&& !memcmp(before.nodemask, after.nodemask,
+					sizeof(before.nodemask)),
+			"The memory policy of the thread is restored");
+	} else {
+		skip(1, "Memory policy not available");
+	}
+	(void) syscall(__NR_set_mempolicy, MPOL_DEFAULT, NULL, 0UL);
+#else
+	skip(1, "Memory policy not available");
+#endif
+	destroy_channel(handle);
+}
+
+static
+void test_per_thread(void)
+{
+	struct lttng_ust_shm_handle *handle;
+	int i, preferred = 0;
+
+	handle = create_channel(&per_thread_config, NR_THREAD_STREAMS, 0);
+	if (!handle) {
+		fail("Per-thread streams have no preferred node");
+		return;
+	}
+	for (i = 0; i < NR_THREAD_STREAMS; i++) {
+		if (handle->table->objects[1 + i].numa_node != -1)
+			preferred = 1;
+	}
+	ok(!preferred, "Per-thread streams have no preferred node");
+	destroy_channel(handle);
+}
+
+int main(void)
+{
+	plan_tests(NUM_TESTS);
+
+	test_cpu_to_node();
+	test_per_cpu();
+	test_per_thread();
+	return exit_status();
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Per-thread ring buffer allocation: a channel is created as the consumer
+ * does, and mapped back as the application does. Writer threads then
+ * claim streams from the channel pool.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include <lttng/ringbuffer-config.h>
+#include "frontend_types.h"
+#include "shm.h"
+#include "tlsfixup.h"
+#include "tap.h"
+
+#define NUM_TESTS	9
+#define NR_STREAMS	2
+#define SUBBUF_SIZE	4096
+#define NUM_SUBBUF	2
+
+struct subbuffer_header {
+	uint64_t tsc;
+	uint64_t data_size;
+};
+
+static uint64_t test_clock;
+
+static inline uint64_t lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return uatomic_add_return(&test_clock, 1);
+}
+
+static inline
+size_t record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+			  struct channel *chan, size_t offset,
+			  size_t *pre_header_padding,
+			  struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "api.h"
+
+static
+uint64_t client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static
+size_t client_packet_header_size(void)
+{
+	return sizeof(struct subbuffer_header);
+}
+
+static
+void client_buffer_begin(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+			 unsigned int subbuf_idx,
+			 struct lttng_ust_shm_handle *handle)
+{
+}
+
+static
+void client_buffer_end(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+		       unsigned int subbuf_idx, unsigned long data_size,
+		       struct lttng_ust_shm_handle *handle)
+{
+}
+
+static const struct lttng_ust_lib_ring_buffer_config client_config = {
+	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
+	.cb.record_header_size = client_record_header_size,
+	.cb.subbuffer_header_size = client_packet_header_size,
+	.cb.buffer_begin = client_buffer_begin,
+	.cb.buffer_end = client_buffer_end,
+
+	.tsc_bits = 0,
+	.alloc = RING_BUFFER_ALLOC_PER_THREAD,
+	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.mode = RING_BUFFER_DISCARD,
+	.backend = RING_BUFFER_PAGE,
+	.output = RING_BUFFER_MMAP,
+	.oops = RING_BUFFER_OOPS_CONSISTENCY,
+	.ipi = RING_BUFFER_NO_IPI_BARRIER,
+	.wakeup = RING_BUFFER_WAKEUP_BY_WRITER,
+};
+
+/* Consumer and application views of the channel. */
+static struct lttng_ust_shm_handle *consumer_handle, *app_handle;
+
+struct writer {
+	pthread_t thread;
+	pid_t tid;
+	int ret;
+	int stream;
+	int owned;
+};
+
+static pthread_barrier_t written, hold;
+
+static
+struct lttng_ust_lib_ring_buffer *app_buf(int stream)
+{
+	struct channel *chan = shmp(app_handle, app_handle->chan);
+
+	return shmp(app_handle, chan->backend.buf[stream].shmp);
+}
+
+static
+void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	struct lttng_ust_lib_ring_buffer_ctx ctx;
+	uint32_t value = 42;
+
+	w->tid = syscall(SYS_gettid);
+	lib_ring_buffer_ctx_init(&ctx, shmp(app_handle, app_handle->chan),
+		NULL, sizeof(value), sizeof(value), -1, app_handle, NULL);
+	w->ret = lib_ring_buffer_reserve(&client_config, &ctx);
+	if (!w->ret) {
+		lib_ring_buffer_write(&client_config, &ctx, &value,
+			sizeof(value));
+		lib_ring_buffer_commit(&client_config, &ctx);
+		w->stream = ctx.cpu;
+		w->owned = CMM_LOAD_SHARED(app_buf(ctx.cpu)->owner) == w->tid;
+	}
+	pthread_barrier_wait(&written);
+	/* Stay idle until the main thread is done with our stream. */
+	pthread_barrier_wait(&hold);
+	return NULL;
+}
+
+static
+int create_channel(void)
+{
+	int stream_fds[NR_STREAMS], i;
+	struct shm_object *obj;
+	void *chan_data;
+
+	for (i = 0; i < NR_STREAMS; i++) {
+		char path[] = "/tmp/lttng-ust-test-XXXXXX";
+
+		stream_fds[i] = mkstemp(path);
+		if (stream_fds[i] < 0)
+			return -1;
+		(void) unlink(path);
+	}
+	consumer_handle = channel_create(&client_config, "per-thread",
+		NULL, 0, 0, NULL, NULL, SUBBUF_SIZE, NUM_SUBBUF, 0, 0,
+		stream_fds, NR_STREAMS, 0);
+	if (!consumer_handle)
+		return -1;
+
+	/* Hand the channel and its streams over, as sessiond does. */
+	obj = &consumer_handle->table->objects[0];
+	chan_data = malloc(obj->memory_map_size);
+	if (!chan_data)
+		return -1;
+	memcpy(chan_data, obj->memory_map, obj->memory_map_size);
+	app_handle = channel_handle_create(chan_data, obj->memory_map_size,
+		dup(obj->wait_fd[1]));
+	if (!app_handle)
+		return -1;
+	for (i = 0; i < NR_STREAMS; i++) {
+		obj = &consumer_handle->table->objects[1 + i];
+		if (channel_handle_add_stream(app_handle, dup(obj->shm_fd),
+				dup(obj->wait_fd[1]), i,
+				obj->memory_map_size))
+			return -1;
+	}
+	return 0;
+}
+
+static
+int start_writers(struct writer *w, int nr)
+{
+	int i;
+
+	pthread_barrier_init(&written, NULL, nr + 1);
+	pthread_barrier_init(&hold, NULL, nr + 1);
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&w[i].thread, NULL, writer_thread, &w[i]))
+			return -1;
+	}
+	pthread_barrier_wait(&written);
+	return 0;
+}
+
+static
+void stop_writers(struct writer *w, int nr)
+{
+	int i;
+
+	pthread_barrier_wait(&hold);
+	for (i = 0; i < nr; i++)
+		pthread_join(w[i].thread, NULL);
+	pthread_barrier_destroy(&written);
+	pthread_barrier_destroy(&hold);
+}
+
+static
+int read_subbuf(int stream)
+{
+	struct channel *chan = shmp(consumer_handle, consumer_handle->chan);
+	struct lttng_ust_lib_ring_buffer *buf;
+	int ret;
+
+	buf = shmp(consumer_handle, chan->backend.buf[stream].shmp);
+	ret = lib_ring_buffer_get_next_subbuf(buf, consumer_handle);
+	if (!ret)
+		lib_ring_buffer_put_next_subbuf(buf, consumer_handle);
+	return ret;
+}
+
+static
+pid_t dead_pid(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (!pid)
+		_exit(0);
+	(void) waitpid(pid, NULL, 0);
+	return pid;
+}
+
+int main(void)
+{
+	struct writer w[NR_STREAMS + 1];
+	int i;
+
+	plan_tests(NUM_TESTS);
+
+	/* Normally done by the liblttng-ust constructor. */
+	lib_ring_buffer_thread_init();
+	if (create_channel()) {
+		fail("Create per-thread channel");
+		return exit_status();
+	}
+	pass("Create per-thread channel");
+
+	/* Two threads for two streams, plus a third one. */
+	memset(w, 0, sizeof(w));
+	if (start_writers(w, NR_STREAMS + 1))
+		return exit_status();
+	ok(!w[0].ret && !w[1].ret && !w[2].ret,
+		"All threads record their event, even with the pool exhausted");
+	ok((w[0].owned + w[1].owned + w[2].owned) == NR_STREAMS,
+		"Each stream of the pool is claimed by a single thread");
+	for (i = 0; i < NR_STREAMS + 1; i++) {
+		if (!w[i].owned)
+			break;
+	}
+	ok(i <= NR_STREAMS && w[i].stream >= 0 && w[i].stream < NR_STREAMS,
+		"The thread left without stream shares one of the pool");
+	ok(read_subbuf(w[0].stream) != 0,
+		"No sub-buffer is ready before the flush");
+	lib_ring_buffer_switch_slow(app_buf(w[0].stream), SWITCH_ACTIVE,
+		app_handle);
+	ok(read_subbuf(w[0].stream) == 0,
+		"Flush delivers the data of a stream owned by an idle thread");
+	stop_writers(w, NR_STREAMS + 1);
+	ok(!app_buf(0)->owner && !app_buf(1)->owner,
+		"Streams are given back to the pool at thread exit");
+
+	/* Streams held by threads that died without releasing them. */
+	for (i = 0; i < NR_STREAMS; i++)
+		app_buf(i)->owner = dead_pid();
+	memset(w, 0, sizeof(w));
+	if (start_writers(w, 1))
+		return exit_status();
+	ok(!w[0].ret && w[0].owned,
+		"Stream of a dead owner is reclaimed");
+	stop_writers(w, 1);
+
+	channel_destroy(shmp(app_handle, app_handle->chan), app_handle, 0);
+	channel_destroy(shmp(consumer_handle, consumer_handle->chan),
+		consumer_handle, 1);
+	lib_ring_buffer_thread_exit();
+	pass("Destroy per-thread channel");
+	return exit_status();
+}
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Stream shm options: channels are created as the consumer does with
+ * memory file, huge page and pre-faulting options, and mapped back as
+ * the application does. Huge pages fall back on a regular memory file
+ * when the hugetlb pool cannot hold the streams.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include <lttng/ringbuffer-config.h>
+#include "frontend_types.h"
+#include "shm.h"
+#include "tap.h"
+
+#define NUM_TESTS	10
+#define SUBBUF_SIZE	65536
+#define NUM_SUBBUF	4
+
+#define HUGETLBFS_MAGIC	0x958458f6
+
+struct subbuffer_header {
+	uint64_t tsc;
+	uint64_t data_size;
+};
+
+static uint64_t test_clock;
+
+static inline uint64_t lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return uatomic_add_return(&test_clock, 1);
+}
+
+static inline
+size_t record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+			  struct channel *chan, size_t offset,
+			  size_t *pre_header_padding,
+			  struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "api.h"
+
+static
+uint64_t client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static
+size_t client_packet_header_size(void)
+{
+	return sizeof(struct subbuffer_header);
+}
+
+static
+void client_buffer_begin(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+			 unsigned int subbuf_idx,
+			 struct lttng_ust_shm_handle *handle)
+{
+}
+
+static
+void client_buffer_end(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+		       unsigned int subbuf_idx, unsigned long data_size,
+		       struct lttng_ust_shm_handle *handle)
+{
+}
+
+static const struct lttng_ust_lib_ring_buffer_config client_config = {
+	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
+	.cb.record_header_size = client_record_header_size,
+	.cb.subbuffer_header_size = client_packet_header_size,
+	.cb.buffer_begin = client_buffer_begin,
+	.cb.buffer_end = client_buffer_end,
+
+	.tsc_bits = 0,
+	.alloc = RING_BUFFER_ALLOC_PER_CPU,
+	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.mode = RING_BUFFER_DISCARD,
+	.backend = RING_BUFFER_PAGE,
+	.output = RING_BUFFER_MMAP,
+	.oops = RING_BUFFER_OOPS_CONSISTENCY,
+	.ipi = RING_BUFFER_NO_IPI_BARRIER,
+	.wakeup = RING_BUFFER_WAKEUP_BY_WRITER,
+};
+
+/* Consumer and application views of a channel. */
+struct test_channel {
+	struct lttng_ust_shm_handle *consumer_handle, *app_handle;
+};
+
+/*
+ * Memory file backed channels do not use the stream fds of the
+ * consumer, which then passes -1.
+ */
+static
+int create_channel(struct test_channel *tc, unsigned int shm_flags)
+{
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	struct shm_object *obj;
+	void *chan_data;
+	int *stream_fds;
+
+	memset(tc, 0, sizeof(*tc));
+	stream_fds = calloc(nr_streams, sizeof(*stream_fds));
+	if (!stream_fds)
+		return -1;
+	for (i = 0; i < nr_streams; i++) {
+		char path[] = "/tmp/lttng-ust-test-XXXXXX";
+
+		if (shm_flags & RING_BUFFER_SHM_MEMFD) {
+			stream_fds[i] = -1;
+			continue;
+		}
+		stream_fds[i] = mkstemp(path);
+		if (stream_fds[i] < 0)
+			goto end;
+		(void) unlink(path);
+	}
+	tc->consumer_handle = channel_create(&client_config, "shm",
+		NULL, 0, 0, NULL, NULL, SUBBUF_SIZE, NUM_SUBBUF, 0, 0,
+		stream_fds, nr_streams, shm_flags);
+	if (!tc->consumer_handle)
+		goto end;
+
+	/* Hand the channel and its streams over, as sessiond does. */
+	obj = &tc->consumer_handle->table->objects[0];
+	chan_data = malloc(obj->memory_map_size);
+	if (!chan_data)
+		goto end;
+	memcpy(chan_data, obj->memory_map, obj->memory_map_size);
+	tc->app_handle = channel_handle_create(chan_data, obj->memory_map_size,
+		dup(obj->wait_fd[1]));
+	if (!tc->app_handle)
+		goto end;
+	for (i = 0; i < nr_streams; i++) {
+		obj = &tc->consumer_handle->table->objects[1 + i];
+		if (channel_handle_add_stream(tc->app_handle, dup(obj->shm_fd),
+				dup(obj->wait_fd[1]), i,
+				obj->memory_map_size))
+			goto end;
+	}
+	ret = 0;
+end:
+	free(stream_fds);
+	return ret;
+}
+
+static
+void destroy_channel(struct test_channel *tc)
+{
+	if (tc->app_handle)
+		channel_destroy(shmp(tc->app_handle, tc->app_handle->chan),
+			tc->app_handle, 0);
+	if (tc->consumer_handle)
+		channel_destroy(shmp(tc->consumer_handle,
+				tc->consumer_handle->chan),
+			tc->consumer_handle, 1);
+}
+
+static
+struct shm_object *stream_obj(struct lttng_ust_shm_handle *handle,
+		int stream)
+{
+	return &handle->table->objects[1 + stream];
+}
+
+/* Returns 1 if the file space of the stream is entirely allocated. */
+static
+int stream_allocated(struct lttng_ust_shm_handle *handle, int stream)
+{
+	struct shm_object *obj = stream_obj(handle, stream);
+	struct stat st;
+
+	if (fstat(obj->shm_fd, &st))
+		return 0;
+	return (size_t) st.st_size >= obj->memory_map_size
+		&& (size_t) st.st_blocks * 512 >= obj->memory_map_size;
+}
+
+static
+int stream_is_memfd(struct lttng_ust_shm_handle *handle, int stream)
+{
+	char path[32], target[64];
+	ssize_t len;
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d",
+		stream_obj(handle, stream)->shm_fd);
+	len = readlink(path, target, sizeof(target) - 1);
+	if (len < 0)
+		return 0;
+	target[len] = '\0';
+	return !strncmp(target, "/memfd:", strlen("/memfd:"));
+}
+
+static
+int stream_is_hugetlb(struct lttng_ust_shm_handle *handle, int stream)
+{
+	struct statfs st;
+
+	if (fstatfs(stream_obj(handle, stream)->shm_fd, &st))
+		return 0;
+	return st.f_type == HUGETLBFS_MAGIC;
+}
+
+/*
+ * Returns 1 if all the pages of the stream mapping are mapped in this
+ * process, from its resident set size in /proc/self/smaps.
+ */
+static
+int stream_mapped_in(struct lttng_ust_shm_handle *handle, int stream)
+{
+	struct shm_object *obj = stream_obj(handle, stream);
+	unsigned long start, end, rss_kb;
+	int found = 0, ret = 0;
+	char line[256];
+	FILE *fp;
+
+	fp = fopen("/proc/self/smaps", "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			found = start == (unsigned long) obj->memory_map;
+			continue;
+		}
+		if (found && sscanf(line, "Rss: %lu kB", &rss_kb) == 1) {
+			ret = rss_kb * 1024 >= obj->memory_map_size;
+			break;
+		}
+	}
+	fclose(fp);
+	return ret;
+}
+
+static
+size_t get_hugepage_size(void)
+{
+	unsigned long size_kb = 0;
+	char line[128];
+	FILE *fp;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "Hugepagesize: %lu kB", &size_kb) == 1)
+			break;
+	}
+	fclose(fp);
+	return (size_t) size_kb * 1024;
+}
+
+/* Write through the application mapping, read from the consumer one. */
+static
+int write_read_stream(struct test_channel *tc, int stream)
+{
+	struct lttng_ust_lib_ring_buffer_ctx ctx;
+	struct lttng_ust_lib_ring_buffer *buf;
+	struct channel *chan;
+	uint32_t value = 42, read_value;
+	int ret;
+
+	lib_ring_buffer_ctx_init(&ctx,
+		shmp(tc->app_handle, tc->app_handle->chan), NULL,
+		sizeof(value), sizeof(value), stream, tc->app_handle, NULL);
+	ret = lib_ring_buffer_reserve(&client_config, &ctx);
+	if (ret)
+		return ret;
+	lib_ring_buffer_write(&client_config, &ctx, &value, sizeof(value));
+	lib_ring_buffer_commit(&client_config, &ctx);
+	chan = shmp(tc->app_handle, tc->app_handle->chan);
+	lib_ring_buffer_switch_slow(
+		shmp(tc->app_handle, chan->backend.buf[stream].shmp),
+		SWITCH_ACTIVE, tc->app_handle);
+
+	chan = shmp(tc->consumer_handle, tc->consumer_handle->chan);
+	buf = shmp(tc->consumer_handle, chan->backend.buf[stream].shmp);
+	ret = lib_ring_buffer_get_next_subbuf(buf, tc->consumer_handle);
+	if (ret)
+		return ret;
+	if (lib_ring_buffer_read(&buf->backend,
+			buf->cons_snapshot + sizeof(struct subbuffer_header),
+			&read_value, sizeof(read_value), tc->consumer_handle)
+				!= sizeof(read_value)
+			|| read_value != value)
+		ret = -1;
+	lib_ring_buffer_put_next_subbuf(buf, tc->consumer_handle);
+	return ret;
+}
+
+static
+void test_memfd(void)
+{
+	struct test_channel tc;
+
+	if (create_channel(&tc, RING_BUFFER_SHM_MEMFD)) {
+		fail("Create memory file backed channel without stream fds");
+		skip(2, "No channel");
+		destroy_channel(&tc);
+		return;
+	}
+	pass("Create memory file backed channel without stream fds");
+	ok(stream_is_memfd(tc.consumer_handle, 0)
+			&& stream_obj(tc.consumer_handle, 0)->shm_fd_ownership
+			&& stream_allocated(tc.consumer_handle, 0),
+		"Streams are memory files owned by the tracer, allocated upfront");
+	ok(!write_read_stream(&tc, 0),
+		"The application and the consumer share the memory file");
+	destroy_channel(&tc);
+}
+
+static
+void test_hugepage(void)
+{
+	size_t hugepage_size = get_hugepage_size();
+	struct test_channel tc;
+
+	if (create_channel(&tc, RING_BUFFER_SHM_MEMFD
+			| RING_BUFFER_SHM_HUGEPAGE)) {
+		fail("Create huge page backed channel");
+		skip(2, "No channel");
+		destroy_channel(&tc);
+		return;
+	}
+	pass("Create huge page backed channel");
+	if (hugepage_size) {
+		ok(!(stream_obj(tc.consumer_handle, 0)->memory_map_size
+				% hugepage_size),
+			"Stream size is rounded up to the huge page size");
+	} else {
+		skip(1, "Huge pages not available");
+	}
+	if (stream_is_hugetlb(tc.consumer_handle, 0))
+		diag("Streams are taken from the hugetlb pool");
+	else
+		diag("Streams fall back on transparent huge pages");
+	ok(stream_is_hugetlb(tc.consumer_handle, 0)
+			|| (stream_is_memfd(tc.consumer_handle, 0)
+				&& stream_allocated(tc.consumer_handle, 0)),
+		"Streams are taken from the hugetlb pool, or are memory files allocated upfront");
+	destroy_channel(&tc);
+}
+
+static
+void test_populate(void)
+{
+	struct test_channel tc;
+
+	if (create_channel(&tc, RING_BUFFER_SHM_POPULATE)) {
+		fail("Create pre-faulted channel");
+		skip(2, "No channel");
+		destroy_channel(&tc);
+		return;
+	}
+	pass("Create pre-faulted channel");
+	ok(stream_mapped_in(tc.consumer_handle, 0),
+		"Streams are pre-faulted by the consumer");
+	ok(stream_mapped_in(tc.app_handle, 0),
+		"Streams are pre-faulted by the application");
+	destroy_channel(&tc);
+
+	if (create_channel(&tc, 0)) {
+		fail("Streams of a regular channel are faulted in on use");
+		destroy_channel(&tc);
+		return;
+	}
+	ok(!stream_mapped_in(tc.consumer_handle, 0)
+			&& !stream_mapped_in(tc.app_handle, 0),
+		"Streams of a regular channel are faulted in on use");
+	destroy_channel(&tc);
+}
+
+int main(void)
+{
+	plan_tests(NUM_TESTS);
+
+	test_memfd();
+	test_hugepage();
+	test_populate();
+	return exit_status();
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Channel switch timers: timers of the same period share a timerfd
+ * group, waited on by a single timer thread. After fork, the child
+ * starts over with its own timer thread and groups, and tears down the
+ * groups it inherited without disturbing the timers of the parent.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <lttng/ringbuffer-config.h>
+#include "frontend_types.h"
+#include "shm.h"
+#include "tlsfixup.h"
+#include "tap.h"
+
+#define NUM_TESTS	9
+#define SUBBUF_SIZE	4096
+#define NUM_SUBBUF	2
+#define TIMER_PERIOD	10000	/* us */
+#define MAX_WAIT_LOOPS	100
+
+/* Child exit status bits. */
+#define CHILD_NEW_FLUSHED	(1 << 0)
+#define CHILD_NEW_GROUP		(1 << 1)
+#define CHILD_INHERITED_CLOSED	(1 << 2)
+
+struct subbuffer_header {
+	uint64_t tsc;
+	uint64_t data_size;
+};
+
+static uint64_t test_clock;
+
+static inline uint64_t lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return uatomic_add_return(&test_clock, 1);
+}
+
+static inline
+size_t record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+			  struct channel *chan, size_t offset,
+			  size_t *pre_header_padding,
+			  struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	*pre_header_padding = 0;
+	return 0;
+}
+
+#include "api.h"
+
+static
+uint64_t client_ring_buffer_clock_read(struct channel *chan)
+{
+	return lib_ring_buffer_clock_read(chan);
+}
+
+static
+size_t client_record_header_size(const struct lttng_ust_lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lttng_ust_lib_ring_buffer_ctx *ctx)
+{
+	return record_header_size(config, chan, offset,
+				  pre_header_padding, ctx);
+}
+
+static
+size_t client_packet_header_size(void)
+{
+	return sizeof(struct subbuffer_header);
+}
+
+static
+void client_buffer_begin(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+			 unsigned int subbuf_idx,
+			 struct lttng_ust_shm_handle *handle)
+{
+}
+
+static
+void client_buffer_end(struct lttng_ust_lib_ring_buffer *buf, uint64_t tsc,
+		       unsigned int subbuf_idx, unsigned long data_size,
+		       struct lttng_ust_shm_handle *handle)
+{
+}
+
+static const struct lttng_ust_lib_ring_buffer_config client_config = {
+	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
+	.cb.record_header_size = client_record_header_size,
+	.cb.subbuffer_header_size = client_packet_header_size,
+	.cb.buffer_begin = client_buffer_begin,
+	.cb.buffer_end = client_buffer_end,
+
+	.tsc_bits = 0,
+	.alloc = RING_BUFFER_ALLOC_PER_CPU,
+	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.mode = RING_BUFFER_DISCARD,
+	.backend = RING_BUFFER_PAGE,
+	.output = RING_BUFFER_MMAP,
+	.oops = RING_BUFFER_OOPS_CONSISTENCY,
+	.ipi = RING_BUFFER_NO_IPI_BARRIER,
+	.wakeup = RING_BUFFER_WAKEUP_BY_WRITER,
+};
+
+static
+struct lttng_ust_lib_ring_buffer *stream_buf(struct lttng_ust_shm_handle *handle)
+{
+	struct channel *chan = shmp(handle, handle->chan);
+
+	return shmp(handle, chan->backend.buf[0].shmp);
+}
+
+/*
+ * Create a channel with a switch timer, and open the stream of cpu 0
+ * for reading, as the switch timer only flushes streams being read.
+ */
+static
+struct lttng_ust_shm_handle *create_channel(unsigned int switch_timer_interval)
+{
+	struct lttng_ust_shm_handle *handle = NULL;
+	int nr_streams = num_possible_cpus(), i;
+	int *stream_fds;
+
+	stream_fds = calloc(nr_streams, sizeof(*stream_fds));
+	if (!stream_fds)
+		return NULL;
+	for (i = 0; i < nr_streams; i++) {
+		char path[] = "/tmp/lttng-ust-test-XXXXXX";
+
+		stream_fds[i] = mkstemp(path);
+		if (stream_fds[i] < 0)
+			goto end;
+		(void) unlink(path);
+	}
+	handle = channel_create(&client_config, "timer",
+		NULL, 0, 0, NULL, NULL, SUBBUF_SIZE, NUM_SUBBUF,
+		switch_timer_interval, 0, stream_fds, nr_streams, 0);
+	if (handle && lib_ring_buffer_open_read(stream_buf(handle), handle)) {
+		channel_destroy(shmp(handle, handle->chan), handle, 1);
+		handle = NULL;
+	}
+end:
+	free(stream_fds);
+	return handle;
+}
+
+static
+void destroy_channel(struct lttng_ust_shm_handle *handle)
+{
+	lib_ring_buffer_release_read(stream_buf(handle), handle);
+	channel_destroy(shmp(handle, handle->chan), handle, 1);
+}
+
+/*
+ * Write a record to the stream of cpu 0, and wait for the switch timer
+ * to deliver it. Returns 0 once delivered.
+ */
+static
+int write_flushed(struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_lib_ring_buffer *buf = stream_buf(handle);
+	struct lttng_ust_lib_ring_buffer_ctx ctx;
+	uint32_t value = 42;
+	int i, ret;
+
+	lib_ring_buffer_ctx_init(&ctx, shmp(handle, handle->chan), NULL,
+		sizeof(value), sizeof(value), 0, handle, NULL);
+	ret = lib_ring_buffer_reserve(&client_config, &ctx);
+	if (ret)
+		return ret;
+	lib_ring_buffer_write(&client_config, &ctx, &value, sizeof(value));
+	lib_ring_buffer_commit(&client_config, &ctx);
+
+	for (i = 0; i < MAX_WAIT_LOOPS; i++) {
+		if (!lib_ring_buffer_get_next_subbuf(buf, handle)) {
+			lib_ring_buffer_put_next_subbuf(buf, handle);
+			return 0;
+		}
+		(void) usleep(TIMER_PERIOD);
+	}
+	return -1;
+}
+
+static
+int count_timerfds(void)
+{
+	struct dirent *entry;
+	int count = 0;
+	DIR *dir;
+
+	dir = opendir("/proc/self/fd");
+	if (!dir)
+		return -1;
+	while ((entry = readdir(dir)) != NULL) {
+		char path[PATH_MAX], target[64];
+		ssize_t len;
+
+		snprintf(path, sizeof(path), "/proc/self/fd/%s",
+			entry->d_name);
+		len = readlink(path, target, sizeof(target) - 1);
+		if (len < 0)
+			continue;
+		target[len] = '\0';
+		if (!strcmp(target, "anon_inode:[timerfd]"))
+			count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+static
+uint64_t process_cpu_time_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * The child gets a new timer thread and group for its own channel, and
+ * closes the groups it inherited when tearing down the inherited
+ * channels.
+ */
+static
+int run_child(struct lttng_ust_shm_handle **inherited, int nr_inherited)
+{
+	struct lttng_ust_shm_handle *handle;
+	int status = 0, i;
+
+	/* Normally done by the liblttng-ust fork wrapper. */
+	lib_ring_buffer_timer_after_fork_child();
+
+	handle = create_channel(TIMER_PERIOD);
+	if (!handle)
+		return status;
+	if (!write_flushed(handle))
+		status |= CHILD_NEW_FLUSHED;
+	if (count_timerfds() == 3)
+		status |= CHILD_NEW_GROUP;
+	/* The streams, and their readers, are shared with the parent. */
+	for (i = 0; i < nr_inherited; i++)
+		channel_destroy(shmp(inherited[i], inherited[i]->chan),
+			inherited[i], 1);
+	destroy_channel(handle);
+	if (!count_timerfds())
+		status |= CHILD_INHERITED_CLOSED;
+	return status;
+}
+
+static
+void test_fork(struct lttng_ust_shm_handle **handles, int nr_handles)
+{
+	int status = 0;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		fail("Fork");
+		skip(4, "No child");
+		return;
+	}
+	if (!pid)
+		_exit(run_child(handles, nr_handles));
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		status = 0;
+	else
+		status = WEXITSTATUS(status);
+
+	ok(status & CHILD_NEW_FLUSHED,
+		"The child timer thread flushes the channels of the child");
+	ok(status & CHILD_NEW_GROUP,
+		"Channels of the child do not join the inherited groups");
+	ok(status & CHILD_INHERITED_CLOSED,
+		"The child closes the inherited timerfds with the inherited channels");
+	ok(!write_flushed(handles[0]),
+		"The parent timers keep running after the child teardown");
+}
+
+/*
+ * A child which still holds the timerfds keeps them alive after the
+ * parent closes them: the timer thread of the parent must not keep
+ * getting their events.
+ */
+static
+void test_removed_group(struct lttng_ust_shm_handle **handles, int nr_handles)
+{
+	uint64_t cpu_time;
+	int pipe_fds[2], i;
+	pid_t pid;
+	char c;
+
+	if (pipe(pipe_fds)) {
+		fail("Timer thread is idle once the groups held by a child are removed");
+		return;
+	}
+	pid = fork();
+	if (!pid) {
+		(void) close(pipe_fds[1]);
+		(void) read(pipe_fds[0], &c, 1);
+		_exit(0);
+	}
+	(void) close(pipe_fds[0]);
+	for (i = 0; i < nr_handles; i++)
+		destroy_channel(handles[i]);
+	cpu_time = process_cpu_time_ns();
+	(void) usleep(20 * TIMER_PERIOD);
+	cpu_time = process_cpu_time_ns() - cpu_time;
+	(void) close(pipe_fds[1]);
+	if (pid > 0)
+		(void) waitpid(pid, NULL, 0);
+	ok(pid > 0 && cpu_time < 10 * TIMER_PERIOD * 1000ULL,
+		"Timer thread is idle once the groups held by a child are removed");
+}
+
+int main(void)
+{
+	struct lttng_ust_shm_handle *handles[3];
+
+	plan_tests(NUM_TESTS);
+
+	/* Two channels with the same period, and one with another one. */
+	handles[0] = create_channel(TIMER_PERIOD);
+	handles[1] = create_channel(TIMER_PERIOD);
+	handles[2] = create_channel(2 * TIMER_PERIOD);
+	if (!handles[0] || !handles[1] || !handles[2]) {
+		fail("Create channels with switch timers");
+		return exit_status();
+	}
+	pass("Create channels with switch timers");
+	ok(count_timerfds() == 2,
+		"Timers of the same period share a timerfd");
+	ok(!write_flushed(handles[0]),
+		"The switch timer delivers the written data");
+
+	test_fork(handles, 3);
+	test_removed_group(handles, 3);
+	ok(count_timerfds() == 0,
+		"All timerfds are closed with the channels");
+	return exit_status();
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Static branch tracepoints: a probe is connected to and disconnected
+ * from a tracepoint over and over, which patches its call sites, while
+ * other threads run through them, some with all signals blocked.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <signal.h>
+#include <pthread.h>
+#include <urcu/uatomic.h>
+
+#define TRACEPOINT_DEFINE
+#define TRACEPOINT_PROBE_DYNAMIC_LINKAGE
+#define TRACEPOINT_STATIC_BRANCH
+#include "ust_tests_static_branch.h"
+#include "tap.h"
+
+#define NUM_TESTS	6
+#define NR_THREADS	4
+#define NR_ROUNDS	1000
+#define NR_CALLS	10
+
+#define BRANCH_INSN_DISABLED	0x3d	/* cmp $imm32, %eax */
+#define BRANCH_INSN_ENABLED	0xe9	/* jmp rel32 */
+
+struct runner {
+	pthread_t thread;
+	int block_signals;
+	unsigned long loops;
+};
+
+static __thread unsigned long hits;
+static int stop;
+
+static
+void probe(void *data, int value)
+{
+	hits++;
+}
+
+static
+void *runner_thread(void *arg)
+{
+	struct runner *r = arg;
+
+	if (r->block_signals) {
+		sigset_t set;
+
+		sigfillset(&set);
+		pthread_sigmask(SIG_BLOCK, &set, NULL);
+	}
+	while (!uatomic_read(&stop)) {
+		tracepoint(ust_tests_static_branch, event, 1);
+		r->loops++;
+	}
+	return NULL;
+}
+
+/* Second call site of the tracepoint. */
+static
+void __attribute__((noinline)) other_call_site(void)
+{
+	if (tracepoint_enabled(ust_tests_static_branch, event))
+		do_tracepoint(ust_tests_static_branch, event, 2);
+}
+
+static
+unsigned long run_call_sites(void)
+{
+	int i;
+
+	hits = 0;
+	for (i = 0; i < NR_CALLS; i++) {
+		tracepoint(ust_tests_static_branch, event, 0);
+		other_call_site();
+	}
+	return hits;
+}
+
+/*
+ * Returns the first byte shared by all call sites, or -1 if they
+ * differ.
+ */
+static
+int call_sites_insn(void)
+{
+	struct lttng_ust_tracepoint_branch *b;
+	unsigned char insn = *(unsigned char *) __start___tracepoints_branches[0].site;
+
+	for (b = __start___tracepoints_branches;
+			b < __stop___tracepoints_branches; b++) {
+		if (*(unsigned char *) b->site != insn)
+			return -1;
+	}
+	return insn;
+}
+
+int main(void)
+{
+	struct runner r[NR_THREADS];
+	const char *name = "ust_tests_static_branch:event";
+	const char *signature = __tracepoint_ust_tests_static_branch___event.signature;
+	int i, round, enabled_ok = 1, disabled_ok = 1, enabled_insn_ok = 1,
+		disabled_insn = 0, running = 1;
+
+	plan_tests(NUM_TESTS);
+
+	if (__stop___tracepoints_branches - __start___tracepoints_branches < 2) {
+		skip(NUM_TESTS, "Static branches not supported by the compiler");
+		return exit_status();
+	}
+	ok(call_sites_insn() == BRANCH_INSN_ENABLED,
+		"Call sites are emitted in the jmp form");
+
+	for (i = 0; i < NR_THREADS; i++) {
+		r[i].block_signals = i & 1;
+		r[i].loops = 0;
+		if (pthread_create(&r[i].thread, NULL, runner_thread, &r[i])) {
+			fail("Create runner threads");
+			return exit_status();
+		}
+	}
+	for (round = 0; round < NR_ROUNDS; round++) {
+		if (__tracepoint_probe_register(name, (void (*)(void)) probe,
+				NULL, signature)) {
+			enabled_ok = 0;
+			break;
+		}
+		if (run_call_sites() != 2 * NR_CALLS)
+			enabled_ok = 0;
+		if (call_sites_insn() != BRANCH_INSN_ENABLED)
+			enabled_insn_ok = 0;
+		if (__tracepoint_probe_unregister(name, (void (*)(void)) probe,
+				NULL)) {
+			disabled_ok = 0;
+			break;
+		}
+		if (run_call_sites())
+			disabled_ok = 0;
+		if (!round)
+			disabled_insn = call_sites_insn();
+	}
+	uatomic_set(&stop, 1);
+	for (i = 0; i < NR_THREADS; i++) {
+		pthread_join(r[i].thread, NULL);
+		if (!r[i].loops)
+			running = 0;
+	}
+
+	ok(enabled_ok, "Enabled call sites reach the probe");
+	ok(disabled_ok, "Disabled call sites do not reach the probe");
+	ok(enabled_insn_ok, "Call sites are in the jmp form while enabled");
+	if (disabled_insn == BRANCH_INSN_ENABLED)
+		diag("Call sites are not patched: they check the tracepoint state");
+	ok(disabled_insn == BRANCH_INSN_DISABLED
+			|| disabled_insn == BRANCH_INSN_ENABLED,
+		"All call sites are in the cmp form, or all are left in the jmp form, while disabled");
+	ok(running, "Threads run through the call sites while they are patched, even with signals blocked");
+	return exit_status();
+}
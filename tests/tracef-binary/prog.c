@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2016  Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Binary tracef() argument packing: the arguments of each format are
+ * packed into a buffer, and compared with the layout described in
+ * tracef-binary.c, built here argument by argument.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <wchar.h>
+
+#include "tracef-binary.h"
+#include "tap.h"
+
+#define NUM_TESTS	17
+#define BUF_LEN		256
+
+struct expect {
+	uint8_t buf[BUF_LEN];
+	size_t len;
+};
+
+static uint8_t packed[BUF_LEN];
+
+#define EXPECT(e, type, value)						\
+	do {								\
+		type __v = (value);					\
+									\
+		memcpy(&(e)->buf[(e)->len], &__v, sizeof(__v));		\
+		(e)->len += sizeof(__v);				\
+	} while (0)
+
+static
+void expect_bytes(struct expect *e, const void *src, size_t len)
+{
+	memcpy(&e->buf[e->len], src, len);
+	e->len += len;
+}
+
+static
+ssize_t pack_args(size_t len, const char *fmt, ...)
+{
+	va_list ap;
+	ssize_t ret;
+
+	memset(packed, 0xff, sizeof(packed));
+	va_start(ap, fmt);
+	ret = lttng_ust_tracef_pack_args(packed, len, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+static
+int match(ssize_t ret, const struct expect *e)
+{
+	return ret == (ssize_t) e->len && !memcmp(packed, e->buf, e->len);
+}
+
+static
+void test_conversions(void)
+{
+	struct expect e;
+	long double ld;
+	ssize_t ret;
+	int n = -1;
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%-+ #0'5d|%08.3f|%I4x|%%", 42, 1.5, 7U);
+	EXPECT(&e, int, 42);
+	EXPECT(&e, double, 1.5);
+	EXPECT(&e, unsigned int, 7U);
+	ok(match(ret, &e), "Flags, widths and precisions are skipped");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%*d %-*.*f", 4, 1, 10, 2, 0.25);
+	EXPECT(&e, int, 4);
+	EXPECT(&e, int, 1);
+	EXPECT(&e, int, 10);
+	EXPECT(&e, int, 2);
+	EXPECT(&e, double, 0.25);
+	ok(match(ret, &e), "\"*\" widths and precisions are packed as int");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%hhd %hu %ld %lld %qd %jd %zu %Zd %td",
+		(int) 'a', (int) 2, 3L, 4LL, 5LL, (intmax_t) 6, (size_t) 7,
+		(size_t) 8, (ptrdiff_t) 9);
+	EXPECT(&e, int, 'a');
+	EXPECT(&e, int, 2);
+	EXPECT(&e, long, 3L);
+	EXPECT(&e, long long, 4LL);
+	EXPECT(&e, long long, 5LL);
+	EXPECT(&e, intmax_t, 6);
+	EXPECT(&e, size_t, 7);
+	EXPECT(&e, size_t, 8);
+	EXPECT(&e, ptrdiff_t, 9);
+	ok(match(ret, &e), "Integer length modifiers select the argument type");
+
+	/* The padding of long double is not compared. */
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%e %c %lc %C %p %Lg", 1.0, 'x',
+		(wint_t) L'y', (wint_t) L'z', (void *) &e, 2.0L);
+	EXPECT(&e, double, 1.0);
+	EXPECT(&e, int, 'x');
+	EXPECT(&e, wint_t, L'y');
+	EXPECT(&e, wint_t, L'z');
+	EXPECT(&e, void *, &e);
+	memcpy(&ld, &packed[e.len], sizeof(ld));
+	ok(ret == (ssize_t) (e.len + sizeof(ld))
+		&& !memcmp(packed, e.buf, e.len) && ld == 2.0L,
+		"Floating point, character and pointer arguments");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%d%n%d", 1, &n, 2);
+	EXPECT(&e, int, 1);
+	EXPECT(&e, int, 2);
+	ok(match(ret, &e) && n == -1, "%%n is consumed, but not stored");
+
+	memset(&e, 0, sizeof(e));
+	errno = EINVAL;
+	ret = pack_args(BUF_LEN, "%d %m", 1);
+	EXPECT(&e, int, 1);
+	EXPECT(&e, int, EINVAL);
+	ok(match(ret, &e), "%%m is packed as the value of errno");
+}
+
+static
+void test_strings(void)
+{
+	struct expect e;
+	ssize_t ret;
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%s|%10s|%s", "abc", "de", (char *) NULL);
+	expect_bytes(&e, "abc", 4);
+	expect_bytes(&e, "de", 3);
+	expect_bytes(&e, "(null)", 7);
+	ok(match(ret, &e), "Strings are packed with their terminating '\\0'");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%.4s|%.s|%.10s", "abcdefgh", "ijk", "lm");
+	expect_bytes(&e, "abcd", 5);
+	expect_bytes(&e, "", 1);
+	expect_bytes(&e, "lm", 3);
+	ok(match(ret, &e), "Strings are cut at the precision");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%.*s|%.*s", 2, "xyz", -1, "xyz");
+	EXPECT(&e, int, 2);
+	expect_bytes(&e, "xy", 3);
+	EXPECT(&e, int, -1);
+	expect_bytes(&e, "xyz", 4);
+	ok(match(ret, &e), "\"*\" precisions cut strings, unless negative");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(BUF_LEN, "%ls|%.2S|%.*ls", L"ab", L"wxyz", 1, L"uv");
+	expect_bytes(&e, L"ab", 3 * sizeof(wchar_t));
+	expect_bytes(&e, L"wx", 3 * sizeof(wchar_t));
+	EXPECT(&e, int, 1);
+	expect_bytes(&e, L"u", 2 * sizeof(wchar_t));
+	ok(match(ret, &e), "Wide strings are packed and cut at the precision");
+}
+
+static
+void test_unsupported(void)
+{
+	ok(pack_args(BUF_LEN, "%2$d %1$d", 1, 2) == -1,
+		"Positional arguments are rejected");
+	ok(pack_args(BUF_LEN, "%*1$d", 1) == -1,
+		"Positional field widths are rejected");
+	ok(pack_args(BUF_LEN, "%.*2$f", 1.0, 2) == -1,
+		"Positional precisions are rejected");
+	ok(pack_args(BUF_LEN, "%d %k", 1) == -1,
+		"Unknown conversions are rejected");
+}
+
+static
+void test_truncation(void)
+{
+	struct expect e;
+	ssize_t ret;
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(8, "%d%s%d", 1, "abcdefgh", 2);
+	EXPECT(&e, int, 1);
+	expect_bytes(&e, "abc", 4);
+	ok(match(ret, &e), "The last string is truncated to fit");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(6, "%d%d%s", 1, 2, "abc");
+	EXPECT(&e, int, 1);
+	ok(match(ret, &e) && packed[e.len] == 0xff,
+		"Arguments which do not fit are left out");
+
+	memset(&e, 0, sizeof(e));
+	ret = pack_args(4, "%d%*d", 1, 2, 3);
+	EXPECT(&e, int, 1);
+	ok(match(ret, &e), "Arguments are left out from a \"*\" width on");
+}
+
+int main(void)
+{
+	plan_tests(NUM_TESTS);
+
+	test_conversions();
+	test_strings();
+	test_unsupported();
+	test_truncation();
+	return exit_status();
+}